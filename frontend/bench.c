@@ -0,0 +1,396 @@
+/*
+ * Headless benchmark runner: boots a CD image or PSX EXE with the builtin
+ * plugins, no video output, a null sound driver and no frame limiter,
+ * runs it for a fixed number of frames and reports the speed.
+ *
+ * This work is licensed under the terms of the GNU GPLv2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../libpcsxcore/misc.h"
+#include "../libpcsxcore/psxcounters.h"
+#include "../libpcsxcore/psxmem_map.h"
+#include "../libpcsxcore/r3000a.h"
+#include "../libpcsxcore/new_dynarec/new_dynarec.h"
+#include "../plugins/dfsound/out.h"
+#include "../plugins/dfsound/spu_config.h"
+#include "../plugins/dfinput/externals.h"
+#include "main.h"
+#include "plugin.h"
+#include "plugin_lib.h"
+#include "pcnt.h"
+
+/* frontend glue normally provided by plugin_lib.c or libretro.c */
+int in_type1, in_type2;
+int in_a1[2] = { 127, 127 }, in_a2[2] = { 127, 127 };
+int in_keystate;
+int in_enable_vibration;
+
+static int vout_open(void)
+{
+	return 0;
+}
+
+static void vout_set_mode(int w, int h, int raw_w, int raw_h, int bpp)
+{
+}
+
+static void vout_flip(const void *vram, int stride, int bgr24, int w, int h,
+	int dirty_y, int dirty_h)
+{
+	pl_rearmed_cbs.flip_cnt++;
+}
+
+static void vout_close(void)
+{
+}
+
+static void *pl_mmap(unsigned int size)
+{
+	return psxMap(0, size, 0, MAP_TAG_VRAM);
+}
+
+static void pl_munmap(void *ptr, unsigned int size)
+{
+	psxUnmap(ptr, size, MAP_TAG_VRAM);
+}
+
+struct rearmed_cbs pl_rearmed_cbs = {
+	.pl_vout_open = vout_open,
+	.pl_vout_set_mode = vout_set_mode,
+	.pl_vout_flip = vout_flip,
+	.pl_vout_close = vout_close,
+	.mmap = pl_mmap,
+	.munmap = pl_munmap,
+	/* from psxcounters */
+	.gpu_hcnt = &hSyncCount,
+	.gpu_frame_count = &frame_counter,
+};
+
+void pl_frame_limit(void)
+{
+	/* no limiting, just make psxCpu->Execute() return once per frame */
+	stop = 1;
+
+	pcnt_end(PCNT_ALL);
+	pcnt_print();
+	pcnt_start(PCNT_ALL);
+}
+
+void pl_timing_prepare(int is_pal)
+{
+}
+
+void plat_trigger_vibrate(int pad, int low, int high)
+{
+}
+
+void pl_update_gun(int *xn, int *yn, int *xres, int *yres, int *in)
+{
+}
+
+/* null sound output, registered in place of the libretro one */
+static int snd_init(void)
+{
+	return 0;
+}
+
+static void snd_finish(void)
+{
+}
+
+static int snd_busy(void)
+{
+	return 0;
+}
+
+static void snd_feed(void *buf, int bytes)
+{
+}
+
+void out_register_libretro(struct out_driver *drv)
+{
+	drv->name = "bench";
+	drv->init = snd_init;
+	drv->finish = snd_finish;
+	drv->busy = snd_busy;
+	drv->feed = snd_feed;
+}
+
+/* per subsystem timing, by wrapping the plugin entry points */
+enum {
+	BT_GPU,
+	BT_SPU,
+	BT_CDR,
+	BT_CNT
+};
+
+static const char *bt_names[BT_CNT] = { "gpu", "spu", "cdr" };
+static uint64_t bt_ns[BT_CNT];
+
+static uint64_t bench_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#define bt_hook_func(name, args, pargs, cnt) \
+static void (CALLBACK *o_##name) args; \
+static void w_##name args \
+{ \
+	uint64_t start = bench_ns(); \
+	o_##name pargs; \
+	bt_ns[cnt] += bench_ns() - start; \
+}
+
+#define bt_hook_func_ret(retn, name, args, pargs, cnt) \
+static retn (CALLBACK *o_##name) args; \
+static retn w_##name args \
+{ \
+	retn ret; \
+	uint64_t start = bench_ns(); \
+	ret = o_##name pargs; \
+	bt_ns[cnt] += bench_ns() - start; \
+	return ret; \
+}
+
+bt_hook_func              (GPU_writeStatus, (uint32_t a0), (a0), BT_GPU)
+bt_hook_func              (GPU_writeData, (uint32_t a0), (a0), BT_GPU)
+bt_hook_func              (GPU_writeDataMem, (uint32_t *a0, int a1), (a0, a1), BT_GPU)
+bt_hook_func_ret(uint32_t, GPU_readStatus, (void), (), BT_GPU)
+bt_hook_func_ret(uint32_t, GPU_readData, (void), (), BT_GPU)
+bt_hook_func              (GPU_readDataMem, (uint32_t *a0, int a1), (a0, a1), BT_GPU)
+bt_hook_func_ret(long,     GPU_dmaChain, (uint32_t *a0, uint32_t a1), (a0, a1), BT_GPU)
+bt_hook_func              (GPU_updateLace, (void), (), BT_GPU)
+
+bt_hook_func              (SPU_writeRegister, (unsigned long a0, unsigned short a1, unsigned int a2), (a0, a1, a2), BT_SPU)
+bt_hook_func_ret(unsigned short,SPU_readRegister, (unsigned long a0), (a0), BT_SPU)
+bt_hook_func              (SPU_writeDMA, (unsigned short a0), (a0), BT_SPU)
+bt_hook_func_ret(unsigned short,SPU_readDMA, (void), (), BT_SPU)
+bt_hook_func              (SPU_writeDMAMem, (unsigned short *a0, int a1, unsigned int a2), (a0, a1, a2), BT_SPU)
+bt_hook_func              (SPU_readDMAMem, (unsigned short *a0, int a1, unsigned int a2), (a0, a1, a2), BT_SPU)
+bt_hook_func              (SPU_playADPCMchannel, (xa_decode_t *a0), (a0), BT_SPU)
+bt_hook_func              (SPU_async, (uint32_t a0, uint32_t a1), (a0, a1), BT_SPU)
+bt_hook_func_ret(int,      SPU_playCDDAchannel, (short *a0, int a1), (a0, a1), BT_SPU)
+
+bt_hook_func_ret(long,     CDR_readTrack, (unsigned char *a0), (a0), BT_CDR)
+bt_hook_func_ret(unsigned char *, CDR_getBuffer, (void), (), BT_CDR)
+bt_hook_func_ret(long,     CDR_readCDDA, (unsigned char a0, unsigned char a1, unsigned char a2, unsigned char *a3), (a0, a1, a2, a3), BT_CDR)
+
+#define hook_it(name) { \
+	o_##name = name; \
+	name = w_##name; \
+}
+
+static void bench_hook_plugins(void)
+{
+	hook_it(GPU_writeStatus);
+	hook_it(GPU_writeData);
+	hook_it(GPU_writeDataMem);
+	hook_it(GPU_readStatus);
+	hook_it(GPU_readData);
+	hook_it(GPU_readDataMem);
+	hook_it(GPU_dmaChain);
+	hook_it(GPU_updateLace);
+	hook_it(SPU_writeRegister);
+	hook_it(SPU_readRegister);
+	hook_it(SPU_writeDMA);
+	hook_it(SPU_readDMA);
+	hook_it(SPU_writeDMAMem);
+	hook_it(SPU_readDMAMem);
+	hook_it(SPU_playADPCMchannel);
+	hook_it(SPU_async);
+	hook_it(SPU_playCDDAchannel);
+	hook_it(CDR_readTrack);
+	hook_it(CDR_getBuffer);
+	hook_it(CDR_readCDDA);
+}
+
+static int is_exe_name(const char *fname)
+{
+	const char *ext = strrchr(fname, '.');
+
+	return ext != NULL && (strcasecmp(ext, ".exe") == 0 ||
+		strcasecmp(ext, ".psx") == 0 || strcasecmp(ext, ".psexe") == 0 ||
+		strcasecmp(ext, ".cpe") == 0);
+}
+
+static void usage(const char *argv0)
+{
+	printf("usage: %s [options] <cd image or PSX EXE>\n"
+		"\t-frames N\temulated frames to run (default 3000)\n"
+		"\t-skip N\t\tframes to run before measuring (default 0)\n"
+		"\t-bios FILE\tBIOS image to use (default: HLE)\n"
+		"\t-interp\t\tuse the interpreter\n"
+		"\t-intcache\tenable the interpreter decode cache\n"
+		"\t-cdspeed N\tcdrom seek/read time divisor (default 1)\n"
+		"\t-gputhread\tdraw in a separate thread\n"
+		"\t-gpubands\tsplit drawing between cores (gpu_neon)\n"
+		"\t-gputrace FILE\trecord the measured frames' gpu commands\n"
+		"\t-psxout\t\tenable PSX output\n", argv0);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *file = NULL, *bios = NULL, *gputrace = NULL;
+	int frames = 3000, skip = 0;
+	int interp = 0, intcache = 0, psxout = 0, cdspeed = 1, gputhread = 0;
+	int gpubands = 0;
+	uint64_t t_start, t_cpu, cycles = 0;
+	u32 last_cycle, code_writes;
+	double secs, other;
+	const char *p;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-frames") && i + 1 < argc)
+			frames = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-skip") && i + 1 < argc)
+			skip = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-bios") && i + 1 < argc)
+			bios = argv[++i];
+		else if (!strcmp(argv[i], "-cdspeed") && i + 1 < argc)
+			cdspeed = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-interp"))
+			interp = 1;
+		else if (!strcmp(argv[i], "-intcache"))
+			intcache = 1;
+		else if (!strcmp(argv[i], "-gputrace") && i + 1 < argc)
+			gputrace = argv[++i];
+		else if (!strcmp(argv[i], "-gputhread"))
+			gputhread = 1;
+		else if (!strcmp(argv[i], "-gpubands"))
+			gpubands = 1;
+		else if (!strcmp(argv[i], "-psxout"))
+			psxout = 1;
+		else if (argv[i][0] != '-' && file == NULL)
+			file = argv[i];
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (file == NULL || frames <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	emu_core_preinit();
+
+	if (bios != NULL) {
+		p = strrchr(bios, '/');
+		if (p != NULL) {
+			snprintf(Config.BiosDir, sizeof(Config.BiosDir), "%.*s",
+				(int)(p - bios), bios);
+			bios = p + 1;
+		}
+		else
+			strcpy(Config.BiosDir, ".");
+		snprintf(Config.Bios, sizeof(Config.Bios), "%s", bios);
+	}
+	strcpy(Config.Mcd1, "none");
+	strcpy(Config.Mcd2, "none");
+	Config.Cpu = interp ? CPU_INTERPRETER : CPU_DYNAREC;
+	Config.IntCache = intcache;
+	Config.CdrSpeed = cdspeed;
+	Config.PsxOut = psxout;
+	// keep all work on this thread so that it gets accounted for,
+	// unless asked otherwise
+	spu_config.iUseThread = 0;
+	pl_rearmed_cbs.thread_rendering = gputhread;
+	pl_rearmed_cbs.gpu_neon.band_rendering = gpubands;
+	cycle_multiplier = 175;
+
+	if (!is_exe_name(file))
+		set_cd_image(file);
+
+	if (emu_core_init() != 0)
+		return 1;
+
+	if (LoadPlugins() == -1) {
+		SysPrintf("failed to load plugins\n");
+		return 1;
+	}
+	if (OpenPlugins() == -1) {
+		SysPrintf("failed to open plugins\n");
+		return 1;
+	}
+	plugin_call_rearmed_cbs();
+	dfinput_activate();
+
+	CheckCdrom();
+	SysReset();
+
+	if (is_exe_name(file)) {
+		if (Load(file) == -1) {
+			SysPrintf("could not load %s\n", file);
+			return 1;
+		}
+	}
+	else {
+		if (LoadCdrom() == -1) {
+			SysPrintf("could not load CD-ROM!\n");
+			return 1;
+		}
+		emu_on_new_cd(0);
+	}
+
+	for (i = 0; i < skip; i++) {
+		stop = 0;
+		psxCpu->Execute();
+	}
+
+	if (gputrace != NULL) {
+		// starts from a snapshot of the current gpu state
+		pl_rearmed_cbs.gpu_trace_file = gputrace;
+		plugin_call_rearmed_cbs();
+	}
+
+	bench_hook_plugins();
+	pcnt_hook_plugins();
+	pl_rearmed_cbs.flip_cnt = 0;
+	last_cycle = psxRegs.cycle;
+	code_writes = psxCodeInvalidations;
+	t_start = bench_ns();
+
+	for (i = 0; i < frames; i++) {
+		stop = 0;
+		pcnt_start(PCNT_CPU);
+		psxCpu->Execute();
+		pcnt_end(PCNT_CPU);
+		cycles += (u32)(psxRegs.cycle - last_cycle);
+		last_cycle = psxRegs.cycle;
+	}
+
+	t_cpu = bench_ns() - t_start;
+	secs = t_cpu / 1e9;
+
+	printf("frames:        %d in %.3f s\n", frames, secs);
+	printf("frames/s:      %.2f (%u flips)\n", frames / secs,
+		pl_rearmed_cbs.flip_cnt);
+	printf("cycles/s:      %.2f M (%.2fx realtime)\n", cycles / secs / 1e6,
+		cycles / secs / PSXCLK);
+	printf("code writes:   %u\n", psxCodeInvalidations - code_writes);
+
+	other = t_cpu;
+	for (i = 0; i < BT_CNT; i++) {
+		printf("%-4s           %6.2f%%\n", bt_names[i],
+			bt_ns[i] * 100.0 / t_cpu);
+		other -= bt_ns[i];
+	}
+	printf("cpu+rest       %6.2f%%\n", other * 100.0 / t_cpu);
+
+	ClosePlugins();
+	SysClose();
+
+	return 0;
+}
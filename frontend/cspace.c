@@ -9,6 +9,16 @@
  */
 
 #include "cspace.h"
+#include "cspace_x86.h"
+
+#ifdef CSPACE_X86
+// the public names are dispatchers in cspace_x86.c
+#define bgr555_to_rgb565 bgr555_to_rgb565_c
+#define bgr888_to_rgb888 bgr888_to_rgb888_c
+#define bgr888_to_rgb565 bgr888_to_rgb565_c
+#define rgb888_to_rgb565 rgb888_to_rgb565_c
+#define bgr555_to_uyvy   bgr555_to_uyvy_c
+#endif
 
 /*
  * note: these are intended for testing and should be avoided
@@ -54,9 +64,55 @@ void bgr888_to_rgb565(void *dst_, const void *src_, int bytes)
 	}
 }
 
-// TODO?
-void rgb888_to_rgb565(void *dst, const void *src, int bytes) {}
-void bgr888_to_rgb888(void *dst, const void *src, int bytes) {}
+void rgb888_to_rgb565(void *dst_, const void *src_, int bytes)
+{
+	const unsigned char *src = src_;
+	unsigned int *dst = dst_;
+	unsigned int r1, g1, b1, r2, g2, b2;
+
+	for (; bytes >= 6; bytes -= 6, src += 6, dst++) {
+		b1 = src[0] & 0xf8;
+		g1 = src[1] & 0xfc;
+		r1 = src[2] & 0xf8;
+		b2 = src[3] & 0xf8;
+		g2 = src[4] & 0xfc;
+		r2 = src[5] & 0xf8;
+		*dst = (r2 << 24) | (g2 << 19) | (b2 << 13) |
+			(r1 << 8) | (g1 << 3) | (b1 >> 3);
+	}
+}
+
+void bgr888_to_rgb888(void *dst_, const void *src_, int bytes)
+{
+	const unsigned char *src = src_;
+	unsigned char *dst = dst_;
+	unsigned char t;
+
+	for (; bytes >= 3; bytes -= 3, src += 3, dst += 3) {
+		t = src[0];
+		dst[1] = src[1];
+		dst[0] = src[2];
+		dst[2] = t;
+	}
+}
+
+// scanline dimming: each component is scaled by brightness2k/2048
+void bgr555_to_rgb565_b(void *dst_, const void *src_, int bytes,
+	int brightness2k)
+{
+	const unsigned short *src = src_;
+	unsigned short *dst = dst_;
+	unsigned int p, r, g, b;
+	int x;
+
+	for (x = 0; x < bytes / 2; x++) {
+		p = src[x];
+		r = (((p & 0x001f) >>  0) * brightness2k) & 0xf800;
+		g = (((p & 0x03e0) >>  5) * brightness2k >> 5) & 0x07e0;
+		b = (((p & 0x7c00) >> 10) * brightness2k) >> 11;
+		dst[x] = r | g | b;
+	}
+}
 
 #endif // __ARM_NEON__
 
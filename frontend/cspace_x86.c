@@ -0,0 +1,332 @@
+/*
+ * x86 SIMD versions of the cspace converters.
+ *
+ * Each function does as many whole vectors as it can and leaves the
+ * rest of the line to the C version, so results are identical to it.
+ * This file is empty for other targets.
+ *
+ * This work is licensed under the terms of any of these licenses
+ * (at your option):
+ *  - GNU GPL, version 2 or later.
+ *  - GNU LGPL, version 2.1 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdlib.h>
+#include "cspace.h"
+#include "cspace_x86.h"
+
+#ifdef CSPACE_X86
+
+#include <immintrin.h>
+
+#define TARGET(x) __attribute__((target(x)))
+
+#define loadu128(p)     _mm_loadu_si128((const __m128i *)(p))
+#define storeu128(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define loadu256(p)     _mm256_loadu_si256((const __m256i *)(p))
+#define storeu256(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+// two unaligned 16 byte loads into the halves of a ymm
+#define loadu2x128(lo, hi) \
+	_mm256_inserti128_si256(_mm256_castsi128_si256(loadu128(lo)), loadu128(hi), 1)
+
+/* bgr555 -> rgb565 */
+
+TARGET("sse2")
+static void bgr555_to_rgb565_sse2(void *dst_, const void *src_, int bytes)
+{
+	const unsigned char *src = src_;
+	unsigned char *dst = dst_;
+	const __m128i m5 = _mm_set1_epi16(0x001f);
+	const __m128i mg = _mm_set1_epi16(0x03e0);
+	__m128i p, r, g, b;
+	int i;
+
+	for (i = 0; i + 16 <= bytes; i += 16) {
+		p = loadu128(src + i);
+		r = _mm_slli_epi16(p, 11);
+		g = _mm_slli_epi16(_mm_and_si128(p, mg), 1);
+		b = _mm_and_si128(_mm_srli_epi16(p, 10), m5);
+		storeu128(dst + i, _mm_or_si128(_mm_or_si128(r, g), b));
+	}
+	if (i < bytes)
+		bgr555_to_rgb565_c(dst + i, src + i, bytes - i);
+}
+
+TARGET("avx2")
+static void bgr555_to_rgb565_avx2(void *dst_, const void *src_, int bytes)
+{
+	const unsigned char *src = src_;
+	unsigned char *dst = dst_;
+	const __m256i m5 = _mm256_set1_epi16(0x001f);
+	const __m256i mg = _mm256_set1_epi16(0x03e0);
+	__m256i p, r, g, b;
+	int i;
+
+	for (i = 0; i + 32 <= bytes; i += 32) {
+		p = loadu256(src + i);
+		r = _mm256_slli_epi16(p, 11);
+		g = _mm256_slli_epi16(_mm256_and_si256(p, mg), 1);
+		b = _mm256_and_si256(_mm256_srli_epi16(p, 10), m5);
+		storeu256(dst + i, _mm256_or_si256(_mm256_or_si256(r, g), b));
+	}
+	if (i < bytes)
+		bgr555_to_rgb565_sse2(dst + i, src + i, bytes - i);
+}
+
+/*
+ * 24bpp -> rgb565
+ * 4 pixels are spread to 32bit lanes holding b0 | b1 << 8 | b2 << 16
+ * (bytes in memory order), then shifted into place. The loads are 16
+ * bytes for 12 bytes of pixels, so the loops stop 4 bytes early.
+ */
+
+#define SPREAD24 \
+	 0,  1,  2, -1,  3,  4,  5, -1,  6,  7,  8, -1,  9, 10, 11, -1
+
+// p, w: intrinsic prefix and vector width (_mm, 128 or _mm256, 256)
+
+// b0 to the top, b2 to the bottom: bgr888 (r, g, b in memory order)
+#define TO565_B0_HI(v, mr, mg, mb, p, w) \
+	p##_or_si##w(p##_or_si##w( \
+		p##_and_si##w(p##_slli_epi32(v, 8), mr), \
+		p##_and_si##w(p##_srli_epi32(v, 5), mg)), \
+		p##_and_si##w(p##_srli_epi32(v, 19), mb))
+
+// b2 to the top, b0 to the bottom: rgb888 (b, g, r in memory order)
+#define TO565_B2_HI(v, mr, mg, mb, p, w) \
+	p##_or_si##w(p##_or_si##w( \
+		p##_and_si##w(p##_srli_epi32(v, 8), mr), \
+		p##_and_si##w(p##_srli_epi32(v, 5), mg)), \
+		p##_and_si##w(p##_srli_epi32(v, 3), mb))
+
+// 32bit lanes holding 16bit values -> 16bit lanes
+#define PACK32_16(a, b, p) \
+	p##_packs_epi32(p##_srai_epi32(p##_slli_epi32(a, 16), 16), \
+			p##_srai_epi32(p##_slli_epi32(b, 16), 16))
+
+#define DEF_24_TO_565(name, conv) \
+TARGET("ssse3") \
+static void name##_ssse3(void *dst_, const void *src_, int bytes) \
+{ \
+	const unsigned char *src = src_; \
+	unsigned char *dst = dst_; \
+	const __m128i spread = _mm_setr_epi8(SPREAD24); \
+	const __m128i mr = _mm_set1_epi32(0xf800); \
+	const __m128i mg = _mm_set1_epi32(0x07e0); \
+	const __m128i mb = _mm_set1_epi32(0x001f); \
+	__m128i a, b; \
+	int i; \
+\
+	for (i = 0; i + 24 + 4 <= bytes; i += 24, dst += 16) { \
+		a = _mm_shuffle_epi8(loadu128(src + i), spread); \
+		b = _mm_shuffle_epi8(loadu128(src + i + 12), spread); \
+		a = conv(a, mr, mg, mb, _mm, 128); \
+		b = conv(b, mr, mg, mb, _mm, 128); \
+		storeu128(dst, PACK32_16(a, b, _mm)); \
+	} \
+	if (i < bytes) \
+		name##_c(dst, src + i, bytes - i); \
+} \
+\
+TARGET("avx2") \
+static void name##_avx2(void *dst_, const void *src_, int bytes) \
+{ \
+	const unsigned char *src = src_; \
+	unsigned char *dst = dst_; \
+	const __m256i spread = _mm256_setr_epi8(SPREAD24, SPREAD24); \
+	const __m256i mr = _mm256_set1_epi32(0xf800); \
+	const __m256i mg = _mm256_set1_epi32(0x07e0); \
+	const __m256i mb = _mm256_set1_epi32(0x001f); \
+	__m256i a, b; \
+	int i; \
+\
+	for (i = 0; i + 48 + 4 <= bytes; i += 48, dst += 32) { \
+		/* pixels 0-3 | 4-7 and 8-11 | 12-15 */ \
+		a = _mm256_shuffle_epi8(loadu2x128(src + i, src + i + 12), spread); \
+		b = _mm256_shuffle_epi8(loadu2x128(src + i + 24, src + i + 36), spread); \
+		a = conv(a, mr, mg, mb, _mm256, 256); \
+		b = conv(b, mr, mg, mb, _mm256, 256); \
+		/* packs works per lane: 0-3 8-11 | 4-7 12-15 */ \
+		a = PACK32_16(a, b, _mm256); \
+		storeu256(dst, _mm256_permute4x64_epi64(a, 0xd8)); \
+	} \
+	if (i < bytes) \
+		name##_ssse3(dst, src + i, bytes - i); \
+}
+
+DEF_24_TO_565(bgr888_to_rgb565, TO565_B0_HI)
+DEF_24_TO_565(rgb888_to_rgb565, TO565_B2_HI)
+
+/*
+ * bgr888 -> rgb888, swaps the 1st and 3rd byte of each pixel.
+ * Works in place, the stores only write back bytes 12-15 of a load
+ * unchanged. avx2 gains nothing here (the lanes have to be joined).
+ */
+
+#define SWAP24 \
+	 2,  1,  0,  5,  4,  3,  8,  7,  6, 11, 10,  9, 12, 13, 14, 15
+
+TARGET("ssse3")
+static void bgr888_to_rgb888_ssse3(void *dst_, const void *src_, int bytes)
+{
+	const unsigned char *src = src_;
+	unsigned char *dst = dst_;
+	const __m128i swap = _mm_setr_epi8(SWAP24);
+	__m128i a, b;
+	int i;
+
+	for (i = 0; i + 24 + 4 <= bytes; i += 24) {
+		a = _mm_shuffle_epi8(loadu128(src + i), swap);
+		b = _mm_shuffle_epi8(loadu128(src + i + 12), swap);
+		storeu128(dst + i, a);
+		storeu128(dst + i + 12, b);
+	}
+	if (i < bytes)
+		bgr888_to_rgb888_c(dst + i, src + i, bytes - i);
+}
+
+/*
+ * bgr555 -> uyvy
+ * u, y and v of a pixel only depend on its 15 bits, so they come from
+ * a table built with the C converter (exact by construction) and are
+ * fetched with gathers.
+ */
+
+static unsigned int *uyvy_tab; // u | y << 8 | v << 16
+
+static int uyvy_tab_init(void)
+{
+	unsigned short p[2];
+	unsigned int out;
+	int i;
+
+	uyvy_tab = malloc(0x8000 * sizeof(uyvy_tab[0]));
+	if (uyvy_tab == NULL)
+		return -1;
+	for (i = 0; i < 0x8000; i++) {
+		p[0] = p[1] = i;
+		bgr555_to_uyvy_c(&out, p, 2);
+		uyvy_tab[i] = out & 0xffffff;
+	}
+	return 0;
+}
+
+TARGET("avx2")
+static void bgr555_to_uyvy_avx2(void *d, const void *s, int pixels)
+{
+	const unsigned short *src = s;
+	unsigned int *dst = d;
+	const __m256i m15 = _mm256_set1_epi32(0x7fff);
+	const __m256i muvy = _mm256_set1_epi64x(0x00ffffff);
+	const __m256i my1 = _mm256_set1_epi64x(0xff000000);
+	const __m256i even = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+	__m256i p, t;
+
+	if (uyvy_tab == NULL && uyvy_tab_init() != 0) {
+		bgr555_to_uyvy_c(d, s, pixels);
+		return;
+	}
+
+	for (; pixels >= 8; pixels -= 8, src += 8, dst += 4) {
+		p = _mm256_cvtepu16_epi32(loadu128(src));
+		t = _mm256_i32gather_epi32((const int *)uyvy_tab,
+			_mm256_and_si256(p, m15), 4);
+		// per pixel pair: u0 y0 v0 from the first, y1 from the second
+		t = _mm256_or_si256(_mm256_and_si256(t, muvy),
+			_mm256_and_si256(_mm256_srli_epi64(t, 16), my1));
+		t = _mm256_permutevar8x32_epi32(t, even);
+		storeu128(dst, _mm256_castsi256_si128(t));
+	}
+	if (pixels > 0)
+		bgr555_to_uyvy_c(dst, src, pixels);
+}
+
+/* dispatch */
+
+static struct {
+	void (*bgr555_to_rgb565)(void *dst, const void *src, int bytes);
+	void (*bgr888_to_rgb888)(void *dst, const void *src, int bytes);
+	void (*bgr888_to_rgb565)(void *dst, const void *src, int bytes);
+	void (*rgb888_to_rgb565)(void *dst, const void *src, int bytes);
+	void (*bgr555_to_uyvy)(void *d, const void *s, int pixels);
+} f;
+static int level = -1;
+
+int cspace_x86_detect(void)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return CSPACE_X86_AVX2;
+	if (__builtin_cpu_supports("ssse3"))
+		return CSPACE_X86_SSSE3;
+	if (__builtin_cpu_supports("sse2"))
+		return CSPACE_X86_SSE2;
+	return CSPACE_X86_C;
+}
+
+int cspace_x86_set_level(int l)
+{
+	int have = cspace_x86_detect();
+
+	if (l > have)
+		l = have;
+
+	f.bgr555_to_rgb565 = bgr555_to_rgb565_c;
+	f.bgr888_to_rgb888 = bgr888_to_rgb888_c;
+	f.bgr888_to_rgb565 = bgr888_to_rgb565_c;
+	f.rgb888_to_rgb565 = rgb888_to_rgb565_c;
+	f.bgr555_to_uyvy = bgr555_to_uyvy_c;
+	if (l >= CSPACE_X86_SSE2)
+		f.bgr555_to_rgb565 = bgr555_to_rgb565_sse2;
+	if (l >= CSPACE_X86_SSSE3) {
+		f.bgr888_to_rgb888 = bgr888_to_rgb888_ssse3;
+		f.bgr888_to_rgb565 = bgr888_to_rgb565_ssse3;
+		f.rgb888_to_rgb565 = rgb888_to_rgb565_ssse3;
+	}
+	if (l >= CSPACE_X86_AVX2) {
+		f.bgr555_to_rgb565 = bgr555_to_rgb565_avx2;
+		f.bgr888_to_rgb565 = bgr888_to_rgb565_avx2;
+		f.rgb888_to_rgb565 = rgb888_to_rgb565_avx2;
+		f.bgr555_to_uyvy = bgr555_to_uyvy_avx2;
+	}
+	level = l;
+
+	return l;
+}
+
+#define check_level() \
+	if (level < 0) \
+		cspace_x86_set_level(CSPACE_X86_AVX2)
+
+void bgr555_to_rgb565(void *dst, const void *src, int bytes)
+{
+	check_level();
+	f.bgr555_to_rgb565(dst, src, bytes);
+}
+
+void bgr888_to_rgb888(void *dst, const void *src, int bytes)
+{
+	check_level();
+	f.bgr888_to_rgb888(dst, src, bytes);
+}
+
+void bgr888_to_rgb565(void *dst, const void *src, int bytes)
+{
+	check_level();
+	f.bgr888_to_rgb565(dst, src, bytes);
+}
+
+void rgb888_to_rgb565(void *dst, const void *src, int bytes)
+{
+	check_level();
+	f.rgb888_to_rgb565(dst, src, bytes);
+}
+
+void bgr555_to_uyvy(void *d, const void *s, int pixels)
+{
+	check_level();
+	f.bgr555_to_uyvy(d, s, pixels);
+}
+
+#endif // CSPACE_X86
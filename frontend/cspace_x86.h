@@ -0,0 +1,39 @@
+/*
+ * x86 SIMD versions of the cspace converters, picked at runtime
+ * according to what the cpu supports.
+ */
+#if (defined(__i386__) || defined(__x86_64__)) \
+    && (__GNUC__ >= 5 || defined(__clang__))
+#define CSPACE_X86
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+enum cspace_x86_level {
+	CSPACE_X86_C,
+	CSPACE_X86_SSE2,
+	CSPACE_X86_SSSE3,
+	CSPACE_X86_AVX2,
+};
+
+// the plain C versions in cspace.c
+void bgr555_to_rgb565_c(void *dst, const void *src, int bytes);
+void bgr888_to_rgb888_c(void *dst, const void *src, int bytes);
+void bgr888_to_rgb565_c(void *dst, const void *src, int bytes);
+void rgb888_to_rgb565_c(void *dst, const void *src, int bytes);
+void bgr555_to_uyvy_c(void *d, const void *s, int pixels);
+
+// best level the cpu supports
+int cspace_x86_detect(void);
+
+// makes the public functions use the given level (limited to what the
+// cpu has), returns the one actually used; for testing/benchmarking
+int cspace_x86_set_level(int level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
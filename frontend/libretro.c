@@ -31,6 +31,7 @@
 #include "plugin_lib.h"
 #include "arm_features.h"
 #include "revision.h"
+#include "pcnt.h"
 #include "libretro.h"
 
 static retro_video_refresh_t video_cb;
@@ -43,6 +44,7 @@ static struct retro_rumble_interface rumble;
 static void *vout_buf;
 static int vout_width, vout_height;
 static int vout_doffs_old, vout_fb_dirty;
+static int vout_buf_valid; // holds the last frame
 static bool vout_can_dupe;
 static bool duping_enable;
 
@@ -105,6 +107,7 @@ static void vout_set_mode(int w, int h, int raw_w, int raw_h, int bpp)
 {
 	vout_width = w;
 	vout_height = h;
+	vout_buf_valid = 0;
 }
 
 #ifndef FRONTEND_SUPPORTS_RGB565
@@ -119,7 +122,8 @@ static void convert(void *buf, size_t bytes)
 }
 #endif
 
-static void vout_flip(const void *vram, int stride, int bgr24, int w, int h)
+static void vout_flip(const void *vram, int stride, int bgr24, int w, int h,
+	int dirty_y, int dirty_h)
 {
 	unsigned short *dest = vout_buf;
 	const unsigned short *src = vram;
@@ -129,6 +133,7 @@ static void vout_flip(const void *vram, int stride, int bgr24, int w, int h)
 	if (vram == NULL) {
 		// blanking
 		memset(vout_buf, 0, dstride * h * 2);
+		vout_buf_valid = 0;
 		goto out;
 	}
 
@@ -138,9 +143,20 @@ static void vout_flip(const void *vram, int stride, int bgr24, int w, int h)
 		// clear borders
 		memset(vout_buf, 0, dstride * h * 2);
 		vout_doffs_old = doffs;
+		vout_buf_valid = 0;
 	}
 	dest += doffs;
 
+#ifdef FRONTEND_SUPPORTS_RGB565
+	// the rest is still there from the last frame
+	if (vout_buf_valid) {
+		dest += dirty_y * dstride;
+		src += dirty_y * stride;
+		h1 = dirty_h;
+	}
+	vout_buf_valid = 1;
+#endif
+
 	if (bgr24)
 	{
 		// XXX: could we switch to RETRO_PIXEL_FORMAT_XRGB8888 here?
@@ -195,6 +211,10 @@ void pl_frame_limit(void)
 {
 	/* called once per frame, make psxCpu->Execute() above return */
 	stop = 1;
+
+	pcnt_end(PCNT_ALL);
+	pcnt_print();
+	pcnt_start(PCNT_ALL);
 }
 
 void pl_timing_prepare(int is_pal)
@@ -246,18 +266,23 @@ void out_register_libretro(struct out_driver *drv)
 void retro_set_environment(retro_environment_t cb)
 {
    static const struct retro_variable vars[] = {
-      { "pcsx_rearmed_frameskip", "Frameskip; 0|1|2|3" },
+      { "pcsx_rearmed_frameskip", "Frameskip; 0|1|2|3|adaptive" },
       { "pcsx_rearmed_region", "Region; Auto|NTSC|PAL" },
       { "pcsx_rearmed_pad1type", "Pad 1 Type; standard|analog" },
       { "pcsx_rearmed_pad2type", "Pad 2 Type; standard|analog" },
 #ifndef DRC_DISABLE
       { "pcsx_rearmed_drc", "Dynamic recompiler; enabled|disabled" },
 #endif
+      { "pcsx_rearmed_int_cache", "Interpreter decode cache; disabled|enabled" },
+      { "pcsx_rearmed_cd_fastload", "Fast CD loading (applied on reset); disabled|2x|4x|8x" },
 #ifdef __ARM_NEON__
       { "pcsx_rearmed_neon_interlace_enable", "Enable interlacing mode(s); disabled|enabled" },
       { "pcsx_rearmed_neon_enhancement_enable", "Enhanced resolution (slow); disabled|enabled" },
       { "pcsx_rearmed_neon_enhancement_no_main", "Enhanced resolution speed hack; disabled|enabled" },
+      { "pcsx_rearmed_neon_band_rendering", "Multi-core rendering; disabled|enabled" },
 #endif
+      { "pcsx_rearmed_gpu_thread_rendering", "Threaded rendering; disabled|enabled" },
+      { "pcsx_rearmed_gpu_deferred_rendering", "Deferred frameskip; disabled|enabled" },
       { "pcsx_rearmed_duping_enable", "Frame duping; on|off" },
       { "pcsx_rearmed_spu_reverb", "Sound: Reverb; on|off" },
       { "pcsx_rearmed_spu_interpolation", "Sound: Interpolation; simple|gaussian|cubic|off" },
@@ -394,13 +419,21 @@ static void save_close(void *file)
 
 bool retro_serialize(void *data, size_t size)
 { 
-	int ret = SaveState(data);
+	int ret;
+
+	pcnt_start(PCNT_STATE);
+	ret = SaveState(data);
+	pcnt_end(PCNT_STATE);
 	return ret == 0 ? true : false;
 }
 
 bool retro_unserialize(const void *data, size_t size)
 {
-	int ret = LoadState(data);
+	int ret;
+
+	pcnt_start(PCNT_STATE);
+	ret = LoadState(data);
+	pcnt_end(PCNT_STATE);
 	return ret == 0 ? true : false;
 }
 
@@ -859,6 +892,7 @@ bool retro_load_game(const struct retro_game_info *info)
 		SysPrintf("failed to load plugins\n");
 		return false;
 	}
+	pcnt_hook_plugins();
 
 	plugins_opened = 1;
 	NetOpened = 0;
@@ -960,7 +994,12 @@ static void update_variables(bool in_flight)
    var.key = "pcsx_rearmed_frameskip";
 
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) || var.value)
-      pl_rearmed_cbs.frameskip = atoi(var.value);
+   {
+      if (strcmp(var.value, "adaptive") == 0)
+         pl_rearmed_cbs.frameskip = -2;
+      else
+         pl_rearmed_cbs.frameskip = atoi(var.value);
+   }
 
    var.value = NULL;
    var.key = "pcsx_rearmed_region";
@@ -1029,8 +1068,41 @@ static void update_variables(bool in_flight)
       else if (strcmp(var.value, "enabled") == 0)
          pl_rearmed_cbs.gpu_neon.enhancement_no_main = 1;
    }
+
+   var.value = NULL;
+   var.key = "pcsx_rearmed_neon_band_rendering";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) || var.value)
+   {
+      if (strcmp(var.value, "disabled") == 0)
+         pl_rearmed_cbs.gpu_neon.band_rendering = 0;
+      else if (strcmp(var.value, "enabled") == 0)
+         pl_rearmed_cbs.gpu_neon.band_rendering = 1;
+   }
 #endif
 
+   var.value = "NULL";
+   var.key = "pcsx_rearmed_gpu_thread_rendering";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) || var.value)
+   {
+      if (strcmp(var.value, "disabled") == 0)
+         pl_rearmed_cbs.thread_rendering = 0;
+      else if (strcmp(var.value, "enabled") == 0)
+         pl_rearmed_cbs.thread_rendering = 1;
+   }
+
+   var.value = "NULL";
+   var.key = "pcsx_rearmed_gpu_deferred_rendering";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) || var.value)
+   {
+      if (strcmp(var.value, "disabled") == 0)
+         pl_rearmed_cbs.deferred_rendering = 0;
+      else if (strcmp(var.value, "enabled") == 0)
+         pl_rearmed_cbs.deferred_rendering = 1;
+   }
+
    var.value = "NULL";
    var.key = "pcsx_rearmed_duping_enable";
 
@@ -1064,6 +1136,28 @@ static void update_variables(bool in_flight)
    }
 #endif
 
+   var.value = NULL;
+   var.key = "pcsx_rearmed_int_cache";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) || var.value)
+   {
+      if (strcmp(var.value, "disabled") == 0)
+         Config.IntCache = 0;
+      else if (strcmp(var.value, "enabled") == 0)
+         Config.IntCache = 1;
+   }
+
+   var.value = NULL;
+   var.key = "pcsx_rearmed_cd_fastload";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) || var.value)
+   {
+      if (strcmp(var.value, "disabled") == 0)
+         Config.CdrSpeed = 1;
+      else
+         Config.CdrSpeed = atoi(var.value);
+   }
+
    var.value = "NULL";
    var.key = "pcsx_rearmed_spu_reverb";
 
@@ -1131,7 +1225,9 @@ void retro_run(void)
 	}
 
 	stop = 0;
+	pcnt_start(PCNT_CPU);
 	psxCpu->Execute();
+	pcnt_end(PCNT_CPU);
 
 	video_cb((vout_fb_dirty || !vout_can_dupe || !duping_enable) ? vout_buf : NULL,
 		vout_width, vout_height, vout_width * 2);
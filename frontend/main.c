@@ -124,10 +124,12 @@ void emu_set_default_config(void)
 	Config.Xa = Config.Cdda = Config.Sio =
 	Config.SpuIrq = Config.RCntFix = Config.VSyncWA = 0;
 	Config.PsxAuto = 1;
+	Config.CdrSpeed = 1;
 
 	pl_rearmed_cbs.gpu_neon.allow_interlace = 2; // auto
 	pl_rearmed_cbs.gpu_neon.enhancement_enable =
-	pl_rearmed_cbs.gpu_neon.enhancement_no_main = 0;
+	pl_rearmed_cbs.gpu_neon.enhancement_no_main =
+	pl_rearmed_cbs.gpu_neon.band_rendering = 0;
 	pl_rearmed_cbs.gpu_peops.iUseDither = 0;
 	pl_rearmed_cbs.gpu_peops.dwActFixes = 1<<7;
 	pl_rearmed_cbs.gpu_unai.abe_hack =
@@ -135,6 +137,8 @@ void emu_set_default_config(void)
 	pl_rearmed_cbs.gpu_unai.no_blend = 0;
 	memset(&pl_rearmed_cbs.gpu_peopsgl, 0, sizeof(pl_rearmed_cbs.gpu_peopsgl));
 	pl_rearmed_cbs.gpu_peopsgl.iVRamSize = 64;
+	pl_rearmed_cbs.thread_rendering = 0;
+	pl_rearmed_cbs.deferred_rendering = 0;
 	pl_rearmed_cbs.gpu_peopsgl.iTexGarbageCollection = 1;
 
 	spu_config.iUseReverb = 1;
@@ -647,7 +651,9 @@ int main(int argc, char *argv[])
 		stop = 0;
 		emu_action = SACTION_NONE;
 
+		pcnt_start(PCNT_CPU);
 		psxCpu->Execute();
+		pcnt_end(PCNT_CPU);
 		if (emu_action != SACTION_NONE)
 			do_emu_action();
 	}
@@ -771,7 +777,9 @@ int emu_save_state(int slot)
 	if (ret != 0)
 		return ret;
 
+	pcnt_start(PCNT_STATE);
 	ret = SaveState(fname);
+	pcnt_end(PCNT_STATE);
 #ifdef HAVE_PRE_ARMV7 /* XXX GPH hack */
 	sync();
 #endif
@@ -791,7 +799,10 @@ int emu_load_state(int slot)
 	if (ret != 0)
 		return ret;
 
-	return LoadState(fname);
+	pcnt_start(PCNT_STATE);
+	ret = LoadState(fname);
+	pcnt_end(PCNT_STATE);
+	return ret;
 }
 
 #ifndef ANDROID
@@ -92,7 +92,7 @@ typedef enum
 static int last_vout_w, last_vout_h, last_vout_bpp;
 static int cpu_clock, cpu_clock_st, volume_boost, frameskip;
 static char last_selected_fname[MAXPATHLEN];
-static int config_save_counter, region, in_type_sel1, in_type_sel2;
+static int config_save_counter, region, cdr_fast, in_type_sel1, in_type_sel2;
 static int psx_clock;
 static int memcard1_sel = -1, memcard2_sel = -1;
 extern int g_autostateld_opt;
@@ -306,6 +306,7 @@ static void menu_sync_config(void)
 		Config.PsxType = region - 1;
 	}
 	cycle_multiplier = 10000 / psx_clock;
+	Config.CdrSpeed = 1 << cdr_fast;
 
 	switch (in_type_sel1) {
 	case 1:  in_type1 = PSE_PAD_TYPE_ANALOGPAD; break;
@@ -323,7 +324,7 @@ static void menu_sync_config(void)
 	}
 
 	spu_config.iVolume = 768 + 128 * volume_boost;
-	pl_rearmed_cbs.frameskip = frameskip - 1;
+	pl_rearmed_cbs.frameskip = frameskip == 5 ? -2 : frameskip - 1;
 	pl_timing_prepare(Config.PsxType);
 }
 
@@ -345,6 +346,7 @@ static void menu_set_defconfig(void)
 	psx_clock = DEFAULT_PSX_CLOCK;
 
 	region = 0;
+	cdr_fast = 0;
 	in_type_sel1 = in_type_sel2 = 0;
 	in_evdev_allow_abs_only = 0;
 
@@ -398,7 +400,9 @@ static const struct {
 	CE_CONFIG_VAL(RCntFix),
 	CE_CONFIG_VAL(VSyncWA),
 	CE_CONFIG_VAL(Cpu),
+	CE_CONFIG_VAL(IntCache),
 	CE_INTVAL(region),
+	CE_INTVAL(cdr_fast),
 	CE_INTVAL_V(g_scaler, 3),
 	CE_INTVAL(g_gamma),
 	CE_INTVAL(g_layer_x),
@@ -423,6 +427,8 @@ static const struct {
 	CE_INTVAL_N("adev0_is_nublike", in_adev_is_nublike[0]),
 	CE_INTVAL_N("adev1_is_nublike", in_adev_is_nublike[1]),
 	CE_INTVAL_V(frameskip, 3),
+	CE_INTVAL_P(thread_rendering),
+	CE_INTVAL_P(deferred_rendering),
 	CE_INTVAL_P(gpu_peops.iUseDither),
 	CE_INTVAL_P(gpu_peops.dwActFixes),
 	CE_INTVAL_P(gpu_unai.lineskip),
@@ -432,6 +438,7 @@ static const struct {
 	CE_INTVAL_P(gpu_neon.allow_interlace),
 	CE_INTVAL_P(gpu_neon.enhancement_enable),
 	CE_INTVAL_P(gpu_neon.enhancement_no_main),
+	CE_INTVAL_P(gpu_neon.band_rendering),
 	CE_INTVAL_P(gpu_peopsgl.bDrawDither),
 	CE_INTVAL_P(gpu_peopsgl.iFilterType),
 	CE_INTVAL_P(gpu_peopsgl.iFrameTexType),
@@ -1235,11 +1242,7 @@ static int menu_loop_keyconfig(int id, int keys)
 static const char *men_scaler[] = {
 	"1x1", "integer scaled 2x", "scaled 4:3", "integer scaled 4:3", "fullscreen", "custom", NULL
 };
-static const char *men_soft_filter[] = { "None",
-#ifdef __ARM_NEON__
-	"scale2x", "eagle2x",
-#endif
-	NULL };
+static const char *men_soft_filter[] = { "None", "scale2x", "eagle2x", NULL };
 static const char *men_dummy[] = { NULL };
 static const char h_scaler[]    = "int. 2x  - scales w. or h. 2x if it fits on screen\n"
 				  "int. 4:3 - uses integer if possible, else fractional";
@@ -1309,10 +1312,8 @@ static menu_entry e_menu_gfx_options[] =
 	mee_onoff     ("Software Scaling",         MA_OPT_SCALER2, soft_scaling, 1),
 	mee_enum      ("Hardware Filter",          MA_OPT_HWFILTER, plat_target.hwfilter, men_dummy),
 	mee_enum_h    ("Software Filter",          MA_OPT_SWFILTER, soft_filter, men_soft_filter, h_soft_filter),
-#ifdef __ARM_NEON__
 	mee_onoff     ("Scanlines",                MA_OPT_SCANLINES, scanlines, 1),
 	mee_range_h   ("Scanline brightness",      MA_OPT_SCANLINE_LEVEL, scanline_level, 0, 100, h_scanline_l),
-#endif
 	mee_range_h   ("Gamma adjustment",         MA_OPT_GAMMA, g_gamma, 1, 200, h_gamma),
 //	mee_onoff     ("Vsync",                    0, vsync, 1),
 	mee_cust_h    ("Setup custom scaler",      MA_OPT_VARSCALER_C, menu_loop_cscaler, NULL, h_cscaler),
@@ -1339,6 +1340,9 @@ static const char h_gpu_neon_enhanced[] =
 	"(not available for high resolution games)";
 static const char h_gpu_neon_enhanced_hack[] =
 	"Speed hack for above option (glitches some games)";
+static const char h_gpu_neon_bands[] =
+	"Splits the screen between the other CPU cores\n"
+	"(no effect on single core systems)";
 static const char *men_gpu_interlace[] = { "Off", "On", "Auto", NULL };
 
 static menu_entry e_menu_plugin_gpu_neon[] =
@@ -1346,6 +1350,7 @@ static menu_entry e_menu_plugin_gpu_neon[] =
 	mee_enum      ("Enable interlace mode",      0, pl_rearmed_cbs.gpu_neon.allow_interlace, men_gpu_interlace),
 	mee_onoff_h   ("Enhanced resolution (slow)", 0, pl_rearmed_cbs.gpu_neon.enhancement_enable, 1, h_gpu_neon_enhanced),
 	mee_onoff_h   ("Enhanced res. speed hack",   0, pl_rearmed_cbs.gpu_neon.enhancement_no_main, 1, h_gpu_neon_enhanced_hack),
+	mee_onoff_h   ("Multi-core rendering",       0, pl_rearmed_cbs.gpu_neon.band_rendering, 1, h_gpu_neon_bands),
 	mee_end,
 };
 
@@ -1539,6 +1544,7 @@ static int menu_loop_speed_hacks(int id, int keys)
 	return 0;
 }
 
+static const char *men_cdr_fast[] = { "Off", "2x", "4x", "8x", NULL };
 static const char h_cfg_cpul[]   = "Shows CPU usage in %";
 static const char h_cfg_spu[]    = "Shows active SPU channels\n"
 				   "(green: normal, red: fmod, blue: noise)";
@@ -1554,6 +1560,10 @@ static const char h_cfg_rcnt2[]  = "InuYasha Sengoku Battle Fix\n"
 				   "(timing hack, breaks other games)";
 static const char h_cfg_nodrc[]  = "Disable dynamic recompiler and use interpreter\n"
 				   "Might be useful to overcome some dynarec bugs";
+static const char h_cfg_icache[] = "Interpreter only: decode code blocks once and\n"
+				   "reuse them, faster with the same accuracy";
+static const char h_cfg_cdrfast[] = "Shorten CD seeks and data reads, XA and CD audio\n"
+				   "still stream at normal speed. Applied on reset";
 static const char h_cfg_shacks[] = "Breaks games but may give better performance\n"
 				   "must reload game for any change to take effect";
 
@@ -1569,6 +1579,8 @@ static menu_entry e_menu_adv_options[] =
 	//mee_onoff_h   ("Rootcounter hack",       0, Config.RCntFix, 1, h_cfg_rcnt1),
 	mee_onoff_h   ("Rootcounter hack 2",     0, Config.VSyncWA, 1, h_cfg_rcnt2),
 	mee_onoff_h   ("Disable dynarec (slow!)",0, Config.Cpu, 1, h_cfg_nodrc),
+	mee_onoff_h   ("Interpreter decode cache",0, Config.IntCache, 1, h_cfg_icache),
+	mee_enum_h    ("Fast CD loading",        0, cdr_fast, men_cdr_fast, h_cfg_cdrfast),
 	mee_handler_h ("[Speed hacks]",             menu_loop_speed_hacks, h_cfg_shacks),
 	mee_end,
 };
@@ -1590,7 +1602,7 @@ static int mh_restore_defaults(int id, int keys)
 }
 
 static const char *men_region[]       = { "Auto", "NTSC", "PAL", NULL };
-static const char *men_frameskip[]    = { "Auto", "Off", "1", "2", "3", NULL };
+static const char *men_frameskip[]    = { "Auto", "Off", "1", "2", "3", "Adaptive", NULL };
 /*
 static const char *men_confirm_save[] = { "OFF", "writes", "loads", "both", NULL };
 static const char h_confirm_save[]    = "Ask for confirmation when overwriting save,\n"
@@ -1598,7 +1610,12 @@ static const char h_confirm_save[]    = "Ask for confirmation when overwriting s
 */
 static const char h_restore_def[]     = "Switches back to default / recommended\n"
 					"configuration";
-static const char h_frameskip[]       = "Warning: frameskip sometimes causes glitches\n";
+static const char h_frameskip[]       = "Warning: frameskip sometimes causes glitches\n"
+					"Adaptive skips by measured drawing cost";
+static const char h_gpu_thread[]      = "Draws in parallel with emulation, needs a\n"
+					"multicore CPU. Not for the GLES plugin";
+static const char h_gpu_deferred[]    = "Frameskip decides once a frame is complete\n"
+					"and skips it only if it's actually late";
 
 static menu_entry e_menu_options[] =
 {
@@ -1613,6 +1630,8 @@ static menu_entry e_menu_options[] =
 #else
 	mee_onoff     ("Threaded SPU",             MA_OPT_SPU_THREAD, spu_config.iUseThread, 1),
 #endif
+	mee_onoff_h   ("Threaded GPU",             0, pl_rearmed_cbs.thread_rendering, 1, h_gpu_thread),
+	mee_onoff_h   ("Deferred frameskip",       0, pl_rearmed_cbs.deferred_rendering, 1, h_gpu_deferred),
 	mee_handler_id("[Display]",                MA_OPT_DISP_OPTS, menu_loop_gfx_options),
 	mee_handler   ("[BIOS/Plugins]",           menu_loop_plugin_options),
 	mee_handler   ("[Advanced]",               menu_loop_adv_options),
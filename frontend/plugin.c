@@ -227,19 +227,26 @@ void plugin_call_rearmed_cbs(void)
 #ifdef PCNT
 
 /* basic profile stuff */
+#include <stdlib.h>
 #include "pcnt.h"
 
 unsigned int pcounters[PCNT_CNT];
-unsigned int pcounter_starts[PCNT_CNT];
+unsigned char pcnt_stack[PCNT_DEPTH];
+unsigned int pcnt_sp, pcnt_last;
+
+static const char *pcnt_names[PCNT_CNT] = { "", "cpu", "gpu", "spu", "cdr",
+	"mdec", "dma", "blit", "gte", "cheat", "state", "test" };
+static FILE *pcnt_file;
+static unsigned int pcnt_frame;
 
 #define pc_hook_func(name, args, pargs, cnt) \
 extern void (*name) args; \
 static void (*o_##name) args; \
 static void w_##name args \
 { \
-	unsigned int pc_start = pcnt_get(); \
+	pcnt_start(cnt); \
 	o_##name pargs; \
-	pcounters[cnt] += pcnt_get() - pc_start; \
+	pcnt_end(cnt); \
 }
 
 #define pc_hook_func_ret(retn, name, args, pargs, cnt) \
@@ -248,9 +255,9 @@ static retn (*o_##name) args; \
 static retn w_##name args \
 { \
 	retn ret; \
-	unsigned int pc_start = pcnt_get(); \
+	pcnt_start(cnt); \
 	ret = o_##name pargs; \
-	pcounters[cnt] += pcnt_get() - pc_start; \
+	pcnt_end(cnt); \
 	return ret; \
 }
 
@@ -273,6 +280,10 @@ pc_hook_func              (SPU_playADPCMchannel, (void *a0), (a0), PCNT_SPU)
 pc_hook_func              (SPU_async, (uint32_t a0, uint32_t a1), (a0, a1), PCNT_SPU)
 pc_hook_func_ret(int,      SPU_playCDDAchannel, (short *a0, int a1), (a0, a1), PCNT_SPU)
 
+pc_hook_func_ret(long,     CDR_readTrack, (unsigned char *a0), (a0), PCNT_CDR)
+pc_hook_func_ret(unsigned char *, CDR_getBuffer, (void), (), PCNT_CDR)
+pc_hook_func_ret(long,     CDR_readCDDA, (unsigned char a0, unsigned char a1, unsigned char a2, unsigned char *a3), (a0, a1, a2, a3), PCNT_CDR)
+
 #define hook_it(name) { \
 	o_##name = name; \
 	name = w_##name; \
@@ -280,8 +291,20 @@ pc_hook_func_ret(int,      SPU_playCDDAchannel, (short *a0, int a1), (a0, a1), P
 
 void pcnt_hook_plugins(void)
 {
+	const char *path = getenv("PCNT_CSV");
+	int i;
+
 	pcnt_init();
 
+	if (pcnt_file == NULL && path != NULL)
+		pcnt_file = fopen(path, "w");
+	if (pcnt_file == NULL)
+		pcnt_file = stdout;
+	fprintf(pcnt_file, "frame,total");
+	for (i = 1; i < PCNT_CNT; i++)
+		fprintf(pcnt_file, ",%s", pcnt_names[i]);
+	fprintf(pcnt_file, ",rem\n");
+
 	hook_it(GPU_writeStatus);
 	hook_it(GPU_writeData);
 	hook_it(GPU_writeDataMem);
@@ -299,6 +322,28 @@ void pcnt_hook_plugins(void)
 	hook_it(SPU_playADPCMchannel);
 	hook_it(SPU_async);
 	hook_it(SPU_playCDDAchannel);
+	hook_it(CDR_readTrack);
+	hook_it(CDR_getBuffer);
+	hook_it(CDR_readCDDA);
+}
+
+void pcnt_print(void)
+{
+	unsigned int total = 0;
+	int i;
+
+	if (pcnt_file == NULL)
+		return;
+
+	for (i = 0; i < PCNT_CNT; i++)
+		total += pcounters[i];
+
+	fprintf(pcnt_file, "%u,%u", pcnt_frame++, total);
+	for (i = 1; i < PCNT_CNT; i++)
+		fprintf(pcnt_file, ",%u", pcounters[i]);
+	fprintf(pcnt_file, ",%u\n", pcounters[PCNT_ALL]);
+
+	memset(pcounters, 0, sizeof(pcounters));
 }
 
 // hooked into recompiler
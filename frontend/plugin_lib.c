@@ -20,8 +20,14 @@
 #include "libpicofe/fonts.h"
 #include "libpicofe/input.h"
 #include "libpicofe/plat.h"
+#ifdef __ARM_NEON__
 #include "libpicofe/arm/neon_scale2x.h"
 #include "libpicofe/arm/neon_eagle2x.h"
+#define scale2x_16_16 neon_scale2x_16_16
+#define eagle2x_16_16 neon_eagle2x_16_16
+#else
+#include "soft_filter.h"
+#endif
 #include "plugin_lib.h"
 #include "menu.h"
 #include "main.h"
@@ -47,10 +53,12 @@ void *pl_vout_buf;
 int g_layer_x, g_layer_y, g_layer_w, g_layer_h;
 static int pl_vout_w, pl_vout_h, pl_vout_bpp; /* output display/layer */
 static int pl_vout_scale_w, pl_vout_scale_h, pl_vout_yoffset;
+static void *pl_vout_buf_drawn; /* has the last frame as converted */
 static int psx_w, psx_h, psx_bpp;
 static int vsync_cnt;
 static int is_pal, frame_interval, frame_interval1024;
 static int vsync_usec_time;
+static struct gpu_fskip_stats pl_fskip_stats;
 
 // platform hooks
 void (*pl_plat_clear)(void);
@@ -113,6 +121,16 @@ static void print_fps(int h, int border)
 		pl_rearmed_cbs.vsps_cur);
 }
 
+static void print_fskip(int h, int border)
+{
+	const struct gpu_fskip_stats *st = &pl_fskip_stats;
+
+	hud_printf(pl_vout_buf, pl_vout_w, border + 2, h - HUD_HEIGHT * 2,
+		"skip %2u%% gpu %4.1f emu %4.1f / %4.1f", st->skip_rate * 100 / 256,
+		st->render_us / 1000.0f, st->emu_us / 1000.0f,
+		st->budget_us / 1000.0f);
+}
+
 static void print_cpu_usage(int w, int h, int border)
 {
 	hud_printf(pl_vout_buf, pl_vout_w, pl_vout_w - border - 28,
@@ -149,10 +167,11 @@ static __attribute__((noinline)) void draw_active_chans(int vout_w, int vout_h)
 	}
 }
 
-static void print_hud(int w, int h, int xborder)
+// returns 1 if anything was drawn
+static int print_hud(int w, int h, int xborder)
 {
 	if (h < 16)
-		return;
+		return 0;
 
 	if (w < pl_vout_w)
 		xborder += (pl_vout_w - w) / 2;
@@ -167,8 +186,15 @@ static void print_hud(int w, int h, int xborder)
 	else if (g_opts & OPT_SHOWFPS)
 		print_fps(h, xborder);
 
+	if ((g_opts & OPT_SHOWFPS) && pl_rearmed_cbs.frameskip == -2
+	    && h >= HUD_HEIGHT * 3)
+		print_fskip(h, xborder);
+
 	if (g_opts & OPT_SHOWCPU)
 		print_cpu_usage(w, h, xborder);
+
+	return (g_opts & (OPT_SHOWSPU|OPT_SHOWFPS|OPT_SHOWCPU))
+		|| hud_msg[0] != 0;
 }
 
 /* update scaler target size according to user settings */
@@ -264,7 +290,6 @@ static void pl_vout_set_mode(int w, int h, int raw_w, int raw_h, int bpp)
 	}
 
 	pl_vout_scale_w = pl_vout_scale_h = 1;
-#ifdef __ARM_NEON__
 	if (soft_filter) {
 		if (resolution_ok(w * 2, h * 2) && bpp == 16) {
 			pl_vout_scale_w = 2;
@@ -279,11 +304,11 @@ static void pl_vout_set_mode(int w, int h, int raw_w, int raw_h, int bpp)
 		if (h <= 256)
 			pl_vout_scale_h = 2;
 	}
-#endif
 	vout_w *= pl_vout_scale_w;
 	vout_h *= pl_vout_scale_h;
 
 	update_layer_size(vout_w, vout_h);
+	pl_vout_buf_drawn = NULL;
 
 	pl_vout_buf = plat_gvideo_set_mode(&vout_w, &vout_h, &vout_bpp);
 	if (pl_vout_buf == NULL && pl_plat_blit == NULL)
@@ -302,13 +327,15 @@ static void pl_vout_set_mode(int w, int h, int raw_w, int raw_h, int bpp)
 	menu_notify_mode_change(pl_vout_w, pl_vout_h, pl_vout_bpp);
 }
 
-static void pl_vout_flip(const void *vram, int stride, int bgr24, int w, int h)
+static void pl_vout_flip(const void *vram, int stride, int bgr24,
+	int w, int h, int dirty_y, int dirty_h)
 {
 	static int doffs_old, clear_counter;
 	unsigned char *dest = pl_vout_buf;
 	const unsigned short *src = vram;
 	int dstride = pl_vout_w, h1 = h;
-	int doffs;
+	int doffs, partial;
+	void *drawn = NULL;
 
 	pcnt_start(PCNT_BLIT);
 
@@ -327,6 +354,18 @@ static void pl_vout_flip(const void *vram, int stride, int bgr24, int w, int h)
 
 	if (doffs > doffs_old)
 		clear_counter = 2;
+
+	// only the changed rows need converting if this buffer still
+	// has the last frame as is (not with page flipping or the hud),
+	// and no filter looks at the neighbouring rows
+	partial = dest != NULL && dest == pl_vout_buf_drawn
+		&& doffs == doffs_old && clear_counter == 0
+		&& soft_filter == SOFT_FILTER_NONE
+		&& (scanlines == 0 || scanline_level == 100);
+	if (partial) {
+		src += dirty_y * stride;
+		h1 = dirty_h;
+	}
 	doffs_old = doffs;
 
 	if (clear_counter > 0) {
@@ -351,7 +390,10 @@ static void pl_vout_flip(const void *vram, int stride, int bgr24, int w, int h)
 
 	if (bgr24)
 	{
+		drawn = pl_vout_buf;
 		if (pl_rearmed_cbs.only_16bpp) {
+			if (partial)
+				dest += dirty_y * dstride * 2;
 			for (; h1-- > 0; dest += dstride * 2, src += stride)
 			{
 				bgr888_to_rgb565(dest, src, w * 3);
@@ -360,6 +402,8 @@ static void pl_vout_flip(const void *vram, int stride, int bgr24, int w, int h)
 		else {
 			dest -= doffs * 2;
 			dest += (doffs / 8) * 24;
+			if (partial)
+				dest += dirty_y * dstride * 3;
 
 			for (; h1-- > 0; dest += dstride * 3, src += stride)
 			{
@@ -367,15 +411,14 @@ static void pl_vout_flip(const void *vram, int stride, int bgr24, int w, int h)
 			}
 		}
 	}
-#ifdef __ARM_NEON__
 	else if (soft_filter == SOFT_FILTER_SCALE2X && pl_vout_scale_w == 2)
 	{
-		neon_scale2x_16_16(src, (void *)dest, w,
+		scale2x_16_16(src, (void *)dest, w,
 			stride * 2, dstride * 2, h);
 	}
 	else if (soft_filter == SOFT_FILTER_EAGLE2X && pl_vout_scale_w == 2)
 	{
-		neon_eagle2x_16_16(src, (void *)dest, w,
+		eagle2x_16_16(src, (void *)dest, w,
 			stride * 2, dstride * 2, h);
 	}
 	else if (scanlines != 0 && scanline_level != 100)
@@ -393,9 +436,11 @@ static void pl_vout_flip(const void *vram, int stride, int bgr24, int w, int h)
 			dest += dstride * 2, src += stride;
 		}
 	}
-#endif
 	else
 	{
+		drawn = pl_vout_buf;
+		if (partial)
+			dest += dirty_y * dstride * 2;
 		for (; h1-- > 0; dest += dstride * 2, src += stride)
 		{
 			bgr555_to_rgb565(dest, src, w * 2);
@@ -403,7 +448,9 @@ static void pl_vout_flip(const void *vram, int stride, int bgr24, int w, int h)
 	}
 
 out_hud:
-	print_hud(w * pl_vout_scale_w, h * pl_vout_scale_h, 0);
+	if (print_hud(w * pl_vout_scale_w, h * pl_vout_scale_h, 0))
+		drawn = NULL;
+	pl_vout_buf_drawn = drawn;
 
 out:
 	pcnt_end(PCNT_BLIT);
@@ -423,6 +470,7 @@ static int pl_vout_open(void)
 
 	// force mode update on pl_vout_set_mode() call from gpulib/vout_pl
 	pl_vout_buf = NULL;
+	pl_vout_buf_drawn = NULL;
 
 	plat_gvideo_open(is_pal);
 
@@ -447,6 +495,9 @@ static void pl_set_gpu_caps(int caps)
 void *pl_prepare_screenshot(int *w, int *h, int *bpp)
 {
 	void *ret = plat_prepare_screenshot(w, h, bpp);
+
+	// might be converted in place
+	pl_vout_buf_drawn = NULL;
 	if (ret != NULL)
 		return ret;
 
@@ -478,6 +529,7 @@ static int dispmode_doubleres(void)
 	snprintf(hud_msg, sizeof(hud_msg), "double resolution");
 	return 1;
 }
+#endif
 
 static int dispmode_scale2x(void)
 {
@@ -500,15 +552,14 @@ static int dispmode_eagle2x(void)
 	snprintf(hud_msg, sizeof(hud_msg), "eagle2x");
 	return 1;
 }
-#endif
 
 static int (*dispmode_switchers[])(void) = {
 	dispmode_default,
 #ifdef __ARM_NEON__
 	dispmode_doubleres,
+#endif
 	dispmode_scale2x,
 	dispmode_eagle2x,
-#endif
 };
 
 static int dispmode_current;
@@ -649,6 +700,7 @@ void pl_frame_limit(void)
 	update_input();
 
 	pcnt_end(PCNT_ALL);
+	pcnt_print();
 	gettimeofday(&now, 0);
 
 	if (now.tv_sec != tv_old.tv_sec) {
@@ -671,14 +723,6 @@ void pl_frame_limit(void)
 		}
 		tv_old = now;
 	}
-#ifdef PCNT
-	static int ya_vsync_count;
-	if (++ya_vsync_count == PCNT_FRAMES) {
-		pcnt_print(pl_rearmed_cbs.vsps_cur);
-		ya_vsync_count = 0;
-	}
-#endif
-
 	// tv_expect uses usec*1024 units instead of usecs for better accuracy
 	tv_expect.tv_usec += frame_interval1024;
 	if (tv_expect.tv_usec >= (1000000 << 10)) {
@@ -851,6 +895,7 @@ void pl_init(void)
 
 	pl_rearmed_cbs.gpu_hcnt = &hSyncCount;
 	pl_rearmed_cbs.gpu_frame_count = &frame_counter;
+	pl_rearmed_cbs.fskip_stats = &pl_fskip_stats;
 
 	psxMapHook = pl_emu_mmap;
 	psxUnmapHook = pl_emu_munmap;
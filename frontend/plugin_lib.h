@@ -36,12 +36,22 @@ void  pl_switch_dispmode(void);
 void  pl_timing_prepare(int is_pal);
 void  pl_frame_limit(void);
 
+// adaptive frameskip (frameskip -2) decisions and costs, filled by gpulib
+struct gpu_fskip_stats {
+	unsigned int frames, skipped;
+	unsigned int skip_rate;	// currently skipping this many of 256 frames
+	unsigned int render_us;	// drawing a frame, average
+	unsigned int emu_us;	// the rest of the work a frame takes, average
+	unsigned int budget_us;	// what both have to fit in
+};
+
 struct rearmed_cbs {
 	void  (*pl_get_layer_pos)(int *x, int *y, int *w, int *h);
 	int   (*pl_vout_open)(void);
 	void  (*pl_vout_set_mode)(int w, int h, int raw_w, int raw_h, int bpp);
+	// only rows dirty_y to dirty_y + dirty_h - 1 changed since the last flip
 	void  (*pl_vout_flip)(const void *vram, int stride, int bgr24,
-			      int w, int h);
+			      int w, int h, int dirty_y, int dirty_h);
 	void  (*pl_vout_close)(void);
 	void *(*mmap)(unsigned int size);
 	void  (*munmap)(void *ptr, unsigned int size);
@@ -57,14 +67,19 @@ struct rearmed_cbs {
 	// gpu options
 	int   frameskip;
 	int   fskip_advice;
+	struct gpu_fskip_stats *fskip_stats; // optional
 	unsigned int *gpu_frame_count;
 	unsigned int *gpu_hcnt;
 	unsigned int flip_cnt; // increment manually if not using pl_vout_flip
 	unsigned int only_16bpp; // platform is 16bpp-only
+	int   thread_rendering; // gpulib draws in a separate thread
+	int   deferred_rendering; // frameskip draws frames once they're shown
+	const char *gpu_trace_file; // gpulib records commands here if set
 	struct {
 		int   allow_interlace; // 0 off, 1 on, 2 guess
 		int   enhancement_enable;
 		int   enhancement_no_main;
+		int   band_rendering; // draw on all cores, split by lines
 	} gpu_neon;
 	struct {
 		int   iUseDither;
@@ -0,0 +1,298 @@
+/*
+ * scale2x/eagle2x filters for targets without the libpicofe NEON ones.
+ *
+ * Source lines are converted to rgb565 and widened to 32 bits so that
+ * the pixel comparisons can be done 4 at a time with the compiler's
+ * generic vector types (SSE2, NEON, AltiVec, or plain scalar code if
+ * there is nothing better), with no shuffles needed for the 2x output.
+ * Horizontal bands of the frame are filtered in parallel by a small
+ * pool of worker threads.
+ *
+ * This work is licensed under the terms of the GNU GPLv2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "soft_filter.h"
+
+#define MAX_WIDTH   1024
+#define MAX_THREADS 3
+// below this many source lines per band threads are not worth it
+#define MIN_BAND_LINES 16
+
+typedef uint32_t v4u32 __attribute__((vector_size(16)));
+
+typedef void (line_func)(uint16_t *d0, uint16_t *d1, const uint32_t *u,
+	const uint32_t *c, const uint32_t *n, int w);
+
+static inline v4u32 vload(const uint32_t *p)
+{
+	v4u32 v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+// a if mask set, else b
+static inline v4u32 vsel(v4u32 mask, v4u32 a, v4u32 b)
+{
+	return (a & mask) | (b & ~mask);
+}
+
+// pairs of output pixels as words, stored to a possibly unaligned dst
+static inline void vstore_pairs(uint16_t *d, v4u32 left, v4u32 right)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v4u32 v = (left << 16) | right;
+#else
+	v4u32 v = left | (right << 16);
+#endif
+	memcpy(d, &v, sizeof(v));
+}
+
+static inline void store_pair(uint16_t *d, uint32_t left, uint32_t right)
+{
+	d[0] = left;
+	d[1] = right;
+}
+
+/*
+ * Converts a bgr555 line to rgb565 words with one pixel of padding on
+ * each side (a copy of the edge pixel), so the filters can always
+ * look at their neighbours.
+ */
+static void convert_line(uint32_t *d, const uint16_t *s, int w)
+{
+	uint32_t p;
+	int x;
+
+	for (x = 0; x < w; x++) {
+		p = s[x];
+		d[x + 1] = ((p & 0x7c00) >> 10) | ((p & 0x03e0) << 1)
+			| ((p & 0x001f) << 11);
+	}
+	d[0] = d[1];
+	d[w + 1] = d[w];
+}
+
+/*
+ *  A B C
+ *  D E F  ->  E0 E1
+ *  G H I      E2 E3
+ *
+ * u, c and n are the padded lines above, at and below the current one.
+ */
+static void scale2x_line(uint16_t *d0, uint16_t *d1, const uint32_t *u,
+	const uint32_t *c, const uint32_t *n, int w)
+{
+	uint32_t B, D, E, F, H;
+	int x;
+
+	for (x = 0; x + 4 <= w; x += 4) {
+		v4u32 vB = vload(u + x + 1), vD = vload(c + x);
+		v4u32 vE = vload(c + x + 1), vF = vload(c + x + 2);
+		v4u32 vH = vload(n + x + 1);
+		v4u32 db = (v4u32)(vD == vB), bf = (v4u32)(vB == vF);
+		v4u32 dh = (v4u32)(vD == vH), hf = (v4u32)(vH == vF);
+
+		vstore_pairs(d0 + x * 2,
+			vsel(db & ~bf & ~dh, vD, vE),
+			vsel(bf & ~db & ~hf, vF, vE));
+		vstore_pairs(d1 + x * 2,
+			vsel(dh & ~db & ~hf, vD, vE),
+			vsel(hf & ~dh & ~bf, vF, vE));
+	}
+	for (; x < w; x++) {
+		B = u[x + 1]; D = c[x]; E = c[x + 1]; F = c[x + 2]; H = n[x + 1];
+		store_pair(d0 + x * 2,
+			(D == B && B != F && D != H) ? D : E,
+			(B == F && B != D && F != H) ? F : E);
+		store_pair(d1 + x * 2,
+			(D == H && D != B && H != F) ? D : E,
+			(H == F && D != H && B != F) ? F : E);
+	}
+}
+
+static void eagle2x_line(uint16_t *d0, uint16_t *d1, const uint32_t *u,
+	const uint32_t *c, const uint32_t *n, int w)
+{
+	uint32_t A, B, C, D, E, F, G, H, I;
+	int x;
+
+	for (x = 0; x + 4 <= w; x += 4) {
+		v4u32 vA = vload(u + x), vB = vload(u + x + 1), vC = vload(u + x + 2);
+		v4u32 vD = vload(c + x), vE = vload(c + x + 1), vF = vload(c + x + 2);
+		v4u32 vG = vload(n + x), vH = vload(n + x + 1), vI = vload(n + x + 2);
+
+		vstore_pairs(d0 + x * 2,
+			vsel((v4u32)(vA == vB) & (v4u32)(vA == vD), vA, vE),
+			vsel((v4u32)(vC == vB) & (v4u32)(vC == vF), vC, vE));
+		vstore_pairs(d1 + x * 2,
+			vsel((v4u32)(vG == vD) & (v4u32)(vG == vH), vG, vE),
+			vsel((v4u32)(vI == vF) & (v4u32)(vI == vH), vI, vE));
+	}
+	for (; x < w; x++) {
+		A = u[x]; B = u[x + 1]; C = u[x + 2];
+		D = c[x]; E = c[x + 1]; F = c[x + 2];
+		G = n[x]; H = n[x + 1]; I = n[x + 2];
+		store_pair(d0 + x * 2,
+			(A == B && A == D) ? A : E,
+			(C == B && C == F) ? C : E);
+		store_pair(d1 + x * 2,
+			(G == D && G == H) ? G : E,
+			(I == F && I == H) ? I : E);
+	}
+}
+
+struct sf_job {
+	line_func *line;
+	const uint8_t *src;
+	uint8_t *dst;
+	int w, h, src_stride, dst_stride;
+};
+
+static void filter_band(const struct sf_job *j, int y0, int y1)
+{
+	uint32_t lines[3][MAX_WIDTH + 2];
+	uint32_t *u = lines[0], *c = lines[1], *n = lines[2], *t;
+	int y;
+
+#define SRC_LINE(y_) ((const uint16_t *)(j->src + (y_) * j->src_stride))
+	convert_line(u, SRC_LINE(y0 > 0 ? y0 - 1 : 0), j->w);
+	convert_line(c, SRC_LINE(y0), j->w);
+	for (y = y0; y < y1; y++) {
+		convert_line(n, SRC_LINE(y + 1 < j->h ? y + 1 : y), j->w);
+		j->line((uint16_t *)(j->dst + y * 2 * j->dst_stride),
+			(uint16_t *)(j->dst + (y * 2 + 1) * j->dst_stride),
+			u, c, n, j->w);
+		t = u; u = c; c = n; n = t;
+	}
+#undef SRC_LINE
+}
+
+/* band worker pool */
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond_work;
+	pthread_cond_t cond_done;
+	struct sf_job job;
+	unsigned int seq;	// bumped for each new job
+	int bands;
+	int next_band;
+	int bands_left;
+	int threads;		// workers running, -1 before first use
+} pool = {
+	PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_COND_INITIALIZER,
+	PTHREAD_COND_INITIALIZER,
+	.threads = -1,
+};
+
+static void band_range(int band, int *y0, int *y1)
+{
+	*y0 = pool.job.h * band / pool.bands;
+	*y1 = pool.job.h * (band + 1) / pool.bands;
+}
+
+// called and returns with pool.lock held
+static void pool_do_bands(void)
+{
+	int band, y0, y1;
+
+	while (pool.next_band < pool.bands) {
+		band = pool.next_band++;
+		band_range(band, &y0, &y1);
+		pthread_mutex_unlock(&pool.lock);
+
+		filter_band(&pool.job, y0, y1);
+
+		pthread_mutex_lock(&pool.lock);
+		if (--pool.bands_left == 0)
+			pthread_cond_signal(&pool.cond_done);
+	}
+}
+
+static void *pool_worker(void *arg)
+{
+	unsigned int seen = 0;
+
+	pthread_mutex_lock(&pool.lock);
+	for (;;) {
+		while (pool.seq == seen)
+			pthread_cond_wait(&pool.cond_work, &pool.lock);
+		seen = pool.seq;
+		pool_do_bands();
+	}
+
+	return NULL;
+}
+
+static void pool_init(void)
+{
+	pthread_t thread;
+	long cpus;
+	int i;
+
+	pool.threads = 0;
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	for (i = 0; i < cpus - 1 && i < MAX_THREADS; i++) {
+		if (pthread_create(&thread, NULL, pool_worker, NULL) != 0)
+			break;
+		pthread_detach(thread);
+		pool.threads++;
+	}
+}
+
+static void run_filter(line_func *line, const void *src, void *dst,
+	int width, int src_stride, int dst_stride, int height)
+{
+	struct sf_job job = { line, src, dst, width, height,
+		src_stride, dst_stride };
+	int bands;
+
+	if (width > MAX_WIDTH)
+		job.w = width = MAX_WIDTH;
+	if (width <= 0 || height <= 0)
+		return;
+
+	if (pool.threads < 0)
+		pool_init();
+
+	bands = pool.threads + 1;
+	if (bands > height / MIN_BAND_LINES)
+		bands = height / MIN_BAND_LINES;
+	if (bands <= 1) {
+		filter_band(&job, 0, height);
+		return;
+	}
+
+	pthread_mutex_lock(&pool.lock);
+	pool.job = job;
+	pool.bands = bands;
+	pool.next_band = 0;
+	pool.bands_left = bands;
+	pool.seq++;
+	pthread_cond_broadcast(&pool.cond_work);
+
+	// this thread takes bands too
+	pool_do_bands();
+	while (pool.bands_left > 0)
+		pthread_cond_wait(&pool.cond_done, &pool.lock);
+	pthread_mutex_unlock(&pool.lock);
+}
+
+void scale2x_16_16(const void *src, void *dst, int width,
+	int src_stride, int dst_stride, int height)
+{
+	run_filter(scale2x_line, src, dst, width, src_stride, dst_stride, height);
+}
+
+void eagle2x_16_16(const void *src, void *dst, int width,
+	int src_stride, int dst_stride, int height)
+{
+	run_filter(eagle2x_line, src, dst, width, src_stride, dst_stride, height);
+}
@@ -0,0 +1,22 @@
+#ifndef __SOFT_FILTER_H__
+#define __SOFT_FILTER_H__
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * Portable versions of the libpicofe NEON 2x filters: bgr555 in,
+ * rgb565 out at twice the width and height. Strides are in bytes.
+ */
+void scale2x_16_16(const void *src, void *dst, int width,
+		int src_stride, int dst_stride, int height);
+void eagle2x_16_16(const void *src, void *dst, int width,
+		int src_stride, int dst_stride, int height);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SOFT_FILTER_H__ */
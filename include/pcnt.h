@@ -1,83 +1,39 @@
 
 enum pcounters {
 	PCNT_ALL,
+	PCNT_CPU,
 	PCNT_GPU,
 	PCNT_SPU,
+	PCNT_CDR,
+	PCNT_MDEC,
+	PCNT_DMA,
 	PCNT_BLIT,
 	PCNT_GTE,
+	PCNT_CHEAT,
+	PCNT_STATE,
 	PCNT_TEST,
 	PCNT_CNT
 };
 
 #ifdef PCNT
 
-#if defined(__ARM_ARCH_7A__) || defined(ARM1176)
-#define PCNT_DIV 1000
-#else
-#include <sys/time.h>
-#define PCNT_DIV 1
-#endif
+/*
+ * Time is always charged to the innermost running counter, so nested
+ * sections (gpu inside a dma inside cpu) don't count twice and the
+ * columns of a frame add up to its total. PCNT_ALL is the bottom of
+ * the stack and brackets a frame: its own share is the frontend time
+ * not covered by anything else.
+ *
+ * Units are cpu cycles on ARMv7/ARM1176, TSC ticks on x86 and
+ * nanoseconds elsewhere.
+ */
+#include <time.h>
 
-static const char *pcnt_names[PCNT_CNT] = { "", "gpu", "spu", "blit", "gte", "test" };
-
-#define PCNT_FRAMES 10
+#define PCNT_DEPTH 16
 
 extern unsigned int pcounters[PCNT_CNT];
-extern unsigned int pcounter_starts[PCNT_CNT];
-
-#define pcnt_start(id) \
-	pcounter_starts[id] = pcnt_get()
-
-#define pcnt_end(id) \
-	pcounters[id] += pcnt_get() - pcounter_starts[id]
-
-void pcnt_hook_plugins(void);
-
-static inline void pcnt_print(float fps)
-{
-	static int print_counter;
-	unsigned int total, rem;
-	int i;
-
-	for (i = 0; i < PCNT_CNT; i++)
-		pcounters[i] /= PCNT_DIV * PCNT_FRAMES;
-
-	rem = total = pcounters[PCNT_ALL];
-	for (i = 1; i < PCNT_CNT; i++)
-		rem -= pcounters[i];
-	if (!total)
-		total++;
-
-	if (--print_counter < 0) {
-		printf("     ");
-		for (i = 1; i < PCNT_CNT; i++)
-			printf("%5s ", pcnt_names[i]);
-		printf("%5s\n", "rem");
-		print_counter = 30;
-	}
-
-	printf("%4.1f ", fps);
-#if 0
-	static float pcounters_all[PCNT_CNT+1];
-	static int pcounter_samples;
-	pcounter_samples++;
-
-	for (i = 1; i < PCNT_CNT; i++) {
-		pcounters_all[i] += pcounters[i];
-		printf("%5.0f ", pcounters_all[i] / pcounter_samples);
-	}
-	pcounters_all[i] += rem;
-	printf("%5.0f\n", pcounters_all[i] / pcounter_samples);
-#else
-	for (i = 1; i < PCNT_CNT; i++)
-		printf("%5u ", pcounters[i]);
-	printf("%5u (", rem);
-	for (i = 1; i < PCNT_CNT; i++)
-		printf("%2u ", pcounters[i] * 100 / total);
-	printf("%2u) %u\n", rem * 100 / total, total);
-#endif
-	memset(pcounters, 0, sizeof(pcounters));
-}
+extern unsigned char pcnt_stack[PCNT_DEPTH];
+extern unsigned int pcnt_sp, pcnt_last;
 
 static inline unsigned int pcnt_get(void)
 {
@@ -88,18 +44,47 @@ static inline unsigned int pcnt_get(void)
 #elif defined(ARM1176)
 	__asm__ volatile("mrc p15, 0, %0, c15, c12, 1"
 			 : "=r"(val));
+#elif defined(__i386__) || defined(__x86_64__)
+	unsigned int hi;
+	__asm__ volatile("rdtsc" : "=a"(val), "=d"(hi));
 #else
-	// all slow on ARM :(
-	//struct timespec tv;
-	//clock_gettime(CLOCK_MONOTONIC_RAW, &tv);
-	//val = tv.tv_sec * 1000000000 + tv.tv_nsec;
-	struct timeval tv;
-	gettimeofday(&tv, NULL);
-	val = tv.tv_sec * 1000000 + tv.tv_usec;
+	struct timespec tv;
+#ifdef CLOCK_MONOTONIC_RAW
+	clock_gettime(CLOCK_MONOTONIC_RAW, &tv);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &tv);
+#endif
+	val = tv.tv_sec * 1000000000u + tv.tv_nsec;
 #endif
 	return val;
 }
 
+static inline void pcnt_charge(void)
+{
+	unsigned int now = pcnt_get();
+	pcounters[pcnt_stack[pcnt_sp]] += now - pcnt_last;
+	pcnt_last = now;
+}
+
+/* PCNT_ALL only moves the frame start, it's never pushed or popped */
+static inline void pcnt_start(int id)
+{
+	if (id == PCNT_ALL) {
+		pcnt_last = pcnt_get();
+		return;
+	}
+	pcnt_charge();
+	if (pcnt_sp < PCNT_DEPTH - 1)
+		pcnt_stack[++pcnt_sp] = id;
+}
+
+static inline void pcnt_end(int id)
+{
+	pcnt_charge();
+	if (id != PCNT_ALL && pcnt_sp > 0)
+		pcnt_sp--;
+}
+
 static inline void pcnt_init(void)
 {
 #ifdef __ARM_ARCH_7A__
@@ -117,8 +102,17 @@ static inline void pcnt_init(void)
 	v &= ~8; // ccnt divider 0
 	asm volatile("mcr p15, 0, %0, c15, c12, 0" :: "r"(v));
 #endif
+	pcnt_sp = 0;
+	pcnt_stack[0] = PCNT_ALL;
+	pcnt_last = pcnt_get();
 }
 
+void pcnt_hook_plugins(void);
+
+/* called once per frame after pcnt_end(PCNT_ALL), writes a csv line
+ * to $PCNT_CSV or stdout and clears the counters */
+void pcnt_print(void);
+
 void pcnt_gte_start(int op);
 void pcnt_gte_end(int op);
 
@@ -127,6 +121,6 @@ void pcnt_gte_end(int op);
 #define pcnt_start(id)
 #define pcnt_end(id)
 #define pcnt_hook_plugins()
-#define pcnt_print(fps)
+#define pcnt_print()
 
 #endif
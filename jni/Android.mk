@@ -64,8 +64,8 @@ $(shell cd "$(LOCAL_PATH)" && ((git describe || echo) | sed -e 's/.*/#define REV
 $(shell cd "$(LOCAL_PATH)" && (diff -q ../frontend/revision.h_ ../frontend/revision.h > /dev/null 2>&1 || cp ../frontend/revision.h_ ../frontend/revision.h))
 $(shell cd "$(LOCAL_PATH)" && (rm ../frontend/revision.h_))
 
-LOCAL_SRC_FILES += ../libpcsxcore/cdriso.c ../libpcsxcore/cdrom.c ../libpcsxcore/cheat.c ../libpcsxcore/debug.c \
-   ../libpcsxcore/decode_xa.c ../libpcsxcore/disr3000a.c ../libpcsxcore/mdec.c \
+LOCAL_SRC_FILES += ../libpcsxcore/cdrcompr.c ../libpcsxcore/cdriso.c ../libpcsxcore/cdrom.c ../libpcsxcore/cheat.c \
+   ../libpcsxcore/debug.c ../libpcsxcore/decode_xa.c ../libpcsxcore/disr3000a.c ../libpcsxcore/mdec.c \
    ../libpcsxcore/misc.c ../libpcsxcore/plugins.c ../libpcsxcore/ppf.c ../libpcsxcore/psxbios.c \
    ../libpcsxcore/psxcommon.c ../libpcsxcore/psxcounters.c ../libpcsxcore/psxdma.c ../libpcsxcore/psxhle.c \
    ../libpcsxcore/psxhw.c ../libpcsxcore/psxinterpreter.c ../libpcsxcore/psxmem.c ../libpcsxcore/r3000a.c \
@@ -78,7 +78,7 @@ LOCAL_SRC_FILES += ../plugins/dfsound/dma.c ../plugins/dfsound/freeze.c \
    ../plugins/dfsound/out.c ../plugins/dfsound/nullsnd.c
 
 # builtin gpu
-LOCAL_SRC_FILES += ../plugins/gpulib/gpu.c ../plugins/gpulib/vout_pl.c
+LOCAL_SRC_FILES += ../plugins/gpulib/gpu.c ../plugins/gpulib/gpu_thread.c ../plugins/gpulib/gpu_trace.c ../plugins/gpulib/vout_pl.c
 
 # cdrcimg
 LOCAL_SRC_FILES += ../plugins/cdrcimg/cdrcimg.c
@@ -87,7 +87,7 @@ LOCAL_SRC_FILES += ../plugins/cdrcimg/cdrcimg.c
 LOCAL_SRC_FILES += ../plugins/dfinput/main.c ../plugins/dfinput/pad.c ../plugins/dfinput/guncon.c
 
 # misc
-LOCAL_SRC_FILES += ../frontend/main.c ../frontend/plugin.c ../frontend/cspace.c
+LOCAL_SRC_FILES += ../frontend/main.c ../frontend/plugin.c ../frontend/cspace.c ../frontend/cspace_x86.c
 
 # libretro
 LOCAL_SRC_FILES += ../frontend/libretro.c
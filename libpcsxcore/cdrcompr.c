@@ -0,0 +1,96 @@
+/*
+ * This work is licensed under the terms of any of these licenses
+ * (at your option):
+ *  - GNU GPL, version 2 or later.
+ *  - GNU LGPL, version 2.1 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "cdrcompr.h"
+
+// reads the header and block index of a .cbin (CISO) image, 'table'
+// gets count + 1 entries, the last one being the end of the data
+int cdr_compr_read_cbin(FILE *f, off_t **table, unsigned int *count)
+{
+	struct ciso_header hdr;
+	unsigned int *raw = NULL;
+	unsigned long long len;
+	unsigned int i;
+	off_t *t = NULL;
+
+	if (fseeko(f, 0, SEEK_SET) != 0 || fread(&hdr, sizeof(hdr), 1, f) != 1)
+		return -1;
+	if (strncmp(hdr.magic, "CISO", 4) != 0 || hdr.total_bytes == 0 || hdr.block_size == 0)
+		return -1;
+	if (hdr.header_size != 0 && hdr.header_size != sizeof(hdr)
+	    && fseeko(f, hdr.header_size, SEEK_SET) != 0)
+		return -1;
+
+	len = hdr.total_bytes / hdr.block_size;
+	if (len == 0 || len >= 0xffffffffu || len + 1 > SIZE_MAX / sizeof(t[0]))
+		return -1;
+
+	raw = malloc((len + 1) * sizeof(raw[0]));
+	t = malloc((len + 1) * sizeof(t[0]));
+	if (raw == NULL || t == NULL
+	    || fread(raw, sizeof(raw[0]), len + 1, f) != len + 1) {
+		free(raw);
+		free(t);
+		return -1;
+	}
+
+	for (i = 0; i < len + 1; i++) {
+		t[i] = (off_t)(raw[i] & 0x7fffffff) << hdr.align;
+		if (raw[i] & 0x80000000)
+			t[i] |= CDR_COMPR_PLAIN;
+	}
+	free(raw);
+
+	*table = t;
+	*count = len;
+	return 0;
+}
+
+// returns whether the block is deflated (1) or stored (0)
+int cdr_compr_block_pos(const off_t *table, unsigned int block,
+	off_t *start, unsigned int *size)
+{
+	*start = table[block] & ~CDR_COMPR_PLAIN;
+	*size = (table[block + 1] & ~CDR_COMPR_PLAIN) - *start;
+
+	return !(table[block] & CDR_COMPR_PLAIN);
+}
+
+// inflates a raw deflate block, 'z' is set up on first use and kept
+// for the next calls
+int cdr_compr_inflate(z_stream *z, void *out, unsigned long *out_size,
+	void *in, unsigned long in_size)
+{
+	int ret = 0;
+
+	if (z->zalloc == NULL) {
+		z->next_in = Z_NULL;
+		z->avail_in = 0;
+		z->zalloc = Z_NULL;
+		z->zfree = Z_NULL;
+		z->opaque = Z_NULL;
+		ret = inflateInit2(z, -15);
+	}
+	else
+		ret = inflateReset(z);
+	if (ret != Z_OK)
+		return ret;
+
+	z->next_in = in;
+	z->avail_in = in_size;
+	z->next_out = out;
+	z->avail_out = *out_size;
+
+	ret = inflate(z, Z_NO_FLUSH);
+
+	*out_size -= z->avail_out;
+	return ret == 1 ? 0 : ret;
+}
@@ -0,0 +1,47 @@
+/*
+ * This work is licensed under the terms of any of these licenses
+ * (at your option):
+ *  - GNU GPL, version 2 or later.
+ *  - GNU LGPL, version 2.1 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+/*
+ * Block index and decoding of compressed CD images (.cbin and .pbp),
+ * shared by cdriso.c and the image converter in tools/.
+ */
+
+#ifndef __CDRCOMPR_H__
+#define __CDRCOMPR_H__
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <zlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct ciso_header {
+	char magic[4];
+	unsigned int header_size;
+	unsigned long long total_bytes;
+	unsigned int block_size;
+	unsigned char ver;		// 1
+	unsigned char align;
+	unsigned char rsv_06[2];
+};
+
+// index entries are file offsets, this bit marks blocks stored as is
+#define CDR_COMPR_PLAIN ((off_t)1 << (sizeof(off_t) * 8 - 1))
+
+int cdr_compr_read_cbin(FILE *f, off_t **table, unsigned int *count);
+int cdr_compr_block_pos(const off_t *table, unsigned int block,
+	off_t *start, unsigned int *size);
+int cdr_compr_inflate(z_stream *z, void *out, unsigned long *out_size,
+	void *in, unsigned long in_size);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -24,6 +24,7 @@
 #include "cdrom.h"
 #include "cdriso.h"
 #include "ppf.h"
+#include "cdrcompr.h"
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -34,15 +35,19 @@
 #else
 #include <pthread.h>
 #include <sys/time.h>
+#include <sys/mman.h>
 #include <unistd.h>
+#define CDR_READAHEAD
+#define CDR_MMAP
 #endif
+#include <sys/stat.h>
 #include <errno.h>
 #include <zlib.h>
 
-#define OFF_T_MSB ((off_t)1 << (sizeof(off_t) * 8 - 1))
-
 unsigned int cdrIsoMultidiskCount;
 unsigned int cdrIsoMultidiskSelect;
+unsigned int cdrIsoReadaheadHits;
+unsigned int cdrIsoReadaheadMisses;
 
 static FILE *cdHandle = NULL;
 static FILE *cddaHandle = NULL;
@@ -57,9 +62,12 @@ static boolean multifile = FALSE;
 static unsigned char cdbuffer[CD_FRAMESIZE_RAW];
 static unsigned char subbuffer[SUB_FRAMESIZE];
 
-static unsigned char sndbuffer[CD_FRAMESIZE_RAW * 10];
+// cdda is read and queued to the SPU this many sectors at a time
+#define CDDA_BATCH_SECTORS		8
+
+static unsigned char sndbuffer[CD_FRAMESIZE_RAW * CDDA_BATCH_SECTORS];
 
-#define CDDA_FRAMETIME			(1000 * (sizeof(sndbuffer) / CD_FRAMESIZE_RAW) / 75)
+#define CDDA_FRAMETIME			(1000 * CDDA_BATCH_SECTORS / 75)
 
 #ifdef _WIN32
 static HANDLE threadid;
@@ -82,14 +90,48 @@ static unsigned int pregapOffset;
 #define cddaCurPos cdda_cur_sector
 
 // compressed image stuff
-static struct {
-	unsigned char buff_raw[16][CD_FRAMESIZE_RAW];
+#ifndef COMPR_CACHE_BLOCKS
+#define COMPR_CACHE_BLOCKS 8
+#endif
+#define COMPR_PREFETCH_BLOCKS 2
+#if COMPR_CACHE_BLOCKS < 4
+#error need room for the current, the prefetched and two loading blocks
+#endif
+
+struct compr_blk {
+	unsigned char raw[16][CD_FRAMESIZE_RAW];
+	unsigned int block;
+	unsigned int stamp;	// for lru
+	int busy;		// being inflated, block is already set
+};
+
+// state of a thread doing inflate: the emu thread, the CDDA playthread
+// or the prefetcher
+struct compr_worker {
 	unsigned char buff_compressed[CD_FRAMESIZE_RAW * 16 + 100];
+	z_stream z;
+};
+
+static struct {
+	struct compr_blk cache[COMPR_CACHE_BLOCKS];
+	struct compr_blk *current;	// returned by ISOgetBuffer_compr, never evicted
+	struct compr_worker main;
+	struct compr_worker cdda;
 	off_t *index_table;
 	unsigned int index_len;
 	unsigned int block_shift;
-	unsigned int current_block;
 	unsigned int sector_in_blk;
+	unsigned int stamp;
+	unsigned int last_block;
+	int dir;			// direction of the last reads, for prefetch
+	unsigned int hits, misses;
+#ifdef CDR_READAHEAD
+	struct compr_worker prefetch;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int thread_running, quit, want;
+#endif
 } *compr_img;
 
 int (*cdimg_read_func)(FILE *f, unsigned int base, void *dest, int sector);
@@ -102,6 +144,8 @@ long CALLBACK CDR__setfilename(char *filename);
 long CALLBACK CDR__getStatus(struct CdrStat *stat);
 
 static void DecodeRawSubData(void);
+static int cdda_read_batch(unsigned char *buf, int count);
+static int ecm_attach(FILE *f, const char *fname, unsigned int *size);
 
 struct trackinfo {
 	enum {DATA=1, CDDA} type;
@@ -173,43 +217,55 @@ static long GetTickCount(void) {
 }
 #endif
 
-// this thread plays audio data
+#ifndef _WIN32
+static pthread_mutex_t cdda_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cdda_cond = PTHREAD_COND_INITIALIZER;
+#endif
+
+// sleeps for about ms milliseconds, stopCDDA() cuts it short
+static void cdda_sleep(long ms)
+{
+#ifdef _WIN32
+	usleep(ms * 1000);
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += ms / 1000;
+	ts.tv_nsec += (ms % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+	pthread_mutex_lock(&cdda_lock);
+	if (playing)
+		pthread_cond_timedwait(&cdda_cond, &cdda_lock, &ts);
+	pthread_mutex_unlock(&cdda_lock);
+#endif
+}
+
+// this thread plays audio data: it reads the track a batch at a time
+// and queues it to the SPU, which plays it from its ring at its own rate
 #ifdef _WIN32
 static void playthread(void *param)
 #else
 static void *playthread(void *param)
 #endif
 {
-	long osleep, d, t, i, s;
+	long osleep, t, i, s, wait, start, fed = 0;
 	unsigned char	tmp;
-	int ret = 0, sector_offs;
+	int ret = 0;
 
-	t = GetTickCount();
+	t = start = GetTickCount();
 
 	while (playing) {
-		s = 0;
-		for (i = 0; i < sizeof(sndbuffer) / CD_FRAMESIZE_RAW; i++) {
-			sector_offs = cdda_cur_sector - cdda_first_sector;
-			if (sector_offs < 0) {
-				d = CD_FRAMESIZE_RAW;
-				memset(sndbuffer + s, 0, d);
-			}
-			else {
-				d = cdimg_read_func(cddaHandle, cdda_file_offset,
-					sndbuffer + s, sector_offs);
-				if (d < CD_FRAMESIZE_RAW)
-					break;
-			}
-
-			s += d;
-			cdda_cur_sector++;
-		}
-
-		if (s == 0) {
+		s = cdda_read_batch(sndbuffer, CDDA_BATCH_SECTORS);
+		if (s <= 0) {
 			playing = FALSE;
 			initial_offset = 0;
 			break;
 		}
+		cdda_cur_sector += s / CD_FRAMESIZE_RAW;
 
 		if (!cdr.Muted && playing) {
 			if (cddaBigEndian) {
@@ -224,9 +280,22 @@ static void *playthread(void *param)
 			//cdrAttenuate((short *)sndbuffer, s / 4, 1);
 			do {
 				ret = SPU_playCDDAchannel((short *)sndbuffer, s);
-				if (ret == 0x7761)
-					usleep(6 * 1000);
-			} while (ret == 0x7761 && playing); // rearmed_wait
+				if (ret != 0x7761)
+					break;
+				// the SPU ring is full, wait until it has room for a
+				// batch at the rate it has been taking data so far
+				// (faster than realtime when the emu is fast-forwarding)
+				wait = CDDA_FRAMETIME;
+				if (fed > 0)
+					wait = (GetTickCount() - start) * s / fed;
+				if (wait < 2)
+					wait = 2;
+				if (wait > CDDA_FRAMETIME)
+					wait = CDDA_FRAMETIME;
+				cdda_sleep(wait);
+			} while (playing); // rearmed_wait
+			if (ret == 0x676f)
+				fed += s;
 		}
 
 		if (ret != 0x676f) { // !rearmed_go
@@ -249,7 +318,7 @@ static void *playthread(void *param)
 				t = now;
 			}
 
-			usleep(osleep * 1000);
+			cdda_sleep(osleep);
 			t += CDDA_FRAMETIME;
 		}
 
@@ -269,10 +338,14 @@ static void stopCDDA() {
 		return;
 	}
 
-	playing = FALSE;
 #ifdef _WIN32
+	playing = FALSE;
 	WaitForSingleObject(threadid, INFINITE);
 #else
+	pthread_mutex_lock(&cdda_lock);
+	playing = FALSE;
+	pthread_cond_signal(&cdda_cond);
+	pthread_mutex_unlock(&cdda_lock);
 	pthread_join(threadid, NULL);
 #endif
 }
@@ -451,6 +524,7 @@ static int parsecue(const char *isofile) {
 	unsigned int	incue_max_len;
 	unsigned int	t, file_len, mode, sector_offs;
 	unsigned int	sector_size = 2352;
+	const char	*fname;
 
 	numtracks = 0;
 
@@ -561,6 +635,7 @@ static int parsecue(const char *isofile) {
 				sscanf(linebuf, " FILE %255s", tmpb);
 
 			// absolute path?
+			fname = tmpb;
 			ti[numtracks + 1].handle = fopen(tmpb, "rb");
 			if (ti[numtracks + 1].handle == NULL) {
 				// relative to .cue?
@@ -572,6 +647,7 @@ static int parsecue(const char *isofile) {
 				else
 					tmp = tmpb;
 				strncpy(incue_fname, tmp, incue_max_len);
+				fname = filepath;
 				ti[numtracks + 1].handle = fopen(filepath, "rb");
 			}
 
@@ -586,15 +662,21 @@ static int parsecue(const char *isofile) {
 				SysPrintf(_("\ncould not open: %s\n"), filepath);
 				continue;
 			}
-			fseek(ti[numtracks + 1].handle, 0, SEEK_END);
-			file_len = ftell(ti[numtracks + 1].handle) / 2352;
+			if (ecm_attach(ti[numtracks + 1].handle, fname, &t) == 0)
+				file_len = t / 2352;
+			else {
+				fseek(ti[numtracks + 1].handle, 0, SEEK_END);
+				file_len = ftell(ti[numtracks + 1].handle) / 2352;
+			}
 
 			if (numtracks == 0 && strlen(isofile) >= 4 &&
 				strcmp(isofile + strlen(isofile) - 4, ".cue") == 0)
 			{
 				// user selected .cue as image file, use it's data track instead
 				fclose(cdHandle);
-				cdHandle = fopen(filepath, "rb");
+				cdHandle = fopen(fname, "rb");
+				if (cdHandle != NULL)
+					ecm_attach(cdHandle, fname, NULL);
 			}
 		}
 	}
@@ -910,7 +992,6 @@ static int handlepbp(const char *isofile) {
 		goto fail_io;
 
 	compr_img->block_shift = 4;
-	compr_img->current_block = (unsigned int)-1;
 
 	compr_img->index_len = (0x100000 - 0x4000) / sizeof(index_entry);
 	compr_img->index_table = malloc((compr_img->index_len + 1) * sizeof(compr_img->index_table[0]));
@@ -946,87 +1027,26 @@ fail_io:
 }
 
 static int handlecbin(const char *isofile) {
-	struct
-	{
-		char magic[4];
-		unsigned int header_size;
-		unsigned long long total_bytes;
-		unsigned int block_size;
-		unsigned char ver;		// 1
-		unsigned char align;
-		unsigned char rsv_06[2];
-	} ciso_hdr;
 	const char *ext = NULL;
-	unsigned int *index_table = NULL;
-	unsigned int index = 0, plain;
-	int i, ret;
 
 	if (strlen(isofile) >= 5)
 		ext = isofile + strlen(isofile) - 5;
 	if (ext == NULL || (strcasecmp(ext + 1, ".cbn") != 0 && strcasecmp(ext, ".cbin") != 0))
 		return -1;
 
-	fseek(cdHandle, 0, SEEK_SET);
-
-	ret = fread(&ciso_hdr, 1, sizeof(ciso_hdr), cdHandle);
-	if (ret != sizeof(ciso_hdr)) {
-		SysPrintf("failed to read ciso header\n");
-		return -1;
-	}
-
-	if (strncmp(ciso_hdr.magic, "CISO", 4) != 0 || ciso_hdr.total_bytes <= 0 || ciso_hdr.block_size <= 0) {
-		SysPrintf("bad ciso header\n");
-		return -1;
-	}
-	if (ciso_hdr.header_size != 0 && ciso_hdr.header_size != sizeof(ciso_hdr)) {
-		ret = fseeko(cdHandle, ciso_hdr.header_size, SEEK_SET);
-		if (ret != 0) {
-			SysPrintf("failed to seek to %x\n", ciso_hdr.header_size);
-			return -1;
-		}
-	}
-
 	compr_img = calloc(1, sizeof(*compr_img));
 	if (compr_img == NULL)
-		goto fail_io;
+		return -1;
 
 	compr_img->block_shift = 0;
-	compr_img->current_block = (unsigned int)-1;
-
-	compr_img->index_len = ciso_hdr.total_bytes / ciso_hdr.block_size;
-	index_table = malloc((compr_img->index_len + 1) * sizeof(index_table[0]));
-	if (index_table == NULL)
-		goto fail_io;
-
-	ret = fread(index_table, sizeof(index_table[0]), compr_img->index_len, cdHandle);
-	if (ret != compr_img->index_len) {
-		SysPrintf("failed to read index table\n");
-		goto fail_index;
-	}
-
-	compr_img->index_table = malloc((compr_img->index_len + 1) * sizeof(compr_img->index_table[0]));
-	if (compr_img->index_table == NULL)
-		goto fail_index;
-
-	for (i = 0; i < compr_img->index_len + 1; i++) {
-		index = index_table[i];
-		plain = index & 0x80000000;
-		index &= 0x7fffffff;
-		compr_img->index_table[i] = (off_t)index << ciso_hdr.align;
-		if (plain)
-			compr_img->index_table[i] |= OFF_T_MSB;
-	}
-
-	return 0;
-
-fail_index:
-	free(index_table);
-fail_io:
-	if (compr_img != NULL) {
+	if (cdr_compr_read_cbin(cdHandle, &compr_img->index_table, &compr_img->index_len) != 0) {
+		SysPrintf("bad ciso header or index\n");
 		free(compr_img);
 		compr_img = NULL;
+		return -1;
 	}
-	return -1;
+
+	return 0;
 }
 
 // this function tries to get the .sub file of the given .img
@@ -1089,107 +1109,270 @@ static int cdread_sub_mixed(FILE *f, unsigned int base, void *dest, int sector)
 	return ret;
 }
 
-static int uncompress2(void *out, unsigned long *out_size, void *in, unsigned long in_size)
-{
-	static z_stream z;
-	int ret = 0;
-
-	if (z.zalloc == NULL) {
-		// XXX: one-time leak here..
-		z.next_in = Z_NULL;
-		z.avail_in = 0;
-		z.zalloc = Z_NULL;
-		z.zfree = Z_NULL;
-		z.opaque = Z_NULL;
-		ret = inflateInit2(&z, -15);
-	}
-	else
-		ret = inflateReset(&z);
-	if (ret != Z_OK)
-		return ret;
-
-	z.next_in = in;
-	z.avail_in = in_size;
-	z.next_out = out;
-	z.avail_out = *out_size;
-
-	ret = inflate(&z, Z_NO_FLUSH);
-	//inflateEnd(&z);
-
-	*out_size -= z.avail_out;
-	return ret == 1 ? 0 : ret;
-}
+#ifdef CDR_READAHEAD
+#define compr_lock()   pthread_mutex_lock(&compr_img->lock)
+#define compr_unlock() pthread_mutex_unlock(&compr_img->lock)
+#define compr_wait()   pthread_cond_wait(&compr_img->cond, &compr_img->lock)
+#define compr_wake()   pthread_cond_broadcast(&compr_img->cond)
+#else
+#define compr_lock()
+#define compr_unlock()
+#define compr_wait()
+#define compr_wake()
+#endif
 
-static int cdread_compressed(FILE *f, unsigned int base, void *dest, int sector)
+// reads and inflates a block into blk->raw, called without the lock held
+static int compr_load_block(struct compr_worker *w, struct compr_blk *blk,
+	unsigned int block)
 {
 	unsigned long cdbuffer_size, cdbuffer_size_expect;
 	unsigned int size;
 	int is_compressed;
 	off_t start_byte;
-	int ret, block;
-
-	if (base)
-		sector += base / 2352;
-
-	block = sector >> compr_img->block_shift;
-	compr_img->sector_in_blk = sector & ((1 << compr_img->block_shift) - 1);
-
-	if (block == compr_img->current_block) {
-		//printf("hit sect %d\n", sector);
-		goto finish;
-	}
+	int ret;
 
-	if (sector >= compr_img->index_len * 16) {
-		SysPrintf("sector %d is past img end\n", sector);
+	is_compressed = cdr_compr_block_pos(compr_img->index_table, block,
+		&start_byte, &size);
+	if (size > sizeof(w->buff_compressed)) {
+		SysPrintf("block %d is too large: %u\n", block, size);
 		return -1;
 	}
 
-	start_byte = compr_img->index_table[block] & ~OFF_T_MSB;
+#ifdef CDR_READAHEAD
+	// pread so that the prefetcher doesn't race for the file position
+	ret = pread(fileno(cdHandle), is_compressed ? w->buff_compressed : blk->raw[0],
+		size, start_byte);
+#else
 	if (fseeko(cdHandle, start_byte, SEEK_SET) != 0) {
 		SysPrintf("seek error for block %d at %llx: ",
 			block, (long long)start_byte);
 		perror(NULL);
 		return -1;
 	}
-
-	is_compressed = !(compr_img->index_table[block] & OFF_T_MSB);
-	size = (compr_img->index_table[block + 1] & ~OFF_T_MSB) - start_byte;
-	if (size > sizeof(compr_img->buff_compressed)) {
-		SysPrintf("block %d is too large: %u\n", block, size);
-		return -1;
-	}
-
-	if (fread(is_compressed ? compr_img->buff_compressed : compr_img->buff_raw[0],
-				1, size, cdHandle) != size) {
-		SysPrintf("read error for block %d at %x: ", block, start_byte);
+	ret = fread(is_compressed ? w->buff_compressed : blk->raw[0], 1, size, cdHandle);
+#endif
+	if (ret != size) {
+		SysPrintf("read error for block %d at %llx: ", block, (long long)start_byte);
 		perror(NULL);
 		return -1;
 	}
 
 	if (is_compressed) {
-		cdbuffer_size_expect = sizeof(compr_img->buff_raw[0]) << compr_img->block_shift;
+		cdbuffer_size_expect = sizeof(blk->raw[0]) << compr_img->block_shift;
 		cdbuffer_size = cdbuffer_size_expect;
-		ret = uncompress2(compr_img->buff_raw[0], &cdbuffer_size, compr_img->buff_compressed, size);
+		ret = cdr_compr_inflate(&w->z, blk->raw[0], &cdbuffer_size,
+			w->buff_compressed, size);
 		if (ret != 0) {
-			SysPrintf("uncompress failed with %d for block %d, sector %d\n",
-					ret, block, sector);
+			SysPrintf("uncompress failed with %d for block %d\n", ret, block);
 			return -1;
 		}
 		if (cdbuffer_size != cdbuffer_size_expect)
-			SysPrintf("cdbuffer_size: %lu != %lu, sector %d\n", cdbuffer_size,
-					cdbuffer_size_expect, sector);
+			SysPrintf("cdbuffer_size: %lu != %lu, block %d\n", cdbuffer_size,
+					cdbuffer_size_expect, block);
 	}
 
-	// done at last!
-	compr_img->current_block = block;
+	return 0;
+}
+
+// called with the lock held
+static struct compr_blk *compr_find(unsigned int block)
+{
+	int i;
+
+	for (i = 0; i < COMPR_CACHE_BLOCKS; i++)
+		if (compr_img->cache[i].block == block)
+			return &compr_img->cache[i];
+
+	return NULL;
+}
+
+// least recently used idle slot, called with the lock held
+static struct compr_blk *compr_victim(void)
+{
+	struct compr_blk *blk, *victim = NULL;
+	int i;
+
+	for (i = 0; i < COMPR_CACHE_BLOCKS; i++) {
+		blk = &compr_img->cache[i];
+		if (blk->busy || blk == compr_img->current)
+			continue;
+		if (victim == NULL || (int)(blk->stamp - victim->stamp) < 0)
+			victim = blk;
+	}
+
+	return victim;
+}
+
+#ifdef CDR_READAHEAD
+
+// inflates the blocks following the last read one in its direction
+static void *compr_thread(void *param)
+{
+	struct compr_blk *blk;
+	unsigned int block;
+	int i, ret;
+
+	compr_lock();
+	while (!compr_img->quit) {
+		if (!compr_img->want) {
+			compr_wait();
+			continue;
+		}
+		compr_img->want = 0;
+
+		for (i = 1; i <= COMPR_PREFETCH_BLOCKS && !compr_img->want; i++) {
+			block = compr_img->last_block + compr_img->dir * i;
+			if (block >= compr_img->index_len || compr_find(block) != NULL)
+				continue;
+			blk = compr_victim();
+			if (blk == NULL)
+				break;
+
+			blk->block = block;
+			blk->busy = 1;
+			blk->stamp = ++compr_img->stamp;
+			compr_unlock();
+
+			ret = compr_load_block(&compr_img->prefetch, blk, block);
+
+			compr_lock();
+			if (ret != 0)
+				blk->block = (unsigned int)-1;
+			blk->busy = 0;
+			compr_wake();
+		}
+	}
+	compr_unlock();
+
+	return NULL;
+}
+
+#endif
+
+static void compr_start(void)
+{
+	int i;
+
+	for (i = 0; i < COMPR_CACHE_BLOCKS; i++)
+		compr_img->cache[i].block = (unsigned int)-1;
+	compr_img->last_block = (unsigned int)-1;
+	compr_img->dir = 1;
+
+#ifdef CDR_READAHEAD
+	pthread_mutex_init(&compr_img->lock, NULL);
+	pthread_cond_init(&compr_img->cond, NULL);
+	compr_img->thread_running =
+		pthread_create(&compr_img->thread, NULL, compr_thread, NULL) == 0;
+#endif
+}
+
+static void compr_stop(void)
+{
+#ifdef CDR_READAHEAD
+	if (compr_img->thread_running) {
+		compr_lock();
+		compr_img->quit = 1;
+		compr_wake();
+		compr_unlock();
+		pthread_join(compr_img->thread, NULL);
+	}
+	pthread_cond_destroy(&compr_img->cond);
+	pthread_mutex_destroy(&compr_img->lock);
+	if (compr_img->prefetch.z.zalloc != NULL)
+		inflateEnd(&compr_img->prefetch.z);
+#endif
+	if (compr_img->main.z.zalloc != NULL)
+		inflateEnd(&compr_img->main.z);
+	if (compr_img->cdda.z.zalloc != NULL)
+		inflateEnd(&compr_img->cdda.z);
+
+	SysPrintf("cdriso block cache: %u hits, %u misses\n",
+		compr_img->hits, compr_img->misses);
+}
+
+// reads a sector through the cache, inflating with the caller's worker
+static int compr_read(struct compr_worker *w, unsigned int base, void *dest,
+	int sector)
+{
+	struct compr_blk *blk;
+	unsigned int block, sector_in_blk;
+	int ret;
+
+	if (base)
+		sector += base / 2352;
+
+	block = sector >> compr_img->block_shift;
+	sector_in_blk = sector & ((1 << compr_img->block_shift) - 1);
+
+	if (block >= compr_img->index_len) {
+		SysPrintf("sector %d is past img end\n", sector);
+		return -1;
+	}
+
+	compr_lock();
+	blk = compr_find(block);
+	while (blk != NULL && blk->busy) {
+		// the prefetcher is on it already
+		compr_wait();
+		blk = compr_find(block);
+	}
+	if (blk != NULL) {
+		compr_img->hits++;
+	}
+	else {
+		compr_img->misses++;
+		blk = compr_victim();
+		if (blk == NULL) {
+			compr_unlock();
+			SysPrintf("no free block for sector %d\n", sector);
+			return -1;
+		}
+		blk->block = block;
+		blk->busy = 1;
+		compr_unlock();
+
+		ret = compr_load_block(w, blk, block);
+
+		compr_lock();
+		blk->busy = 0;
+		compr_wake();
+		if (ret != 0) {
+			blk->block = (unsigned int)-1;
+			compr_unlock();
+			return -1;
+		}
+	}
+	blk->stamp = ++compr_img->stamp;
+
+	if (dest == cdbuffer) { // copy avoid HACK
+		compr_img->current = blk;
+		compr_img->sector_in_blk = sector_in_blk;
+	}
+	else
+		memcpy(dest, blk->raw[sector_in_blk], CD_FRAMESIZE_RAW);
+
+	// only the emu thread's reads steer the prefetch
+	if (w == &compr_img->main && block != compr_img->last_block) {
+		if (block == compr_img->last_block + 1)
+			compr_img->dir = 1;
+		else if (block == compr_img->last_block - 1)
+			compr_img->dir = -1;
+		compr_img->last_block = block;
+#ifdef CDR_READAHEAD
+		compr_img->want = 1;
+		compr_wake();
+#endif
+	}
+	compr_unlock();
 
-finish:
-	if (dest != cdbuffer) // copy avoid HACK
-		memcpy(dest, compr_img->buff_raw[compr_img->sector_in_blk],
-			CD_FRAMESIZE_RAW);
 	return CD_FRAMESIZE_RAW;
 }
 
+static int cdread_compressed(FILE *f, unsigned int base, void *dest, int sector)
+{
+	return compr_read(&compr_img->main, base, dest, sector);
+}
+
 static int cdread_2048(FILE *f, unsigned int base, void *dest, int sector)
 {
 	int ret;
@@ -1205,8 +1388,880 @@ static int cdread_2048(FILE *f, unsigned int base, void *dest, int sector)
 	return ret;
 }
 
+// ECM images: sectors stored without their sync, EDC and ECC, which are
+// regenerated on read. An index of the ECM records is built on first
+// open and kept in "<image>.idx" next to the image.
+#define ECM_CACHE_SECTORS 32
+#define ECM_IDX_MAGIC "ECMIDX1"
+
+struct ecm_chunk {
+	unsigned int out_offs;	// offset in the decoded image
+	unsigned int in_offs;	// offset of the record data in the .ecm
+	unsigned int count;
+	unsigned int type;
+};
+
+// state of one open .ecm handle: the data reads go through cdHandle and
+// the cdda reads through the track handles, so they don't share a cache.
+struct ecm_image {
+	FILE *f;
+	struct ecm_chunk *chunks;
+	unsigned int chunk_count;
+	unsigned int out_size;
+	struct {
+		int sector;
+		unsigned int stamp;
+		unsigned char raw[CD_FRAMESIZE_RAW];
+	} cache[ECM_CACHE_SECTORS];
+	unsigned int stamp;
+#ifdef CDR_READAHEAD
+	pthread_mutex_t lock;	// ISOreadCDDA and the cdda thread share a handle
+#endif
+};
+
+static struct ecm_image *ecm_imgs[MAXTRACKS + 2];
+static int ecm_img_count;
+
+#ifdef CDR_READAHEAD
+#define ecm_lock(img)   pthread_mutex_lock(&(img)->lock)
+#define ecm_unlock(img) pthread_mutex_unlock(&(img)->lock)
+#else
+#define ecm_lock(img)
+#define ecm_unlock(img)
+#endif
+
+// bytes a record element takes in the .ecm and in the decoded image
+static const unsigned int ecm_in_size[4]  = { 1, 3 + 0x800, 0x804, 0x918 };
+static const unsigned int ecm_out_size[4] = { 1, CD_FRAMESIZE_RAW, 2336, 2336 };
+
+static unsigned char ecc_f_lut[256];
+static unsigned char ecc_b_lut[256];
+static unsigned int edc_lut[256];
+
+static void eccedc_init(void)
+{
+	unsigned int i, j, edc;
+
+	for (i = 0; i < 256; i++) {
+		j = (i << 1) ^ (i & 0x80 ? 0x11d : 0);
+		ecc_f_lut[i] = j;
+		ecc_b_lut[i ^ j] = i;
+		edc = i;
+		for (j = 0; j < 8; j++)
+			edc = (edc >> 1) ^ (edc & 1 ? 0xd8018001 : 0);
+		edc_lut[i] = edc;
+	}
+}
+
+static void edc_put(unsigned char *dst, const unsigned char *src, int size)
+{
+	unsigned int edc = 0;
+
+	while (size--)
+		edc = (edc >> 8) ^ edc_lut[(edc ^ *src++) & 0xff];
+
+	dst[0] = edc;
+	dst[1] = edc >> 8;
+	dst[2] = edc >> 16;
+	dst[3] = edc >> 24;
+}
+
+static void ecc_computeblock(const unsigned char *src, unsigned int major_count,
+	unsigned int minor_count, unsigned int major_mult, unsigned int minor_inc,
+	unsigned char *dst)
+{
+	unsigned int size = major_count * minor_count;
+	unsigned int major, minor, index;
+	unsigned char ecc_a, ecc_b, temp;
+
+	for (major = 0; major < major_count; major++) {
+		index = (major >> 1) * major_mult + (major & 1);
+		ecc_a = ecc_b = 0;
+		for (minor = 0; minor < minor_count; minor++) {
+			temp = src[index];
+			index += minor_inc;
+			if (index >= size)
+				index -= size;
+			ecc_a ^= temp;
+			ecc_b ^= temp;
+			ecc_a = ecc_f_lut[ecc_a];
+		}
+		ecc_a = ecc_b_lut[ecc_f_lut[ecc_a] ^ ecc_b];
+		dst[major] = ecc_a;
+		dst[major + major_count] = ecc_a ^ ecc_b;
+	}
+}
+
+// P and Q parity, mode 2 sectors compute it with a zero address
+static void ecc_put(unsigned char *sector, int zero_address)
+{
+	unsigned char address[4];
+
+	memcpy(address, sector + 12, 4);
+	if (zero_address)
+		memset(sector + 12, 0, 4);
+	ecc_computeblock(sector + 12, 86, 24, 2, 86, sector + 0x81c);
+	ecc_computeblock(sector + 12, 52, 43, 86, 88, sector + 0x8c8);
+	memcpy(sector + 12, address, 4);
+}
+
+static struct ecm_image *ecm_find_image(FILE *f)
+{
+	int i;
+
+	for (i = 0; i < ecm_img_count; i++)
+		if (ecm_imgs[i]->f == f)
+			return ecm_imgs[i];
+
+	return NULL;
+}
+
+// positioned read, the file position of the handle is not relied on
+static int ecm_fetch(struct ecm_image *img, void *buf, unsigned int len, off_t pos)
+{
+#ifdef CDR_READAHEAD
+	return pread(fileno(img->f), buf, len, pos) == (ssize_t)len ? 0 : -1;
+#else
+	if (fseeko(img->f, pos, SEEK_SET) != 0)
+		return -1;
+	return fread(buf, 1, len, img->f) == len ? 0 : -1;
+#endif
+}
+
+// reads record element 'i' of chunk 'c' and rebuilds it in 'sector',
+// returns where the decoded bytes start in it
+static unsigned char *ecm_decode(struct ecm_image *img, const struct ecm_chunk *c,
+	unsigned int i, unsigned char *sector)
+{
+	static const unsigned char sync[12] =
+		{ 0, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0 };
+	off_t pos = c->in_offs + (off_t)i * ecm_in_size[c->type];
+
+	switch (c->type) {
+	case 1: // mode 1
+		memcpy(sector, sync, sizeof(sync));
+		if (ecm_fetch(img, sector + 12, 3, pos) != 0
+		    || ecm_fetch(img, sector + 16, 0x800, pos + 3) != 0)
+			return NULL;
+		sector[15] = 1;
+		edc_put(sector + 0x810, sector, 0x810);
+		memset(sector + 0x814, 0, 8);
+		ecc_put(sector, 0);
+		return sector;
+	case 2: // mode 2 form 1
+		if (ecm_fetch(img, sector + 0x14, 0x804, pos) != 0)
+			return NULL;
+		memcpy(sector + 0x10, sector + 0x14, 4);
+		edc_put(sector + 0x818, sector + 0x10, 0x808);
+		ecc_put(sector, 1);
+		return sector + 0x10;
+	case 3: // mode 2 form 2
+		if (ecm_fetch(img, sector + 0x14, 0x918, pos) != 0)
+			return NULL;
+		memcpy(sector + 0x10, sector + 0x14, 4);
+		edc_put(sector + 0x92c, sector + 0x10, 0x91c);
+		return sector + 0x10;
+	}
+
+	return NULL;
+}
+
+// last chunk starting at or before out_offs
+static const struct ecm_chunk *ecm_find(const struct ecm_image *img,
+	unsigned int out_offs)
+{
+	unsigned int lo = 0, hi = img->chunk_count, mid;
+
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (img->chunks[mid].out_offs <= out_offs)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return &img->chunks[lo];
+}
+
+static int ecm_build_sector(struct ecm_image *img, unsigned char *dest, int sector)
+{
+	unsigned char tmp[CD_FRAMESIZE_RAW];
+	const struct ecm_chunk *c, *end;
+	unsigned int pos, done, i, offs, len, unit;
+	unsigned char *src;
+
+	pos = sector * CD_FRAMESIZE_RAW;
+	c = ecm_find(img, pos);
+	end = img->chunks + img->chunk_count;
+
+	for (done = 0; done < CD_FRAMESIZE_RAW && c < end; c++) {
+		unit = ecm_out_size[c->type];
+		if (pos + done >= c->out_offs + c->count * unit)
+			continue;
+		i = (pos + done - c->out_offs) / unit;
+		offs = (pos + done - c->out_offs) % unit;
+
+		for (; i < c->count && done < CD_FRAMESIZE_RAW; i++, offs = 0) {
+			if (c->type == 0) {
+				// raw bytes, take all we need in one go
+				len = c->count - i;
+				if (len > CD_FRAMESIZE_RAW - done)
+					len = CD_FRAMESIZE_RAW - done;
+				if (ecm_fetch(img, dest + done, len, (off_t)c->in_offs + i) != 0)
+					return -1;
+				done += len;
+				break;
+			}
+
+			src = ecm_decode(img, c, i, tmp);
+			if (src == NULL)
+				return -1;
+			len = unit - offs;
+			if (len > CD_FRAMESIZE_RAW - done)
+				len = CD_FRAMESIZE_RAW - done;
+			memcpy(dest + done, src + offs, len);
+			done += len;
+		}
+	}
+
+	return done == CD_FRAMESIZE_RAW ? 0 : -1;
+}
+
+static int cdread_ecm(FILE *f, unsigned int base, void *dest, int sector)
+{
+	struct ecm_image *img = ecm_find_image(f);
+	int i, victim = 0, ret = -1;
+
+	// tracks from other (non-ecm) files of a .cue
+	if (img == NULL)
+		return cdread_normal(f, base, dest, sector);
+
+	sector += base / CD_FRAMESIZE_RAW;
+	if (sector < 0 || (unsigned int)(sector + 1) * CD_FRAMESIZE_RAW > img->out_size)
+		return -1;
+
+	ecm_lock(img);
+	for (i = 0; i < ECM_CACHE_SECTORS; i++) {
+		if (img->cache[i].sector == sector)
+			goto finish;
+		if ((int)(img->cache[i].stamp - img->cache[victim].stamp) < 0)
+			victim = i;
+	}
+
+	i = victim;
+	img->cache[i].sector = -1;
+	if (ecm_build_sector(img, img->cache[i].raw, sector) != 0) {
+		SysPrintf("ecm: failed to rebuild sector %d\n", sector);
+		goto out;
+	}
+	img->cache[i].sector = sector;
+
+finish:
+	img->cache[i].stamp = ++img->stamp;
+	memcpy(dest, img->cache[i].raw, CD_FRAMESIZE_RAW);
+	ret = CD_FRAMESIZE_RAW;
+out:
+	ecm_unlock(img);
+	return ret;
+}
+
+// reads for the cdda side, which may be on an .ecm track file of a .cue
+// even when the data track is not
+static int cdread_track(FILE *f, unsigned int base, void *dest, int sector)
+{
+	if (ecm_find_image(f) != NULL)
+		return cdread_ecm(f, base, dest, sector);
+
+	return cdimg_read_func(f, base, dest, sector);
+}
+
+// walks all record headers of the .ecm
+static int ecm_scan(struct ecm_image *img)
+{
+	struct ecm_chunk *c;
+	unsigned int count, alloc = 0;
+	unsigned long long out = 0;
+	int type, bits, ch;
+	off_t pos = 4;
+
+	fseeko(img->f, pos, SEEK_SET);
+	for (;;) {
+		ch = getc(img->f);
+		if (ch == EOF)
+			return -1;
+		type = ch & 3;
+		count = (ch >> 2) & 0x1f;
+		for (bits = 5; ch & 0x80; bits += 7) {
+			ch = getc(img->f);
+			if (ch == EOF || bits > 31)
+				return -1;
+			count |= (unsigned int)(ch & 0x7f) << bits;
+		}
+		if (count == 0xffffffff)
+			break;
+		count++;
+		pos = ftello(img->f);
+
+		if (img->chunk_count == alloc) {
+			alloc = alloc ? alloc * 2 : 1024;
+			c = realloc(img->chunks, alloc * sizeof(*c));
+			if (c == NULL)
+				return -1;
+			img->chunks = c;
+		}
+		c = &img->chunks[img->chunk_count++];
+		c->out_offs = out;
+		c->in_offs = pos;
+		c->count = count;
+		c->type = type;
+
+		out += (unsigned long long)count * ecm_out_size[type];
+		pos += (off_t)count * ecm_in_size[type];
+		if (out > 0xffffffffu || pos > 0xffffffffu)
+			return -1;
+		if (fseeko(img->f, pos, SEEK_SET) != 0)
+			return -1;
+	}
+	img->out_size = out;
+
+	return img->chunk_count > 0 ? 0 : -1;
+}
+
+struct ecm_idx_header {
+	char magic[8];
+	unsigned long long ecm_size;
+	long long ecm_mtime;
+	unsigned int chunk_count;
+	unsigned int out_size;
+};
+
+// the index comes from outside, check it describes a sane record layout
+static int ecm_check_index(const struct ecm_chunk *chunks, unsigned int count,
+	unsigned int out_size, unsigned long long ecm_size)
+{
+	unsigned long long out = 0, in_end;
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		const struct ecm_chunk *c = &chunks[i];
+		if (c->type > 3 || c->count == 0 || c->out_offs != out || c->in_offs < 4)
+			return -1;
+		in_end = c->in_offs + (unsigned long long)c->count * ecm_in_size[c->type];
+		if (in_end > ecm_size)
+			return -1;
+		out += (unsigned long long)c->count * ecm_out_size[c->type];
+		if (out > 0xffffffffu)
+			return -1;
+	}
+
+	return out == out_size ? 0 : -1;
+}
+
+static int ecm_load_index(struct ecm_image *img, const char *idxname,
+	const struct ecm_idx_header *want)
+{
+	struct ecm_idx_header hdr;
+	FILE *f;
+	int ret = -1;
+
+	f = fopen(idxname, "rb");
+	if (f == NULL)
+		return -1;
+
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 || memcmp(hdr.magic, want->magic, 8) != 0
+	    || hdr.ecm_size != want->ecm_size || hdr.ecm_mtime != want->ecm_mtime
+	    || hdr.chunk_count == 0 || hdr.chunk_count > hdr.ecm_size
+	    || hdr.chunk_count > (size_t)-1 / sizeof(img->chunks[0]))
+		goto out;
+
+	img->chunks = malloc((size_t)hdr.chunk_count * sizeof(img->chunks[0]));
+	if (img->chunks == NULL)
+		goto out;
+	if (fread(img->chunks, sizeof(img->chunks[0]), hdr.chunk_count, f)
+	    != hdr.chunk_count
+	    || ecm_check_index(img->chunks, hdr.chunk_count, hdr.out_size,
+	                       hdr.ecm_size) != 0) {
+		free(img->chunks);
+		img->chunks = NULL;
+		goto out;
+	}
+	img->chunk_count = hdr.chunk_count;
+	img->out_size = hdr.out_size;
+	ret = 0;
+
+out:
+	fclose(f);
+	return ret;
+}
+
+static void ecm_save_index(const struct ecm_image *img, const char *idxname,
+	struct ecm_idx_header *hdr)
+{
+	FILE *f;
+
+	f = fopen(idxname, "wb");
+	if (f == NULL)
+		return; // read-only media probably, just rescan next time
+
+	hdr->chunk_count = img->chunk_count;
+	hdr->out_size = img->out_size;
+	if (fwrite(hdr, sizeof(*hdr), 1, f) != 1
+	    || fwrite(img->chunks, sizeof(img->chunks[0]), img->chunk_count, f)
+	       != img->chunk_count) {
+		fclose(f);
+		remove(idxname);
+		return;
+	}
+	fclose(f);
+}
+
+// sets up ecm decoding for handle 'f' if its file is an .ecm, 'size'
+// gets the decoded size
+static int ecm_attach(FILE *f, const char *fname, unsigned int *size)
+{
+	struct ecm_idx_header hdr;
+	struct ecm_image *img;
+	char idxname[MAXPATHLEN];
+	char magic[4];
+	struct stat st;
+	int i;
+
+	img = ecm_find_image(f);
+	if (img != NULL)
+		goto done;
+
+	if (ecm_img_count == sizeof(ecm_imgs) / sizeof(ecm_imgs[0]))
+		return -1;
+	fseek(f, 0, SEEK_SET);
+	if (fread(magic, 1, 4, f) != 4 || memcmp(magic, "ECM", 4) != 0)
+		return -1;
+
+	img = calloc(1, sizeof(*img));
+	if (img == NULL)
+		return -1;
+	img->f = f;
+	for (i = 0; i < ECM_CACHE_SECTORS; i++)
+		img->cache[i].sector = -1;
+
+	if (edc_lut[1] == 0)
+		eccedc_init();
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, ECM_IDX_MAGIC, sizeof(ECM_IDX_MAGIC));
+	if (fstat(fileno(f), &st) == 0) {
+		hdr.ecm_size = st.st_size;
+		hdr.ecm_mtime = st.st_mtime;
+	}
+	snprintf(idxname, sizeof(idxname), "%s.idx", fname);
+
+	if (ecm_load_index(img, idxname, &hdr) != 0) {
+		if (ecm_scan(img) != 0) {
+			SysPrintf("bad ecm file: %s\n", fname);
+			free(img->chunks);
+			free(img);
+			return -1;
+		}
+		ecm_save_index(img, idxname, &hdr);
+	}
+
+#ifdef CDR_READAHEAD
+	pthread_mutex_init(&img->lock, NULL);
+#endif
+	ecm_imgs[ecm_img_count++] = img;
+
+done:
+	if (size != NULL)
+		*size = img->out_size;
+	return 0;
+}
+
+static void ecm_free_images(void)
+{
+	int i;
+
+	for (i = 0; i < ecm_img_count; i++) {
+#ifdef CDR_READAHEAD
+		pthread_mutex_destroy(&ecm_imgs[i]->lock);
+#endif
+		free(ecm_imgs[i]->chunks);
+		free(ecm_imgs[i]);
+		ecm_imgs[i] = NULL;
+	}
+	ecm_img_count = 0;
+}
+
+#ifdef CDR_READAHEAD
+
+// sectors of a raw image are fetched by a background thread ahead of
+// the last one read, so sequential reads don't wait for the disk. When
+// the image is mapped the thread only faults the pages of those sectors
+// in and the reads are served from the mapping.
+#define RA_SECTORS 64
+
+static struct {
+	struct {
+		int sector;
+		unsigned char buf[CD_FRAMESIZE_RAW + SUB_FRAMESIZE];
+	} slot[RA_SECTORS];
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int fd, stride;
+	const unsigned char *map;
+	int want;	// first sector of the window to keep filled
+	int next;	// next sector the thread will look at
+	int end;	// image end, or first sector that failed to read
+	int quit;
+} *ra;
+
+// reads a byte of every page of the range so that the emu thread
+// doesn't take the page faults
+static void readahead_touch(size_t pos, size_t len)
+{
+	static size_t page;
+	volatile unsigned char sink;
+	size_t p;
+
+	if (page == 0)
+		page = sysconf(_SC_PAGESIZE);
+	for (p = pos & ~(page - 1); p < pos + len; p += page)
+		sink = ra->map[p];
+	(void)sink;
+}
+
+static void *readahead_thread(void *param)
+{
+	int sector, ret;
+
+	pthread_mutex_lock(&ra->lock);
+	while (!ra->quit) {
+		if (ra->next < ra->want || ra->next > ra->want + RA_SECTORS)
+			ra->next = ra->want;
+		sector = ra->next;
+		if (sector == ra->want + RA_SECTORS || sector >= ra->end || sector < 0) {
+			pthread_cond_wait(&ra->cond, &ra->lock);
+			continue;
+		}
+		if (ra->slot[sector % RA_SECTORS].sector == sector) {
+			ra->next++;
+			continue;
+		}
+
+		if (ra->map != NULL) {
+			pthread_mutex_unlock(&ra->lock);
+			readahead_touch((size_t)sector * ra->stride, ra->stride);
+			pthread_mutex_lock(&ra->lock);
+			if (ra->next == sector)
+				ra->next++;
+			continue;
+		}
+
+		// invalid while being filled, the reader only takes matching slots
+		ra->slot[sector % RA_SECTORS].sector = -1;
+		pthread_mutex_unlock(&ra->lock);
+
+		ret = pread(ra->fd, ra->slot[sector % RA_SECTORS].buf, ra->stride,
+			(off_t)sector * ra->stride);
+
+		pthread_mutex_lock(&ra->lock);
+		if (ret != ra->stride) {
+			ra->end = sector;
+			continue;
+		}
+		ra->slot[sector % RA_SECTORS].sector = sector;
+		if (ra->next == sector)
+			ra->next++;
+	}
+	pthread_mutex_unlock(&ra->lock);
+
+	return NULL;
+}
+
+// returns 1 and fills cdbuffer (and subbuffer) if the sector was ready;
+// a mapped image always returns 0, the caller reads from the mapping
+static int readahead_read(int sector)
+{
+	int hit;
+
+	if (ra == NULL)
+		return 0;
+
+	pthread_mutex_lock(&ra->lock);
+	if (ra->map != NULL) {
+		hit = sector >= ra->want && sector < ra->next;
+		ra->want = sector + 1;
+		pthread_cond_signal(&ra->cond);
+		pthread_mutex_unlock(&ra->lock);
+		if (hit)
+			cdrIsoReadaheadHits++;
+		else
+			cdrIsoReadaheadMisses++;
+		return 0;
+	}
+	hit = sector >= 0 && ra->slot[sector % RA_SECTORS].sector == sector;
+	if (hit) {
+		memcpy(cdbuffer, ra->slot[sector % RA_SECTORS].buf, CD_FRAMESIZE_RAW);
+		if (subChanMixed)
+			memcpy(subbuffer, ra->slot[sector % RA_SECTORS].buf + CD_FRAMESIZE_RAW,
+				SUB_FRAMESIZE);
+	}
+	ra->want = sector + 1;
+	pthread_cond_signal(&ra->cond);
+	pthread_mutex_unlock(&ra->lock);
+
+	if (!hit) {
+		cdrIsoReadaheadMisses++;
+		return 0;
+	}
+
+	cdrIsoReadaheadHits++;
+	if (subChanMixed && subChanRaw)
+		DecodeRawSubData();
+	return 1;
+}
+
+// 'map' is the mapping of cdHandle, or NULL to read the file
+static void readahead_start(const void *map)
+{
+	struct stat st;
+	int i;
+
+	ra = calloc(1, sizeof(*ra));
+	if (ra == NULL)
+		return;
+
+	for (i = 0; i < RA_SECTORS; i++)
+		ra->slot[i].sector = -1;
+	ra->fd = fileno(cdHandle);
+	ra->map = map;
+	ra->stride = CD_FRAMESIZE_RAW;
+	if (subChanMixed)
+		ra->stride += SUB_FRAMESIZE;
+	ra->end = 0;
+	if (fstat(ra->fd, &st) == 0)
+		ra->end = st.st_size / ra->stride;
+	cdrIsoReadaheadHits = cdrIsoReadaheadMisses = 0;
+
+	pthread_mutex_init(&ra->lock, NULL);
+	pthread_cond_init(&ra->cond, NULL);
+	if (pthread_create(&ra->thread, NULL, readahead_thread, NULL) != 0) {
+		SysPrintf("cdriso: failed to start readahead\n");
+		pthread_cond_destroy(&ra->cond);
+		pthread_mutex_destroy(&ra->lock);
+		free(ra);
+		ra = NULL;
+	}
+}
+
+static void readahead_stop(void)
+{
+	if (ra == NULL)
+		return;
+
+	pthread_mutex_lock(&ra->lock);
+	ra->quit = 1;
+	pthread_cond_signal(&ra->cond);
+	pthread_mutex_unlock(&ra->lock);
+	pthread_join(ra->thread, NULL);
+
+	pthread_cond_destroy(&ra->cond);
+	pthread_mutex_destroy(&ra->lock);
+	free(ra);
+	ra = NULL;
+
+	SysPrintf("cdriso readahead: %u hits, %u misses\n",
+		cdrIsoReadaheadHits, cdrIsoReadaheadMisses);
+}
+
+#else
+#define readahead_read(sector) 0
+#define readahead_start(map)
+#define readahead_stop()
+#endif
+
+#ifdef CDR_MMAP
+
+// uncompressed image files are mapped whole, data sectors are then
+// served straight from the mapping without a copy. The mapping is
+// private and writable because PPF patching is done in place.
+static struct img_map {
+	FILE *f;
+	unsigned char *base;
+	size_t size;
+	int last_sector;
+} img_maps[MAXTRACKS + 2];
+static int img_map_count;
+static unsigned char *mmap_sector = cdbuffer;
+
+#define MMAP_WILLNEED_SECTORS 64
+
+static struct img_map *find_map(FILE *f)
+{
+	int i;
+
+	for (i = 0; i < img_map_count; i++)
+		if (img_maps[i].f == f)
+			return &img_maps[i];
+
+	return NULL;
+}
+
+static int map_file(FILE *f, int advice)
+{
+	struct img_map *m;
+	struct stat st;
+	void *base;
+
+	if (f == NULL || find_map(f) != NULL)
+		return 0;
+	if (img_map_count >= sizeof(img_maps) / sizeof(img_maps[0]))
+		return -1;
+	if (fstat(fileno(f), &st) != 0 || st.st_size == 0
+	    || (size_t)st.st_size != st.st_size)
+		return -1;
+
+	base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		fileno(f), 0);
+	if (base == MAP_FAILED)
+		return -1;
+	madvise(base, st.st_size, advice);
+
+	m = &img_maps[img_map_count++];
+	m->f = f;
+	m->base = base;
+	m->size = st.st_size;
+	m->last_sector = -2;
+	return 0;
+}
+
+static void unmap_files(void)
+{
+	int i;
+
+	for (i = 0; i < img_map_count; i++)
+		munmap(img_maps[i].base, img_maps[i].size);
+	img_map_count = 0;
+	mmap_sector = cdbuffer;
+}
+
+static int cdread_mmap(FILE *f, unsigned int base, void *dest, int sector)
+{
+	int stride = subChanMixed ? CD_FRAMESIZE_RAW + SUB_FRAMESIZE : CD_FRAMESIZE_RAW;
+	struct img_map *m = find_map(f);
+	size_t pos;
+
+	if (m == NULL || sector < 0
+	    || (pos = base + (size_t)sector * stride) + stride > m->size) {
+		if (dest == cdbuffer)
+			mmap_sector = cdbuffer;
+		return subChanMixed ? cdread_sub_mixed(f, base, dest, sector)
+			: cdread_normal(f, base, dest, sector);
+	}
+
+	// a seek, ask for the pages ahead of the new position
+	if (sector != m->last_sector + 1) {
+		size_t page = sysconf(_SC_PAGESIZE);
+		size_t start = pos & ~(page - 1);
+		size_t len = (size_t)MMAP_WILLNEED_SECTORS * stride;
+		if (start + len > m->size)
+			len = m->size - start;
+		madvise(m->base + start, len, MADV_WILLNEED);
+	}
+	m->last_sector = sector;
+
+	if (subChanMixed) {
+		memcpy(subbuffer, m->base + pos + CD_FRAMESIZE_RAW, SUB_FRAMESIZE);
+		if (subChanRaw) DecodeRawSubData();
+	}
+
+	if (dest == cdbuffer) // copy avoid HACK
+		mmap_sector = m->base + pos;
+	else
+		memcpy(dest, m->base + pos, CD_FRAMESIZE_RAW);
+
+	return CD_FRAMESIZE_RAW;
+}
+
+// returns 0 if the main image got mapped; track and subchannel files
+// that fail to map just keep using stdio
+static int mmap_image(void)
+{
+	int i;
+
+	if (map_file(cdHandle, MADV_SEQUENTIAL) != 0)
+		return -1;
+
+	map_file(subHandle, MADV_SEQUENTIAL);
+	for (i = 1; i <= numtracks; i++)
+		if (ecm_find_image(ti[i].handle) == NULL)
+			map_file(ti[i].handle, MADV_NORMAL);
+
+	return 0;
+}
+
+static unsigned char * CALLBACK ISOgetBuffer_mmap(void) {
+	return mmap_sector + 12;
+}
+
+#else
+#define unmap_files()
+#endif
+
+// reads up to count sectors of the playing track for the cdda thread;
+// plain images take a single read (or copy from the mapping) per batch
+// and don't share a file position with the data reads. Returns bytes.
+static int cdda_read_batch(unsigned char *buf, int count)
+{
+	int sector_offs = cdda_cur_sector - cdda_first_sector;
+	int i, ret, s = 0;
+
+	// pregap before the track start plays silent
+	if (sector_offs < 0) {
+		if (count > -sector_offs)
+			count = -sector_offs;
+		memset(buf, 0, count * CD_FRAMESIZE_RAW);
+		return count * CD_FRAMESIZE_RAW;
+	}
+
+#ifdef CDR_MMAP
+	if (!subChanMixed && ecm_find_image(cddaHandle) == NULL
+	    && (cdimg_read_func == cdread_normal || cdimg_read_func == cdread_mmap)) {
+		size_t pos = cdda_file_offset + (size_t)sector_offs * CD_FRAMESIZE_RAW;
+		struct img_map *m = find_map(cddaHandle);
+		if (m != NULL) {
+			if (pos >= m->size)
+				return 0;
+			s = count * CD_FRAMESIZE_RAW;
+			if (pos + s > m->size)
+				s = (m->size - pos) / CD_FRAMESIZE_RAW * CD_FRAMESIZE_RAW;
+			memcpy(buf, m->base + pos, s);
+			return s;
+		}
+		ret = pread(fileno(cddaHandle), buf, count * CD_FRAMESIZE_RAW, pos);
+		return ret > 0 ? ret / CD_FRAMESIZE_RAW * CD_FRAMESIZE_RAW : 0;
+	}
+#endif
+
+	for (i = 0; i < count; i++) {
+		// not the emu thread, so not its inflate state either
+		if (cdimg_read_func == cdread_compressed)
+			ret = compr_read(&compr_img->cdda, cdda_file_offset, buf + s,
+				sector_offs + i);
+		else
+			ret = cdread_track(cddaHandle, cdda_file_offset, buf + s,
+				sector_offs + i);
+		if (ret < CD_FRAMESIZE_RAW)
+			break;
+		s += CD_FRAMESIZE_RAW;
+	}
+
+	return s;
+}
+
 static unsigned char * CALLBACK ISOgetBuffer_compr(void) {
-	return compr_img->buff_raw[compr_img->sector_in_blk] + 12;
+	if (compr_img->current == NULL)
+		return cdbuffer + 12;
+	return compr_img->current->raw[compr_img->sector_in_blk] + 12;
 }
 
 static unsigned char * CALLBACK ISOgetBuffer(void) {
@@ -1270,11 +2325,17 @@ static long CALLBACK ISOopen(void) {
 		SysPrintf("[pbp]");
 		CDR_getBuffer = ISOgetBuffer_compr;
 		cdimg_read_func = cdread_compressed;
+		compr_start();
 	}
 	else if (handlecbin(GetIsoFile()) == 0) {
 		SysPrintf("[cbin]");
 		CDR_getBuffer = ISOgetBuffer_compr;
 		cdimg_read_func = cdread_compressed;
+		compr_start();
+	}
+	else if (ecm_attach(cdHandle, GetIsoFile(), NULL) == 0) {
+		SysPrintf("[ecm]");
+		cdimg_read_func = cdread_ecm;
 	}
 
 	if (!subChanMixed && opensubfile(GetIsoFile()) == 0) {
@@ -1288,7 +2349,7 @@ static long CALLBACK ISOopen(void) {
 
 	// maybe user selected metadata file instead of main .bin ..
 	bin_filename = GetIsoFile();
-	if (ftello(cdHandle) < 2352 * 0x10) {
+	if (ftello(cdHandle) < 2352 * 0x10 && cdimg_read_func != cdread_ecm) {
 		static const char *exts[] = { ".bin", ".BIN", ".img", ".IMG" };
 		FILE *tmpf = NULL;
 		size_t i;
@@ -1314,7 +2375,7 @@ static long CALLBACK ISOopen(void) {
 	}
 
 	// guess whether it is mode1/2048
-	if (ftello(cdHandle) % 2048 == 0) {
+	if (cdimg_read_func == cdread_normal && ftello(cdHandle) % 2048 == 0) {
 		unsigned int modeTest = 0;
 		fseek(cdHandle, 0, SEEK_SET);
 		fread(&modeTest, 4, 1, cdHandle);
@@ -1337,16 +2398,36 @@ static long CALLBACK ISOopen(void) {
 	// make sure we have another handle open for cdda
 	if (numtracks > 1 && ti[1].handle == NULL) {
 		ti[1].handle = fopen(bin_filename, "rb");
+		if (ti[1].handle != NULL && cdimg_read_func == cdread_ecm)
+			ecm_attach(ti[1].handle, bin_filename, NULL);
 	}
 	cdda_cur_sector = 0;
 	cdda_file_offset = 0;
 
+	if (cdimg_read_func == cdread_normal || cdimg_read_func == cdread_sub_mixed) {
+#ifdef CDR_MMAP
+		if (mmap_image() == 0) {
+			SysPrintf("cdriso: using mmap\n");
+			CDR_getBuffer = ISOgetBuffer_mmap;
+			cdimg_read_func = cdread_mmap;
+			readahead_start(find_map(cdHandle)->base);
+		}
+		else
+#endif
+			readahead_start(NULL);
+	}
+
 	return 0;
 }
 
 static long CALLBACK ISOclose(void) {
 	int i;
 
+	readahead_stop();
+	stopCDDA();
+	if (compr_img != NULL)
+		compr_stop();
+
 	if (cdHandle != NULL) {
 		fclose(cdHandle);
 		cdHandle = NULL;
@@ -1355,8 +2436,10 @@ static long CALLBACK ISOclose(void) {
 		fclose(subHandle);
 		subHandle = NULL;
 	}
-	stopCDDA();
 	cddaHandle = NULL;
+	unmap_files();
+
+	ecm_free_images();
 
 	if (compr_img != NULL) {
 		free(compr_img->index_table);
@@ -1474,13 +2557,24 @@ static long CALLBACK ISOreadTrack(unsigned char *time) {
 		}
 	}
 
-	ret = cdimg_read_func(cdHandle, 0, cdbuffer, sector);
+	if (readahead_read(sector))
+		ret = CD_FRAMESIZE_RAW;
+	else
+		ret = cdimg_read_func(cdHandle, 0, cdbuffer, sector);
 	if (ret < 0)
 		return -1;
 
 	if (subHandle != NULL) {
-		fseek(subHandle, sector * SUB_FRAMESIZE, SEEK_SET);
-		fread(subbuffer, 1, SUB_FRAMESIZE, subHandle);
+#ifdef CDR_MMAP
+		struct img_map *m = find_map(subHandle);
+		if (m != NULL && sector >= 0 && (size_t)(sector + 1) * SUB_FRAMESIZE <= m->size)
+			memcpy(subbuffer, m->base + sector * SUB_FRAMESIZE, SUB_FRAMESIZE);
+		else
+#endif
+		{
+			fseek(subHandle, sector * SUB_FRAMESIZE, SEEK_SET);
+			fread(subbuffer, 1, SUB_FRAMESIZE, subHandle);
+		}
 
 		if (subChanRaw) DecodeRawSubData();
 	}
@@ -1586,7 +2680,7 @@ long CALLBACK ISOreadCDDA(unsigned char m, unsigned char s, unsigned char f, uns
 				break;
 	}
 
-	ret = cdimg_read_func(ti[file].handle, ti[track].start_offset,
+	ret = cdread_track(ti[file].handle, ti[track].start_offset,
 		buffer, cddaCurPos - track_start);
 	if (ret != CD_FRAMESIZE_RAW) {
 		memset(buffer, 0, CD_FRAMESIZE_RAW);
@@ -30,6 +30,8 @@ int cdrIsoActive(void);
 
 extern unsigned int cdrIsoMultidiskCount;
 extern unsigned int cdrIsoMultidiskSelect;
+extern unsigned int cdrIsoReadaheadHits;
+extern unsigned int cdrIsoReadaheadMisses;
 
 #ifdef __cplusplus
 }
@@ -152,6 +152,41 @@ enum seeked_state {
 
 static struct CdrStat stat;
 
+// Titles that time their loading or streaming against the drive and
+// break with Config.CdrSpeed, by CdromId.
+static const char * const cdr_speed_exempt_ids[] = {
+	"SCUS94227", "SCES00311",	// MediEvil - cutscene speech
+	"SLPM86666", "SLUS01334",	// Rockman X5 / Mega Man X5 - capcom logo
+	NULL
+};
+
+// read/seek time divisor, 1 = real drive timing
+static int cdr_speed_div = 1;
+
+static void cdrUpdateSpeed(void) {
+	int i;
+
+	cdr_speed_div = Config.CdrSpeed > 1 ? Config.CdrSpeed : 1;
+	if (cdr_speed_div > 16)
+		cdr_speed_div = 16;
+	for (i = 0; cdr_speed_exempt_ids[i] != NULL; i++) {
+		if (strcmp(CdromId, cdr_speed_exempt_ids[i]) == 0) {
+			cdr_speed_div = 1;
+			break;
+		}
+	}
+}
+
+// time until the next sector; XA streaming stays at the real rate so
+// the SPU is fed exactly as fast as it plays
+static int cdrReadDelay(void) {
+	int delay = (cdr.Mode & MODE_SPEED) ? (cdReadTime / 2) : cdReadTime;
+
+	if (cdr.Mode & MODE_STRSND)
+		return delay;
+	return delay / cdr_speed_div;
+}
+
 static unsigned int msf2sec(const u8 *msf) {
 	return ((msf[0] * 60 + msf[1]) * 75) + msf[2];
 }
@@ -831,7 +866,7 @@ void cdrInterrupt() {
 			Rockman X5 = 0.5-4x
 			- fix capcom logo
 			*/
-			CDRMISC_INT(cdr.Seeked == SEEK_DONE ? 0x800 : cdReadTime * 4);
+			CDRMISC_INT(cdr.Seeked == SEEK_DONE ? 0x800 : cdReadTime * 4 / cdr_speed_div);
 			cdr.Seeked = SEEK_PENDING;
 			start_rotating = 1;
 			break;
@@ -948,12 +983,12 @@ void cdrInterrupt() {
 				// - fix cutscene speech (startup)
 
 				// ??? - use more accurate seek time later
-				CDREAD_INT((cdr.Mode & 0x80) ? (cdReadTime / 2) : cdReadTime * 1);
+				CDREAD_INT(cdrReadDelay());
 			} else {
 				cdr.StatP |= STATUS_READ;
 				cdr.StatP &= ~STATUS_SEEK;
 
-				CDREAD_INT((cdr.Mode & 0x80) ? (cdReadTime / 2) : cdReadTime * 1);
+				CDREAD_INT(cdrReadDelay());
 			}
 
 			cdr.Result[0] = cdr.StatP;
@@ -1085,7 +1120,7 @@ void cdrReadInterrupt() {
 		memset(cdr.Transfer, 0, DATA_SIZE);
 		cdr.Stat = DiskError;
 		cdr.Result[0] |= STATUS_ERROR;
-		CDREAD_INT((cdr.Mode & 0x80) ? (cdReadTime / 2) : cdReadTime);
+		CDREAD_INT(cdrReadDelay());
 		return;
 	}
 
@@ -1127,7 +1162,7 @@ void cdrReadInterrupt() {
 
 	cdr.Readed = 0;
 
-	CDREAD_INT((cdr.Mode & MODE_SPEED) ? (cdReadTime / 2) : cdReadTime);
+	CDREAD_INT(cdrReadDelay());
 
 	/*
 	Croc 2: $40 - only FORM1 (*)
@@ -1473,6 +1508,7 @@ void cdrReset() {
 	cdr.AttenuatorRightToRight = 0x80;
 
 	getCdInfo();
+	cdrUpdateSpeed();
 }
 
 int cdrFreeze(void *f, int Mode) {
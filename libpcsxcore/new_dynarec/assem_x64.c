@@ -0,0 +1,2828 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *   Mupen64plus/PCSX - assem_x64.c                                        *
+ *   Copyright (C) 2009-2011 Ari64                                         *
+ *   Copyright (C) 2010-2011 Gražvydas "notaz" Ignotas                     *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.          *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "../gte.h"
+#define FLAGLESS
+#include "../gte.h"
+#undef FLAGLESS
+#include "pcnt.h"
+
+char *translation_cache;
+
+// rax, rcx, rdx, rsi, rdi, r8-r11
+#define CALLER_SAVE_REGS 0x0fc7
+
+#define unused __attribute__((unused))
+
+extern int cycle_count;
+extern int last_count;
+extern int pcaddr;
+extern int pending_exception;
+extern int branch_target;
+extern void *dynarec_local;
+extern u_int mini_ht[32][2];
+
+void do_interrupt();
+void jump_vaddr_eax();
+void jump_vaddr_ecx();
+void jump_vaddr_edx();
+void jump_vaddr_ebx();
+void jump_vaddr_ebp();
+void jump_vaddr_esi();
+void jump_vaddr_edi();
+void jump_vaddr_r8();
+void jump_vaddr_r9();
+void jump_vaddr_r10();
+void jump_vaddr_r11();
+void jump_vaddr_r12();
+
+// filled by arch_init(), function addresses don't fit a static u_int
+static u_int jump_vaddr_reg[16];
+
+/* Linker */
+
+// The host addresses generic code passes around are 32 bits wide.
+// Anything in the translation cache is zero-extended, everything else
+// is in this module, close to dynarec_local.
+static void *host_ptr(u_int a)
+{
+  if(a-(u_int)BASE_ADDR<(1u<<TARGET_SIZE_2))
+    return (void *)(uintptr_t)a;
+  return (char *)&dynarec_local+(int)(a-(u_int)(uintptr_t)&dynarec_local);
+}
+
+// offset of a module variable from FP
+static int fp_offset(int addr)
+{
+  return (char *)host_ptr(addr)-(char *)&dynarec_local;
+}
+
+static void set_jump_target(int addr,u_int target)
+{
+  u_char *ptr=(u_char *)(uintptr_t)(u_int)addr;
+  if(ptr[0]==0x0f) {
+    assert((ptr[1]&0xf0)==0x80); // jcc rel32
+    *(u_int *)(ptr+2)=target-(u_int)addr-6;
+  }
+  else {
+    assert(ptr[0]==0xe9||ptr[0]==0xe8); // jmp/call rel32
+    *(u_int *)(ptr+1)=target-(u_int)addr-5;
+  }
+}
+
+// the branch target, for the stub or other insn at addr
+static u_int get_jump_target(u_char *ptr)
+{
+  if(ptr[0]==0x0f) {
+    assert((ptr[1]&0xf0)==0x80);
+    return (u_int)(uintptr_t)ptr+6+*(int *)(ptr+2);
+  }
+  assert(ptr[0]==0xe9||ptr[0]==0xe8);
+  return (u_int)(uintptr_t)ptr+5+*(int *)(ptr+1);
+}
+
+// from a pointer to external jump stub (which was produced by emit_extjump2)
+// find where the jumping insn is
+static void *find_extjump_insn(void *stub)
+{
+  u_char *ptr=stub;
+  assert(ptr[0]==0xbf&&ptr[5]==0xbe); // mov edi,target; mov esi,insn
+  return (void *)(uintptr_t)*(u_int *)(ptr+6);
+}
+
+// find where external branch is liked to using addr of it's stub:
+// get address that insn one after stub loads (dyna_linker arg2),
+// treat it as a pointer to branch insn,
+// return addr where that branch jumps to
+static int get_pointer(void *stub)
+{
+  //printf("get_pointer(%x)\n",(int)stub);
+  return get_jump_target(find_extjump_insn(stub));
+}
+
+/* The dirty stub, as emitted by do_dirty_stub:
+   bf imm32           mov edi,vaddr
+   48 be imm64        mov rsi,source
+   48 ba imm64        mov rdx,copy
+   b9 imm32           mov ecx,len
+   49 bd imm64        mov r13,verify_code
+   41 ff d5           call r13 */
+#define DIRTY_STUB_SIZE 43
+
+static int is_dirty_stub(u_char *ptr)
+{
+  return ptr[0]==0xbf&&ptr[5]==0x48&&ptr[6]==0xbe&&ptr[15]==0x48&&ptr[16]==0xba
+    &&ptr[25]==0xb9&&ptr[30]==0x49&&ptr[31]==0xbd&&ptr[40]==0x41&&ptr[41]==0xff&&ptr[42]==0xd5;
+}
+
+// Find the "clean" entry point from a "dirty" entry point
+// by skipping past the call to verify_code
+static u_int get_clean_addr(int addr)
+{
+  u_char *ptr=(u_char *)(uintptr_t)(u_int)addr;
+  assert(is_dirty_stub(ptr));
+  ptr+=DIRTY_STUB_SIZE;
+  if(*ptr==0xe9) {
+    return get_jump_target(ptr); // follow jump
+  }
+  return (u_int)(uintptr_t)ptr;
+}
+
+static int verify_dirty(u_int *ptr)
+{
+  u_char *p=(u_char *)ptr;
+  assert(is_dirty_stub(p));
+  void *source=*(void **)(p+7);
+  void *copy=*(void **)(p+17);
+  u_int len=*(u_int *)(p+26);
+  //printf("verify_dirty: %p %p %x\n",source,copy,len);
+  return !memcmp(source,copy,len);
+}
+
+// This doesn't necessarily find all clean entry points, just
+// guarantees that it's not dirty
+static int isclean(int addr)
+{
+  u_char *ptr=(u_char *)(uintptr_t)(u_int)addr;
+  if(!is_dirty_stub(ptr)) return 1;
+  if(*(void **)(ptr+32)==(void *)verify_code) return 0;
+  if(*(void **)(ptr+32)==(void *)verify_code_ds) return 0;
+  return 1;
+}
+
+// get source that block at addr was compiled from (host pointers)
+static void get_bounds(int addr,u_int *start,u_int *end)
+{
+  u_char *ptr=(u_char *)(uintptr_t)(u_int)addr;
+  assert(is_dirty_stub(ptr));
+  u_int source=(u_int)*(uintptr_t *)(ptr+7);
+  u_int len=*(u_int *)(ptr+26);
+  *start=source;
+  *end=source+len;
+}
+
+/* Register allocation */
+
+// Note: registers are allocated clean (unmodified state)
+// if you intend to modify the register, you must call dirty_reg().
+static void alloc_reg(struct regstat *cur,int i,signed char reg)
+{
+  int r,hr;
+  int preferred_reg = (reg&7);
+  if(preferred_reg==EXCLUDE_REG||preferred_reg==HOST_CCREG) preferred_reg+=4; // r8/r9
+  if(reg==CCREG) preferred_reg=HOST_CCREG;
+  if(reg==PTEMP||reg==FTEMP) preferred_reg=12;
+
+  // Don't allocate unused registers
+  if((cur->u>>reg)&1) return;
+
+  // see if it's already allocated
+  for(hr=0;hr<HOST_REGS;hr++)
+  {
+    if(cur->regmap[hr]==reg) return;
+  }
+
+  // Keep the same mapping if the register was already allocated in a loop
+  preferred_reg = loop_reg(i,reg,preferred_reg);
+
+  // Try to allocate the preferred register
+  if(cur->regmap[preferred_reg]==-1) {
+    cur->regmap[preferred_reg]=reg;
+    cur->dirty&=~(1<<preferred_reg);
+    cur->isconst&=~(1<<preferred_reg);
+    return;
+  }
+  r=cur->regmap[preferred_reg];
+  if(r<64&&((cur->u>>r)&1)) {
+    cur->regmap[preferred_reg]=reg;
+    cur->dirty&=~(1<<preferred_reg);
+    cur->isconst&=~(1<<preferred_reg);
+    return;
+  }
+  if(r>=64&&((cur->uu>>(r&63))&1)) {
+    cur->regmap[preferred_reg]=reg;
+    cur->dirty&=~(1<<preferred_reg);
+    cur->isconst&=~(1<<preferred_reg);
+    return;
+  }
+
+  // Clear any unneeded registers
+  // We try to keep the mapping consistent, if possible, because it
+  // makes branches easier (especially loops).  So we try to allocate
+  // first (see above) before removing old mappings.  If this is not
+  // possible then go ahead and clear out the registers that are no
+  // longer needed.
+  for(hr=0;hr<HOST_REGS;hr++)
+  {
+    r=cur->regmap[hr];
+    if(r>=0) {
+      if(r<64) {
+        if((cur->u>>r)&1) {cur->regmap[hr]=-1;break;}
+      }
+      else
+      {
+        if((cur->uu>>(r&63))&1) {cur->regmap[hr]=-1;break;}
+      }
+    }
+  }
+  // Try to allocate any available register, but prefer
+  // registers that have not been used recently.
+  if(i>0) {
+    for(hr=0;hr<HOST_REGS;hr++) {
+      if(hr!=EXCLUDE_REG&&cur->regmap[hr]==-1) {
+        if(regs[i-1].regmap[hr]!=rs1[i-1]&&regs[i-1].regmap[hr]!=rs2[i-1]&&regs[i-1].regmap[hr]!=rt1[i-1]&&regs[i-1].regmap[hr]!=rt2[i-1]) {
+          cur->regmap[hr]=reg;
+          cur->dirty&=~(1<<hr);
+          cur->isconst&=~(1<<hr);
+          return;
+        }
+      }
+    }
+  }
+  // Try to allocate any available register
+  for(hr=0;hr<HOST_REGS;hr++) {
+    if(hr!=EXCLUDE_REG&&cur->regmap[hr]==-1) {
+      cur->regmap[hr]=reg;
+      cur->dirty&=~(1<<hr);
+      cur->isconst&=~(1<<hr);
+      return;
+    }
+  }
+
+  // Ok, now we have to evict someone
+  // Pick a register we hopefully won't need soon
+  u_char hsn[MAXREG+1];
+  memset(hsn,10,sizeof(hsn));
+  int j;
+  lsn(hsn,i,&preferred_reg);
+  //printf("eax=%d ecx=%d edx=%d ebx=%d ebp=%d esi=%d edi=%d\n",cur->regmap[0],cur->regmap[1],cur->regmap[2],cur->regmap[3],cur->regmap[5],cur->regmap[6],cur->regmap[7]);
+  //printf("hsn(%x): %d %d %d %d %d %d %d\n",start+i*4,hsn[cur->regmap[0]&63],hsn[cur->regmap[1]&63],hsn[cur->regmap[2]&63],hsn[cur->regmap[3]&63],hsn[cur->regmap[5]&63],hsn[cur->regmap[6]&63],hsn[cur->regmap[7]&63]);
+  if(i>0) {
+    // Don't evict the cycle count at entry points, otherwise the entry
+    // stub will have to write it.
+    if(bt[i]&&hsn[CCREG]>2) hsn[CCREG]=2;
+    if(i>1&&hsn[CCREG]>2&&(itype[i-2]==RJUMP||itype[i-2]==UJUMP||itype[i-2]==CJUMP||itype[i-2]==SJUMP||itype[i-2]==FJUMP)) hsn[CCREG]=2;
+    for(j=10;j>=3;j--)
+    {
+      // Alloc preferred register if available
+      if(hsn[r=cur->regmap[preferred_reg]&63]==j) {
+        for(hr=0;hr<HOST_REGS;hr++) {
+          // Evict both parts of a 64-bit register
+          if((cur->regmap[hr]&63)==r) {
+            cur->regmap[hr]=-1;
+            cur->dirty&=~(1<<hr);
+            cur->isconst&=~(1<<hr);
+          }
+        }
+        cur->regmap[preferred_reg]=reg;
+        return;
+      }
+      for(r=1;r<=MAXREG;r++)
+      {
+        if(hsn[r]==j&&r!=rs1[i-1]&&r!=rs2[i-1]&&r!=rt1[i-1]&&r!=rt2[i-1]) {
+          for(hr=0;hr<HOST_REGS;hr++) {
+            if(hr!=HOST_CCREG||j<hsn[CCREG]) {
+              if(cur->regmap[hr]==r+64) {
+                cur->regmap[hr]=reg;
+                cur->dirty&=~(1<<hr);
+                cur->isconst&=~(1<<hr);
+                return;
+              }
+            }
+          }
+          for(hr=0;hr<HOST_REGS;hr++) {
+            if(hr!=HOST_CCREG||j<hsn[CCREG]) {
+              if(cur->regmap[hr]==r) {
+                cur->regmap[hr]=reg;
+                cur->dirty&=~(1<<hr);
+                cur->isconst&=~(1<<hr);
+                return;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  for(j=10;j>=0;j--)
+  {
+    for(r=1;r<=MAXREG;r++)
+    {
+      if(hsn[r]==j) {
+        for(hr=0;hr<HOST_REGS;hr++) {
+          if(cur->regmap[hr]==r+64) {
+            cur->regmap[hr]=reg;
+            cur->dirty&=~(1<<hr);
+            cur->isconst&=~(1<<hr);
+            return;
+          }
+        }
+        for(hr=0;hr<HOST_REGS;hr++) {
+          if(cur->regmap[hr]==r) {
+            cur->regmap[hr]=reg;
+            cur->dirty&=~(1<<hr);
+            cur->isconst&=~(1<<hr);
+            return;
+          }
+        }
+      }
+    }
+  }
+  SysPrintf("This shouldn't happen (alloc_reg)");exit(1);
+}
+
+static void alloc_reg64(struct regstat *cur,int i,signed char reg)
+{
+  int preferred_reg = 8+(reg&1);
+  int r,hr;
+
+  // allocate the lower 32 bits
+  alloc_reg(cur,i,reg);
+
+  // Don't allocate unused registers
+  if((cur->uu>>reg)&1) return;
+
+  // see if the upper half is already allocated
+  for(hr=0;hr<HOST_REGS;hr++)
+  {
+    if(cur->regmap[hr]==reg+64) return;
+  }
+
+  // Keep the same mapping if the register was already allocated in a loop
+  preferred_reg = loop_reg(i,reg,preferred_reg);
+
+  // Try to allocate the preferred register
+  if(cur->regmap[preferred_reg]==-1) {
+    cur->regmap[preferred_reg]=reg|64;
+    cur->dirty&=~(1<<preferred_reg);
+    cur->isconst&=~(1<<preferred_reg);
+    return;
+  }
+  r=cur->regmap[preferred_reg];
+  if(r<64&&((cur->u>>r)&1)) {
+    cur->regmap[preferred_reg]=reg|64;
+    cur->dirty&=~(1<<preferred_reg);
+    cur->isconst&=~(1<<preferred_reg);
+    return;
+  }
+  if(r>=64&&((cur->uu>>(r&63))&1)) {
+    cur->regmap[preferred_reg]=reg|64;
+    cur->dirty&=~(1<<preferred_reg);
+    cur->isconst&=~(1<<preferred_reg);
+    return;
+  }
+
+  // Clear any unneeded registers
+  // We try to keep the mapping consistent, if possible, because it
+  // makes branches easier (especially loops).  So we try to allocate
+  // first (see above) before removing old mappings.  If this is not
+  // possible then go ahead and clear out the registers that are no
+  // longer needed.
+  for(hr=HOST_REGS-1;hr>=0;hr--)
+  {
+    r=cur->regmap[hr];
+    if(r>=0) {
+      if(r<64) {
+        if((cur->u>>r)&1) {cur->regmap[hr]=-1;break;}
+      }
+      else
+      {
+        if((cur->uu>>(r&63))&1) {cur->regmap[hr]=-1;break;}
+      }
+    }
+  }
+  // Try to allocate any available register, but prefer
+  // registers that have not been used recently.
+  if(i>0) {
+    for(hr=0;hr<HOST_REGS;hr++) {
+      if(hr!=EXCLUDE_REG&&cur->regmap[hr]==-1) {
+        if(regs[i-1].regmap[hr]!=rs1[i-1]&&regs[i-1].regmap[hr]!=rs2[i-1]&&regs[i-1].regmap[hr]!=rt1[i-1]&&regs[i-1].regmap[hr]!=rt2[i-1]) {
+          cur->regmap[hr]=reg|64;
+          cur->dirty&=~(1<<hr);
+          cur->isconst&=~(1<<hr);
+          return;
+        }
+      }
+    }
+  }
+  // Try to allocate any available register
+  for(hr=0;hr<HOST_REGS;hr++) {
+    if(hr!=EXCLUDE_REG&&cur->regmap[hr]==-1) {
+      cur->regmap[hr]=reg|64;
+      cur->dirty&=~(1<<hr);
+      cur->isconst&=~(1<<hr);
+      return;
+    }
+  }
+
+  // Ok, now we have to evict someone
+  // Pick a register we hopefully won't need soon
+  u_char hsn[MAXREG+1];
+  memset(hsn,10,sizeof(hsn));
+  int j;
+  lsn(hsn,i,&preferred_reg);
+  //printf("eax=%d ecx=%d edx=%d ebx=%d ebp=%d esi=%d edi=%d\n",cur->regmap[0],cur->regmap[1],cur->regmap[2],cur->regmap[3],cur->regmap[5],cur->regmap[6],cur->regmap[7]);
+  //printf("hsn(%x): %d %d %d %d %d %d %d\n",start+i*4,hsn[cur->regmap[0]&63],hsn[cur->regmap[1]&63],hsn[cur->regmap[2]&63],hsn[cur->regmap[3]&63],hsn[cur->regmap[5]&63],hsn[cur->regmap[6]&63],hsn[cur->regmap[7]&63]);
+  if(i>0) {
+    // Don't evict the cycle count at entry points, otherwise the entry
+    // stub will have to write it.
+    if(bt[i]&&hsn[CCREG]>2) hsn[CCREG]=2;
+    if(i>1&&hsn[CCREG]>2&&(itype[i-2]==RJUMP||itype[i-2]==UJUMP||itype[i-2]==CJUMP||itype[i-2]==SJUMP||itype[i-2]==FJUMP)) hsn[CCREG]=2;
+    for(j=10;j>=3;j--)
+    {
+      // Alloc preferred register if available
+      if(hsn[r=cur->regmap[preferred_reg]&63]==j) {
+        for(hr=0;hr<HOST_REGS;hr++) {
+          // Evict both parts of a 64-bit register
+          if((cur->regmap[hr]&63)==r) {
+            cur->regmap[hr]=-1;
+            cur->dirty&=~(1<<hr);
+            cur->isconst&=~(1<<hr);
+          }
+        }
+        cur->regmap[preferred_reg]=reg|64;
+        return;
+      }
+      for(r=1;r<=MAXREG;r++)
+      {
+        if(hsn[r]==j&&r!=rs1[i-1]&&r!=rs2[i-1]&&r!=rt1[i-1]&&r!=rt2[i-1]) {
+          for(hr=0;hr<HOST_REGS;hr++) {
+            if(hr!=HOST_CCREG||j<hsn[CCREG]) {
+              if(cur->regmap[hr]==r+64) {
+                cur->regmap[hr]=reg|64;
+                cur->dirty&=~(1<<hr);
+                cur->isconst&=~(1<<hr);
+                return;
+              }
+            }
+          }
+          for(hr=0;hr<HOST_REGS;hr++) {
+            if(hr!=HOST_CCREG||j<hsn[CCREG]) {
+              if(cur->regmap[hr]==r) {
+                cur->regmap[hr]=reg|64;
+                cur->dirty&=~(1<<hr);
+                cur->isconst&=~(1<<hr);
+                return;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  for(j=10;j>=0;j--)
+  {
+    for(r=1;r<=MAXREG;r++)
+    {
+      if(hsn[r]==j) {
+        for(hr=0;hr<HOST_REGS;hr++) {
+          if(cur->regmap[hr]==r+64) {
+            cur->regmap[hr]=reg|64;
+            cur->dirty&=~(1<<hr);
+            cur->isconst&=~(1<<hr);
+            return;
+          }
+        }
+        for(hr=0;hr<HOST_REGS;hr++) {
+          if(cur->regmap[hr]==r) {
+            cur->regmap[hr]=reg|64;
+            cur->dirty&=~(1<<hr);
+            cur->isconst&=~(1<<hr);
+            return;
+          }
+        }
+      }
+    }
+  }
+  SysPrintf("This shouldn't happen");exit(1);
+}
+
+// Allocate a temporary register.  This is done without regard to
+// dirty status or whether the register we request is on the unneeded list
+// Note: This will only allocate one register, even if called multiple times
+static void alloc_reg_temp(struct regstat *cur,int i,signed char reg)
+{
+  int r,hr;
+  int preferred_reg = -1;
+
+  // see if it's already allocated
+  for(hr=0;hr<HOST_REGS;hr++)
+  {
+    if(hr!=EXCLUDE_REG&&cur->regmap[hr]==reg) return;
+  }
+
+  // Try to allocate any available register
+  for(hr=HOST_REGS-1;hr>=0;hr--) {
+    if(hr!=EXCLUDE_REG&&cur->regmap[hr]==-1) {
+      cur->regmap[hr]=reg;
+      cur->dirty&=~(1<<hr);
+      cur->isconst&=~(1<<hr);
+      return;
+    }
+  }
+
+  // Find an unneeded register
+  for(hr=HOST_REGS-1;hr>=0;hr--)
+  {
+    r=cur->regmap[hr];
+    if(r>=0) {
+      if(r<64) {
+        if((cur->u>>r)&1) {
+          if(i==0||((unneeded_reg[i-1]>>r)&1)) {
+            cur->regmap[hr]=reg;
+            cur->dirty&=~(1<<hr);
+            cur->isconst&=~(1<<hr);
+            return;
+          }
+        }
+      }
+      else
+      {
+        if((cur->uu>>(r&63))&1) {
+          if(i==0||((unneeded_reg_upper[i-1]>>(r&63))&1)) {
+            cur->regmap[hr]=reg;
+            cur->dirty&=~(1<<hr);
+            cur->isconst&=~(1<<hr);
+            return;
+          }
+        }
+      }
+    }
+  }
+
+  // Ok, now we have to evict someone
+  // Pick a register we hopefully won't need soon
+  // TODO: we might want to follow unconditional jumps here
+  // TODO: get rid of dupe code and make this into a function
+  u_char hsn[MAXREG+1];
+  memset(hsn,10,sizeof(hsn));
+  int j;
+  lsn(hsn,i,&preferred_reg);
+  //printf("hsn: %d %d %d %d %d %d %d\n",hsn[cur->regmap[0]&63],hsn[cur->regmap[1]&63],hsn[cur->regmap[2]&63],hsn[cur->regmap[3]&63],hsn[cur->regmap[5]&63],hsn[cur->regmap[6]&63],hsn[cur->regmap[7]&63]);
+  if(i>0) {
+    // Don't evict the cycle count at entry points, otherwise the entry
+    // stub will have to write it.
+    if(bt[i]&&hsn[CCREG]>2) hsn[CCREG]=2;
+    if(i>1&&hsn[CCREG]>2&&(itype[i-2]==RJUMP||itype[i-2]==UJUMP||itype[i-2]==CJUMP||itype[i-2]==SJUMP||itype[i-2]==FJUMP)) hsn[CCREG]=2;
+    for(j=10;j>=3;j--)
+    {
+      for(r=1;r<=MAXREG;r++)
+      {
+        if(hsn[r]==j&&r!=rs1[i-1]&&r!=rs2[i-1]&&r!=rt1[i-1]&&r!=rt2[i-1]) {
+          for(hr=0;hr<HOST_REGS;hr++) {
+            if(hr!=HOST_CCREG||hsn[CCREG]>2) {
+              if(cur->regmap[hr]==r+64) {
+                cur->regmap[hr]=reg;
+                cur->dirty&=~(1<<hr);
+                cur->isconst&=~(1<<hr);
+                return;
+              }
+            }
+          }
+          for(hr=0;hr<HOST_REGS;hr++) {
+            if(hr!=HOST_CCREG||hsn[CCREG]>2) {
+              if(cur->regmap[hr]==r) {
+                cur->regmap[hr]=reg;
+                cur->dirty&=~(1<<hr);
+                cur->isconst&=~(1<<hr);
+                return;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  for(j=10;j>=0;j--)
+  {
+    for(r=1;r<=MAXREG;r++)
+    {
+      if(hsn[r]==j) {
+        for(hr=0;hr<HOST_REGS;hr++) {
+          if(cur->regmap[hr]==r+64) {
+            cur->regmap[hr]=reg;
+            cur->dirty&=~(1<<hr);
+            cur->isconst&=~(1<<hr);
+            return;
+          }
+        }
+        for(hr=0;hr<HOST_REGS;hr++) {
+          if(cur->regmap[hr]==r) {
+            cur->regmap[hr]=reg;
+            cur->dirty&=~(1<<hr);
+            cur->isconst&=~(1<<hr);
+            return;
+          }
+        }
+      }
+    }
+  }
+  SysPrintf("This shouldn't happen");exit(1);
+}
+
+// Allocate a specific x86-64 register.
+static void alloc_x64_reg(struct regstat *cur,int i,signed char reg,int hr)
+{
+  int n;
+  int dirty=0;
+
+  // see if it's already allocated (and dealloc it)
+  for(n=0;n<HOST_REGS;n++)
+  {
+    if(n!=EXCLUDE_REG&&cur->regmap[n]==reg) {
+      dirty=(cur->dirty>>n)&1;
+      cur->regmap[n]=-1;
+    }
+  }
+
+  cur->regmap[hr]=reg;
+  cur->dirty&=~(1<<hr);
+  cur->dirty|=dirty<<hr;
+  cur->isconst&=~(1<<hr);
+}
+
+// Alloc cycle count into dedicated register
+static void alloc_cc(struct regstat *cur,int i)
+{
+  alloc_x64_reg(cur,i,CCREG,HOST_CCREG);
+}
+
+
+/* Special alloc */
+
+
+/* Assembler */
+
+static unused char regname[16][5] = {
+ "eax",
+ "ecx",
+ "edx",
+ "ebx",
+ "esp",
+ "ebp",
+ "esi",
+ "edi",
+ "r8d",
+ "r9d",
+ "r10d",
+ "r11d",
+ "r12d",
+ "r13d",
+ "r14d",
+ "r15d"};
+
+static void output_byte(u_char byte)
+{
+  *(out++)=byte;
+}
+static void output_w32(u_int word)
+{
+  *((u_int *)out)=word;
+  out+=4;
+}
+static void output_w64(uint64_t dword)
+{
+  *((uint64_t *)out)=dword;
+  out+=8;
+}
+
+#define REX_W    1 // 64-bit operand
+#define REX_BYTE 2 // force the prefix, spl/bpl/sil/dil instead of ah/ch/dh/bh
+
+static void output_rex(int flags,int r,int x,int b)
+{
+  int rex=0x40|((flags&REX_W)<<3)|((r&8)>>1)|((x&8)>>2)|((b&8)>>3);
+  if(rex!=0x40||(flags&REX_BYTE)) output_byte(rex);
+}
+
+// one byte opcodes, or two with the 0x0f escape
+static void output_op(int op)
+{
+  if(op>0xff) output_byte(op>>8);
+  output_byte(op);
+}
+
+static void emit_op_rr(int op,int flags,int reg,int rm)
+{
+  output_rex(flags,reg,0,rm);
+  output_op(op);
+  output_byte(0xc0|((reg&7)<<3)|(rm&7));
+}
+
+// [base+index*(1<<scale)+offset], index<0 if none.
+// a32 truncates the address to 32 bits (0x67 prefix), which is
+// how the guest memory is accessed.
+static void emit_op_rm(int op,int flags,int reg,int base,int index,int scale,int offset,int a32)
+{
+  int mod;
+  assert(index!=4);
+  if(a32) output_byte(0x67);
+  output_rex(flags,reg,index<0?0:index,base);
+  output_op(op);
+  if(offset==0&&(base&7)!=5) mod=0;
+  else if(offset==(signed char)offset) mod=1;
+  else mod=2;
+  if(index>=0||(base&7)==4) {
+    output_byte((mod<<6)|((reg&7)<<3)|4);
+    output_byte((scale<<6)|((index<0?4:index&7)<<3)|(base&7));
+  }
+  else
+    output_byte((mod<<6)|((reg&7)<<3)|(base&7));
+  if(mod==1) output_byte(offset);
+  if(mod==2) output_w32(offset);
+}
+
+// op with an immediate, ext is the /digit of the 0x81 group:
+// 0 add, 1 or, 2 adc, 3 sbb, 4 and, 5 sub, 6 xor, 7 cmp
+static void emit_alu_imm(int ext,int flags,int imm,int rt)
+{
+  if(imm==(signed char)imm) {
+    emit_op_rr(0x83,flags,ext,rt);
+    output_byte(imm);
+  }
+  else {
+    emit_op_rr(0x81,flags,ext,rt);
+    output_w32(imm);
+  }
+}
+
+static void emit_mov(int rs,int rt)
+{
+  assem_debug("mov %s,%s\n",regname[rt],regname[rs]);
+  emit_op_rr(0x89,0,rs,rt);
+}
+
+static void emit_mov64(int rs,int rt)
+{
+  assem_debug("mov %%%s,%%%s (64)\n",regname[rt],regname[rs]);
+  emit_op_rr(0x89,REX_W,rs,rt);
+}
+
+static void emit_add(int rs1,int rs2,int rt)
+{
+  // lea, doesn't touch the flags
+  assem_debug("lea %s,[%s+%s]\n",regname[rt],regname[rs1],regname[rs2]);
+  if(rs2==4) { int t=rs1; rs1=rs2; rs2=t; } // esp can't be an index
+  emit_op_rm(0x8d,0,rt,rs1,rs2,0,0,0);
+}
+
+// x86 alu ops are two operand, rt=rt op rs
+static void emit_alu_rr(int op,int rs,int rt)
+{
+  emit_op_rr(op,0,rs,rt);
+}
+
+static void emit_adds(int rs1,int rs2,int rt)
+{
+  assem_debug("add %s,%s,%s\n",regname[rt],regname[rs1],regname[rs2]);
+  if(rt==rs2) emit_alu_rr(0x01,rs1,rt);
+  else {
+    if(rs1!=rt) emit_mov(rs1,rt);
+    emit_alu_rr(0x01,rs2,rt);
+  }
+}
+
+static void emit_subs(int rs1,int rs2,int rt)
+{
+  assem_debug("sub %s,%s,%s\n",regname[rt],regname[rs1],regname[rs2]);
+  if(rt==rs2&&rs1!=rs2) {
+    emit_mov(rs1,13);
+    emit_alu_rr(0x29,rs2,13);
+    emit_mov(13,rt);
+  }
+  else {
+    if(rs1!=rt) emit_mov(rs1,rt);
+    emit_alu_rr(0x29,rs2,rt);
+  }
+}
+
+static void emit_sub(int rs1,int rs2,int rt)
+{
+  emit_subs(rs1,rs2,rt);
+}
+
+static void emit_sbb(int rs1,int rs2)
+{
+  assem_debug("sbb %%%s,%%%s\n",regname[rs1],regname[rs2]);
+  emit_alu_rr(0x19,rs2,rs1);
+}
+
+static void emit_neg(int rs, int rt)
+{
+  assem_debug("neg %s,%s\n",regname[rt],regname[rs]);
+  if(rs!=rt) emit_mov(rs,rt);
+  emit_op_rr(0xf7,0,3,rt);
+}
+
+static void emit_negs(int rs, int rt)
+{
+  emit_neg(rs,rt);
+}
+
+// mov r32,imm rather than xor, the flags must survive
+static void emit_movimm(u_int imm,u_int rt)
+{
+  assem_debug("mov %s,#%d\n",regname[rt],imm);
+  output_rex(0,0,0,rt);
+  output_byte(0xb8|(rt&7));
+  output_w32(imm);
+}
+
+static void emit_zeroreg(int rt)
+{
+  emit_movimm(0,rt);
+}
+
+// always the 10 byte form, stubs get parsed by their size
+static void emit_movimm64(uintptr_t imm,int rt)
+{
+  assem_debug("movabs %%%s,#%lx\n",regname[rt],(u_long)imm);
+  output_rex(REX_W,0,0,rt);
+  output_byte(0xb8|(rt&7));
+  output_w64(imm);
+}
+
+static void emit_movimm_ptr(uintptr_t imm,int rt)
+{
+  if(imm==(u_int)imm)
+    emit_movimm(imm,rt);
+  else
+    emit_movimm64(imm,rt);
+}
+
+static void emit_readword(int addr, int rt)
+{
+  int offset=fp_offset(addr);
+  assem_debug("mov %s,fp+%d\n",regname[rt],offset);
+  emit_op_rm(0x8b,0,rt,FP,-1,0,offset,0);
+}
+
+static void emit_readptr(int addr, int rt)
+{
+  int offset=fp_offset(addr);
+  assem_debug("mov %%%s,fp+%d (64)\n",regname[rt],offset);
+  emit_op_rm(0x8b,REX_W,rt,FP,-1,0,offset,0);
+}
+
+static void emit_writeword(int rt, int addr)
+{
+  int offset=fp_offset(addr);
+  assem_debug("mov fp+%d,%s\n",offset,regname[rt]);
+  emit_op_rm(0x89,0,rt,FP,-1,0,offset,0);
+}
+
+static void emit_loadreg(int r, int hr)
+{
+  if(r&64) {
+    SysPrintf("64bit load in 32bit mode!\n");
+    assert(0);
+    return;
+  }
+  if((r&63)==0)
+    emit_zeroreg(hr);
+  else {
+    int addr=((int)reg)+((r&63)<<REG_SHIFT)+((r&64)>>4);
+    if((r&63)==HIREG) addr=(int)&hi+((r&64)>>4);
+    if((r&63)==LOREG) addr=(int)&lo+((r&64)>>4);
+    if(r==CCREG) addr=(int)&cycle_count;
+    if(r==CSREG) addr=(int)&Status;
+    if(r==FSREG) addr=(int)&FCR31;
+    if(r==INVCP) addr=(int)&invc_ptr;
+    emit_readword(addr,hr);
+  }
+}
+
+static void emit_storereg(int r, int hr)
+{
+  if(r&64) {
+    SysPrintf("64bit store in 32bit mode!\n");
+    assert(0);
+    return;
+  }
+  int addr=((int)reg)+((r&63)<<REG_SHIFT)+((r&64)>>4);
+  if((r&63)==HIREG) addr=(int)&hi+((r&64)>>4);
+  if((r&63)==LOREG) addr=(int)&lo+((r&64)>>4);
+  if(r==CCREG) addr=(int)&cycle_count;
+  if(r==FSREG) addr=(int)&FCR31;
+  emit_writeword(hr,addr);
+}
+
+static void emit_test(int rs, int rt)
+{
+  assem_debug("test %s,%s\n",regname[rs],regname[rt]);
+  emit_alu_rr(0x85,rt,rs);
+}
+
+static void emit_testimm(int rs,int imm)
+{
+  assem_debug("test %s,$%d\n",regname[rs],imm);
+  emit_op_rr(0xf7,0,0,rs);
+  output_w32(imm);
+}
+
+static void emit_not(int rs,int rt)
+{
+  assem_debug("not %s,%s\n",regname[rt],regname[rs]);
+  if(rs!=rt) emit_mov(rs,rt);
+  emit_op_rr(0xf7,0,2,rt);
+}
+
+// commutative ops
+static void emit_alu_rrr(int op,int rs1,int rs2,int rt)
+{
+  if(rt==rs2) emit_alu_rr(op,rs1,rt);
+  else {
+    if(rs1!=rt) emit_mov(rs1,rt);
+    emit_alu_rr(op,rs2,rt);
+  }
+}
+
+static void emit_and(u_int rs1,u_int rs2,u_int rt)
+{
+  assem_debug("and %s,%s,%s\n",regname[rt],regname[rs1],regname[rs2]);
+  emit_alu_rrr(0x21,rs1,rs2,rt);
+}
+
+static void emit_or(u_int rs1,u_int rs2,u_int rt)
+{
+  assem_debug("or %s,%s,%s\n",regname[rt],regname[rs1],regname[rs2]);
+  emit_alu_rrr(0x09,rs1,rs2,rt);
+}
+
+static void emit_or_and_set_flags(int rs1,int rs2,int rt)
+{
+  emit_or(rs1,rs2,rt);
+}
+
+static void emit_xor(u_int rs1,u_int rs2,u_int rt)
+{
+  assem_debug("xor %s,%s,%s\n",regname[rt],regname[rs1],regname[rs2]);
+  emit_alu_rrr(0x31,rs1,rs2,rt);
+}
+
+static void emit_addimm(u_int rs,int imm,u_int rt)
+{
+  if(imm!=0) {
+    // lea, doesn't touch the flags
+    assem_debug("lea %s,[%s+%d]\n",regname[rt],regname[rs],imm);
+    emit_op_rm(0x8d,0,rt,rs,-1,0,imm,0);
+  }
+  else if(rs!=rt) emit_mov(rs,rt);
+}
+
+static void emit_addimm64(int rs,int imm,int rt)
+{
+  assem_debug("lea %%%s,[%%%s+%d]\n",regname[rt],regname[rs],imm);
+  emit_op_rm(0x8d,REX_W,rt,rs,-1,0,imm,0);
+}
+
+static void emit_addimm_and_set_flags(int imm,int rt)
+{
+  assem_debug("add %s,#%d\n",regname[rt],imm);
+  emit_alu_imm(0,0,imm,rt);
+}
+
+static void emit_addimm_no_flags(u_int imm,u_int rt)
+{
+  emit_addimm(rt,imm,rt);
+}
+
+static unused void emit_addnop(u_int r)
+{
+  assem_debug("nop\n");
+  output_byte(0x90);
+}
+
+static void emit_adcimm(int imm,u_int rt)
+{
+  assem_debug("adc %s,%d\n",regname[rt],imm);
+  emit_alu_imm(2,0,imm,rt);
+}
+
+static void emit_addimm64_32(int rsh,int rsl,int imm,int rth,int rtl)
+{
+  if(rsh==rtl) {
+    emit_mov(rsh,13);
+    rsh=13;
+  }
+  if(rsl!=rtl) emit_mov(rsl,rtl);
+  if(rsh!=rth) emit_mov(rsh,rth);
+  emit_alu_imm(0,0,imm,rtl);
+  emit_alu_imm(2,0,imm>>31,rth);
+}
+
+static void emit_signextend16(int rs,int rt)
+{
+  assem_debug("movswl %s,%s\n",regname[rt],regname[rs]);
+  emit_op_rr(0x0fbf,0,rt,rs);
+}
+
+static void emit_signextend8(int rs,int rt)
+{
+  assem_debug("movsbl %s,%s\n",regname[rt],regname[rs]);
+  emit_op_rr(0x0fbe,REX_BYTE,rt,rs);
+}
+
+static void emit_movzwl_reg(int rs,int rt)
+{
+  assem_debug("movzwl %s,%s\n",regname[rt],regname[rs]);
+  emit_op_rr(0x0fb7,0,rt,rs);
+}
+
+static void emit_andimm(int rs,int imm,int rt)
+{
+  if(imm==0) {
+    emit_zeroreg(rt);
+  }else if(imm==0xff) {
+    assem_debug("movzbl %s,%s\n",regname[rt],regname[rs]);
+    emit_op_rr(0x0fb6,REX_BYTE,rt,rs);
+  }else if(imm==0xffff) {
+    emit_movzwl_reg(rs,rt);
+  }else{
+    assem_debug("and %s,%s,#%d\n",regname[rt],regname[rs],imm);
+    if(rs!=rt) emit_mov(rs,rt);
+    emit_alu_imm(4,0,imm,rt);
+  }
+}
+
+static void emit_orimm(int rs,int imm,int rt)
+{
+  assem_debug("or %s,%s,#%d\n",regname[rt],regname[rs],imm);
+  if(rs!=rt) emit_mov(rs,rt);
+  if(imm!=0) emit_alu_imm(1,0,imm,rt);
+}
+
+static void emit_xorimm(int rs,int imm,int rt)
+{
+  assem_debug("xor %s,%s,#%d\n",regname[rt],regname[rs],imm);
+  if(rs!=rt) emit_mov(rs,rt);
+  if(imm!=0) emit_alu_imm(6,0,imm,rt);
+}
+
+// ext: 0 rol, 1 ror, 4 shl, 5 shr, 7 sar
+static void emit_shiftimm(int ext,int rs,u_int imm,int rt)
+{
+  if(rs!=rt) emit_mov(rs,rt);
+  if(imm==0) return;
+  emit_op_rr(0xc1,0,ext,rt);
+  output_byte(imm);
+}
+
+static void emit_shlimm(int rs,u_int imm,int rt)
+{
+  assem_debug("shl %s,%s,#%d\n",regname[rt],regname[rs],imm);
+  emit_shiftimm(4,rs,imm,rt);
+}
+
+static void emit_shrimm(int rs,u_int imm,int rt)
+{
+  assem_debug("shr %s,%s,#%d\n",regname[rt],regname[rs],imm);
+  emit_shiftimm(5,rs,imm,rt);
+}
+
+static void emit_sarimm(int rs,u_int imm,int rt)
+{
+  assem_debug("sar %s,%s,#%d\n",regname[rt],regname[rs],imm);
+  emit_shiftimm(7,rs,imm,rt);
+}
+
+static void emit_rorimm(int rs,u_int imm,int rt)
+{
+  assem_debug("ror %s,%s,#%d\n",regname[rt],regname[rs],imm);
+  emit_shiftimm(1,rs,imm,rt);
+}
+
+// rt=rs<<imm|rs2>>(32-imm)
+static void emit_shldimm(int rs,int rs2,u_int imm,int rt)
+{
+  assem_debug("shld %s,%s,%s,%d\n",regname[rt],regname[rs],regname[rs2],imm);
+  if(rt==rs2&&rt!=rs) {
+    emit_mov(rs2,13);
+    rs2=13;
+  }
+  if(rs!=rt) emit_mov(rs,rt);
+  emit_op_rr(0x0fa4,0,rs2,rt);
+  output_byte(imm);
+}
+
+// rt=rs>>imm|rs2<<(32-imm)
+static void emit_shrdimm(int rs,int rs2,u_int imm,int rt)
+{
+  assem_debug("shrd %s,%s,%s,%d\n",regname[rt],regname[rs],regname[rs2],imm);
+  if(rt==rs2&&rt!=rs) {
+    emit_mov(rs2,13);
+    rs2=13;
+  }
+  if(rs!=rt) emit_mov(rs,rt);
+  emit_op_rr(0x0fac,0,rs2,rt);
+  output_byte(imm);
+}
+
+// rt=rs shifted by the amount in the shift register,
+// x86 can only shift by cl, so swap it in and out
+static void emit_shift_var(int ext,int rs,int shift,int rt)
+{
+  assem_debug("%s %s,%s,%s\n",ext==4?"shl":ext==5?"shr":"sar",regname[rt],regname[rs],regname[shift]);
+  emit_mov(rs,13);
+  if(shift!=ECX) emit_op_rr(0x87,0,shift,ECX);
+  emit_op_rr(0xd3,0,ext,13);
+  if(shift!=ECX) emit_op_rr(0x87,0,shift,ECX);
+  emit_mov(13,rt);
+}
+
+static void emit_shrne_imm(int rs,u_int imm,int rt)
+{
+  // skip over the shift if the flags say equal
+  u_char *jaddr=out;
+  output_byte(0x74);
+  output_byte(0);
+  emit_shrimm(rs,imm,rt);
+  jaddr[1]=out-jaddr-2;
+}
+
+static void emit_cmpimm(int rs,int imm)
+{
+  assem_debug("cmp %s,#%d\n",regname[rs],imm);
+  emit_alu_imm(7,0,imm,rs);
+}
+
+static void emit_cmp(int rs,int rt)
+{
+  assem_debug("cmp %s,%s\n",regname[rs],regname[rt]);
+  emit_alu_rr(0x39,rt,rs);
+}
+
+// x86 condition codes
+#define CC_O  0x0
+#define CC_NO 0x1
+#define CC_B  0x2
+#define CC_AE 0x3
+#define CC_E  0x4
+#define CC_NE 0x5
+#define CC_S  0x8
+#define CC_NS 0x9
+#define CC_L  0xc
+#define CC_GE 0xd
+#define CC_LE 0xe
+#define CC_G  0xf
+
+static void emit_cmov_reg(int cc,int rs,int rt)
+{
+  assem_debug("cmov%x %s,%s\n",cc,regname[rt],regname[rs]);
+  emit_op_rr(0x0f40|cc,0,rt,rs);
+}
+
+// there is no cmov with an immediate, r13 holds it
+static void emit_cmov_imm(int cc,int imm,int rt)
+{
+  emit_movimm(imm,13);
+  emit_cmov_reg(cc,13,rt);
+}
+
+static void emit_cmovne_imm(int imm,int rt)
+{
+  emit_cmov_imm(CC_NE,imm,rt);
+}
+
+static void emit_cmovl_imm(int imm,int rt)
+{
+  emit_cmov_imm(CC_L,imm,rt);
+}
+
+static void emit_cmovb_imm(int imm,int rt)
+{
+  emit_cmov_imm(CC_B,imm,rt);
+}
+
+static void emit_cmovs_imm(int imm,int rt)
+{
+  emit_cmov_imm(CC_S,imm,rt);
+}
+
+static void emit_cmove_reg(int rs,int rt)
+{
+  emit_cmov_reg(CC_E,rs,rt);
+}
+
+static void emit_cmovne_reg(int rs,int rt)
+{
+  emit_cmov_reg(CC_NE,rs,rt);
+}
+
+static void emit_cmovl_reg(int rs,int rt)
+{
+  emit_cmov_reg(CC_L,rs,rt);
+}
+
+static void emit_cmovs_reg(int rs,int rt)
+{
+  emit_cmov_reg(CC_S,rs,rt);
+}
+
+static void emit_slti32(int rs,int imm,int rt)
+{
+  if(rs!=rt) emit_zeroreg(rt);
+  emit_cmpimm(rs,imm);
+  if(rs==rt) emit_movimm(0,rt);
+  emit_cmovl_imm(1,rt);
+}
+
+static void emit_sltiu32(int rs,int imm,int rt)
+{
+  if(rs!=rt) emit_zeroreg(rt);
+  emit_cmpimm(rs,imm);
+  if(rs==rt) emit_movimm(0,rt);
+  emit_cmovb_imm(1,rt);
+}
+
+static void emit_slti64_32(int rsh,int rsl,int imm,int rt)
+{
+  assert(rsh!=rt);
+  emit_slti32(rsl,imm,rt);
+  if(imm>=0)
+  {
+    emit_test(rsh,rsh);
+    emit_cmovne_imm(0,rt);
+    emit_cmovs_imm(1,rt);
+  }
+  else
+  {
+    emit_cmpimm(rsh,-1);
+    emit_cmovne_imm(0,rt);
+    emit_cmovl_imm(1,rt);
+  }
+}
+
+static void emit_sltiu64_32(int rsh,int rsl,int imm,int rt)
+{
+  assert(rsh!=rt);
+  emit_sltiu32(rsl,imm,rt);
+  if(imm>=0)
+  {
+    emit_test(rsh,rsh);
+    emit_cmovne_imm(0,rt);
+  }
+  else
+  {
+    emit_cmpimm(rsh,-1);
+    emit_cmovne_imm(1,rt);
+  }
+}
+
+static void emit_set_gz32(int rs, int rt)
+{
+  //assem_debug("set_gz32\n");
+  emit_cmpimm(rs,1);
+  emit_movimm(1,rt);
+  emit_cmovl_imm(0,rt);
+}
+
+static void emit_set_nz32(int rs, int rt)
+{
+  //assem_debug("set_nz32\n");
+  emit_test(rs,rs);
+  if(rs!=rt) emit_mov(rs,rt);
+  emit_cmovne_imm(1,rt);
+}
+
+static void emit_set_gz64_32(int rsh, int rsl, int rt)
+{
+  //assem_debug("set_gz64\n");
+  emit_set_gz32(rsl,rt);
+  emit_test(rsh,rsh);
+  emit_cmovne_imm(1,rt);
+  emit_cmovs_imm(0,rt);
+}
+
+static void emit_set_nz64_32(int rsh, int rsl, int rt)
+{
+  //assem_debug("set_nz64\n");
+  emit_or_and_set_flags(rsh,rsl,rt);
+  emit_cmovne_imm(1,rt);
+}
+
+static void emit_set_if_less32(int rs1, int rs2, int rt)
+{
+  //assem_debug("set if less (%%%s,%%%s),%%%s\n",regname[rs1],regname[rs2],regname[rt]);
+  if(rs1!=rt&&rs2!=rt) emit_zeroreg(rt);
+  emit_cmp(rs1,rs2);
+  if(rs1==rt||rs2==rt) emit_movimm(0,rt);
+  emit_cmovl_imm(1,rt);
+}
+
+static void emit_set_if_carry32(int rs1, int rs2, int rt)
+{
+  //assem_debug("set if carry (%%%s,%%%s),%%%s\n",regname[rs1],regname[rs2],regname[rt]);
+  if(rs1!=rt&&rs2!=rt) emit_zeroreg(rt);
+  emit_cmp(rs1,rs2);
+  if(rs1==rt||rs2==rt) emit_movimm(0,rt);
+  emit_cmovb_imm(1,rt);
+}
+
+static void emit_set_if_less64_32(int u1, int l1, int u2, int l2, int rt)
+{
+  //assem_debug("set if less64 (%%%s,%%%s,%%%s,%%%s),%%%s\n",regname[u1],regname[l1],regname[u2],regname[l2],regname[rt]);
+  assert(u1!=rt);
+  assert(u2!=rt);
+  emit_cmp(l1,l2);
+  emit_movimm(0,rt);
+  emit_mov(u1,HOST_TEMPREG);
+  emit_sbb(HOST_TEMPREG,u2);
+  emit_cmovl_imm(1,rt);
+}
+
+static void emit_set_if_carry64_32(int u1, int l1, int u2, int l2, int rt)
+{
+  //assem_debug("set if carry64 (%%%s,%%%s,%%%s,%%%s),%%%s\n",regname[u1],regname[l1],regname[u2],regname[l2],regname[rt]);
+  assert(u1!=rt);
+  assert(u2!=rt);
+  emit_cmp(l1,l2);
+  emit_movimm(0,rt);
+  emit_mov(u1,HOST_TEMPREG);
+  emit_sbb(HOST_TEMPREG,u2);
+  emit_cmovb_imm(1,rt);
+}
+
+// a=0 leaves a rel32 placeholder for set_jump_target,
+// anything out of rel32 reach goes through r13
+static void emit_call_ptr(const void *a)
+{
+  intptr_t offset=(const char *)a-((char *)out+5);
+  assem_debug("call %p\n",a);
+  if(a==NULL||offset==(int)offset) {
+    output_byte(0xe8);
+    output_w32(a==NULL?0:offset);
+  }
+  else {
+    emit_movimm64((uintptr_t)a,13);
+    output_byte(0x41);
+    output_byte(0xff);
+    output_byte(0xd5);
+  }
+}
+
+static void emit_jmp_ptr(const void *a)
+{
+  intptr_t offset=(const char *)a-((char *)out+5);
+  assem_debug("jmp %p\n",a);
+  if(a==NULL||offset==(int)offset) {
+    output_byte(0xe9);
+    output_w32(a==NULL?0:offset);
+  }
+  else {
+    emit_movimm64((uintptr_t)a,13);
+    output_byte(0x41);
+    output_byte(0xff);
+    output_byte(0xe5);
+  }
+}
+
+static void emit_jcc_ptr(int cc,const void *a)
+{
+  intptr_t offset=(const char *)a-((char *)out+6);
+  assem_debug("j%x %p\n",cc,a);
+  if(a==NULL||offset==(int)offset) {
+    output_byte(0x0f);
+    output_byte(0x80|cc);
+    output_w32(a==NULL?0:offset);
+  }
+  else {
+    // inverted short jump over the far one
+    output_byte(0x70|(cc^1));
+    output_byte(13);
+    emit_jmp_ptr(a);
+  }
+}
+
+// 0 and 1 are placeholders, set_jump_target() fills in the rel32 later
+static const void *branch_ptr(int a)
+{
+  return (u_int)a>1?host_ptr(a):NULL;
+}
+
+static void emit_call(int a)
+{
+  emit_call_ptr(branch_ptr(a));
+}
+
+static void emit_jmp(int a)
+{
+  emit_jmp_ptr(branch_ptr(a));
+}
+
+static void emit_jne(int a)
+{
+  emit_jcc_ptr(CC_NE,branch_ptr(a));
+}
+
+static void emit_jeq(int a)
+{
+  emit_jcc_ptr(CC_E,branch_ptr(a));
+}
+
+static void emit_js(int a)
+{
+  emit_jcc_ptr(CC_S,branch_ptr(a));
+}
+
+static void emit_jns(int a)
+{
+  emit_jcc_ptr(CC_NS,branch_ptr(a));
+}
+
+static void emit_jl(int a)
+{
+  emit_jcc_ptr(CC_L,branch_ptr(a));
+}
+
+static void emit_jge(int a)
+{
+  emit_jcc_ptr(CC_GE,branch_ptr(a));
+}
+
+static void emit_jno(int a)
+{
+  emit_jcc_ptr(CC_NO,branch_ptr(a));
+}
+
+static void emit_jc(int a)
+{
+  emit_jcc_ptr(CC_B,branch_ptr(a));
+}
+
+static void emit_jae(int a)
+{
+  emit_jcc_ptr(CC_AE,branch_ptr(a));
+}
+
+static unused void emit_jmpreg(u_int r)
+{
+  assem_debug("jmp *%%%s\n",regname[r]);
+  output_rex(0,0,0,r);
+  output_byte(0xff);
+  output_byte(0xe0|(r&7));
+}
+
+static void emit_ret()
+{
+  assem_debug("ret\n");
+  output_byte(0xc3);
+}
+
+// guest memory, rs holds the 32-bit host address
+static void emit_readword_indexed(int offset, int rs, int rt)
+{
+  assem_debug("mov %s,%d(%s)\n",regname[rt],offset,regname[rs]);
+  emit_op_rm(0x8b,0,rt,rs,-1,0,offset,1);
+}
+
+static void emit_readword_indexed_tlb(int addr, int rs, int map, int rt)
+{
+  assert(map<0);
+  emit_readword_indexed(addr,rs,rt);
+}
+
+static void emit_readdword_indexed_tlb(int addr, int rs, int map, int rh, int rl)
+{
+  assert(map<0);
+  if(rh>=0) emit_readword_indexed(addr,rs,rh);
+  emit_readword_indexed(addr+4,rs,rl);
+}
+
+static void emit_movsbl_indexed(int offset, int rs, int rt)
+{
+  assem_debug("movsbl %s,%d(%s)\n",regname[rt],offset,regname[rs]);
+  emit_op_rm(0x0fbe,0,rt,rs,-1,0,offset,1);
+}
+
+static void emit_movsbl_indexed_tlb(int addr, int rs, int map, int rt)
+{
+  assert(map<0);
+  emit_movsbl_indexed(addr,rs,rt);
+}
+
+static void emit_movswl_indexed(int offset, int rs, int rt)
+{
+  assem_debug("movswl %s,%d(%s)\n",regname[rt],offset,regname[rs]);
+  emit_op_rm(0x0fbf,0,rt,rs,-1,0,offset,1);
+}
+
+static void emit_movzbl_indexed(int offset, int rs, int rt)
+{
+  assem_debug("movzbl %s,%d(%s)\n",regname[rt],offset,regname[rs]);
+  emit_op_rm(0x0fb6,0,rt,rs,-1,0,offset,1);
+}
+
+static void emit_movzbl_indexed_tlb(int addr, int rs, int map, int rt)
+{
+  assert(map<0);
+  emit_movzbl_indexed(addr,rs,rt);
+}
+
+static void emit_movzwl_indexed(int offset, int rs, int rt)
+{
+  assem_debug("movzwl %s,%d(%s)\n",regname[rt],offset,regname[rs]);
+  emit_op_rm(0x0fb7,0,rt,rs,-1,0,offset,1);
+}
+
+static void emit_writeword_indexed(int rt, int offset, int rs)
+{
+  assem_debug("mov %d(%s),%s\n",offset,regname[rs],regname[rt]);
+  emit_op_rm(0x89,0,rt,rs,-1,0,offset,1);
+}
+
+static void emit_writeword_indexed_tlb(int rt, int addr, int rs, int map, int temp)
+{
+  assert(map<0);
+  emit_writeword_indexed(rt,addr,rs);
+}
+
+static void emit_writedword_indexed_tlb(int rh, int rl, int addr, int rs, int map, int temp)
+{
+  assert(map<0);
+  assert(rh>=0);
+  emit_writeword_indexed(rh,addr,rs);
+  emit_writeword_indexed(rl,addr+4,rs);
+}
+
+static void emit_writehword_indexed(int rt, int offset, int rs)
+{
+  assem_debug("movw %d(%s),%s\n",offset,regname[rs],regname[rt]);
+  output_byte(0x66);
+  emit_op_rm(0x89,0,rt,rs,-1,0,offset,1);
+}
+
+static void emit_writebyte_indexed(int rt, int offset, int rs)
+{
+  assem_debug("movb %d(%s),%s\n",offset,regname[rs],regname[rt]);
+  emit_op_rm(0x88,REX_BYTE,rt,rs,-1,0,offset,1);
+}
+
+static void emit_writebyte_indexed_tlb(int rt, int addr, int rs, int map, int temp)
+{
+  assert(map<0);
+  emit_writebyte_indexed(rt,addr,rs);
+}
+
+static void emit_mov2imm_compact(int imm1,u_int rt1,int imm2,u_int rt2)
+{
+  emit_movimm(imm1,rt1);
+  emit_movimm(imm2,rt2);
+}
+
+static unused void emit_cmov2imm_e_ne_compact(int imm1,int imm2,u_int rt)
+{
+  emit_movimm(imm1,rt);
+  emit_cmovne_imm(imm2,rt);
+}
+
+// special case for checking invalid_code
+static void emit_cmpmem_indexedsr12_imm(int addr,int r,int imm)
+{
+  assert(imm<128&&imm>=0);
+  assem_debug("cmpb $%d,invalid_code(%s>>12)\n",imm,regname[r]);
+  emit_mov(r,13);
+  emit_shiftimm(5,13,12,13);
+  emit_op_rm(0x80,0,7,FP,13,0,fp_offset(addr),0);
+  output_byte(imm);
+}
+
+static void save_regs_all(u_int reglist)
+{
+  int hr;
+  for(hr=0;hr<16;hr++)
+    if(reglist&(1<<hr))
+      emit_op_rm(0x89,0,hr,FP,-1,0,hr*4,0);
+}
+
+static void restore_regs_all(u_int reglist)
+{
+  int hr;
+  for(hr=0;hr<16;hr++)
+    if(reglist&(1<<hr))
+      emit_op_rm(0x8b,0,hr,FP,-1,0,hr*4,0);
+}
+
+// Save registers before function call
+// (into the start of dynarec_local, reserved for this)
+static void save_regs(u_int reglist)
+{
+  reglist&=CALLER_SAVE_REGS;
+  save_regs_all(reglist);
+}
+
+// Restore registers after function call
+static void restore_regs(u_int reglist)
+{
+  reglist&=CALLER_SAVE_REGS;
+  restore_regs_all(reglist);
+}
+
+/* Stubs/epilogue */
+
+// nothing to flush, immediates are inline on x86
+static void literal_pool(int n)
+{
+}
+
+static void literal_pool_jumpover(int n)
+{
+}
+
+static void emit_extjump2(u_int addr, int target, void *linker)
+{
+  u_char *ptr=(u_char *)(uintptr_t)addr;
+  assert(ptr[0]==0xe9||(ptr[0]==0x0f&&(ptr[1]&0xf0)==0x80));
+  (void)ptr;
+
+  emit_movimm(target,ARG1_REG);
+  emit_movimm(addr,ARG2_REG);
+  assert(addr>=BASE_ADDR&&addr<(BASE_ADDR+(1<<TARGET_SIZE_2)));
+  //assert((target>=0x80000000&&target<0x80800000)||(target>0xA4000000&&target<0xA4001000));
+//DEBUG >
+#ifdef DEBUG_CYCLE_COUNT
+  emit_readword((int)&last_count,ECX);
+  emit_add(HOST_CCREG,ECX,HOST_CCREG);
+  emit_readword((int)&next_interupt,ECX);
+  emit_writeword(HOST_CCREG,(int)&Count);
+  emit_sub(HOST_CCREG,ECX,HOST_CCREG);
+  emit_writeword(ECX,(int)&last_count);
+#endif
+//DEBUG <
+  emit_jmp_ptr(linker);
+}
+
+static void emit_extjump(int addr, int target)
+{
+  emit_extjump2(addr, target, dyna_linker);
+}
+
+static void emit_extjump_ds(int addr, int target)
+{
+  emit_extjump2(addr, target, dyna_linker_ds);
+}
+
+// put rt_val into rt, potentially making use of rs with value rs_val
+static void emit_movimm_from(u_int rs_val,int rs,u_int rt_val,int rt)
+{
+  int diff=rt_val-rs_val;
+  if(rs_val==rt_val) {
+    if(rs!=rt) emit_mov(rs,rt);
+  }
+  else if(diff==(signed char)diff)
+    emit_addimm(rs,diff,rt);
+  else
+    emit_movimm(rt_val,rt);
+}
+
+// return 1 if above function can do it's job cheaply
+static int is_similar_value(u_int v1,u_int v2)
+{
+  int diff=v2-v1;
+  return diff==(signed char)diff;
+}
+
+static void mov_loadtype_adj(int type,int rs,int rt)
+{
+  switch(type) {
+    case LOADB_STUB:  emit_signextend8(rs,rt); break;
+    case LOADBU_STUB: emit_andimm(rs,0xff,rt); break;
+    case LOADH_STUB:  emit_signextend16(rs,rt); break;
+    case LOADHU_STUB: emit_andimm(rs,0xffff,rt); break;
+    case LOADW_STUB:  if(rs!=rt) emit_mov(rs,rt); break;
+    default: assert(0);
+  }
+}
+
+#include "pcsxmem.h"
+#include "pcsxmem_inline.c"
+
+// r14=mem_[rw]tab[rs>>12]<<1, carry set if it's a handler
+static void emit_memtab_lookup(int tab,int rs)
+{
+  emit_readptr(tab,13);
+  emit_shrimm(rs,12,HOST_TEMPREG);
+  emit_op_rm(0x8b,REX_W,HOST_TEMPREG,13,HOST_TEMPREG,3,0,0);
+  emit_op_rr(0xd1,REX_W,4,HOST_TEMPREG);
+}
+
+static void do_readstub(int n)
+{
+  assem_debug("do_readstub %x\n",start+stubs[n][3]*4);
+  set_jump_target(stubs[n][1],(int)out);
+  int type=stubs[n][0];
+  int i=stubs[n][3];
+  int rs=stubs[n][4];
+  struct regstat *i_regs=host_ptr(stubs[n][5]);
+  u_int reglist=stubs[n][7];
+  signed char *i_regmap=i_regs->regmap;
+  int rt,load;
+  if(itype[i]==C1LS||itype[i]==C2LS||itype[i]==LOADLR) {
+    rt=get_reg(i_regmap,FTEMP);
+  }else{
+    rt=get_reg(i_regmap,rt1[i]);
+  }
+  assert(rs>=0);
+  load=itype[i]==C1LS||itype[i]==C2LS||(rt>=0&&rt1[i]!=0);
+  emit_memtab_lookup((int)&mem_rtab,rs);
+  int jaddr=(int)out;
+  emit_jc(0);
+  if(load) {
+    emit_mov(rs,13);
+    switch(type) {
+      case LOADB_STUB:  emit_op_rm(0x0fbe,0,rt,HOST_TEMPREG,13,0,0,0); break;
+      case LOADBU_STUB: emit_op_rm(0x0fb6,0,rt,HOST_TEMPREG,13,0,0,0); break;
+      case LOADH_STUB:  emit_op_rm(0x0fbf,0,rt,HOST_TEMPREG,13,0,0,0); break;
+      case LOADHU_STUB: emit_op_rm(0x0fb7,0,rt,HOST_TEMPREG,13,0,0,0); break;
+      case LOADW_STUB:  emit_op_rm(0x8b,0,rt,HOST_TEMPREG,13,0,0,0); break;
+    }
+  }
+  emit_jmp(stubs[n][2]); // return address
+
+  set_jump_target(jaddr,(int)out);
+  if(rt>=0&&rt1[i]!=0)
+    reglist&=~(1<<rt);
+  save_regs(reglist);
+  void *handler=NULL;
+  if(type==LOADB_STUB||type==LOADBU_STUB)
+    handler=jump_handler_read8;
+  if(type==LOADH_STUB||type==LOADHU_STUB)
+    handler=jump_handler_read16;
+  if(type==LOADW_STUB)
+    handler=jump_handler_read32;
+  assert(handler!=NULL);
+  if(rs!=ARG1_REG) emit_mov(rs,ARG1_REG);
+  emit_mov64(HOST_TEMPREG,ARG2_REG);
+  int cc=get_reg(i_regmap,CCREG);
+  if(cc<0)
+    emit_loadreg(CCREG,ARG3_REG);
+  emit_addimm(cc<0?ARG3_REG:cc,CLOCK_ADJUST((int)stubs[n][6]+1),ARG3_REG);
+  emit_call_ptr(handler);
+  if(load)
+    mov_loadtype_adj(type,EAX,rt);
+  restore_regs(reglist);
+  emit_jmp(stubs[n][2]); // return address
+}
+
+// return memhandler, or get directly accessable address and return 0
+static uintptr_t get_direct_memhandler(void *table,u_int addr,int type,uintptr_t *addr_host)
+{
+  uintptr_t l1,l2=0;
+  l1=((uintptr_t *)table)[addr>>12];
+  if((l1&((uintptr_t)1<<63))==0) {
+    uintptr_t v=l1<<1;
+    *addr_host=v+addr;
+    return 0;
+  }
+  else {
+    l1<<=1;
+    if(type==LOADB_STUB||type==LOADBU_STUB||type==STOREB_STUB)
+      l2=((uintptr_t *)l1)[0x1000/4 + 0x1000/2 + (addr&0xfff)];
+    else if(type==LOADH_STUB||type==LOADHU_STUB||type==STOREH_STUB)
+      l2=((uintptr_t *)l1)[0x1000/4 + (addr&0xfff)/2];
+    else
+      l2=((uintptr_t *)l1)[(addr&0xfff)/4];
+    if((l2&((uintptr_t)1<<63))==0) {
+      uintptr_t v=l2<<1;
+      *addr_host=v+(addr&0xfff);
+      return 0;
+    }
+    return l2<<1;
+  }
+}
+
+static void inline_readstub(int type, int i, u_int addr, signed char regmap[], int target, int adj, u_int reglist)
+{
+  int rs=get_reg(regmap,target);
+  int rt=get_reg(regmap,target);
+  if(rs<0) rs=get_reg(regmap,-1);
+  assert(rs>=0);
+  uintptr_t handler,host_addr=0;
+  int is_dynamic;
+  int cc=get_reg(regmap,CCREG);
+  if(pcsx_direct_read(type,addr,CLOCK_ADJUST(adj+1),cc,target?rs:-1,rt))
+    return;
+  handler=get_direct_memhandler(mem_rtab,addr,type,&host_addr);
+  if (handler==0) {
+    if(rt<0||rt1[i]==0)
+      return;
+    // may be anywhere in the host address space, not just guest RAM
+    emit_movimm_ptr(host_addr,13);
+    switch(type) {
+      case LOADB_STUB:  emit_op_rm(0x0fbe,0,rt,13,-1,0,0,0); break;
+      case LOADBU_STUB: emit_op_rm(0x0fb6,0,rt,13,-1,0,0,0); break;
+      case LOADH_STUB:  emit_op_rm(0x0fbf,0,rt,13,-1,0,0,0); break;
+      case LOADHU_STUB: emit_op_rm(0x0fb7,0,rt,13,-1,0,0,0); break;
+      case LOADW_STUB:  emit_op_rm(0x8b,0,rt,13,-1,0,0,0); break;
+      default:          assert(0);
+    }
+    return;
+  }
+  is_dynamic=pcsxmem_is_handler_dynamic(addr);
+  if(is_dynamic) {
+    if(type==LOADB_STUB||type==LOADBU_STUB)
+      handler=(uintptr_t)jump_handler_read8;
+    if(type==LOADH_STUB||type==LOADHU_STUB)
+      handler=(uintptr_t)jump_handler_read16;
+    if(type==LOADW_STUB)
+      handler=(uintptr_t)jump_handler_read32;
+  }
+
+  // call a memhandler
+  if(rt>=0&&rt1[i]!=0)
+    reglist&=~(1<<rt);
+  save_regs(reglist);
+  emit_movimm(addr,ARG1_REG);
+  if(cc<0)
+    emit_loadreg(CCREG,ARG3_REG);
+  if(is_dynamic) {
+    emit_movimm_ptr(((uintptr_t *)mem_rtab)[addr>>12]<<1,ARG2_REG);
+    emit_addimm(cc<0?ARG3_REG:cc,CLOCK_ADJUST(adj+1),ARG3_REG);
+  }
+  else {
+    emit_readword((int)&last_count,ARG4_REG);
+    emit_addimm(cc<0?ARG3_REG:cc,CLOCK_ADJUST(adj+1),ARG3_REG);
+    emit_add(ARG3_REG,ARG4_REG,ARG3_REG);
+    emit_writeword(ARG3_REG,(int)&Count);
+  }
+
+  emit_call_ptr((void *)handler);
+
+  if(rt>=0&&rt1[i]!=0) {
+    switch(type) {
+      case LOADB_STUB:  emit_signextend8(EAX,rt); break;
+      case LOADBU_STUB: emit_andimm(EAX,0xff,rt); break;
+      case LOADH_STUB:  emit_signextend16(EAX,rt); break;
+      case LOADHU_STUB: emit_andimm(EAX,0xffff,rt); break;
+      case LOADW_STUB:  if(rt!=EAX) emit_mov(EAX,rt); break;
+      default:          assert(0);
+    }
+  }
+  restore_regs(reglist);
+}
+
+// edi=addr, esi=data, whichever registers they come from
+static void pass_args(int a0, int a1)
+{
+  emit_mov(a1,13);
+  if(a0!=ARG1_REG) emit_mov(a0,ARG1_REG);
+  emit_mov(13,ARG2_REG);
+}
+
+static void do_writestub(int n)
+{
+  assem_debug("do_writestub %x\n",start+stubs[n][3]*4);
+  set_jump_target(stubs[n][1],(int)out);
+  int type=stubs[n][0];
+  int i=stubs[n][3];
+  int rs=stubs[n][4];
+  struct regstat *i_regs=host_ptr(stubs[n][5]);
+  u_int reglist=stubs[n][7];
+  signed char *i_regmap=i_regs->regmap;
+  int rt,r;
+  if(itype[i]==C1LS||itype[i]==C2LS) {
+    rt=get_reg(i_regmap,r=FTEMP);
+  }else{
+    rt=get_reg(i_regmap,r=rs2[i]);
+  }
+  assert(rs>=0);
+  assert(rt>=0);
+  emit_memtab_lookup((int)&mem_wtab,rs);
+  int jaddr=(int)out;
+  emit_jc(0);
+  emit_mov(rs,13);
+  switch(type) {
+    case STOREB_STUB: emit_op_rm(0x88,REX_BYTE,rt,HOST_TEMPREG,13,0,0,0); break;
+    case STOREH_STUB: output_byte(0x66); emit_op_rm(0x89,0,rt,HOST_TEMPREG,13,0,0,0); break;
+    case STOREW_STUB: emit_op_rm(0x89,0,rt,HOST_TEMPREG,13,0,0,0); break;
+    default:          assert(0);
+  }
+  emit_jmp(stubs[n][2]); // return address (invcode check)
+
+  set_jump_target(jaddr,(int)out);
+  save_regs(reglist);
+  void *handler=NULL;
+  switch(type) {
+    case STOREB_STUB: handler=jump_handler_write8; break;
+    case STOREH_STUB: handler=jump_handler_write16; break;
+    case STOREW_STUB: handler=jump_handler_write32; break;
+  }
+  assert(handler!=NULL);
+  pass_args(rs,rt);
+  emit_mov64(HOST_TEMPREG,ARG4_REG);
+  int cc=get_reg(i_regmap,CCREG);
+  if(cc<0)
+    emit_loadreg(CCREG,ARG3_REG);
+  emit_addimm(cc<0?ARG3_REG:cc,CLOCK_ADJUST((int)stubs[n][6]+1),ARG3_REG);
+  // returns new cycle_count
+  emit_call_ptr(handler);
+  emit_addimm(EAX,-CLOCK_ADJUST((int)stubs[n][6]+1),cc<0?ARG3_REG:cc);
+  if(cc<0)
+    emit_storereg(CCREG,ARG3_REG);
+  restore_regs(reglist);
+  emit_jmp(stubs[n][2]); // return address
+}
+
+static void inline_writestub(int type, int i, u_int addr, signed char regmap[], int target, int adj, u_int reglist)
+{
+  int rt=get_reg(regmap,target);
+  assert(rt>=0);
+  uintptr_t handler,host_addr=0;
+  handler=get_direct_memhandler(mem_wtab,addr,type,&host_addr);
+  if (handler==0) {
+    emit_movimm_ptr(host_addr,13);
+    switch(type) {
+      case STOREB_STUB: emit_op_rm(0x88,REX_BYTE,rt,13,-1,0,0,0); break;
+      case STOREH_STUB: output_byte(0x66); emit_op_rm(0x89,0,rt,13,-1,0,0,0); break;
+      case STOREW_STUB: emit_op_rm(0x89,0,rt,13,-1,0,0,0); break;
+      default:          assert(0);
+    }
+    return;
+  }
+
+  // call a memhandler
+  save_regs(reglist);
+  emit_mov(rt,ARG2_REG);
+  emit_movimm(addr,ARG1_REG);
+  int cc=get_reg(regmap,CCREG);
+  if(cc<0)
+    emit_loadreg(CCREG,ARG3_REG);
+  emit_addimm(cc<0?ARG3_REG:cc,CLOCK_ADJUST(adj+1),ARG3_REG);
+  emit_movimm_ptr(handler,ARG4_REG);
+  // returns new cycle_count
+  emit_call_ptr(jump_handler_write_h);
+  emit_addimm(EAX,-CLOCK_ADJUST(adj+1),cc<0?ARG3_REG:cc);
+  if(cc<0)
+    emit_storereg(CCREG,ARG3_REG);
+  restore_regs(reglist);
+}
+
+static void do_unalignedwritestub(int n)
+{
+  assem_debug("do_unalignedwritestub %x\n",start+stubs[n][3]*4);
+  set_jump_target(stubs[n][1],(int)out);
+
+  int i=stubs[n][3];
+  struct regstat *i_regs=host_ptr(stubs[n][4]);
+  int addr=stubs[n][5];
+  u_int reglist=stubs[n][7];
+  signed char *i_regmap=i_regs->regmap;
+  int temp2=get_reg(i_regmap,FTEMP);
+  int rt;
+  rt=get_reg(i_regmap,rs2[i]);
+  assert(rt>=0);
+  assert(addr>=0);
+  assert(opcode[i]==0x2a||opcode[i]==0x2e); // SWL/SWR only implemented
+  reglist|=(1<<addr);
+  reglist&=~(1<<temp2);
+
+  // don't bother with it and call write handler
+  save_regs(reglist);
+  pass_args(addr,rt);
+  int cc=get_reg(i_regmap,CCREG);
+  if(cc<0)
+    emit_loadreg(CCREG,ARG3_REG);
+  emit_addimm(cc<0?ARG3_REG:cc,CLOCK_ADJUST((int)stubs[n][6]+1),ARG3_REG);
+  emit_call_ptr(opcode[i]==0x2a?jump_handle_swl:jump_handle_swr);
+  emit_addimm(EAX,-CLOCK_ADJUST((int)stubs[n][6]+1),cc<0?ARG3_REG:cc);
+  if(cc<0)
+    emit_storereg(CCREG,ARG3_REG);
+  restore_regs(reglist);
+  emit_jmp(stubs[n][2]); // return address
+}
+
+static void do_invstub(int n)
+{
+  u_int reglist=stubs[n][3];
+  set_jump_target(stubs[n][1],(int)out);
+  save_regs(reglist);
+  if(stubs[n][4]!=ARG1_REG) emit_mov(stubs[n][4],ARG1_REG);
+  emit_call_ptr(invalidate_addr);
+  restore_regs(reglist);
+  emit_jmp(stubs[n][2]); // return address
+}
+
+int do_dirty_stub(int i)
+{
+  assem_debug("do_dirty_stub %x\n",start+i*4);
+  // Careful about the code output here, verify_dirty needs to parse it.
+  emit_movimm(start+i*4,ARG1_REG);
+  emit_movimm64((uintptr_t)source,ARG2_REG);
+  emit_movimm64((uintptr_t)copy,ARG3_REG);
+  emit_movimm(slen*4,ARG4_REG);
+  emit_movimm64((uintptr_t)verify_code,13);
+  output_byte(0x41);
+  output_byte(0xff);
+  output_byte(0xd5);
+  int entry=(int)out;
+  load_regs_entry(i);
+  if(entry==(int)out) entry=instr_addr[i];
+  emit_jmp(instr_addr[i]);
+  return entry;
+}
+
+static void do_dirty_stub_ds()
+{
+  // Careful about the code output here, verify_dirty needs to parse it.
+  emit_movimm(start+1,ARG1_REG);
+  emit_movimm64((uintptr_t)source,ARG2_REG);
+  emit_movimm64((uintptr_t)copy,ARG3_REG);
+  emit_movimm(slen*4,ARG4_REG);
+  emit_movimm64((uintptr_t)verify_code_ds,13);
+  output_byte(0x41);
+  output_byte(0xff);
+  output_byte(0xd5);
+}
+
+static void do_cop1stub(int n)
+{
+  assem_debug("do_cop1stub %x\n",start+stubs[n][3]*4);
+  set_jump_target(stubs[n][1],(int)out);
+  int i=stubs[n][3];
+//  int rs=stubs[n][4];
+  struct regstat *i_regs=host_ptr(stubs[n][5]);
+  int ds=stubs[n][6];
+  if(!ds) {
+    load_all_consts(regs[i].regmap_entry,regs[i].was32,regs[i].wasdirty,i);
+    //if(i_regs!=&regs[i]) printf("oops: regs[i]=%x i_regs=%x",(int)&regs[i],(int)i_regs);
+  }
+  //else {printf("fp exception in delay slot\n");}
+  wb_dirtys(i_regs->regmap_entry,i_regs->was32,i_regs->wasdirty);
+  if(regs[i].regmap_entry[HOST_CCREG]!=CCREG) emit_loadreg(CCREG,HOST_CCREG);
+  emit_movimm(start+(i-ds)*4,EAX); // Get PC
+  emit_addimm(HOST_CCREG,CLOCK_ADJUST(ccadj[i]),HOST_CCREG); // CHECK: is this right?  There should probably be an extra cycle...
+  emit_jmp_ptr(ds?fp_exception_ds:fp_exception);
+}
+
+/* Special assem */
+
+static void shift_assemble_x64(int i,struct regstat *i_regs)
+{
+  if(rt1[i]) {
+    if(opcode2[i]<=0x07) // SLLV/SRLV/SRAV
+    {
+      signed char s,t,shift;
+      t=get_reg(i_regs->regmap,rt1[i]);
+      s=get_reg(i_regs->regmap,rs1[i]);
+      shift=get_reg(i_regs->regmap,rs2[i]);
+      if(t>=0){
+        if(rs1[i]==0)
+        {
+          emit_zeroreg(t);
+        }
+        else if(rs2[i]==0)
+        {
+          assert(s>=0);
+          if(s!=t) emit_mov(s,t);
+        }
+        else
+        {
+          // x86 masks the shift amount to 5 bits itself
+          if(opcode2[i]==4) // SLLV
+          {
+            emit_shift_var(4,s,shift,t);
+          }
+          if(opcode2[i]==6) // SRLV
+          {
+            emit_shift_var(5,s,shift,t);
+          }
+          if(opcode2[i]==7) // SRAV
+          {
+            emit_shift_var(7,s,shift,t);
+          }
+        }
+      }
+    } else { // DSLLV/DSRLV/DSRAV
+      assert(0);
+    }
+  }
+}
+
+static void speculate_mov(int rs,int rt)
+{
+  if(rt!=0) {
+    smrv_strong_next|=1<<rt;
+    smrv[rt]=smrv[rs];
+  }
+}
+
+static void speculate_mov_weak(int rs,int rt)
+{
+  if(rt!=0) {
+    smrv_weak_next|=1<<rt;
+    smrv[rt]=smrv[rs];
+  }
+}
+
+static void speculate_register_values(int i)
+{
+  if(i==0) {
+    memcpy(smrv,psxRegs.GPR.r,sizeof(smrv));
+    // gp,sp are likely to stay the same throughout the block
+    smrv_strong_next=(1<<28)|(1<<29)|(1<<30);
+    smrv_weak_next=~smrv_strong_next;
+    //printf(" llr %08x\n", smrv[4]);
+  }
+  smrv_strong=smrv_strong_next;
+  smrv_weak=smrv_weak_next;
+  switch(itype[i]) {
+    case ALU:
+      if     ((smrv_strong>>rs1[i])&1) speculate_mov(rs1[i],rt1[i]);
+      else if((smrv_strong>>rs2[i])&1) speculate_mov(rs2[i],rt1[i]);
+      else if((smrv_weak>>rs1[i])&1) speculate_mov_weak(rs1[i],rt1[i]);
+      else if((smrv_weak>>rs2[i])&1) speculate_mov_weak(rs2[i],rt1[i]);
+      else {
+        smrv_strong_next&=~(1<<rt1[i]);
+        smrv_weak_next&=~(1<<rt1[i]);
+      }
+      break;
+    case SHIFTIMM:
+      smrv_strong_next&=~(1<<rt1[i]);
+      smrv_weak_next&=~(1<<rt1[i]);
+      // fallthrough
+    case IMM16:
+      if(rt1[i]&&is_const(&regs[i],rt1[i])) {
+        int value,hr=get_reg(regs[i].regmap,rt1[i]);
+        if(hr>=0) {
+          if(get_final_value(hr,i,&value))
+               smrv[rt1[i]]=value;
+          else smrv[rt1[i]]=constmap[i][hr];
+          smrv_strong_next|=1<<rt1[i];
+        }
+      }
+      else {
+        if     ((smrv_strong>>rs1[i])&1) speculate_mov(rs1[i],rt1[i]);
+        else if((smrv_weak>>rs1[i])&1) speculate_mov_weak(rs1[i],rt1[i]);
+      }
+      break;
+    case LOAD:
+      if(start<0x2000&&(rt1[i]==26||(smrv[rt1[i]]>>24)==0xa0)) {
+        // special case for BIOS
+        smrv[rt1[i]]=0xa0000000;
+        smrv_strong_next|=1<<rt1[i];
+        break;
+      }
+      // fallthrough
+    case SHIFT:
+    case LOADLR:
+    case MOV:
+      smrv_strong_next&=~(1<<rt1[i]);
+      smrv_weak_next&=~(1<<rt1[i]);
+      break;
+    case COP0:
+    case COP2:
+      if(opcode2[i]==0||opcode2[i]==2) { // MFC/CFC
+        smrv_strong_next&=~(1<<rt1[i]);
+        smrv_weak_next&=~(1<<rt1[i]);
+      }
+      break;
+    case C2LS:
+      if (opcode[i]==0x32) { // LWC2
+        smrv_strong_next&=~(1<<rt1[i]);
+        smrv_weak_next&=~(1<<rt1[i]);
+      }
+      break;
+  }
+}
+
+enum {
+  MTYPE_8000 = 0,
+  MTYPE_8020,
+  MTYPE_0000,
+  MTYPE_A000,
+  MTYPE_1F80,
+};
+
+static int get_ptr_mem_type(u_int a)
+{
+  if(a < 0x00200000) {
+    if(a<0x1000&&((start>>20)==0xbfc||(start>>24)==0xa0))
+      // return wrong, must use memhandler for BIOS self-test to pass
+      // 007 does similar stuff from a00 mirror, weird stuff
+      return MTYPE_8000;
+    return MTYPE_0000;
+  }
+  if(0x1f800000 <= a && a < 0x1f801000)
+    return MTYPE_1F80;
+  if(0x80200000 <= a && a < 0x80800000)
+    return MTYPE_8020;
+  if(0xa0000000 <= a && a < 0xa0200000)
+    return MTYPE_A000;
+  return MTYPE_8000;
+}
+
+static int emit_fastpath_cmp_jump(int i,int addr,int *addr_reg_override)
+{
+  int jaddr=0,type=0;
+  int mr=rs1[i];
+  if(((smrv_strong|smrv_weak)>>mr)&1) {
+    type=get_ptr_mem_type(smrv[mr]);
+    //printf("set %08x @%08x r%d %d\n", smrv[mr], start+i*4, mr, type);
+  }
+  else {
+    // use the mirror we are running on
+    type=get_ptr_mem_type(start);
+    //printf("set nospec   @%08x r%d %d\n", start+i*4, mr, type);
+  }
+
+  if(type==MTYPE_8020) { // RAM 80200000+ mirror
+    emit_andimm(addr,~0x00e00000,HOST_TEMPREG);
+    addr=*addr_reg_override=HOST_TEMPREG;
+    type=0;
+  }
+  else if(type==MTYPE_0000) { // RAM 0 mirror
+    emit_orimm(addr,0x80000000,HOST_TEMPREG);
+    addr=*addr_reg_override=HOST_TEMPREG;
+    type=0;
+  }
+  else if(type==MTYPE_A000) { // RAM A mirror
+    emit_andimm(addr,~0x20000000,HOST_TEMPREG);
+    addr=*addr_reg_override=HOST_TEMPREG;
+    type=0;
+  }
+  else if(type==MTYPE_1F80) { // scratchpad
+    if (psxH == (void *)0x1f800000) {
+      emit_addimm(addr,-0x1f800000,HOST_TEMPREG);
+      emit_cmpimm(HOST_TEMPREG,0x1000);
+      jaddr=(int)out;
+      emit_jae(0);
+    }
+    else {
+      // do usual RAM check, jump will go to the right handler
+      type=0;
+    }
+  }
+
+  if(type==0)
+  {
+    emit_cmpimm(addr,RAM_SIZE);
+    jaddr=(int)out;
+    emit_jno(0);
+    if(ram_offset!=0) {
+      emit_addimm(addr,ram_offset,HOST_TEMPREG);
+      addr=*addr_reg_override=HOST_TEMPREG;
+    }
+  }
+
+  return jaddr;
+}
+
+#define shift_assemble shift_assemble_x64
+
+static void loadlr_assemble_x64(int i,struct regstat *i_regs)
+{
+  int s,tl,temp,temp2,addr,map=-1;
+  int offset;
+  int jaddr=0;
+  int memtarget=0,c=0;
+  int fastload_reg_override=0;
+  u_int hr,reglist=0;
+  tl=get_reg(i_regs->regmap,rt1[i]);
+  s=get_reg(i_regs->regmap,rs1[i]);
+  temp=get_reg(i_regs->regmap,-1);
+  temp2=get_reg(i_regs->regmap,FTEMP);
+  addr=get_reg(i_regs->regmap,AGEN1+(i&1));
+  assert(addr<0);
+  assert(opcode[i]==0x22||opcode[i]==0x26); // LWL/LWR only, no LDL/LDR on the R3000
+  offset=imm[i];
+  for(hr=0;hr<HOST_REGS;hr++) {
+    if(i_regs->regmap[hr]>=0) reglist|=1<<hr;
+  }
+  reglist|=1<<temp;
+  if(offset||s<0||c) addr=temp2;
+  else addr=s;
+  if(s>=0) {
+    c=(i_regs->wasconst>>s)&1;
+    if(c) {
+      memtarget=((signed int)(constmap[i][s]+offset))<(signed int)0x80000000+RAM_SIZE;
+    }
+  }
+  if(!c) {
+    emit_shlimm(addr,3,temp);
+    emit_andimm(addr,0xFFFFFFFC,temp2);
+    jaddr=emit_fastpath_cmp_jump(i,temp2,&fastload_reg_override);
+  }
+  else {
+    if(ram_offset&&memtarget) {
+      emit_addimm(temp2,ram_offset,HOST_TEMPREG);
+      fastload_reg_override=HOST_TEMPREG;
+    }
+    emit_movimm(((constmap[i][s]+offset)<<3)&24,temp);
+  }
+  if(!c||memtarget) {
+    int a=temp2;
+    if(fastload_reg_override) a=fastload_reg_override;
+    emit_readword_indexed_tlb(0,a,map,temp2);
+    if(jaddr) add_stub(LOADW_STUB,jaddr,(int)out,i,temp2,(int)i_regs,ccadj[i],reglist);
+  }
+  else
+    inline_readstub(LOADW_STUB,i,(constmap[i][s]+offset)&0xFFFFFFFC,i_regs->regmap,FTEMP,ccadj[i],reglist);
+  if(rt1[i]) {
+    assert(tl>=0);
+    emit_andimm(temp,24,temp);
+    if (opcode[i]==0x22) // LWL
+      emit_xorimm(temp,24,temp);
+    emit_movimm(-1,HOST_TEMPREG);
+    if (opcode[i]==0x26) { // LWR
+      emit_shift_var(5,temp2,temp,temp2);
+      emit_shift_var(5,HOST_TEMPREG,temp,HOST_TEMPREG);
+    }else{
+      emit_shift_var(4,temp2,temp,temp2);
+      emit_shift_var(4,HOST_TEMPREG,temp,HOST_TEMPREG);
+    }
+    emit_not(HOST_TEMPREG,HOST_TEMPREG);
+    emit_and(tl,HOST_TEMPREG,tl);
+    emit_or(temp2,tl,tl);
+  }
+  //emit_storereg(rt1[i],tl); // DEBUG
+}
+#define loadlr_assemble loadlr_assemble_x64
+
+static void cop0_assemble(int i,struct regstat *i_regs)
+{
+  if(opcode2[i]==0) // MFC0
+  {
+    signed char t=get_reg(i_regs->regmap,rt1[i]);
+    char copr=(source[i]>>11)&0x1f;
+    //assert(t>=0); // Why does this happen?  OOT is weird
+    if(t>=0&&rt1[i]!=0) {
+      emit_readword((int)&reg_cop0+copr*4,t);
+    }
+  }
+  else if(opcode2[i]==4) // MTC0
+  {
+    signed char s=get_reg(i_regs->regmap,rs1[i]);
+    char copr=(source[i]>>11)&0x1f;
+    assert(s>=0);
+    wb_register(rs1[i],i_regs->regmap,i_regs->dirty,i_regs->is32);
+    if(copr==9||copr==11||copr==12||copr==13) {
+      emit_readword((int)&last_count,HOST_TEMPREG);
+      emit_loadreg(CCREG,HOST_CCREG); // TODO: do proper reg alloc
+      emit_add(HOST_CCREG,HOST_TEMPREG,HOST_CCREG);
+      emit_addimm(HOST_CCREG,CLOCK_ADJUST(ccadj[i]),HOST_CCREG);
+      emit_writeword(HOST_CCREG,(int)&Count);
+    }
+    // What a mess.  The status register (12) can enable interrupts,
+    // so needs a special case to handle a pending interrupt.
+    // The interrupt must be taken immediately, because a subsequent
+    // instruction might disable interrupts again.
+    if(copr==12||copr==13) {
+      if (is_delayslot) {
+        // burn cycles to cause cc_interrupt, which will
+        // reschedule next_interupt. Relies on CCREG from above.
+        assem_debug("MTC0 DS %d\n", copr);
+        emit_writeword(HOST_CCREG,(int)&last_count);
+        emit_movimm(0,HOST_CCREG);
+        emit_storereg(CCREG,HOST_CCREG);
+        emit_loadreg(rs1[i],ARG2_REG);
+        emit_movimm(copr,ARG1_REG);
+        emit_call((int)pcsx_mtc0_ds);
+        emit_loadreg(rs1[i],s);
+        return;
+      }
+      emit_movimm(start+i*4+4,HOST_TEMPREG);
+      emit_writeword(HOST_TEMPREG,(int)&pcaddr);
+      emit_movimm(0,HOST_TEMPREG);
+      emit_writeword(HOST_TEMPREG,(int)&pending_exception);
+    }
+    if(s==HOST_CCREG)
+      emit_loadreg(rs1[i],ARG2_REG);
+    else if(s!=ARG2_REG)
+      emit_mov(s,ARG2_REG);
+    emit_movimm(copr,ARG1_REG);
+    emit_call((int)pcsx_mtc0);
+    if(copr==9||copr==11||copr==12||copr==13) {
+      emit_readword((int)&Count,HOST_CCREG);
+      emit_readword((int)&next_interupt,HOST_TEMPREG);
+      emit_addimm(HOST_CCREG,-CLOCK_ADJUST(ccadj[i]),HOST_CCREG);
+      emit_sub(HOST_CCREG,HOST_TEMPREG,HOST_CCREG);
+      emit_writeword(HOST_TEMPREG,(int)&last_count);
+      emit_storereg(CCREG,HOST_CCREG);
+    }
+    if(copr==12||copr==13) {
+      assert(!is_delayslot);
+      emit_readword((int)&pending_exception,HOST_TEMPREG);
+      emit_test(HOST_TEMPREG,HOST_TEMPREG);
+      emit_jne((int)&do_interrupt);
+    }
+    emit_loadreg(rs1[i],s);
+    if(get_reg(i_regs->regmap,rs1[i]|64)>=0)
+      emit_loadreg(rs1[i]|64,get_reg(i_regs->regmap,rs1[i]|64));
+    cop1_usable=0;
+  }
+  else
+  {
+    assert(opcode2[i]==0x10);
+    if((source[i]&0x3f)==0x10) // RFE
+    {
+      emit_readword((int)&Status,EAX);
+      emit_andimm(EAX,0x3c,ECX);
+      emit_andimm(EAX,~0xf,EAX);
+      emit_shrimm(ECX,2,ECX);
+      emit_or(ECX,EAX,EAX);
+      emit_writeword(EAX,(int)&Status);
+    }
+  }
+}
+
+static void cop2_get_dreg(u_int copr,signed char tl,signed char temp)
+{
+  int r;
+  switch (copr) {
+    case 1:
+    case 3:
+    case 5:
+    case 8:
+    case 9:
+    case 10:
+    case 11:
+      emit_readword((int)&reg_cop2d[copr],tl);
+      emit_signextend16(tl,tl);
+      emit_writeword(tl,(int)&reg_cop2d[copr]); // hmh
+      break;
+    case 7:
+    case 16:
+    case 17:
+    case 18:
+    case 19:
+      emit_readword((int)&reg_cop2d[copr],tl);
+      emit_andimm(tl,0xffff,tl);
+      emit_writeword(tl,(int)&reg_cop2d[copr]);
+      break;
+    case 15:
+      emit_readword((int)&reg_cop2d[14],tl); // SXY2
+      emit_writeword(tl,(int)&reg_cop2d[copr]);
+      break;
+    case 28:
+    case 29:
+      // IR1-3 >> 7, saturated to 0..0x1f like gte.c does
+      for(r=0;r<3;r++) {
+        emit_readword((int)&reg_cop2d[9+r],temp);
+        emit_signextend16(temp,temp);
+        emit_sarimm(temp,7,temp);
+        emit_cmpimm(temp,0);
+        emit_cmovl_imm(0,temp);
+        emit_cmpimm(temp,0x1f);
+        emit_cmov_imm(CC_G,0x1f,temp);
+        if(r==0)
+          emit_mov(temp,tl);
+        else {
+          emit_shlimm(temp,5*r,temp);
+          emit_or(temp,tl,tl);
+        }
+      }
+      emit_writeword(tl,(int)&reg_cop2d[copr]);
+      break;
+    default:
+      emit_readword((int)&reg_cop2d[copr],tl);
+      break;
+  }
+}
+
+static void cop2_put_dreg(u_int copr,signed char sl,signed char temp)
+{
+  switch (copr) {
+    case 15:
+      emit_readword((int)&reg_cop2d[13],temp);  // SXY1
+      emit_writeword(sl,(int)&reg_cop2d[copr]);
+      emit_writeword(temp,(int)&reg_cop2d[12]); // SXY0
+      emit_readword((int)&reg_cop2d[14],temp);  // SXY2
+      emit_writeword(sl,(int)&reg_cop2d[14]);
+      emit_writeword(temp,(int)&reg_cop2d[13]); // SXY1
+      break;
+    case 28:
+      emit_andimm(sl,0x001f,temp);
+      emit_shlimm(temp,7,temp);
+      emit_writeword(temp,(int)&reg_cop2d[9]);
+      emit_andimm(sl,0x03e0,temp);
+      emit_shlimm(temp,2,temp);
+      emit_writeword(temp,(int)&reg_cop2d[10]);
+      emit_andimm(sl,0x7c00,temp);
+      emit_shrimm(temp,3,temp);
+      emit_writeword(temp,(int)&reg_cop2d[11]);
+      emit_writeword(sl,(int)&reg_cop2d[28]);
+      break;
+    case 30:
+      // leading zeros, or ones if negative
+      emit_mov(sl,temp);
+      emit_not(sl,13);
+      emit_test(sl,sl);
+      emit_cmovs_reg(13,temp);
+      emit_movimm(-1,13);
+      assem_debug("bsr %s,%s\n",regname[temp],regname[temp]);
+      emit_op_rr(0x0fbd,0,temp,temp);
+      emit_cmove_reg(13,temp);
+      emit_neg(temp,temp);
+      emit_addimm(temp,31,temp);
+      emit_writeword(sl,(int)&reg_cop2d[30]);
+      emit_writeword(temp,(int)&reg_cop2d[31]);
+      break;
+    case 31:
+      break;
+    default:
+      emit_writeword(sl,(int)&reg_cop2d[copr]);
+      break;
+  }
+}
+
+static void cop2_assemble(int i,struct regstat *i_regs)
+{
+  u_int copr=(source[i]>>11)&0x1f;
+  signed char temp=get_reg(i_regs->regmap,-1);
+  if (opcode2[i]==0) { // MFC2
+    signed char tl=get_reg(i_regs->regmap,rt1[i]);
+    if(tl>=0&&rt1[i]!=0)
+      cop2_get_dreg(copr,tl,temp);
+  }
+  else if (opcode2[i]==4) { // MTC2
+    signed char sl=get_reg(i_regs->regmap,rs1[i]);
+    cop2_put_dreg(copr,sl,temp);
+  }
+  else if (opcode2[i]==2) // CFC2
+  {
+    signed char tl=get_reg(i_regs->regmap,rt1[i]);
+    if(tl>=0&&rt1[i]!=0)
+      emit_readword((int)&reg_cop2c[copr],tl);
+  }
+  else if (opcode2[i]==6) // CTC2
+  {
+    signed char sl=get_reg(i_regs->regmap,rs1[i]);
+    switch(copr) {
+      case 4:
+      case 12:
+      case 20:
+      case 26:
+      case 27:
+      case 29:
+      case 30:
+        emit_signextend16(sl,temp);
+        break;
+      case 31:
+        //value = value & 0x7ffff000;
+        //if (value & 0x7f87e000) value |= 0x80000000;
+        emit_andimm(sl,0x7ffff000,temp);
+        emit_orimm(temp,0x80000000,13);
+        emit_testimm(temp,0x7f87e000);
+        emit_cmovne_reg(13,temp);
+        break;
+      default:
+        temp=sl;
+        break;
+    }
+    emit_writeword(temp,(int)&reg_cop2c[copr]);
+    assert(sl>=0);
+  }
+}
+
+static void c2op_assemble(int i,struct regstat *i_regs)
+{
+  u_int c2op=source[i]&0x3f;
+  u_int hr,reglist=0;
+  int need_flags;
+  for(hr=0;hr<HOST_REGS;hr++) {
+    if(i_regs->regmap[hr]>=0) reglist|=1<<hr;
+  }
+
+  if (gte_handlers[c2op]!=NULL) {
+    need_flags=!(gte_unneeded[i+1]>>63); // +1 because of how liveness detection works
+    assem_debug("gte op %08x, unneeded %016llx, need_flags %d\n",
+      source[i],gte_unneeded[i+1],need_flags);
+    if(new_dynarec_hacks&NDHACK_GTE_NO_FLAGS)
+      need_flags=0;
+    // no hand-written parts here, the C handlers take
+    // the operation from psxRegs.code
+    save_regs(reglist);
+    emit_movimm(source[i],ARG2_REG);
+    emit_writeword(ARG2_REG,(int)&psxRegs.code);
+    emit_addimm64(FP,(int)&psxRegs.CP2D.r[0]-(int)&dynarec_local,ARG1_REG); // cop2 regs
+    emit_call_ptr(need_flags?gte_handlers[c2op]:gte_handlers_nf[c2op]);
+    restore_regs(reglist);
+  }
+}
+
+static void cop1_unusable(int i,struct regstat *i_regs)
+{
+  // XXX: should just just do the exception instead
+  if(!cop1_usable) {
+    int jaddr=(int)out;
+    emit_jmp(0);
+    add_stub(FP_STUB,jaddr,(int)out,i,0,(int)i_regs,is_delayslot,0);
+    cop1_usable=1;
+  }
+}
+
+static void cop1_assemble(int i,struct regstat *i_regs)
+{
+  cop1_unusable(i, i_regs);
+}
+
+static void fconv_assemble_x64(int i,struct regstat *i_regs)
+{
+  cop1_unusable(i, i_regs);
+}
+#define fconv_assemble fconv_assemble_x64
+
+static void fcomp_assemble(int i,struct regstat *i_regs)
+{
+  cop1_unusable(i, i_regs);
+}
+
+static void float_assemble(int i,struct regstat *i_regs)
+{
+  cop1_unusable(i, i_regs);
+}
+
+static void multdiv_assemble_x64(int i,struct regstat *i_regs)
+{
+  //  case 0x18: MULT
+  //  case 0x19: MULTU
+  //  case 0x1A: DIV
+  //  case 0x1B: DIVU
+  //  case 0x1C: DMULT
+  //  case 0x1D: DMULTU
+  //  case 0x1E: DDIV
+  //  case 0x1F: DDIVU
+  if(rs1[i]&&rs2[i])
+  {
+    if((opcode2[i]&4)==0) // 32-bit
+    {
+      signed char m1=get_reg(i_regs->regmap,rs1[i]);
+      signed char m2=get_reg(i_regs->regmap,rs2[i]);
+      signed char hi=get_reg(i_regs->regmap,HIREG);
+      signed char lo=get_reg(i_regs->regmap,LOREG);
+      assert(m1>=0);
+      assert(m2>=0);
+      assert(hi>=0);
+      assert(lo>=0);
+      // r14 ends up with lo, r13 with hi
+      if(opcode2[i]==0x18||opcode2[i]==0x19) // MULT/MULTU
+      {
+        if(opcode2[i]==0x18) {
+          emit_op_rr(0x63,REX_W,13,m1); // movslq
+          emit_op_rr(0x63,REX_W,HOST_TEMPREG,m2);
+        }
+        else {
+          emit_mov(m1,13);
+          emit_mov(m2,HOST_TEMPREG);
+        }
+        assem_debug("imul %%r14,%%r13\n");
+        emit_op_rr(0x0faf,REX_W,HOST_TEMPREG,13);
+        emit_mov64(HOST_TEMPREG,13);
+        emit_op_rr(0xc1,REX_W,5,13); // shr $32,%r13
+        output_byte(32);
+      }
+      else // DIV/DIVU
+      {
+        u_char *jaddr,*jaddr2;
+        if(opcode2[i]==0x1A) { // DIV
+          emit_op_rr(0x63,REX_W,HOST_TEMPREG,m1);
+          emit_op_rr(0x63,REX_W,13,m2);
+        }
+        else {
+          emit_mov(m1,HOST_TEMPREG);
+          emit_mov(m2,13);
+        }
+        emit_test(13,13);
+        jaddr=out;
+        output_byte(0x74); // je, division by zero
+        output_byte(0);
+        output_byte(0x50); // push %rax
+        output_byte(0x52); // push %rdx
+        if(opcode2[i]==0x1A) {
+          // 64-bit, 0x80000000/-1 doesn't trap
+          emit_mov64(HOST_TEMPREG,EAX);
+          assem_debug("cqo\n");
+          output_byte(0x48);
+          output_byte(0x99);
+          assem_debug("idiv %%r13\n");
+          emit_op_rr(0xf7,REX_W,7,13);
+        }
+        else {
+          emit_mov(HOST_TEMPREG,EAX);
+          emit_zeroreg(EDX);
+          assem_debug("div %%r13d\n");
+          emit_op_rr(0xf7,0,6,13);
+        }
+        emit_mov(EAX,HOST_TEMPREG);
+        emit_mov(EDX,13);
+        output_byte(0x5a); // pop %rdx
+        output_byte(0x58); // pop %rax
+        jaddr2=out;
+        output_byte(0xeb);
+        output_byte(0);
+        jaddr[1]=out-jaddr-2;
+        // MIPS doesn't trap, lo=(d1<0)?1:-1 (or -1 unsigned), hi=d1
+        emit_mov(HOST_TEMPREG,13);
+        if(opcode2[i]==0x1A) {
+          emit_sarimm(HOST_TEMPREG,31,HOST_TEMPREG);
+          emit_orimm(HOST_TEMPREG,1,HOST_TEMPREG);
+          emit_neg(HOST_TEMPREG,HOST_TEMPREG);
+        }
+        else
+          emit_movimm(-1,HOST_TEMPREG);
+        jaddr2[1]=out-jaddr2-2;
+      }
+      emit_mov(HOST_TEMPREG,lo);
+      emit_mov(13,hi);
+    }
+    else // 64-bit
+      assert(0);
+  }
+  else
+  {
+    // Multiply by zero is zero.
+    // MIPS does not have a divide by zero exception.
+    // The result is undefined, we return zero.
+    signed char hr=get_reg(i_regs->regmap,HIREG);
+    signed char lr=get_reg(i_regs->regmap,LOREG);
+    if(hr>=0) emit_zeroreg(hr);
+    if(lr>=0) emit_zeroreg(lr);
+  }
+}
+#define multdiv_assemble multdiv_assemble_x64
+
+static void wb_valid(signed char pre[],signed char entry[],u_int dirty_pre,u_int dirty,uint64_t is32_pre,uint64_t u,uint64_t uu)
+{
+  //if(dirty_pre==dirty) return;
+  int hr,reg;
+  for(hr=0;hr<HOST_REGS;hr++) {
+    if(hr!=EXCLUDE_REG) {
+      reg=pre[hr];
+      if(((~u)>>(reg&63))&1) {
+        if(reg>0) {
+          if(((dirty_pre&~dirty)>>hr)&1) {
+            if(reg>0&&reg<34) {
+              emit_storereg(reg,hr);
+              if( ((is32_pre&~uu)>>reg)&1 ) {
+                emit_sarimm(hr,31,HOST_TEMPREG);
+                emit_storereg(reg|64,HOST_TEMPREG);
+              }
+            }
+            else if(reg>=64) {
+              emit_storereg(reg,hr);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// The recompiler keeps the cache addresses in 32-bit variables,
+// so the cache goes below 2GB. It also must not alias this module's
+// addresses truncated to 32 bits, see host_ptr().
+static char *tc_mmap(void)
+{
+  uintptr_t hint;
+  for(hint=0x20000000;hint<0x70000000;hint+=1<<TARGET_SIZE_2) {
+    // keep 256MB (modulo 4GB) between it and dynarec_local
+    u_int dist=(u_int)hint-(u_int)(uintptr_t)&dynarec_local;
+    if(dist-0x10000000u>0u-0x20000000u-(1u<<TARGET_SIZE_2))
+      continue;
+    void *p=mmap((void *)hint,1<<TARGET_SIZE_2,
+                 PROT_READ|PROT_WRITE|PROT_EXEC,
+                 MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+    if(p==(void *)hint)
+      return p;
+    if(p!=MAP_FAILED)
+      munmap(p,1<<TARGET_SIZE_2);
+  }
+  SysPrintf("failed to map the translation cache below 2GB\n");
+  abort();
+}
+
+// CPU-architecture-specific initialization
+static void arch_init() {
+  jump_vaddr_reg[0]=(u_int)(uintptr_t)jump_vaddr_eax;
+  jump_vaddr_reg[1]=(u_int)(uintptr_t)jump_vaddr_ecx;
+  jump_vaddr_reg[2]=(u_int)(uintptr_t)jump_vaddr_edx;
+  jump_vaddr_reg[3]=(u_int)(uintptr_t)jump_vaddr_ebx;
+  jump_vaddr_reg[5]=(u_int)(uintptr_t)jump_vaddr_ebp;
+  jump_vaddr_reg[6]=(u_int)(uintptr_t)jump_vaddr_esi;
+  jump_vaddr_reg[7]=(u_int)(uintptr_t)jump_vaddr_edi;
+  jump_vaddr_reg[8]=(u_int)(uintptr_t)jump_vaddr_r8;
+  jump_vaddr_reg[9]=(u_int)(uintptr_t)jump_vaddr_r9;
+  jump_vaddr_reg[10]=(u_int)(uintptr_t)jump_vaddr_r10;
+  jump_vaddr_reg[11]=(u_int)(uintptr_t)jump_vaddr_r11;
+  jump_vaddr_reg[12]=(u_int)(uintptr_t)jump_vaddr_r12;
+}
+
+// vim:shiftwidth=2:expandtab
@@ -0,0 +1,45 @@
+#define HOST_REGS 13
+#define HOST_CCREG 5
+#define HOST_BTREG 3
+#define EXCLUDE_REG 4
+
+//#define IMM_PREFETCH 1
+#define INVERTED_CARRY 1
+#define RAM_SIZE 0x200000
+
+#define REG_SHIFT 2
+
+/* x86-64 calling convention (System V):
+   caller-save: rax, rcx, rdx, rsi, rdi, r8-r11
+   callee-save: rbx, rbp, r12-r15 */
+
+#define EDX 2
+
+#define ARG1_REG 7 /* rdi */
+#define ARG2_REG 6 /* rsi */
+#define ARG3_REG 2 /* rdx */
+#define ARG4_REG 1 /* rcx */
+
+/* Host registers used by the recompiler:
+   rbp = cycle count
+   rbx = branch target
+   r12 = PTEMP/FTEMP
+   r13 = scratch for the code emitter, never allocated
+   r14 = HOST_TEMPREG
+   r15 = FP, &dynarec_local */
+
+#define FP 15
+#define HOST_TEMPREG 14
+
+// Note: FP is set to &dynarec_local when executing generated code.
+// Thus the local variables are actually global and not on the stack.
+
+extern char *invc_ptr;
+
+#define TARGET_SIZE_2 24 // 2^24 = 16 megabytes
+
+// Code generator target address
+// Generated code and the recompiler keep host addresses of the cache
+// in 32-bit variables, so it has to be mapped below 2GB (see tc_mmap()).
+extern char *translation_cache;
+#define BASE_ADDR (u_int)(uintptr_t)translation_cache
@@ -28,61 +28,9 @@ char invalid_code[0x100000];
 static u32 scratch_buf[8*8*2] __attribute__((aligned(64)));
 u32 event_cycles[PSXINT_COUNT];
 
-static void schedule_timeslice(void)
-{
-	u32 i, c = psxRegs.cycle;
-	u32 irqs = psxRegs.interrupt;
-	s32 min, dif;
-
-	min = PSXCLK;
-	for (i = 0; irqs != 0; i++, irqs >>= 1) {
-		if (!(irqs & 1))
-			continue;
-		dif = event_cycles[i] - c;
-		//evprintf("  ev %d\n", dif);
-		if (0 < dif && dif < min)
-			min = dif;
-	}
-	next_interupt = c + min;
-}
-
-typedef void (irq_func)();
-
-static irq_func * const irq_funcs[] = {
-	[PSXINT_SIO]	= sioInterrupt,
-	[PSXINT_CDR]	= cdrInterrupt,
-	[PSXINT_CDREAD]	= cdrReadInterrupt,
-	[PSXINT_GPUDMA]	= gpuInterrupt,
-	[PSXINT_MDECOUTDMA] = mdec1Interrupt,
-	[PSXINT_SPUDMA]	= spuInterrupt,
-	[PSXINT_MDECINDMA] = mdec0Interrupt,
-	[PSXINT_GPUOTCDMA] = gpuotcInterrupt,
-	[PSXINT_CDRDMA] = cdrDmaInterrupt,
-	[PSXINT_CDRLID] = cdrLidSeekInterrupt,
-	[PSXINT_CDRPLAY] = cdrPlayInterrupt,
-	[PSXINT_SPU_UPDATE] = spuUpdate,
-	[PSXINT_RCNT] = psxRcntUpdate,
-};
-
-/* local dupe of psxBranchTest, using event_cycles */
 static void irq_test(void)
 {
-	u32 irqs = psxRegs.interrupt;
-	u32 cycle = psxRegs.cycle;
-	u32 irq, irq_bits;
-
-	// irq_funcs() may queue more irqs
-	psxRegs.interrupt = 0;
-
-	for (irq = 0, irq_bits = irqs; irq_bits != 0; irq++, irq_bits >>= 1) {
-		if (!(irq_bits & 1))
-			continue;
-		if ((s32)(cycle - event_cycles[irq]) >= 0) {
-			irqs &= ~(1 << irq);
-			irq_funcs[irq]();
-		}
-	}
-	psxRegs.interrupt |= irqs;
+	psxEventsRun();
 
 	if ((psxHu32(0x1070) & psxHu32(0x1074)) && (Status & 0x401) == 0x401) {
 		psxException(0x400, 0);
@@ -98,8 +46,6 @@ void gen_interupt()
 	//psxBranchTest();
 	//pending_exception = 1;
 
-	schedule_timeslice();
-
 	evprintf("  -ge %08x, %u->%u (%d)\n", psxRegs.pc, psxRegs.cycle,
 		next_interupt, next_interupt - psxRegs.cycle);
 }
@@ -143,6 +89,7 @@ static void new_dyna_restore(void)
 	event_cycles[PSXINT_RCNT] = psxNextsCounter + psxNextCounter;
 	psxRegs.interrupt |=  1 << PSXINT_RCNT;
 	psxRegs.interrupt &= (1 << PSXINT_COUNT) - 1;
+	psxEventsSchedule();
 
 	new_dyna_pcsx_mem_load_state();
 }
@@ -310,6 +257,9 @@ static int ari64_init()
 
 	new_dynarec_init();
 	new_dyna_pcsx_mem_init();
+#ifdef DRC_DISABLE
+	SysPrintf("dynarec is not available on this host, using interpreter\n");
+#endif
 
 	for (i = 0; i < ARRAY_SIZE(gte_handlers); i++)
 		if (psxCP2[i] != psxNULL)
@@ -339,6 +289,10 @@ static int ari64_init()
 	SysPrintf("%08x/%08x/%08x/%08x/%08x\n",
 		psxM, psxH, psxR, mem_rtab, out);
 
+#ifdef DRC_DISABLE
+	// the interpreter runs in our place, let it manage its caches
+	return psxInt.Init();
+#endif
 	return 0;
 }
 
@@ -349,13 +303,16 @@ static void ari64_reset()
 	invalidate_all_pages();
 	new_dyna_restore();
 	pending_exception = 1;
+#ifdef DRC_DISABLE
+	psxInt.Reset();
+#endif
 }
 
 // execute until predefined leave points
 // (HLE softcall exit and BIOS fastboot end)
 static void ari64_execute_until()
 {
-	schedule_timeslice();
+	psxEventsSchedule();
 
 	evprintf("ari64_execute %08x, %u->%u (%d)\n", psxRegs.pc,
 		psxRegs.cycle, next_interupt, next_interupt - psxRegs.cycle);
@@ -378,6 +335,10 @@ static void ari64_clear(u32 addr, u32 size)
 {
 	u32 start, end, main_ram;
 
+#ifdef DRC_DISABLE
+	psxInt.Clear(addr, size);
+	return;
+#endif
 	size *= 4; /* PCSX uses DMA units (words) */
 
 	evprintf("ari64_clear %08x %04x\n", addr, size);
@@ -397,6 +358,9 @@ static void ari64_shutdown()
 {
 	new_dynarec_cleanup();
 	new_dyna_pcsx_mem_shutdown();
+#ifdef DRC_DISABLE
+	psxInt.Shutdown();
+#endif
 }
 
 extern void intExecute();
@@ -137,7 +137,9 @@ struct ll_entry
   static int linkcount;
   static u_int stubs[MAXBLOCK*3][8];
   static int stubcount;
+#ifdef __arm__
   static u_int literals[1024][2];
+#endif
   static int literalcount;
   static int is_delayslot;
   static int cop1_usable;
@@ -387,6 +389,7 @@ void *get_addr(u_int vaddr)
       if(verify_dirty(head->addr)) {
         //printf("restore candidate: %x (%d) d=%d\n",vaddr,page,invalid_code[vaddr>>12]);
         invalid_code[vaddr>>12]=0;
+        if(get_page(vaddr)<(RAM_SIZE>>12)) psxMemMarkCode(vaddr);
         inv_code_start=inv_code_end=~0;
         if(vpage<2048) {
           restore_candidate[vpage>>3]|=1<<(vpage&7);
@@ -956,6 +959,14 @@ static void invalidate_block_range(u_int block, u_int first, u_int last)
 
   // Don't trap writes
   invalid_code[block]=1;
+  // Blocks of the other mirrors stay in jump_dirty and clean_blocks can
+  // put them back without going through get_addr, so the page only
+  // stops holding code once no mirror has it valid
+  if(page<(RAM_SIZE>>12)
+     &&invalid_code[((u_int)0x00000000>>12)|page]
+     &&invalid_code[((u_int)0x80000000>>12)|page]
+     &&invalid_code[((u_int)0xa0000000>>12)|page])
+    psxMemUnmarkCode(block<<12);
 
   #ifdef USE_MINI_HT
   memset(mini_ht,-1,sizeof(mini_ht));
@@ -1070,9 +1081,11 @@ void add_link(u_int vaddr,void *src)
 {
   u_int page=get_page(vaddr);
   inv_debug("add_link: %x -> %x (%d)\n",(int)src,vaddr,page);
+#ifdef __arm__
   int *ptr=(int *)(src+4);
   assert((*ptr&0x0fff0000)==0x059f0000);
   (void)ptr;
+#endif
   ll_add(jump_out+page,vaddr,src);
   //int ptr=get_pointer(src);
   //inv_debug("add_link: Pointer is to %x\n",(int)ptr);
@@ -3445,7 +3458,11 @@ void hlecall_assemble(int i,struct regstat *i_regs)
   assert(!is_delayslot);
   (void)ccreg;
   emit_movimm(start+i*4+4,0); // Get PC
+#ifdef __x86_64__
+  emit_movimm(source[i]&7,1); // the handler pointer won't fit, pass the index
+#else
   emit_movimm((int)psxHLEt[source[i]&7],1);
+#endif
   emit_addimm(HOST_CCREG,CLOCK_ADJUST(ccadj[i]),HOST_CCREG); // XXX
   emit_jmp((int)jump_hlecall);
 }
@@ -4333,12 +4350,27 @@ void ds_assemble_entry(int i)
   emit_jmp(0);
 }
 
+// Loop from internal branch target t to the branch at i only polls memory
+static int is_idle_loop(int t,int i)
+{
+  psxIdleLoad loads[PSX_IDLE_MAX_LOADS];
+  int n,j;
+  if(t>=i||is_ds[t]||i+2-t>PSX_IDLE_MAX_INSNS) return 0;
+  n=psxIdleLoopCheck((u32 *)&source[t],i+2-t,loads);
+  if(n<0) return 0;
+  // only addresses known at compile time can be checked
+  for(j=0;j<n;j++)
+    if(loads[j].base>=0||!psxIdleLoadOk(loads[j].offset)) return 0;
+  return 1;
+}
+
 void do_cc(int i,signed char i_regmap[],int *adj,int addr,int taken,int invert)
 {
   int count;
   int jaddr;
   int idle=0;
   int t=0;
+  int internal=0;
   if(itype[i]==RJUMP)
   {
     *adj=0;
@@ -4346,6 +4378,7 @@ void do_cc(int i,signed char i_regmap[],int *adj,int addr,int taken,int invert)
   //if(ba[i]>=start && ba[i]<(start+slen*4))
   if(internal_branch(branch_regs[i].is32,ba[i]))
   {
+    internal=1;
     t=(ba[i]-start)>>2;
     if(is_ds[t]) *adj=-1; // Branch into delay slot adds an extra cycle
     else *adj=ccadj[t];
@@ -4364,6 +4397,13 @@ void do_cc(int i,signed char i_regmap[],int *adj,int addr,int taken,int invert)
     jaddr=(int)out;
     emit_jmp(0);
   }
+  else if(taken==TAKEN && !invert && internal && is_idle_loop(t,i)) {
+    // Polling loop, nothing changes until the next event so go there
+    // right away, then resume from the loop head
+    emit_andimm(HOST_CCREG,3,HOST_CCREG);
+    jaddr=(int)out;
+    emit_jmp(0);
+  }
   else if(*adj==0||invert) {
     int cycles=CLOCK_ADJUST(count+2);
     // faster loop HACK
@@ -7001,7 +7041,11 @@ static int new_dynarec_test(void)
 
   beginning = start_block();
   emit_movimm(DRC_TEST_VAL,0); // test
+#if defined(__i386__) || defined(__x86_64__)
+  emit_ret();
+#else
   emit_jmpreg(14);
+#endif
   literal_pool(0);
   end_block(beginning);
   SysPrintf("testing if we can run recompiled code..\n");
@@ -7060,6 +7104,9 @@ void new_dynarec_init()
   int ret = sceKernelGetMemBlockBase(sceBlock, (void **)&translation_cache);
   if (ret < 0)
     SysPrintf("sceKernelGetMemBlockBase failed\n");
+  #elif defined(__x86_64__)
+  // generated code keeps its own addresses in 32-bit words
+  translation_cache = tc_mmap();
   #else
   translation_cache = mmap (NULL, 1 << TARGET_SIZE_2,
             PROT_READ | PROT_WRITE | PROT_EXEC,
@@ -7267,6 +7314,7 @@ int new_recompile_block(int addr)
     u_int page=get_page(start);
 
     invalid_code[start>>12]=0;
+    psxMemMarkCode(start);
     emit_movimm(start,0);
     emit_writeword(0,(int)&pcaddr);
     emit_jmp((int)new_dyna_leave);
@@ -10282,10 +10330,12 @@ int new_recompile_block(int addr)
 
   // for PCSX we need to mark all mirrors too
   if(get_page(start)<(RAM_SIZE>>12))
-    for(i=start>>12;i<=(start+slen*4)>>12;i++)
+    for(i=start>>12;i<=(start+slen*4)>>12;i++) {
       invalid_code[((u_int)0x00000000>>12)|(i&0x1ff)]=
       invalid_code[((u_int)0x80000000>>12)|(i&0x1ff)]=
       invalid_code[((u_int)0xa0000000>>12)|(i&0x1ff)]=0;
+      psxMemMarkCode(i<<12);
+    }
 
   /* Pass 10 - Free memory by expiring oldest blocks */
 
@@ -1,7 +1,9 @@
 
 
+#ifdef __arm__
 #define CORTEX_A8_BRANCH_PREDICTION_HACK 1
 #define USE_MINI_HT 1
+#endif
 //#define REG_PREFETCH 1
 
 #if defined(__MACH__) || defined(VITA)
@@ -10,3 +12,7 @@
 #ifdef VITA
 #define BASE_ADDR_DYNAMIC 1
 #endif
+#ifdef __x86_64__
+// the cache must be placed below 2GB, see tc_mmap()
+#define BASE_ADDR_DYNAMIC 1
+#endif
@@ -13,6 +13,7 @@
 #include "../psxmem_map.h"
 #include "emu_if.h"
 #include "pcsxmem.h"
+#include "pcnt.h"
 
 #ifdef __thumb__
 #error the dynarec is incompatible with Thumb functions,
@@ -22,32 +23,33 @@
 //#define memprintf printf
 #define memprintf(...)
 
-static u32 *mem_readtab;
-static u32 *mem_writetab;
-static u32 mem_iortab[(1+2+4) * 0x1000 / 4];
-static u32 mem_iowtab[(1+2+4) * 0x1000 / 4];
-static u32 mem_ffwtab[(1+2+4) * 0x1000 / 4];
-//static u32 mem_unmrtab[(1+2+4) * 0x1000 / 4];
-static u32 mem_unmwtab[(1+2+4) * 0x1000 / 4];
+// table entries are pointer sized, (host_ptr >> 1) | (is_handler << msb)
+static uintptr_t *mem_readtab;
+static uintptr_t *mem_writetab;
+static uintptr_t mem_iortab[(1+2+4) * 0x1000 / 4];
+static uintptr_t mem_iowtab[(1+2+4) * 0x1000 / 4];
+static uintptr_t mem_ffwtab[(1+2+4) * 0x1000 / 4];
+//static uintptr_t mem_unmrtab[(1+2+4) * 0x1000 / 4];
+static uintptr_t mem_unmwtab[(1+2+4) * 0x1000 / 4];
 
 // When this is called in a loop, and 'h' is a function pointer, clang will crash.
 #ifdef __clang__
-static __attribute__ ((noinline)) void map_item(u32 *out, const void *h, u32 flag)
+static __attribute__ ((noinline)) void map_item(uintptr_t *out, const void *h, uintptr_t flag)
 #else
-static void map_item(u32 *out, const void *h, u32 flag)
+static void map_item(uintptr_t *out, const void *h, uintptr_t flag)
 #endif
 {
-	u32 hv = (u32)h;
+	uintptr_t hv = (uintptr_t)h;
 	if (hv & 1) {
 		SysPrintf("FATAL: %p has LSB set\n", h);
 		abort();
 	}
-	*out = (hv >> 1) | (flag << 31);
+	*out = (hv >> 1) | (flag << (sizeof(hv) * 8 - 1));
 }
 
 // size must be power of 2, at least 4k
 #define map_l1_mem(tab, i, addr, size, base) \
-	map_item(&tab[((addr)>>12) + i], (u8 *)(base) - (u32)(addr) - ((i << 12) & ~(size - 1)), 0)
+	map_item(&tab[((addr)>>12) + i], (u8 *)(base) - (u32)(addr) - (((u32)(i) << 12) & ~(size - 1)), 0)
 
 #define IOMEM32(a) (((a) & 0xfff) / 4)
 #define IOMEM16(a) (0x1000/4 + (((a) & 0xfff) / 2))
@@ -196,7 +198,9 @@ static void io_write_chcr##n(u32 value) \
 { \
 	HW_DMA##n##_CHCR = value; \
 	if (value & 0x01000000 && HW_DMA_PCR & (8 << (n * 4))) { \
+		pcnt_start(n <= 1 ? PCNT_MDEC : PCNT_DMA); \
 		psxDma##n(HW_DMA##n##_MADR, HW_DMA##n##_BCR, value); \
+		pcnt_end(n <= 1 ? PCNT_MDEC : PCNT_DMA); \
 	} \
 }
 
@@ -306,7 +310,7 @@ void new_dyna_pcsx_mem_init(void)
 	int i;
 
 	// have to map these further to keep tcache close to .text
-	mem_readtab = psxMap(0x08000000, 0x200000 * 4, 0, MAP_TAG_LUTS);
+	mem_readtab = psxMap(0x08000000, 0x200000 * sizeof(mem_readtab[0]), 0, MAP_TAG_LUTS);
 	if (mem_readtab == NULL) {
 		SysPrintf("failed to map mem tables\n");
 		exit(1);
@@ -489,6 +493,6 @@ void new_dyna_pcsx_mem_reset(void)
 
 void new_dyna_pcsx_mem_shutdown(void)
 {
-	psxUnmap(mem_readtab, 0x200000 * 4, MAP_TAG_LUTS);
+	psxUnmap(mem_readtab, 0x200000 * sizeof(mem_readtab[0]), MAP_TAG_LUTS);
 	mem_writetab = mem_readtab = NULL;
 }
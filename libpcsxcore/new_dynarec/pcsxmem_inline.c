@@ -15,14 +15,14 @@ static int pcsx_direct_read(int type, u_int addr, int cc_adj, int cc, int rs, in
       case 0x1120: // rcnt2 count
         if (rt < 0) goto dont_care;
         if (cc < 0) return 0;
-        emit_readword((int)&rcnts[2].mode, HOST_TEMPREG);
-        emit_readword((int)&rcnts[2].cycleStart, rt);
-        emit_testimm(HOST_TEMPREG, 0x200);
         emit_readword((int)&last_count, HOST_TEMPREG);
+        emit_readword((int)&rcnts[2].cycleStart, rt);
         emit_sub(HOST_TEMPREG, rt, HOST_TEMPREG);
         emit_add(HOST_TEMPREG, cc, HOST_TEMPREG);
-        if (cc_adj)
-          emit_addimm(HOST_TEMPREG, cc_adj, rt);
+        emit_addimm(HOST_TEMPREG, cc_adj, rt);
+        // the mode test goes last, x86 add/sub clobber the flags
+        emit_readword((int)&rcnts[2].mode, HOST_TEMPREG);
+        emit_testimm(HOST_TEMPREG, 0x200);
         emit_shrne_imm(rt, 3, rt);
         mov_loadtype_adj(type!=LOADW_STUB?type:LOADH_STUB, rt, rt);
         goto hit;
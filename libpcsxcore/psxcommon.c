@@ -23,6 +23,7 @@
 
 #include "cheat.h"
 #include "ppf.h"
+#include "pcnt.h"
 
 PcsxConfig Config;
 boolean NetOpened = FALSE;
@@ -56,7 +57,9 @@ void EmuUpdate() {
 	if (!Config.HLE || !hleSoftCall)
 		SysUpdate();
 
+	pcnt_start(PCNT_CHEAT);
 	ApplyCheats();
+	pcnt_end(PCNT_CHEAT);
 
 	// reamed hack
 	{
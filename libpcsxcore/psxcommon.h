@@ -125,7 +125,9 @@ typedef struct {
 	boolean RCntFix;
 	boolean UseNet;
 	boolean VSyncWA;
+	boolean IntCache; // interpreter: decode instructions once and reuse
 	u8 Cpu; // CPU_DYNAREC or CPU_INTERPRETER
+	u8 CdrSpeed; // cdrom seek/read time divisor, 0/1 = real drive timing
 	u8 PsxType; // PSX_TYPE_NTSC or PSX_TYPE_PAL
 #ifdef _WIN32
 	char Lang[256];
@@ -40,6 +40,7 @@ static u32 branchPC;
 #endif
 
 void execI();
+static void idleLoopTest(u32 tar, u32 bpc);
 
 // Subsets
 void (*psxBSC[64])();
@@ -419,6 +420,10 @@ static void doBranch(u32 tar) {
 	if (psxDelayBranchTest(tar))
 		return;
 
+	// backward branch closing a short loop
+	if (tar <= psxRegs.pc - 4 && psxRegs.pc - 4 - tar < (PSX_IDLE_MAX_INSNS - 1) * 4)
+		idleLoopTest(tar, psxRegs.pc - 4);
+
 	code = (u32 *)PSXM(psxRegs.pc);
 	psxRegs.code = ((code == NULL) ? 0 : SWAP32(*code));
 
@@ -903,28 +908,363 @@ void (*psxCP2BSC[32])() = {
 
 ///////////////////////////////////////////
 
+/*
+ * Decoded instruction cache (Config.IntCache).
+ * RAM and BIOS are split into 4K pages, each page gets an array with one
+ * entry per instruction word holding the fetched code and the final handler
+ * (SPECIAL/REGIMM/COP0 subtables already resolved). Entries are filled a
+ * basic block at a time on first execution and dropped by intClear(),
+ * which is what memory writes and DMA already call for the recompiler.
+ */
+typedef struct {
+	void (*func)();
+	u32 code;
+#ifdef INT_THREADED
+	u32 op;			/* intExecuteThreaded() label index */
+#endif
+} intDecoded;
+
+#define DC_PAGE_SHIFT 12
+#define DC_PAGE_INSNS (1 << (DC_PAGE_SHIFT - 2))
+#define DC_RAM_PAGES  (0x200000 >> DC_PAGE_SHIFT)
+#define DC_ROM_PAGES  (0x80000 >> DC_PAGE_SHIFT)
+
+static intDecoded *dcPages[DC_RAM_PAGES + DC_ROM_PAGES];
+
+static int dcPageIndex(u32 addr) {
+	u32 seg = addr >> 29;
+
+	// KUSEG, KSEG0, KSEG1
+	if (seg != 0 && seg != 4 && seg != 5)
+		return -1;
+	addr &= 0x1fffffff;
+	if (addr < 0x800000)
+		return (addr & 0x1fffff) >> DC_PAGE_SHIFT;
+	if ((addr & ~0x7ffff) == 0x1fc00000)
+		return DC_RAM_PAGES + ((addr & 0x7ffff) >> DC_PAGE_SHIFT);
+	return -1;
+}
+
+static void (*dcResolve(u32 code))() {
+	switch (_fOp_(code)) {
+		case 0x00: return psxSPC[_fFunct_(code)];
+		case 0x01: return psxREG[_fRt_(code)];
+		case 0x10: return psxCP0[_fRs_(code)];
+	}
+	return psxBSC[_fOp_(code)];
+}
+
+#ifdef INT_THREADED
+// flat label index: primary opcodes, then SPECIAL, REGIMM and COP0 subops
+#define INT_T_BSC 0
+#define INT_T_SPC 64
+#define INT_T_REG 128
+#define INT_T_CP0 160
+#define INT_T_COUNT 192
+
+static u32 dcIndex(u32 code) {
+	switch (_fOp_(code)) {
+		case 0x00: return INT_T_SPC + _fFunct_(code);
+		case 0x01: return INT_T_REG + _fRt_(code);
+		case 0x10: return INT_T_CP0 + _fRs_(code);
+	}
+	return INT_T_BSC + _fOp_(code);
+}
+#endif
+
+static int dcEndsBlock(u32 code) {
+	switch (_fOp_(code)) {
+		case 0x00: // JR/JALR/SYSCALL/BREAK
+			return _fFunct_(code) >= 0x08 && _fFunct_(code) <= 0x0d;
+		case 0x01: case 0x02: case 0x03: case 0x04:
+		case 0x05: case 0x06: case 0x07:
+			return 1;
+		case 0x10: // RFE
+			return _fRs_(code) == 0x10;
+	}
+	return 0;
+}
+
+// decode from pc up to the end of the basic block (incl. delay slot)
+static void dcDecodeBlock(intDecoded *page, u32 pc) {
+	u32 i = (pc >> 2) & (DC_PAGE_INSNS - 1);
+	int left = -1;
+	u32 *code;
+
+	code = (u32 *)PSXM(pc);
+	for (; i < DC_PAGE_INSNS && left != 0; i++, code++, left--) {
+		page[i].code = SWAP32(*code);
+		page[i].func = dcResolve(page[i].code);
+#ifdef INT_THREADED
+		page[i].op = dcIndex(page[i].code);
+#endif
+		if (left < 0 && dcEndsBlock(page[i].code))
+			left = 2;
+	}
+}
+
+static intDecoded *dcLookup(u32 pc) {
+	intDecoded *page;
+	int idx;
+
+	idx = dcPageIndex(pc);
+	if (idx < 0)
+		return NULL;
+	page = dcPages[idx];
+	if (page == NULL) {
+		page = calloc(DC_PAGE_INSNS, sizeof(page[0]));
+		if (page == NULL)
+			return NULL;
+		dcPages[idx] = page;
+	}
+	page += (pc >> 2) & (DC_PAGE_INSNS - 1);
+	if (page->func == NULL) {
+		dcDecodeBlock(page - ((pc >> 2) & (DC_PAGE_INSNS - 1)), pc);
+		if (idx < DC_RAM_PAGES)
+			psxMemMarkCode(pc);
+	}
+	return page;
+}
+
+static void dcFlush(int do_free) {
+	int i;
+
+	for (i = 0; i < DC_RAM_PAGES + DC_ROM_PAGES; i++) {
+		if (dcPages[i] == NULL)
+			continue;
+		if (do_free) {
+			free(dcPages[i]);
+			dcPages[i] = NULL;
+		}
+		else
+			memset(dcPages[i], 0, DC_PAGE_INSNS * sizeof(dcPages[i][0]));
+	}
+}
+
+/*
+ * Idle loop skipping: once a loop that only polls memory is known to
+ * spin (see psxIdleLoopCheck), nothing can change before the next event,
+ * so advance the cycle counter straight to it. Verdicts are cached per
+ * branch and dropped when the pages holding the loop are written.
+ */
+#define IDLE_TAB_SIZE 64
+
+typedef struct {
+	u32 pc, tar;
+	int nloads;
+	psxIdleLoad loads[PSX_IDLE_MAX_LOADS];
+} idleEntry;
+
+static idleEntry idleTab[IDLE_TAB_SIZE];
+static u8 idlePages[DC_RAM_PAGES + DC_ROM_PAGES];
+
+static void idleFlush() {
+	int i;
+
+	for (i = 0; i < IDLE_TAB_SIZE; i++)
+		idleTab[i].pc = 1; // never matches an aligned pc
+	memset(idlePages, 0, sizeof(idlePages));
+}
+
+static void idleLoopTest(u32 tar, u32 bpc) {
+	idleEntry *e = &idleTab[(bpc >> 2) & (IDLE_TAB_SIZE - 1)];
+	u32 code[PSX_IDLE_MAX_INSNS];
+	int i, count, idx1, idx2;
+	u32 addr, *p;
+
+	if (e->pc != bpc || e->tar != tar) {
+		e->pc = bpc;
+		e->tar = tar;
+		e->nloads = -1;
+
+		idx1 = dcPageIndex(tar);
+		idx2 = dcPageIndex(bpc + 4);
+		if (idx1 < 0 || idx2 < 0)
+			return;
+		count = (bpc - tar) / 4 + 2;
+		for (i = 0; i < count; i++) {
+			p = (u32 *)PSXM(tar + i * 4);
+			code[i] = SWAP32(*p);
+		}
+		e->nloads = psxIdleLoopCheck(code, count, e->loads);
+		idlePages[idx1] = idlePages[idx2] = 1;
+		if (idx1 < DC_RAM_PAGES)
+			psxMemMarkCode(tar);
+		if (idx2 < DC_RAM_PAGES)
+			psxMemMarkCode(bpc + 4);
+	}
+	if (e->nloads < 0)
+		return;
+
+	for (i = 0; i < e->nloads; i++) {
+		addr = e->loads[i].offset;
+		if (e->loads[i].base >= 0)
+			addr += psxRegs.GPR.r[e->loads[i].base];
+		if (!psxIdleLoadOk(addr))
+			return;
+	}
+
+	if ((s32)(next_interupt - psxRegs.cycle) > 0)
+		psxRegs.cycle = next_interupt;
+}
+
+static void execIC();
+
+#ifdef INT_THREADED
+/*
+ * Direct threaded version of the execI() loop (GCC labels-as-values).
+ * Every handler site fetches the next instruction and jumps straight to
+ * its label, SPECIAL/REGIMM/COP0 subops get their own labels, so there is
+ * no return to a central loop and no nested table call. Handlers are the
+ * regular psx*() functions, which the compiler is free to inline here.
+ * Runs until *done becomes nonzero.
+ */
+#define INT_T_OPS(X) \
+	X(INT_T_BSC, 0x02, J)      X(INT_T_BSC, 0x03, JAL)    X(INT_T_BSC, 0x04, BEQ) \
+	X(INT_T_BSC, 0x05, BNE)    X(INT_T_BSC, 0x06, BLEZ)   X(INT_T_BSC, 0x07, BGTZ) \
+	X(INT_T_BSC, 0x08, ADDI)   X(INT_T_BSC, 0x09, ADDIU)  X(INT_T_BSC, 0x0a, SLTI) \
+	X(INT_T_BSC, 0x0b, SLTIU)  X(INT_T_BSC, 0x0c, ANDI)   X(INT_T_BSC, 0x0d, ORI) \
+	X(INT_T_BSC, 0x0e, XORI)   X(INT_T_BSC, 0x0f, LUI) \
+	X(INT_T_BSC, 0x20, LB)     X(INT_T_BSC, 0x21, LH)     X(INT_T_BSC, 0x22, LWL) \
+	X(INT_T_BSC, 0x23, LW)     X(INT_T_BSC, 0x24, LBU)    X(INT_T_BSC, 0x25, LHU) \
+	X(INT_T_BSC, 0x26, LWR)    X(INT_T_BSC, 0x28, SB)     X(INT_T_BSC, 0x29, SH) \
+	X(INT_T_BSC, 0x2a, SWL)    X(INT_T_BSC, 0x2b, SW)     X(INT_T_BSC, 0x2e, SWR) \
+	X(INT_T_SPC, 0x00, SLL)    X(INT_T_SPC, 0x02, SRL)    X(INT_T_SPC, 0x03, SRA) \
+	X(INT_T_SPC, 0x04, SLLV)   X(INT_T_SPC, 0x06, SRLV)   X(INT_T_SPC, 0x07, SRAV) \
+	X(INT_T_SPC, 0x08, JR)     X(INT_T_SPC, 0x09, JALR)   X(INT_T_SPC, 0x0c, SYSCALL) \
+	X(INT_T_SPC, 0x0d, BREAK)  X(INT_T_SPC, 0x10, MFHI)   X(INT_T_SPC, 0x11, MTHI) \
+	X(INT_T_SPC, 0x12, MFLO)   X(INT_T_SPC, 0x13, MTLO)   X(INT_T_SPC, 0x18, MULT) \
+	X(INT_T_SPC, 0x19, MULTU)  X(INT_T_SPC, 0x1a, DIV)    X(INT_T_SPC, 0x1b, DIVU) \
+	X(INT_T_SPC, 0x20, ADD)    X(INT_T_SPC, 0x21, ADDU)   X(INT_T_SPC, 0x22, SUB) \
+	X(INT_T_SPC, 0x23, SUBU)   X(INT_T_SPC, 0x24, AND)    X(INT_T_SPC, 0x25, OR) \
+	X(INT_T_SPC, 0x26, XOR)    X(INT_T_SPC, 0x27, NOR)    X(INT_T_SPC, 0x2a, SLT) \
+	X(INT_T_SPC, 0x2b, SLTU) \
+	X(INT_T_REG, 0x00, BLTZ)   X(INT_T_REG, 0x01, BGEZ)   X(INT_T_REG, 0x10, BLTZAL) \
+	X(INT_T_REG, 0x11, BGEZAL) \
+	X(INT_T_CP0, 0x00, MFC0)   X(INT_T_CP0, 0x02, CFC0)   X(INT_T_CP0, 0x04, MTC0) \
+	X(INT_T_CP0, 0x06, CTC0)   X(INT_T_CP0, 0x10, RFE)
+
+#define INT_T_LABEL(t, n, name) [t + n] = &&l_##name,
+#define INT_T_BODY(t, n, name) l_##name: psx##name(); INT_T_NEXT();
+
+#define INT_T_NEXT() { \
+	if (*done) \
+		return; \
+	if (use_dc && (d = dcLookup(psxRegs.pc)) != NULL) { \
+		psxRegs.code = d->code; \
+		debugI(); \
+		psxRegs.pc += 4; \
+		psxRegs.cycle += BIAS; \
+		goto *labels[d->op]; \
+	} \
+	code = (u32 *)PSXM(psxRegs.pc); \
+	psxRegs.code = ((code == NULL) ? 0 : SWAP32(*code)); \
+	debugI(); \
+	psxRegs.pc += 4; \
+	psxRegs.cycle += BIAS; \
+	goto *labels[psxRegs.code >> 26]; \
+}
+
+static void intExecuteThreaded(const int *done) {
+	static const void *labels[INT_T_COUNT] = {
+		[INT_T_BSC ... INT_T_SPC - 1] = &&l_BSC,
+		[INT_T_SPC ... INT_T_COUNT - 1] = &&l_NULL,
+		[INT_T_BSC + 0x00] = &&l_SPECIAL,
+		[INT_T_BSC + 0x01] = &&l_REGIMM,
+		[INT_T_BSC + 0x10] = &&l_COP0,
+		INT_T_OPS(INT_T_LABEL)
+	};
+	const int use_dc = Config.IntCache;
+	intDecoded *d;
+	u32 *code;
+
+	INT_T_NEXT();
+
+l_SPECIAL:
+	goto *labels[INT_T_SPC + _Funct_];
+l_REGIMM:
+	goto *labels[INT_T_REG + _Rt_];
+l_COP0:
+	goto *labels[INT_T_CP0 + _Rs_];
+
+	// COP2, LWC2, SWC2, HLE and unknown primary opcodes
+l_BSC:
+	psxBSC[_Op_]();
+	INT_T_NEXT();
+l_NULL:
+	psxNULL();
+	INT_T_NEXT();
+
+	INT_T_OPS(INT_T_BODY)
+}
+#endif
+
 static int intInit() {
 	return 0;
 }
 
 static void intReset() {
+	dcFlush(0);
+	idleFlush();
 }
 
 void intExecute() {
 	extern int stop;
+#ifdef INT_THREADED
+	if (!Config.Debug) {
+		intExecuteThreaded(&stop);
+		return;
+	}
+#endif
+	if (Config.IntCache && !Config.Debug) {
+		for (;!stop;)
+			execIC();
+		return;
+	}
 	for (;!stop;) 
 		execI();
 }
 
 void intExecuteBlock() {
 	branch2 = 0;
+#ifdef INT_THREADED
+	if (!Config.Debug) {
+		intExecuteThreaded(&branch2);
+		return;
+	}
+#endif
+	if (Config.IntCache && !Config.Debug) {
+		while (!branch2) execIC();
+		return;
+	}
 	while (!branch2) execI();
 }
 
 static void intClear(u32 Addr, u32 Size) {
+	u32 end = Addr + Size * 4;
+	u32 start, count;
+	int idx;
+
+	while (Addr < end) {
+		start = (Addr >> 2) & (DC_PAGE_INSNS - 1);
+		count = DC_PAGE_INSNS - start;
+		if (count > (end - Addr) >> 2)
+			count = (end - Addr) >> 2;
+		if (count == 0)
+			break;
+
+		idx = dcPageIndex(Addr);
+		if (idx >= 0 && dcPages[idx] != NULL)
+			memset(&dcPages[idx][start], 0, count * sizeof(dcPages[idx][0]));
+		if (idx >= 0 && idlePages[idx])
+			idleFlush();
+
+		Addr += count * 4;
+	}
 }
 
 static void intShutdown() {
+	dcFlush(1);
 }
 
 // interpreter execution
@@ -942,6 +1282,24 @@ void execI() {
 	psxBSC[psxRegs.code >> 26]();
 }
 
+// same as execI, but using the decoded instruction cache
+static void execIC() {
+	intDecoded *d = dcLookup(psxRegs.pc);
+
+	if (d == NULL) {
+		execI();
+		return;
+	}
+	psxRegs.code = d->code;
+
+	debugI();
+
+	psxRegs.pc += 4;
+	psxRegs.cycle += BIAS;
+
+	d->func();
+}
+
 R3000Acpu psxInt = {
 	intInit,
 	intReset,
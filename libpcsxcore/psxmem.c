@@ -62,6 +62,17 @@ retry:
 		ret = mmap(req, size, PROT_READ | PROT_WRITE, flags, -1, 0);
 		if (ret == MAP_FAILED)
 			return NULL;
+#if defined(__x86_64__) && defined(MAP_32BIT)
+		/* the x86-64 recompiler accesses emulated memory through
+		 * 32-bit addresses, so it must be in the low 4GB */
+		if ((uintptr_t)ret >> 32) {
+			munmap(ret, size);
+			ret = mmap(req, size, PROT_READ | PROT_WRITE,
+				flags | MAP_32BIT, -1, 0);
+			if (ret == MAP_FAILED)
+				return NULL;
+		}
+#endif
 	}
 
 	if (addr != 0 && ret != (void *)addr) {
@@ -108,6 +119,9 @@ s8 *psxH = NULL; // Scratch Pad (1K) & Hardware Registers (8K)
 u8 **psxMemWLUT = NULL;
 u8 **psxMemRLUT = NULL;
 
+u32 psxCodePages[(0x200000 >> 12) / 32];
+u32 psxCodeInvalidations; // stores that hit a page with code
+
 /*  Playstation Memory Map (from Playstation doc by Joshua Walker)
 0x0000_0000-0x0000_ffff		Kernel (64K)
 0x0001_0000-0x001f_ffff		User Memory (1.9 Meg)
@@ -188,6 +202,7 @@ void psxMemReset() {
 
 	memset(psxM, 0, 0x00200000);
 	memset(psxP, 0, 0x00010000);
+	memset(psxCodePages, 0, sizeof(psxCodePages));
 
 	if (strcmp(Config.Bios, "HLE") != 0) {
 		sprintf(bios, "%s/%s", Config.BiosDir, Config.Bios);
@@ -214,12 +229,30 @@ void psxMemShutdown() {
 	free(psxMemWLUT); psxMemWLUT = NULL;
 }
 
+void psxMemMarkCode(u32 mem) {
+	psxCodePages[(mem & 0x1fffff) >> 17] |= 1u << ((mem >> 12) & 31);
+}
+
+void psxMemUnmarkCode(u32 mem) {
+	psxCodePages[(mem & 0x1fffff) >> 17] &= ~(1u << ((mem >> 12) & 31));
+}
+
 static int writeok = 1;
 
+// main RAM and its mirrors in KUSEG, KSEG0 and KSEG1 (8MB window each)
+#define IS_RAM_ADDR(mem) \
+	(((mem) & 0x1f800000) == 0 && ((0x31 >> ((mem) >> 29)) & 1))
+
 u8 psxMemRead8(u32 mem) {
 	char *p;
 	u32 t;
 
+	if (IS_RAM_ADDR(mem)) {
+		if (Config.Debug)
+			DebugCheckBP((mem & 0xffffff) | 0x80000000, R1);
+		return psxMu8(mem);
+	}
+
 	t = mem >> 16;
 	if (t == 0x1f80 || t == 0x9f80 || t == 0xbf80) {
 		if ((mem & 0xffff) < 0x400)
@@ -245,6 +278,12 @@ u16 psxMemRead16(u32 mem) {
 	char *p;
 	u32 t;
 
+	if (IS_RAM_ADDR(mem)) {
+		if (Config.Debug)
+			DebugCheckBP((mem & 0xffffff) | 0x80000000, R2);
+		return psxMu16(mem);
+	}
+
 	t = mem >> 16;
 	if (t == 0x1f80 || t == 0x9f80 || t == 0xbf80) {
 		if ((mem & 0xffff) < 0x400)
@@ -270,6 +309,12 @@ u32 psxMemRead32(u32 mem) {
 	char *p;
 	u32 t;
 
+	if (IS_RAM_ADDR(mem)) {
+		if (Config.Debug)
+			DebugCheckBP((mem & 0xffffff) | 0x80000000, R4);
+		return psxMu32(mem);
+	}
+
 	t = mem >> 16;
 	if (t == 0x1f80 || t == 0x9f80 || t == 0xbf80) {
 		if ((mem & 0xffff) < 0x400)
@@ -295,6 +340,19 @@ void psxMemWrite8(u32 mem, u8 value) {
 	char *p;
 	u32 t;
 
+	if (IS_RAM_ADDR(mem) && writeok) {
+		if (Config.Debug)
+			DebugCheckBP((mem & 0xffffff) | 0x80000000, W1);
+		psxMu8ref(mem) = value;
+#ifdef PSXREC
+		if (psxMemIsCode(mem)) {
+			psxCodeInvalidations++;
+			psxCpu->Clear((mem & (~3)), 1);
+		}
+#endif
+		return;
+	}
+
 	t = mem >> 16;
 	if (t == 0x1f80 || t == 0x9f80 || t == 0xbf80) {
 		if ((mem & 0xffff) < 0x400)
@@ -322,6 +380,19 @@ void psxMemWrite16(u32 mem, u16 value) {
 	char *p;
 	u32 t;
 
+	if (IS_RAM_ADDR(mem) && writeok) {
+		if (Config.Debug)
+			DebugCheckBP((mem & 0xffffff) | 0x80000000, W2);
+		psxMu16ref(mem) = SWAPu16(value);
+#ifdef PSXREC
+		if (psxMemIsCode(mem)) {
+			psxCodeInvalidations++;
+			psxCpu->Clear((mem & (~3)), 1);
+		}
+#endif
+		return;
+	}
+
 	t = mem >> 16;
 	if (t == 0x1f80 || t == 0x9f80 || t == 0xbf80) {
 		if ((mem & 0xffff) < 0x400)
@@ -350,6 +421,19 @@ void psxMemWrite32(u32 mem, u32 value) {
 	u32 t;
 
 //	if ((mem&0x1fffff) == 0x71E18 || value == 0x48088800) SysPrintf("t2fix!!\n");
+	if (IS_RAM_ADDR(mem) && writeok) {
+		if (Config.Debug)
+			DebugCheckBP((mem & 0xffffff) | 0x80000000, W4);
+		psxMu32ref(mem) = SWAPu32(value);
+#ifdef PSXREC
+		if (psxMemIsCode(mem)) {
+			psxCodeInvalidations++;
+			psxCpu->Clear(mem, 1);
+		}
+#endif
+		return;
+	}
+
 	t = mem >> 16;
 	if (t == 0x1f80 || t == 0x9f80 || t == 0xbf80) {
 		if ((mem & 0xffff) < 0x400)
@@ -126,6 +126,17 @@ extern u8 **psxMemRLUT;
 #define PSXREC
 #endif
 
+// 4K pages of RAM that a CPU core holds compiled or decoded code for,
+// stores to other pages don't have to call psxCpu->Clear()
+extern u32 psxCodePages[(0x200000 >> 12) / 32];
+extern u32 psxCodeInvalidations;
+
+#define psxMemIsCode(mem) \
+	(psxCodePages[((mem) & 0x1fffff) >> 17] & (1u << (((mem) >> 12) & 31)))
+
+void psxMemMarkCode(u32 mem);
+void psxMemUnmarkCode(u32 mem);
+
 int psxMemInit();
 void psxMemReset();
 void psxMemShutdown();
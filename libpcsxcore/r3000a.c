@@ -114,85 +114,71 @@ void psxException(u32 code, u32 bd) {
 	if (Config.HLE) psxBiosException();
 }
 
-void psxBranchTest() {
-	if ((psxRegs.cycle - psxNextsCounter) >= psxNextCounter)
-		psxRcntUpdate();
-
-	if (psxRegs.interrupt) {
-		if ((psxRegs.interrupt & (1 << PSXINT_SIO)) && !Config.Sio) { // sio
-			if ((psxRegs.cycle - psxRegs.intCycle[PSXINT_SIO].sCycle) >= psxRegs.intCycle[PSXINT_SIO].cycle) {
-				psxRegs.interrupt &= ~(1 << PSXINT_SIO);
-				sioInterrupt();
-			}
-		}
-		if (psxRegs.interrupt & (1 << PSXINT_CDR)) { // cdr
-			if ((psxRegs.cycle - psxRegs.intCycle[PSXINT_CDR].sCycle) >= psxRegs.intCycle[PSXINT_CDR].cycle) {
-				psxRegs.interrupt &= ~(1 << PSXINT_CDR);
-				cdrInterrupt();
-			}
-		}
-		if (psxRegs.interrupt & (1 << PSXINT_CDREAD)) { // cdr read
-			if ((psxRegs.cycle - psxRegs.intCycle[PSXINT_CDREAD].sCycle) >= psxRegs.intCycle[PSXINT_CDREAD].cycle) {
-				psxRegs.interrupt &= ~(1 << PSXINT_CDREAD);
-				cdrReadInterrupt();
-			}
-		}
-		if (psxRegs.interrupt & (1 << PSXINT_GPUDMA)) { // gpu dma
-			if ((psxRegs.cycle - psxRegs.intCycle[PSXINT_GPUDMA].sCycle) >= psxRegs.intCycle[PSXINT_GPUDMA].cycle) {
-				psxRegs.interrupt &= ~(1 << PSXINT_GPUDMA);
-				gpuInterrupt();
-			}
-		}
-		if (psxRegs.interrupt & (1 << PSXINT_MDECOUTDMA)) { // mdec out dma
-			if ((psxRegs.cycle - psxRegs.intCycle[PSXINT_MDECOUTDMA].sCycle) >= psxRegs.intCycle[PSXINT_MDECOUTDMA].cycle) {
-				psxRegs.interrupt &= ~(1 << PSXINT_MDECOUTDMA);
-				mdec1Interrupt();
-			}
-		}
-		if (psxRegs.interrupt & (1 << PSXINT_SPUDMA)) { // spu dma
-			if ((psxRegs.cycle - psxRegs.intCycle[PSXINT_SPUDMA].sCycle) >= psxRegs.intCycle[PSXINT_SPUDMA].cycle) {
-				psxRegs.interrupt &= ~(1 << PSXINT_SPUDMA);
-				spuInterrupt();
-			}
-		}
-		if (psxRegs.interrupt & (1 << PSXINT_MDECINDMA)) { // mdec in
-			if ((psxRegs.cycle - psxRegs.intCycle[PSXINT_MDECINDMA].sCycle) >= psxRegs.intCycle[PSXINT_MDECINDMA].cycle) {
-				psxRegs.interrupt &= ~(1 << PSXINT_MDECINDMA);
-				mdec0Interrupt();
-			}
-		}
-		if (psxRegs.interrupt & (1 << PSXINT_GPUOTCDMA)) { // gpu otc
-			if ((psxRegs.cycle - psxRegs.intCycle[PSXINT_GPUOTCDMA].sCycle) >= psxRegs.intCycle[PSXINT_GPUOTCDMA].cycle) {
-				psxRegs.interrupt &= ~(1 << PSXINT_GPUOTCDMA);
-				gpuotcInterrupt();
-			}
-		}
-		if (psxRegs.interrupt & (1 << PSXINT_CDRDMA)) { // cdrom
-			if ((psxRegs.cycle - psxRegs.intCycle[PSXINT_CDRDMA].sCycle) >= psxRegs.intCycle[PSXINT_CDRDMA].cycle) {
-				psxRegs.interrupt &= ~(1 << PSXINT_CDRDMA);
-				cdrDmaInterrupt();
-			}
-		}
-		if (psxRegs.interrupt & (1 << PSXINT_CDRPLAY)) { // cdr play timing
-			if ((psxRegs.cycle - psxRegs.intCycle[PSXINT_CDRPLAY].sCycle) >= psxRegs.intCycle[PSXINT_CDRPLAY].cycle) {
-				psxRegs.interrupt &= ~(1 << PSXINT_CDRPLAY);
-				cdrPlayInterrupt();
-			}
-		}
-		if (psxRegs.interrupt & (1 << PSXINT_CDRLID)) { // cdr lid states
-			if ((psxRegs.cycle - psxRegs.intCycle[PSXINT_CDRLID].sCycle) >= psxRegs.intCycle[PSXINT_CDRLID].cycle) {
-				psxRegs.interrupt &= ~(1 << PSXINT_CDRLID);
-				cdrLidSeekInterrupt();
-			}
-		}
-		if (psxRegs.interrupt & (1 << PSXINT_SPU_UPDATE)) { // scheduled spu update
-			if ((psxRegs.cycle - psxRegs.intCycle[PSXINT_SPU_UPDATE].sCycle) >= psxRegs.intCycle[PSXINT_SPU_UPDATE].cycle) {
-				psxRegs.interrupt &= ~(1 << PSXINT_SPU_UPDATE);
-				spuUpdate();
-			}
+/*
+ * Event scheduler, shared with new_dynarec (gen_interupt).
+ * Every PSXINT_* source schedules through new_dyna_set_event(), which
+ * keeps event_cycles[] and pulls next_interupt in if the new event is
+ * sooner, so next_interupt never lies past the earliest pending event.
+ * Callers only need to compare the cycle counter against it; the pending
+ * set is scanned only when something is actually due.
+ */
+typedef void (irq_func)();
+
+static irq_func * const irq_funcs[] = {
+	[PSXINT_SIO]	= sioInterrupt,
+	[PSXINT_CDR]	= cdrInterrupt,
+	[PSXINT_CDREAD]	= cdrReadInterrupt,
+	[PSXINT_GPUDMA]	= gpuInterrupt,
+	[PSXINT_MDECOUTDMA] = mdec1Interrupt,
+	[PSXINT_SPUDMA]	= spuInterrupt,
+	[PSXINT_MDECINDMA] = mdec0Interrupt,
+	[PSXINT_GPUOTCDMA] = gpuotcInterrupt,
+	[PSXINT_CDRDMA] = cdrDmaInterrupt,
+	[PSXINT_CDRLID] = cdrLidSeekInterrupt,
+	[PSXINT_CDRPLAY] = cdrPlayInterrupt,
+	[PSXINT_SPU_UPDATE] = spuUpdate,
+	[PSXINT_RCNT] = psxRcntUpdate,
+};
+
+// sets next_interupt to the earliest pending event (at most 1s away)
+void psxEventsSchedule() {
+	u32 i, c = psxRegs.cycle;
+	u32 irqs = psxRegs.interrupt;
+	s32 min, dif;
+
+	min = PSXCLK;
+	for (i = 0; irqs != 0; i++, irqs >>= 1) {
+		if (!(irqs & 1))
+			continue;
+		dif = event_cycles[i] - c;
+		if (dif < min)
+			min = dif > 0 ? dif : 0;
+	}
+	next_interupt = c + min;
+}
+
+// runs the handlers of all due events, then reschedules
+void psxEventsRun() {
+	u32 cycle = psxRegs.cycle;
+	u32 irq;
+
+	// handlers may queue or cancel other events, so recheck the bits
+	for (irq = 0; irq < sizeof(irq_funcs) / sizeof(irq_funcs[0]); irq++) {
+		if (!(psxRegs.interrupt & (1 << irq)) || irq_funcs[irq] == NULL)
+			continue;
+		if ((s32)(cycle - event_cycles[irq]) >= 0) {
+			psxRegs.interrupt &= ~(1 << irq);
+			irq_funcs[irq]();
 		}
 	}
 
+	psxEventsSchedule();
+}
+
+void psxBranchTest() {
+	if ((s32)(psxRegs.cycle - next_interupt) >= 0)
+		psxEventsRun();
+
 	if (psxHu32(0x1070) & psxHu32(0x1074)) {
 		if ((psxRegs.CP0.n.Status & 0x401) == 0x401) {
 #ifdef PSXCPU_LOG
@@ -204,6 +190,144 @@ void psxBranchTest() {
 	}
 }
 
+/*
+ * Idle loop detection, used by both CPU cores.
+ * 'code' holds 'count' host order words, from the loop head up to and
+ * including the delay slot of the backward branch closing the loop.
+ * The loop is idle if it has no side effects (only loads, ALU ops and
+ * exit branches) and no register is carried from one iteration to the
+ * next, so once the closing branch is taken the loop keeps spinning
+ * unchanged until an event handler modifies the memory it polls.
+ * Returns the number of loads stored to 'loads', -1 if not idle.
+ */
+int psxIdleLoopCheck(const u32 *code, int count, psxIdleLoad *loads) {
+	u32 written = 0, carried = 0, known = 1, cval[32];
+	u32 c, rs, rt, reads;
+	int k, wr, nloads = 0;
+
+	if (count < 2 || count > PSX_IDLE_MAX_INSNS)
+		return -1;
+
+	cval[0] = 0;
+	for (k = 0; k < count; k++) {
+		c = code[k];
+		rs = _fRs_(c);
+		rt = _fRt_(c);
+		reads = 0;
+		wr = 0;
+		switch (_fOp_(c)) {
+			case 0x00: // SPECIAL
+				switch (_fFunct_(c)) {
+					case 0x00: case 0x02: case 0x03: // SLL/SRL/SRA
+						reads = 1u << rt; wr = _fRd_(c); break;
+					case 0x04: case 0x06: case 0x07: // SLLV/SRLV/SRAV
+					case 0x20: case 0x21: case 0x22: case 0x23: // ADD/ADDU/SUB/SUBU
+					case 0x24: case 0x25: case 0x26: case 0x27: // AND/OR/XOR/NOR
+					case 0x2a: case 0x2b: // SLT/SLTU
+						reads = (1u << rs) | (1u << rt); wr = _fRd_(c); break;
+					case 0x10: case 0x12: // MFHI/MFLO, hi/lo can't change here
+						wr = _fRd_(c); break;
+					default:
+						return -1;
+				}
+				break;
+
+			case 0x01: // BLTZ/BGEZ, the linking forms write ra
+				if (rt > 1)
+					return -1;
+				reads = 1u << rs;
+				break;
+			case 0x04: case 0x05: // BEQ/BNE
+				reads = (1u << rs) | (1u << rt);
+				break;
+			case 0x06: case 0x07: // BLEZ/BGTZ
+				reads = 1u << rs;
+				break;
+			case 0x02: // J, only as the closing branch
+				if (k != count - 2)
+					return -1;
+				break;
+
+			case 0x08: case 0x09: case 0x0a: case 0x0b: // ADDI/ADDIU/SLTI/SLTIU
+			case 0x0c: case 0x0d: case 0x0e: // ANDI/ORI/XORI
+				reads = 1u << rs; wr = rt; break;
+			case 0x0f: // LUI
+				wr = rt; break;
+
+			case 0x20: case 0x21: case 0x23: case 0x24: case 0x25: // LB/LH/LW/LBU/LHU
+				if (nloads == PSX_IDLE_MAX_LOADS)
+					return -1;
+				if (known & (1u << rs)) {
+					loads[nloads].base = -1;
+					loads[nloads].offset = cval[rs] + _fImm_(c);
+				}
+				else if (written & (1u << rs))
+					return -1;
+				else {
+					loads[nloads].base = rs;
+					loads[nloads].offset = _fImm_(c);
+				}
+				nloads++;
+				reads = 1u << rs; wr = rt; break;
+
+			default:
+				return -1;
+		}
+
+		// no other branches in the closing branch's delay slot, and
+		// branches other than the closing one must leave the loop
+		if (_fOp_(c) >= 0x01 && _fOp_(c) <= 0x07) {
+			s32 tar = k + 1 + _fImm_(c);
+			if (k == count - 1)
+				return -1;
+			if (k < count - 2 && tar >= 0 && tar < count)
+				return -1;
+		}
+
+		carried |= reads & ~written;
+
+		if (wr == 0)
+			continue;
+		// track constants built up inside the loop, for load addresses
+		if (_fOp_(c) == 0x0f) {
+			cval[wr] = _fImmU_(c) << 16;
+			known |= 1u << wr;
+		}
+		else if ((_fOp_(c) == 0x08 || _fOp_(c) == 0x09 || _fOp_(c) == 0x0d) && (known & (1u << rs))) {
+			cval[wr] = _fOp_(c) == 0x0d ? cval[rs] | _fImmU_(c) : cval[rs] + _fImm_(c);
+			known |= 1u << wr;
+		}
+		else
+			known &= ~(1u << wr);
+		written |= 1u << wr;
+	}
+
+	if (carried & written & ~1)
+		return -1;
+	return nloads;
+}
+
+/*
+ * Whether an idle loop may poll this address: RAM, scratchpad, BIOS and
+ * I/O registers whose reads have no side effects and only change from
+ * event handlers. Root counters advance with time and GPU status may
+ * emulate busy by toggling on reads, so both are left out.
+ */
+int psxIdleLoadOk(u32 addr) {
+	addr &= 0x1fffffff;
+	if (addr < 0x800000 || (addr & ~0x3ff) == 0x1f800000 ||
+	    (addr & ~0x7ffff) == 0x1fc00000)
+		return 1;
+	switch (addr) {
+		case 0x1f801070: case 0x1f801074: // I_STAT/I_MASK
+		case 0x1f801044: case 0x1f801054: // SIO status
+		case 0x1f801800: // CD-ROM index/status
+		case 0x1f801824: // MDEC status
+			return 1;
+	}
+	return addr >= 0x1f801080 && addr < 0x1f801100; // DMA
+}
+
 void psxJumpTest() {
 	if (!Config.HLE && Config.PsxOut) {
 		u32 call = psxRegs.GPR.n.t1 & 0xff;
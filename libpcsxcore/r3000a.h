@@ -280,12 +280,26 @@ void psxReset();
 void psxShutdown();
 void psxException(u32 code, u32 bd);
 void psxBranchTest();
+void psxEventsSchedule();
+void psxEventsRun();
 void psxExecuteBios();
 int  psxTestLoadDelay(int reg, u32 tmp);
 void psxDelayTest(int reg, u32 bpc);
 void psxTestSWInts();
 void psxJumpTest();
 
+// idle loop detection, see psxIdleLoopCheck()
+#define PSX_IDLE_MAX_INSNS 16
+#define PSX_IDLE_MAX_LOADS 4
+
+typedef struct {
+	int base;	// loop invariant GPR the address is based on, -1 if constant
+	u32 offset;	// added to the base, or the full address if constant
+} psxIdleLoad;
+
+int  psxIdleLoopCheck(const u32 *code, int count, psxIdleLoad *loads);
+int  psxIdleLoadOk(u32 addr);
+
 #ifdef __cplusplus
 }
 #endif
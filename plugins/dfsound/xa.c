@@ -34,12 +34,35 @@ static int gauss_window[8] = {0, 0, 0, 0, 0, 0, 0, 0};
 #define gvalr0 gauss_window[4+gauss_ptr]
 #define gvalr(x) gauss_window[4+((gauss_ptr+x)&3)]
 
+// the cdda ring has a single writer (the cdrom thread, FeedCDDA) and a
+// single reader (the mixer), each only moves its own pointer. Samples
+// must be in memory before Feed moves and read out before Play does.
+#ifdef __GNUC__
+#define ring_barrier() __sync_synchronize()
+#else
+#define ring_barrier()
+#endif
+
+INLINE unsigned int *ring_get(unsigned int * volatile *p)
+{
+ unsigned int *v = *p;
+ ring_barrier();
+ return v;
+}
+
+INLINE void ring_set(unsigned int * volatile *p, unsigned int *v)
+{
+ ring_barrier();
+ *p = v;
+}
+
 ////////////////////////////////////////////////////////////////////////
 // MIX XA & CDDA
 ////////////////////////////////////////////////////////////////////////
 
 INLINE void MixXA(int *SSumLR, int ns_to, int decode_pos)
 {
+ unsigned int *play, *feed;
  int cursor = decode_pos;
  int ns;
  short l, r;
@@ -68,10 +91,15 @@ INLINE void MixXA(int *SSumLR, int ns_to, int decode_pos)
   spu.XALastVal = v;
  }
 
- for(ns = 0; ns < ns_to * 2 && spu.CDDAPlay!=spu.CDDAFeed && (spu.CDDAPlay!=spu.CDDAEnd-1||spu.CDDAFeed!=spu.CDDAStart);)
+ play = spu.CDDAPlay;
+ feed = ring_get(&spu.CDDAFeed);
+ if(play == feed)
+  return;
+
+ for(ns = 0; ns < ns_to * 2 && play != feed;)
   {
-   v=*spu.CDDAPlay++;
-   if(spu.CDDAPlay==spu.CDDAEnd) spu.CDDAPlay=spu.CDDAStart;
+   v=*play++;
+   if(play==spu.CDDAEnd) play=spu.CDDAStart;
 
    l = ((int)(short)v * spu.iLeftXAVol) >> 15;
    r = ((int)(short)(v >> 16) * spu.iLeftXAVol) >> 15;
@@ -82,6 +110,7 @@ INLINE void MixXA(int *SSumLR, int ns_to, int decode_pos)
    spu.spuMem[cursor + 0x400/2] = v >> 16;
    cursor = (cursor + 1) & 0x1ff;
   }
+ ring_set(&spu.CDDAPlay, play);
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -381,26 +410,28 @@ INLINE void FeedXA(xa_decode_t *xap)
 
 INLINE int FeedCDDA(unsigned char *pcm, int nBytes)
 {
+ unsigned int *feed = spu.CDDAFeed;
+ unsigned int *play = ring_get(&spu.CDDAPlay);
  int space;
- space=(spu.CDDAPlay-spu.CDDAFeed-1)*4 & (CDDA_BUFFER_SIZE - 1);
+
+ space=(play-feed-1)*4 & (CDDA_BUFFER_SIZE - 1);
  if(space<nBytes)
   return 0x7761; // rearmed_wait
 
  while(nBytes>0)
   {
-   if(spu.CDDAFeed==spu.CDDAEnd) spu.CDDAFeed=spu.CDDAStart;
-   space=(spu.CDDAPlay-spu.CDDAFeed-1)*4 & (CDDA_BUFFER_SIZE - 1);
-   if(spu.CDDAFeed+space/4>spu.CDDAEnd)
-    space=(spu.CDDAEnd-spu.CDDAFeed)*4;
+   space=(spu.CDDAEnd-feed)*4;
    if(space>nBytes)
     space=nBytes;
 
-   memcpy(spu.CDDAFeed,pcm,space);
-   spu.CDDAFeed+=space/4;
+   memcpy(feed,pcm,space);
+   feed+=space/4;
+   if(feed==spu.CDDAEnd) feed=spu.CDDAStart;
    nBytes-=space;
    pcm+=space;
   }
 
+ ring_set(&spu.CDDAFeed, feed);
  return 0x676f; // rearmed_go
 }
 
@@ -32,7 +32,7 @@ static void blit(void)
  // account for centering
  h -= PreviousPSXDisplay.Range.y0;
 
- rcbs->pl_vout_flip(srcs, 1024, PSXDisplay.RGB24, w, h);
+ rcbs->pl_vout_flip(srcs, 1024, PSXDisplay.RGB24, w, h, 0, h);
 }
 
 void DoBufferSwap(void)
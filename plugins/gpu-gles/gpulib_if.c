@@ -535,7 +535,7 @@ int do_cmd_list(unsigned int *list, int list_len, int *last_cmd)
     if (cmd == 0xa0 || cmd == 0xc0)
       break; // image i/o, forward to upper layer
     else if ((cmd & 0xf8) == 0xe0)
-      gpu.ex_regs[cmd & 7] = list[0];
+      gpu.renderer_ex_regs[cmd & 7] = list[0];
 #endif
 
     primTableJ[cmd]((void *)list);
@@ -604,8 +604,8 @@ int do_cmd_list(unsigned int *list, int list_len, int *last_cmd)
   }
 
 breakloop:
-  gpu.ex_regs[1] &= ~0x1ff;
-  gpu.ex_regs[1] |= lGPUstatusRet & 0x1ff;
+  gpu.renderer_ex_regs[1] &= ~0x1ff;
+  gpu.renderer_ex_regs[1] |= lGPUstatusRet & 0x1ff;
 
   *last_cmd = cmd;
   return list - list_start;
@@ -47,6 +47,14 @@ u32 zero_block_spans = 0;
 u32 texture_cache_loads = 0;
 u32 false_modulated_blocks = 0;
 
+// the counters above aren't per band worker, so they're only kept
+// when profiling
+#ifdef PROFILE
+#define stat_add(counter, n) counter += n
+#else
+#define stat_add(counter, n)
+#endif
+
 /* double size for enhancement */
 u32 reciprocal_table[512 * 2];
 
@@ -255,6 +263,8 @@ void update_texture_cache_region(psx_gpu_struct *psx_gpu, u32 x1, u32 y1,
   u32 texel_block;
   u32 sub_x, sub_y;
 
+  render_bands_sync(psx_gpu);
+
   psx_gpu->dirty_textures_8bpp_mask |= mask;
   psx_gpu->dirty_textures_8bpp_alternate_mask |= mask;
 
@@ -316,7 +326,7 @@ void update_texture_4bpp_cache(psx_gpu_struct *psx_gpu)
   vram_ptr += (current_texture_page >> 4) * 256 * 1024;
   vram_ptr += (current_texture_page & 0xF) * 64;
 
-  texture_cache_loads++;
+  stat_add(texture_cache_loads, 1);
 
   tile_y = 16;
   tile_x = 16;
@@ -377,7 +387,7 @@ void update_texture_8bpp_cache_slice(psx_gpu_struct *psx_gpu,
 
   vec_8x16u texels;
 
-  texture_cache_loads++;
+  stat_add(texture_cache_loads, 1);
 
   vram_ptr += (texture_page >> 4) * 256 * 1024;
   vram_ptr += (texture_page & 0xF) * 64;
@@ -452,6 +462,9 @@ void update_texture_8bpp_cache(psx_gpu_struct *psx_gpu)
 void setup_blocks_shaded_untextured_undithered_unswizzled_indirect(
  psx_gpu_struct *psx_gpu);
 
+void render_bands_queue(psx_gpu_struct *psx_gpu);
+u32 render_bands_texture_barrier(psx_gpu_struct *psx_gpu, u32 texture_mode);
+
 void flush_render_block_buffer(psx_gpu_struct *psx_gpu)
 {
   if((psx_gpu->render_mode & RENDER_INTERLACE_ENABLED) &&
@@ -501,9 +514,16 @@ void flush_render_block_buffer(psx_gpu_struct *psx_gpu)
     render_block_handler_struct *render_block_handler =
      psx_gpu->render_block_handler;
 
-    render_block_handler->texture_blocks(psx_gpu);
-    render_block_handler->shade_blocks(psx_gpu);
-    render_block_handler->blend_blocks(psx_gpu);
+    if(psx_gpu->render_bands)
+    {
+      render_bands_queue(psx_gpu);
+    }
+    else
+    {
+      render_block_handler->texture_blocks(psx_gpu);
+      render_block_handler->shade_blocks(psx_gpu);
+      render_block_handler->blend_blocks(psx_gpu);
+    }
 
 #ifdef PROFILE
     span_pixel_blocks += psx_gpu->num_blocks;
@@ -643,7 +663,7 @@ void compute_all_gradients(psx_gpu_struct *psx_gpu, vertex_struct *a,
 
   dup_4x32b(winding_mask, winding_mask_scalar);
   eor_4x32b(gradient_area_sign_a, gradient_area_sign_a, winding_mask);
-  eor_2x32b(gradient_area_sign_b, gradient_area_sign_b, winding_mask);
+  eor_2x32b(gradient_area_sign_b, gradient_area_sign_b, winding_mask.low);
   eor_4x32b(gradient_area_sign_c, gradient_area_sign_c, winding_mask);
 
   mul_scalar_long_2x32b(gradient_wide_a0, 
@@ -791,7 +811,7 @@ void compute_all_gradients(psx_gpu_struct *psx_gpu, vertex_struct *a,
   vec_2x64s alternate_x;                                                       \
   vec_2x64s alternate_dx_dy;                                                   \
   vec_4x32s alternate_x_32;                                                    \
-  vec_2x32s alternate_x_16;                                                    \
+  vec_4x16s alternate_x_16;                                                    \
                                                                                \
   vec_4x16u alternate_select;                                                  \
   vec_4x16s y_mid_point;                                                       \
@@ -866,7 +886,7 @@ void compute_all_gradients(psx_gpu_struct *psx_gpu, vertex_struct *a,
   vec_2x32s heights;                                                           \
   vec_2x32s height_reciprocals;                                                \
   vec_2x32s heights_b;                                                         \
-  vec_4x32u widths;                                                            \
+  vec_2x32u widths;                                                            \
                                                                                \
   u32 edge_shift = reciprocal_table[height];                                   \
                                                                                \
@@ -925,10 +945,10 @@ void compute_all_gradients(psx_gpu_struct *psx_gpu, vertex_struct *a,
 
 
 #define setup_spans_adjust_y_up()                                              \
-  sub_4x32b(y_x4, y_x4, c_0x04)                                                \
+  sub_4x16b(y_x4, y_x4, c_0x04)                                                \
 
 #define setup_spans_adjust_y_down()                                            \
-  add_4x32b(y_x4, y_x4, c_0x04)                                                \
+  add_4x16b(y_x4, y_x4, c_0x04)                                                \
 
 #define setup_spans_adjust_interpolants_up()                                   \
   sub_4x32b(uvrg, uvrg, uvrg_dy);                                              \
@@ -954,7 +974,7 @@ void compute_all_gradients(psx_gpu_struct *psx_gpu, vertex_struct *a,
 
 #define setup_spans_clip(direction, alternate_active)                          \
 {                                                                              \
-  clipped_triangles++;                                                         \
+  stat_add(clipped_triangles, 1);                                              \
   mla_scalar_long_2x32b(edges_xy, edges_dx_dy, (s64)clip);                     \
   setup_spans_clip_alternate_##alternate_active();                             \
   setup_spans_clip_interpolants_##direction();                                 \
@@ -1267,7 +1287,7 @@ void setup_spans_down_right(psx_gpu_struct *psx_gpu, vertex_struct *v_a,
 #define setup_spans_up_flat()                                                  \
   s32 height = y_a - y_c;                                                      \
                                                                                \
-  flat_triangles++;                                                            \
+  stat_add(flat_triangles, 1);                                                 \
   compute_edge_delta_x2();                                                     \
   setup_spans_up(index_left, index_right, none, no)                            \
 
@@ -1296,7 +1316,7 @@ void setup_spans_up_b(psx_gpu_struct *psx_gpu, vertex_struct *v_a,
 #define setup_spans_down_flat()                                                \
   s32 height = y_c - y_a;                                                      \
                                                                                \
-  flat_triangles++;                                                            \
+  stat_add(flat_triangles, 1);                                                 \
   compute_edge_delta_x2();                                                     \
   setup_spans_down(index_left, index_right, none, no)                          \
 
@@ -1440,7 +1460,7 @@ void setup_spans_up_down(psx_gpu_struct *psx_gpu, vertex_struct *v_a,
     }
   }
 
-  left_split_triangles++;
+  stat_add(left_split_triangles, 1);
 }
 
 #endif
@@ -1840,6 +1860,150 @@ void setup_spans_up_down(psx_gpu_struct *psx_gpu, vertex_struct *v_a,
   setup_blocks_store_untextured_pixels_##target##_##edge_type(colors)          \
 
 
+#if defined(__SSE2__) && !defined(NEON_BUILD)
+
+/*
+ * The versions above build each vec_8x16u from two halves stored
+ * separately, which x86 can't forward to the 128 bit load that follows.
+ * These keep each pair of components in one register instead: u and v
+ * (or r and g) end up in the low and high half, like texture_mask.
+ */
+
+#undef setup_blocks_store_shaded_textured
+#undef setup_blocks_store_unshaded_textured
+
+#define setup_blocks_narrow_sse2(_block, _dx4)                                 \
+  _mm_and_si128(_mm_packs_epi32(_mm_srai_epi32(sse_load_128b(_block), 16),     \
+   _mm_srai_epi32(_mm_add_epi32(sse_load_128b(_block), _mm_set1_epi32(_dx4)),  \
+   16)), _mm_set1_epi16(0xFF))                                                 \
+
+#define setup_blocks_narrow_pair_sse2(block_a, dx4_a, block_b, dx4_b)          \
+  _mm_packus_epi16(setup_blocks_narrow_sse2(block_a, dx4_a),                   \
+   setup_blocks_narrow_sse2(block_b, dx4_b))                                   \
+
+#define setup_blocks_texture_swizzled_sse2(_uv)                                \
+{                                                                              \
+  __m128i vu = _mm_shuffle_epi32(_uv, _MM_SHUFFLE(1, 0, 3, 2));                \
+  __m128i low_nibbles = _mm_set1_epi8(0x0F);                                   \
+  __m128i u_swizzled = _mm_or_si128(_mm_and_si128(_uv, low_nibbles),          \
+   _mm_andnot_si128(low_nibbles, _mm_slli_epi16(vu, 4)));                      \
+  __m128i v_swizzled = _mm_or_si128(_mm_andnot_si128(low_nibbles, _uv),       \
+   _mm_and_si128(_mm_srli_epi16(vu, 4), low_nibbles));                         \
+  _uv = _mm_unpacklo_epi8(u_swizzled, _mm_unpackhi_epi64(v_swizzled,           \
+   v_swizzled));                                                               \
+}                                                                              \
+
+#define setup_blocks_texture_unswizzled_sse2(_uv)                              \
+  _uv = _mm_unpacklo_epi8(_uv, _mm_unpackhi_epi64(_uv, _uv))                   \
+
+#define setup_blocks_store_shaded_textured(swizzling, dithering, target,       \
+ edge_type)                                                                    \
+{                                                                              \
+  __m128i uv = setup_blocks_narrow_pair_sse2(u_block, uvrg_dx4.e[0],           \
+   v_block, uvrg_dx4.e[1]);                                                    \
+  __m128i rg = setup_blocks_narrow_pair_sse2(r_block, uvrg_dx4.e[2],           \
+   g_block, uvrg_dx4.e[3]);                                                    \
+  __m128i b_ = _mm_packus_epi16(setup_blocks_narrow_sse2(b_block, b_dx4),      \
+   _mm_setzero_si128());                                                       \
+  vec_4x32u dx8;                                                               \
+                                                                               \
+  dup_4x32b(dx8, uvrg_dx8.e[0]);                                               \
+  add_4x32b(u_block, u_block, dx8);                                            \
+  dup_4x32b(dx8, uvrg_dx8.e[1]);                                               \
+  add_4x32b(v_block, v_block, dx8);                                            \
+  dup_4x32b(dx8, uvrg_dx8.e[2]);                                               \
+  add_4x32b(r_block, r_block, dx8);                                            \
+  dup_4x32b(dx8, uvrg_dx8.e[3]);                                               \
+  add_4x32b(g_block, g_block, dx8);                                            \
+  dup_4x32b(dx8, b_dx8);                                                       \
+  add_4x32b(b_block, b_block, dx8);                                            \
+                                                                               \
+  uv = _mm_and_si128(uv, sse_load_128b(texture_mask));                         \
+  setup_blocks_texture_##swizzling##_sse2(uv);                                 \
+                                                                               \
+  sse_store_128b(block->uv, uv);                                               \
+  sse_store_64b(block->r, rg);                                                 \
+  sse_store_64b(block->g, _mm_unpackhi_epi64(rg, rg));                         \
+  sse_store_64b(block->b, b_);                                                 \
+  block->dither_offsets = vector_cast(vec_8x16u, dither_offsets);              \
+  block->fb_ptr = fb_ptr;                                                      \
+}                                                                              \
+
+#define setup_blocks_store_unshaded_textured(swizzling, dithering, target,     \
+ edge_type)                                                                    \
+{                                                                              \
+  __m128i uv = setup_blocks_narrow_pair_sse2(u_block, uv_dx4.e[0],             \
+   v_block, uv_dx4.e[1]);                                                      \
+  vec_4x32u dx8;                                                               \
+                                                                               \
+  dup_4x32b(dx8, uv_dx8.e[0]);                                                 \
+  add_4x32b(u_block, u_block, dx8);                                            \
+  dup_4x32b(dx8, uv_dx8.e[1]);                                                 \
+  add_4x32b(v_block, v_block, dx8);                                            \
+                                                                               \
+  uv = _mm_and_si128(uv, sse_load_128b(texture_mask));                         \
+  setup_blocks_texture_##swizzling##_sse2(uv);                                 \
+                                                                               \
+  sse_store_128b(block->uv, uv);                                               \
+  block->dither_offsets = vector_cast(vec_8x16u, dither_offsets);              \
+  block->fb_ptr = fb_ptr;                                                      \
+}                                                                              \
+
+#undef setup_blocks_store_shaded_untextured
+
+#define setup_blocks_store_shaded_untextured_dithered_sse2()                   \
+{                                                                              \
+  __m128i dither = _mm_loadl_epi64((__m128i *)dither_offsets.e);               \
+  __m128i four = _mm_set1_epi8(4);                                             \
+  dither = _mm_unpacklo_epi64(dither, dither);                                 \
+  rg = _mm_subs_epu8(_mm_adds_epu8(rg, dither), four);                         \
+  b_ = _mm_subs_epu8(_mm_adds_epu8(b_, dither), four);                         \
+}                                                                              \
+
+#define setup_blocks_store_shaded_untextured_undithered_sse2()                 \
+
+#define setup_blocks_store_shaded_untextured_seed_pixels_indirect_sse2()       \
+  _mm_setzero_si128()                                                          \
+
+#define setup_blocks_store_shaded_untextured_seed_pixels_direct_sse2()         \
+  sse_load_128b(msb_mask)                                                      \
+
+#define setup_blocks_store_shaded_untextured(swizzling, dithering, target,     \
+ edge_type)                                                                    \
+{                                                                              \
+  __m128i rg = setup_blocks_narrow_pair_sse2(r_block, rgb_dx4.e[0],            \
+   g_block, rgb_dx4.e[1]);                                                     \
+  __m128i b_ = _mm_packus_epi16(setup_blocks_narrow_sse2(b_block,              \
+   rgb_dx4.e[2]), _mm_setzero_si128());                                        \
+  __m128i zero = _mm_setzero_si128();                                          \
+  __m128i high_bits = _mm_set1_epi16(0xF8);                                    \
+  __m128i pixels_;                                                             \
+  vec_8x16u pixels;                                                            \
+  vec_4x32u dx8;                                                               \
+                                                                               \
+  dup_4x32b(dx8, rgb_dx8.e[0]);                                                \
+  add_4x32b(r_block, r_block, dx8);                                            \
+  dup_4x32b(dx8, rgb_dx8.e[1]);                                                \
+  add_4x32b(g_block, g_block, dx8);                                            \
+  dup_4x32b(dx8, rgb_dx8.e[2]);                                                \
+  add_4x32b(b_block, b_block, dx8);                                            \
+                                                                               \
+  setup_blocks_store_shaded_untextured_##dithering##_sse2();                   \
+                                                                               \
+  pixels_ = setup_blocks_store_shaded_untextured_seed_pixels_##target##_sse2();\
+  pixels_ = _mm_add_epi16(pixels_,                                             \
+   _mm_srli_epi16(_mm_unpacklo_epi8(rg, zero), 3));                            \
+  pixels_ = _mm_add_epi16(pixels_, _mm_slli_epi16(                             \
+   _mm_and_si128(_mm_unpackhi_epi8(rg, zero), high_bits), 2));                 \
+  pixels_ = _mm_add_epi16(pixels_, _mm_slli_epi16(                             \
+   _mm_and_si128(_mm_unpacklo_epi8(b_, zero), high_bits), 7));                 \
+  sse_store_128b(pixels, pixels_);                                             \
+                                                                               \
+  setup_blocks_store_untextured_pixels_##target##_##edge_type(pixels);         \
+}                                                                              \
+
+#endif
+
 #define setup_blocks_store_draw_mask_textured_indirect(_block, bits)           \
   (_block)->draw_mask_bits = bits                                              \
 
@@ -1867,8 +2031,8 @@ void setup_spans_up_down(psx_gpu_struct *psx_gpu, vertex_struct *v_a,
   }                                                                            \
 
 #define setup_blocks_add_blocks_direct()                                       \
-  texel_blocks_untextured += span_num_blocks;                                  \
-  span_pixel_blocks += span_num_blocks                                         \
+  stat_add(texel_blocks_untextured, span_num_blocks);                          \
+  stat_add(span_pixel_blocks, span_num_blocks)                                 \
 
 
 #define setup_blocks_builder(shading, texturing, dithering, sw, target)        \
@@ -1907,7 +2071,7 @@ void setup_blocks_##shading##_##texturing##_##dithering##_##sw##_##target(     \
                                                                                \
       s32 pixel_span = span_num_blocks * 8;                                    \
       pixel_span -= __builtin_popcount(span_edge_data->right_mask & 0xFF);     \
-      span_pixels += pixel_span;                                               \
+      stat_add(span_pixels, pixel_span);                                       \
                                                                                \
       span_num_blocks--;                                                       \
       while(span_num_blocks)                                                   \
@@ -1929,7 +2093,7 @@ void setup_blocks_##shading##_##texturing##_##dithering##_##sw##_##target(     \
     }                                                                          \
     else                                                                       \
     {                                                                          \
-      zero_block_spans++;                                                      \
+      stat_add(zero_block_spans, 1);                                           \
     }                                                                          \
                                                                                \
     num_spans--;                                                               \
@@ -1996,14 +2160,106 @@ void texture_blocks_16bpp(psx_gpu_struct *psx_gpu);
 void texture_blocks_untextured(psx_gpu_struct *psx_gpu)
 {
   if(psx_gpu->primitive_type != PRIMITIVE_TYPE_SPRITE)
-    texel_blocks_untextured += psx_gpu->num_blocks;
+    stat_add(texel_blocks_untextured, psx_gpu->num_blocks);
 }
 
+#if defined(__SSE2__)
+
+/*
+ * The texels are gathered one at a time, so build them up in a register;
+ * stores to each element of block->texels would stall the 128 bit load
+ * of the whole vector that follows.
+ */
+
+#define texture_blocks_gather_sse2(texel)                                      \
+{                                                                              \
+  __m128i texels = _mm_setzero_si128();                                        \
+  texels = _mm_insert_epi16(texels, texel(0), 0);                              \
+  texels = _mm_insert_epi16(texels, texel(1), 1);                              \
+  texels = _mm_insert_epi16(texels, texel(2), 2);                              \
+  texels = _mm_insert_epi16(texels, texel(3), 3);                              \
+  texels = _mm_insert_epi16(texels, texel(4), 4);                              \
+  texels = _mm_insert_epi16(texels, texel(5), 5);                              \
+  texels = _mm_insert_epi16(texels, texel(6), 6);                              \
+  texels = _mm_insert_epi16(texels, texel(7), 7);                              \
+  sse_store_128b(block->texels, texels);                                       \
+}                                                                              \
+
+// the 4bpp cache has the indexes in bytes too, all below 16
+#define texture_blocks_texel_clut(i)                                           \
+  clut_ptr[texture_ptr_8bpp[block->uv.e[i]]]                                   \
+
+#define texture_blocks_texel_16bpp(i)                                          \
+  texture_ptr_16bpp[block->uv.e[i] + ((block->uv.e[i] & 0xFF00) * 3)]          \
+
+void texture_blocks_4bpp(psx_gpu_struct *psx_gpu)
+{
+  block_struct *block = psx_gpu->blocks;
+  u32 num_blocks = psx_gpu->num_blocks;
+  stat_add(texel_blocks_4bpp, num_blocks);
+
+  u8 *texture_ptr_8bpp = psx_gpu->texture_page_ptr;
+  u16 *clut_ptr = psx_gpu->clut_ptr;
+
+  if(psx_gpu->current_texture_mask & psx_gpu->dirty_textures_4bpp_mask)
+    update_texture_4bpp_cache(psx_gpu);
+
+  while(num_blocks)
+  {
+    texture_blocks_gather_sse2(texture_blocks_texel_clut);
+
+    num_blocks--;
+    block++;
+  }
+}
+
+void texture_blocks_8bpp(psx_gpu_struct *psx_gpu)
+{
+  block_struct *block = psx_gpu->blocks;
+  u32 num_blocks = psx_gpu->num_blocks;
+
+  stat_add(texel_blocks_8bpp, num_blocks);
+
+  if(psx_gpu->current_texture_mask & psx_gpu->dirty_textures_8bpp_mask)
+    update_texture_8bpp_cache(psx_gpu);
+
+  u8 *texture_ptr_8bpp = psx_gpu->texture_page_ptr;
+  u16 *clut_ptr = psx_gpu->clut_ptr;
+
+  while(num_blocks)
+  {
+    texture_blocks_gather_sse2(texture_blocks_texel_clut);
+
+    num_blocks--;
+    block++;
+  }
+}
+
+void texture_blocks_16bpp(psx_gpu_struct *psx_gpu)
+{
+  block_struct *block = psx_gpu->blocks;
+  u32 num_blocks = psx_gpu->num_blocks;
+
+  stat_add(texel_blocks_16bpp, num_blocks);
+
+  u16 *texture_ptr_16bpp = psx_gpu->texture_page_ptr;
+
+  while(num_blocks)
+  {
+    texture_blocks_gather_sse2(texture_blocks_texel_16bpp);
+
+    num_blocks--;
+    block++;
+  }
+}
+
+#else
+
 void texture_blocks_4bpp(psx_gpu_struct *psx_gpu)
 {
   block_struct *block = psx_gpu->blocks;
   u32 num_blocks = psx_gpu->num_blocks;
-  texel_blocks_4bpp += num_blocks;
+  stat_add(texel_blocks_4bpp, num_blocks);
 
   vec_8x8u texels_low;
   vec_8x8u texels_high;
@@ -2055,7 +2311,7 @@ void texture_blocks_8bpp(psx_gpu_struct *psx_gpu)
   block_struct *block = psx_gpu->blocks;
   u32 num_blocks = psx_gpu->num_blocks;
 
-  texel_blocks_8bpp += num_blocks;
+  stat_add(texel_blocks_8bpp, num_blocks);
 
   if(psx_gpu->current_texture_mask & psx_gpu->dirty_textures_8bpp_mask)
     update_texture_8bpp_cache(psx_gpu);
@@ -2089,7 +2345,7 @@ void texture_blocks_16bpp(psx_gpu_struct *psx_gpu)
   block_struct *block = psx_gpu->blocks;
   u32 num_blocks = psx_gpu->num_blocks;
 
-  texel_blocks_16bpp += num_blocks;
+  stat_add(texel_blocks_16bpp, num_blocks);
 
   vec_8x16u texels;
 
@@ -2116,6 +2372,8 @@ void texture_blocks_16bpp(psx_gpu_struct *psx_gpu)
 
 #endif
 
+#endif
+
 
 #define shade_blocks_load_msb_mask_indirect()                                  \
 
@@ -2140,7 +2398,7 @@ void texture_blocks_16bpp(psx_gpu_struct *psx_gpu)
 #define shade_blocks_textured_false_modulated_check_dithered(target)           \
   if(psx_gpu->triangle_color == 0x808080)                                      \
   {                                                                            \
-    false_modulated_blocks += num_blocks;                                      \
+    stat_add(false_modulated_blocks, num_blocks);                              \
   }                                                                            \
 
 #define shade_blocks_textured_false_modulated_check_undithered(target)         \
@@ -2148,7 +2406,7 @@ void texture_blocks_16bpp(psx_gpu_struct *psx_gpu)
   {                                                                            \
                                                                                \
     shade_blocks_textured_unmodulated_##target(psx_gpu);                       \
-    false_modulated_blocks += num_blocks;                                      \
+    stat_add(false_modulated_blocks, num_blocks);                              \
     return;                                                                    \
   }                                                                            \
 
@@ -2580,6 +2838,7 @@ void                                                                           \
   u16 *fb_ptr;                                                                 \
                                                                                \
   dup_8x16b(msb_mask, psx_gpu->mask_msb);                                      \
+  stat_add(blend_blocks, num_blocks);                                          \
                                                                                \
   while(num_blocks)                                                            \
   {                                                                            \
@@ -2596,7 +2855,6 @@ void                                                                           \
     bif_8x16b(framebuffer_pixels, blend_pixels, draw_mask);                    \
     store_8x16b(framebuffer_pixels, fb_ptr);                                   \
                                                                                \
-    blend_blocks++;                                                            \
     num_blocks--;                                                              \
     block++;                                                                   \
   }                                                                            \
@@ -2622,6 +2880,7 @@ void blend_blocks_untextured_add_fourth_on(psx_gpu_struct *psx_gpu);
 
 void blend_blocks_textured_unblended_off(psx_gpu_struct *psx_gpu);
 void blend_blocks_textured_unblended_on(psx_gpu_struct *psx_gpu);
+void blend_blocks_untextured_unblended_off(psx_gpu_struct *psx_gpu);
 
 #ifndef NEON_BUILD
 
@@ -2651,6 +2910,9 @@ blend_blocks_builder(textured, unblended, on);
 
 #endif
 
+// For the band workers, which can't have setup_blocks draw directly.
+blend_blocks_builder(untextured, unblended, off);
+
                                                                                
 #define vertex_swap(_a, _b)                                                    \
 {                                                                              \
@@ -2893,6 +3155,32 @@ render_block_handler_struct render_triangle_block_handlers[] =
   render_blocks_switch_block()
 };
 
+// Replace the direct (untextured, unblended, no mask evaluation) handlers
+// while the bands are on, indexed by shading and dithering.
+render_block_handler_struct render_triangle_band_handlers[] =
+{
+  {
+    setup_blocks_unshaded_untextured_undithered_unswizzled_indirect,
+    texture_blocks_untextured, shade_blocks_unshaded_untextured_indirect,
+    blend_blocks_untextured_unblended_off
+  },
+  {
+    setup_blocks_unshaded_untextured_undithered_unswizzled_indirect,
+    texture_blocks_untextured, shade_blocks_unshaded_untextured_indirect,
+    blend_blocks_untextured_unblended_off
+  },
+  {
+    setup_blocks_shaded_untextured_undithered_unswizzled_indirect,
+    texture_blocks_untextured, shade_blocks_shaded_untextured,
+    blend_blocks_untextured_unblended_off
+  },
+  {
+    setup_blocks_shaded_untextured_dithered_unswizzled_indirect,
+    texture_blocks_untextured, shade_blocks_shaded_untextured,
+    blend_blocks_untextured_unblended_off
+  }
+};
+
 #undef render_blocks_switch_block_modulation
 
 #define render_blocks_switch_block_modulation(texture_mode, blend_mode,        \
@@ -3163,6 +3451,14 @@ static void render_triangle_p(psx_gpu_struct *psx_gpu,
 
   psx_gpu->render_block_handler =
    &(render_triangle_block_handlers[render_state]);
+
+  if(psx_gpu->render_bands && (render_state & (RENDER_FLAGS_TEXTURE_MAP |
+   RENDER_FLAGS_BLEND | RENDER_STATE_MASK_EVALUATE)) == 0)
+  {
+    psx_gpu->render_block_handler =
+     &(render_triangle_band_handlers[(render_state >> 3) & 0x3]);
+  }
+
   ((setup_blocks_function_type *)psx_gpu->render_block_handler->setup_blocks)
    (psx_gpu);
 }
@@ -3239,7 +3535,7 @@ void texture_sprite_blocks_8bpp(psx_gpu_struct *psx_gpu)
 
 #define setup_sprite_tile_add_blocks(tile_num_blocks)                          \
   num_blocks += tile_num_blocks;                                               \
-  sprite_blocks += tile_num_blocks;                                            \
+  stat_add(sprite_blocks, tile_num_blocks);                                    \
                                                                                \
   if(num_blocks > MAX_BLOCKS)                                                  \
   {                                                                            \
@@ -3339,7 +3635,7 @@ void texture_sprite_blocks_8bpp(psx_gpu_struct *psx_gpu)
 
 #define setup_sprite_tile_half_8bpp(edge)                                      \
 {                                                                              \
-  setup_sprite_tile_add_blocks(sub_tile_height * 2);                           \
+  setup_sprite_tile_add_blocks(sub_tile_height);                               \
                                                                                \
   while(sub_tile_height)                                                       \
   {                                                                            \
@@ -3933,7 +4229,7 @@ void setup_sprite_16bpp(psx_gpu_struct *psx_gpu, s32 x, s32 y, s32 u,
 
   texture_offset_base &= ~0x7;
 
-  sprites_16bpp++;
+  stat_add(sprites_16bpp, 1);
 
   if(block_width == 1)
   {
@@ -3942,7 +4238,7 @@ void setup_sprite_16bpp(psx_gpu_struct *psx_gpu, s32 x, s32 y, s32 u,
     while(height)
     {
       num_blocks++;
-      sprite_blocks++;
+      stat_add(sprite_blocks, 1);
 
       if(num_blocks > MAX_BLOCKS)
       {
@@ -3975,7 +4271,7 @@ void setup_sprite_16bpp(psx_gpu_struct *psx_gpu, s32 x, s32 y, s32 u,
     {
       blocks_remaining = block_width - 2;
       num_blocks += block_width;
-      sprite_blocks += block_width;
+      stat_add(sprite_blocks, block_width);
 
       if(num_blocks > MAX_BLOCKS)
       {
@@ -4055,7 +4351,7 @@ void setup_sprite_untextured(psx_gpu_struct *psx_gpu, s32 x, s32 y, s32 u,
   vec_8x16u test_mask = psx_gpu->test_mask;
   vec_8x16u zero_mask;
 
-  sprites_untextured++;
+  stat_add(sprites_untextured, 1);
 
   color = (color_r >> 3) | ((color_g >> 3) << 5) | ((color_b >> 3) << 10);
 
@@ -4125,6 +4421,8 @@ void setup_sprite_untextured_simple(psx_gpu_struct *psx_gpu, s32 x, s32 y,
     flush_render_block_buffer(psx_gpu);
   }
 
+  render_bands_sync(psx_gpu);
+
   while(height)
   {
     num_width = width;
@@ -4339,6 +4637,10 @@ void render_sprite(psx_gpu_struct *psx_gpu, s32 x, s32 y, u32 u, u32 v,
    &(render_sprite_block_handlers[render_state]);
   psx_gpu->render_block_handler = render_block_handler;
 
+  // sprite setup reads the textures itself
+  if(psx_gpu->render_bands && (render_state & RENDER_FLAGS_TEXTURE_MAP))
+    render_bands_texture_barrier(psx_gpu, (render_state >> 8) & 0x3);
+
   ((setup_sprite_function_type *)render_block_handler->setup_blocks)
    (psx_gpu, x, y, u, v, width, height, color);
 }
@@ -4637,6 +4939,7 @@ void render_line(psx_gpu_struct *psx_gpu, vertex_struct *vertexes, u32 flags,
   u16 *vram_ptr;
 
   flush_render_block_buffer(psx_gpu);
+  render_bands_sync(psx_gpu);
   psx_gpu->primitive_type = PRIMITIVE_TYPE_LINE;
 
   vertex_struct *vertex_a = &(vertexes[0]);
@@ -4867,6 +5170,7 @@ void render_block_fill(psx_gpu_struct *psx_gpu, u32 color, u32 x, u32 y,
   if((width == 0) || (height == 0))
     return;
 
+  render_bands_sync(psx_gpu);
   invalidate_texture_cache_region(psx_gpu, x, y, x + width - 1, y + height - 1);
 
   u32 r = color & 0xFF;
@@ -4919,6 +5223,8 @@ void render_block_fill_enh(psx_gpu_struct *psx_gpu, u32 color, u32 x, u32 y,
   if((width == 0) || (height == 0))
     return;
 
+  render_bands_sync(psx_gpu);
+
   if(width > 1024)
     width = 1024;
 
@@ -4968,6 +5274,7 @@ void render_block_copy(psx_gpu_struct *psx_gpu, u16 *source, u32 x, u32 y,
     return;
 
   flush_render_block_buffer(psx_gpu);
+  render_bands_sync(psx_gpu);
   invalidate_texture_cache_region(psx_gpu, x, y, x + width - 1, y + height - 1);
 
   for(draw_y = 0; draw_y < height; draw_y++)
@@ -5142,3 +5449,4 @@ void triangle_benchmark(psx_gpu_struct *psx_gpu)
 #endif
 
 #include "psx_gpu_4x.c"
+#include "psx_gpu_bands.c"
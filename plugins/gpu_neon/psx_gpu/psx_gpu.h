@@ -192,9 +192,12 @@ typedef struct
   s16 saved_viewport_end_y;
   u8 enhancement_buf_by_x16[64];
 
+  // set while the block stages run on the band workers (psx_gpu_bands.c)
+  u8 render_bands;
+
   // Align up to 64 byte boundary to keep the upcoming buffers cache line
   // aligned, also make reachable with single immediate addition
-  u8 reserved_a[160];
+  u8 reserved_a[159];
 
   // 8KB
   block_struct blocks[MAX_BLOCKS_PER_ROW];
@@ -242,6 +245,10 @@ u32 texture_region_mask(s32 x1, s32 y1, s32 x2, s32 y2);
 
 void flush_render_block_buffer(psx_gpu_struct *psx_gpu);
 
+int render_bands_start(psx_gpu_struct *psx_gpu);
+void render_bands_stop(psx_gpu_struct *psx_gpu);
+void render_bands_sync(psx_gpu_struct *psx_gpu);
+
 void initialize_psx_gpu(psx_gpu_struct *psx_gpu, u16 *vram);
 u32 gpu_parse(psx_gpu_struct *psx_gpu, u32 *list, u32 size, u32 *last_command);
 
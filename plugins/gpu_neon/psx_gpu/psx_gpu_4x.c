@@ -30,7 +30,7 @@ void setup_sprite_16bpp_4x(psx_gpu_struct *psx_gpu, s32 x, s32 y, s32 u,
 
   texture_offset_base &= ~0x7;
 
-  sprites_16bpp++;
+  stat_add(sprites_16bpp, 1);
 
   if(block_width == 1)
   {
@@ -44,7 +44,7 @@ void setup_sprite_16bpp_4x(psx_gpu_struct *psx_gpu, s32 x, s32 y, s32 u,
     while(height)
     {
       num_blocks += 4;
-      sprite_blocks += 4;
+      stat_add(sprite_blocks, 4);
 
       if(num_blocks > MAX_BLOCKS)
       {
@@ -103,7 +103,7 @@ void setup_sprite_16bpp_4x(psx_gpu_struct *psx_gpu, s32 x, s32 y, s32 u,
     {
       blocks_remaining = block_width - 2;
       num_blocks += block_width * 4;
-      sprite_blocks += block_width * 4;
+      stat_add(sprite_blocks, block_width * 4);
 
       if(num_blocks > MAX_BLOCKS)
       {
@@ -378,6 +378,9 @@ void render_sprite_4x(psx_gpu_struct *psx_gpu, s32 x, s32 y, u32 u, u32 v,
    &(render_sprite_block_handlers_4x[render_state]);
   psx_gpu->render_block_handler = render_block_handler;
 
+  if(psx_gpu->render_bands && (render_state & RENDER_FLAGS_TEXTURE_MAP))
+    render_bands_texture_barrier(psx_gpu, (render_state >> 8) & 0x3);
+
   ((setup_sprite_function_type *)render_block_handler->setup_blocks)
    (psx_gpu, x, y, u, v, width, height, color);
 }
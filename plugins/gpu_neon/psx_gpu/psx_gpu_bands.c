@@ -0,0 +1,432 @@
+/*
+ * This work is licensed under the terms of any of these licenses
+ * (at your option):
+ *  - GNU GPL, version 2 or later.
+ *  - GNU LGPL, version 2.1 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+/*
+ * Band parallel rendering.
+ *
+ * Instead of running the texture/shade/blend stages itself,
+ * flush_render_block_buffer() copies the blocks along with the part of
+ * psx_gpu_struct those stages read to a ring of jobs. The output is cut
+ * into 8 line bands which are dealt out to the worker threads, and each
+ * worker draws only the blocks that fall in its bands, from every job
+ * in queue order. A pixel is thus always drawn by the same thread and
+ * in the original order, which is all semi-transparency and mask bit
+ * evaluation need. The rare flush with a block crossing into another
+ * band or drawing over its own texture is drawn by the caller once the
+ * workers are done.
+ *
+ * Everything that touches vram or the texture caches outside of the
+ * block stages (fills, copies, lines, simple sprites, cache updates,
+ * gpulib) must call render_bands_sync() first. The stages themselves
+ * read the textures and CLUTs from vram, so render_bands_texture_barrier()
+ * waits for the queued jobs first if they might draw there.
+ */
+
+#include <stddef.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define BAND_MAX_WORKERS 4
+#define BAND_JOBS        64 // power of 2
+#define BAND_LINES_SHIFT 3
+// enhancement buffers are 1024 lines high, vram 512
+#define BAND_MAX_BANDS   (1024 >> BAND_LINES_SHIFT)
+// don't wake idle workers for less than this many jobs
+#define BAND_WAKE_JOBS   4
+
+// what the block stages see of psx_gpu_struct
+#define BAND_HEADER_SIZE offsetof(psx_gpu_struct, blocks)
+#define BAND_STATE_SIZE  offsetof(psx_gpu_struct, span_uvrg_offset)
+
+#define band_blocks(state) ((block_struct *)((state) + BAND_HEADER_SIZE))
+
+// ring positions and wait flags are shared without holding the lock
+#define band_load(v)     __atomic_load_n(&(v), __ATOMIC_SEQ_CST)
+#define band_store(v, x) __atomic_store_n(&(v), x, __ATOMIC_SEQ_CST)
+
+typedef struct
+{
+  // a truncated psx_gpu_struct, with the blocks grouped by worker
+  u8 state[BAND_STATE_SIZE] __attribute__((aligned(64)));
+  u16 worker_blocks_start[BAND_MAX_WORKERS + 1];
+} band_job_struct;
+
+typedef struct
+{
+  // private copy for the stages to work on
+  u8 state[BAND_STATE_SIZE] __attribute__((aligned(64)));
+  u32 rpos;
+  u32 index;
+  pthread_t thread;
+} band_worker_struct;
+
+static struct
+{
+  band_job_struct jobs[BAND_JOBS];
+  band_worker_struct workers[BAND_MAX_WORKERS];
+  u8 worker_by_band[BAND_MAX_BANDS];
+  u32 wpos;
+  u32 wake_pos;
+  u32 num_workers;
+  // texture pages the queued jobs may draw to and read from
+  u32 drawing_mask;
+  u32 reading_mask;
+  int idle_workers;
+  int main_waiting;
+  int quit;
+  pthread_mutex_t lock;
+  pthread_cond_t cond_work;
+  pthread_cond_t cond_progress;
+} bands =
+{
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .cond_work = PTHREAD_COND_INITIALIZER,
+  .cond_progress = PTHREAD_COND_INITIALIZER,
+};
+
+static void band_draw_job(band_worker_struct *worker, band_job_struct *job)
+{
+  psx_gpu_struct *psx_gpu = (psx_gpu_struct *)worker->state;
+  u32 start = job->worker_blocks_start[worker->index];
+  u32 num_blocks = job->worker_blocks_start[worker->index + 1] - start;
+  render_block_handler_struct *render_block_handler;
+
+  if(num_blocks == 0)
+    return;
+
+  memcpy(worker->state, job->state, BAND_HEADER_SIZE);
+  memcpy(band_blocks(worker->state), band_blocks(job->state) + start,
+   num_blocks * sizeof(block_struct));
+  psx_gpu->num_blocks = num_blocks;
+
+  render_block_handler = psx_gpu->render_block_handler;
+  render_block_handler->texture_blocks(psx_gpu);
+  render_block_handler->shade_blocks(psx_gpu);
+  render_block_handler->blend_blocks(psx_gpu);
+}
+
+static void *band_worker_thread(void *arg)
+{
+  band_worker_struct *worker = arg;
+  u32 rpos = worker->rpos;
+
+  while(1)
+  {
+    if(rpos == band_load(bands.wpos))
+    {
+      pthread_mutex_lock(&bands.lock);
+      band_store(bands.idle_workers, bands.idle_workers + 1);
+      while(rpos == band_load(bands.wpos) && !bands.quit)
+        pthread_cond_wait(&bands.cond_work, &bands.lock);
+      band_store(bands.idle_workers, bands.idle_workers - 1);
+      pthread_mutex_unlock(&bands.lock);
+
+      if(rpos == band_load(bands.wpos))
+        break;
+    }
+
+    band_draw_job(worker, &bands.jobs[rpos & (BAND_JOBS - 1)]);
+    rpos++;
+
+    band_store(worker->rpos, rpos);
+    if(band_load(bands.main_waiting))
+    {
+      pthread_mutex_lock(&bands.lock);
+      pthread_cond_signal(&bands.cond_progress);
+      pthread_mutex_unlock(&bands.lock);
+    }
+  }
+
+  return NULL;
+}
+
+// jobs queued that the slowest worker hasn't finished
+static u32 band_jobs_pending(void)
+{
+  u32 pending, max_pending = 0;
+  u32 i;
+
+  for(i = 0; i < bands.num_workers; i++)
+  {
+    pending = bands.wpos - band_load(bands.workers[i].rpos);
+    if(pending > max_pending)
+      max_pending = pending;
+  }
+
+  return max_pending;
+}
+
+static void band_wait(u32 max_pending)
+{
+  if(band_jobs_pending() <= max_pending)
+    return;
+
+  pthread_mutex_lock(&bands.lock);
+  band_store(bands.main_waiting, 1);
+  pthread_cond_broadcast(&bands.cond_work);
+  while(band_jobs_pending() > max_pending)
+    pthread_cond_wait(&bands.cond_progress, &bands.lock);
+  band_store(bands.main_waiting, 0);
+  pthread_mutex_unlock(&bands.lock);
+
+  bands.wake_pos = bands.wpos;
+}
+
+void render_bands_sync(psx_gpu_struct *psx_gpu)
+{
+  if(!psx_gpu->render_bands)
+    return;
+
+  band_wait(0);
+  bands.drawing_mask = 0;
+  bands.reading_mask = 0;
+}
+
+// Like texture_region_mask(), but also covering what runs over the end of
+// the lines into the next ones.
+static u32 band_region_mask(u32 x1, u32 y1, u32 x2, u32 y2)
+{
+  u32 mask = texture_region_mask(x1, y1, x2, y2);
+
+  if(x2 > 1023)
+    mask |= texture_region_mask(0, y1 + 1, x2 - 1024, y2 + 1);
+
+  return mask;
+}
+
+u32 render_bands_texture_barrier(psx_gpu_struct *psx_gpu, u32 texture_mode)
+{
+  u32 read_mask, dirty_mask = 0;
+  u32 x, y;
+
+  if(texture_mode == TEXTURE_MODE_16BPP)
+  {
+    x = (psx_gpu->current_texture_page & 0xF) * 64 + psx_gpu->texture_window_x;
+    y = (psx_gpu->current_texture_page >> 4) * 256 + psx_gpu->texture_window_y;
+    read_mask = band_region_mask(x, y, x + 255, y + 255);
+  }
+  else
+  {
+    x = (psx_gpu->clut_settings & 0x3F) * 16;
+    y = (psx_gpu->clut_settings >> 6) & 0x1FF;
+
+    if(texture_mode == TEXTURE_MODE_8BPP)
+    {
+      read_mask = band_region_mask(x, y, x + 255, y);
+      dirty_mask = psx_gpu->dirty_textures_8bpp_mask;
+    }
+    else
+    {
+      read_mask = band_region_mask(x, y, x + 15, y);
+      dirty_mask = psx_gpu->dirty_textures_4bpp_mask;
+    }
+    dirty_mask &= psx_gpu->current_texture_mask;
+  }
+
+  if((read_mask & bands.drawing_mask) || dirty_mask)
+    render_bands_sync(psx_gpu);
+
+  // the workers must never find a dirty cache
+  if(dirty_mask)
+  {
+    if(texture_mode == TEXTURE_MODE_8BPP)
+      update_texture_8bpp_cache(psx_gpu);
+    else
+      update_texture_4bpp_cache(psx_gpu);
+  }
+
+  return read_mask;
+}
+
+void render_bands_queue(psx_gpu_struct *psx_gpu)
+{
+  render_block_handler_struct *render_block_handler =
+   psx_gpu->render_block_handler;
+  texture_blocks_function_type *texture_blocks =
+   render_block_handler->texture_blocks;
+  u32 num_blocks = psx_gpu->num_blocks;
+  block_struct *block = psx_gpu->blocks;
+  u8 block_worker[MAX_BLOCKS_PER_ROW];
+  u16 worker_position[BAND_MAX_WORKERS];
+  u32 min_x = 1023, max_x = 0, min_y = 511, max_y = 0;
+  u32 band_straddled = 0;
+  u32 read_mask = 0, write_mask = 0;
+  band_job_struct *job;
+  block_struct *job_blocks;
+  u32 offset, x, y, band, worker;
+  u32 i;
+
+  if(texture_blocks == texture_blocks_4bpp)
+    read_mask = render_bands_texture_barrier(psx_gpu, TEXTURE_MODE_4BPP);
+  else if(texture_blocks == texture_blocks_8bpp ||
+   texture_blocks == texture_sprite_blocks_8bpp)
+    read_mask = render_bands_texture_barrier(psx_gpu, TEXTURE_MODE_8BPP);
+  else if(texture_blocks == texture_blocks_16bpp ||
+   render_block_handler->setup_blocks == setup_sprite_16bpp ||
+   render_block_handler->setup_blocks == setup_sprite_16bpp_4x)
+  {
+    // 16bpp sprite setup keeps reading vram after flushing
+    read_mask = render_bands_texture_barrier(psx_gpu, TEXTURE_MODE_16BPP);
+  }
+
+  // Vram and the enhancement buffers both have 2048 byte lines, so the
+  // band is found from the byte offset alone.
+  memset(worker_position, 0, sizeof(worker_position));
+  for(i = 0; i < num_blocks; i++)
+  {
+    offset = (u32)((u8 *)block[i].fb_ptr - (u8 *)psx_gpu->vram_ptr);
+    if(offset < 1024 * 512 * 2)
+    {
+      x = (offset >> 1) & 1023;
+      y = offset >> 11;
+      if(x < min_x)
+        min_x = x;
+      if(x > max_x)
+        max_x = x;
+      if(y < min_y)
+        min_y = y;
+      if(y > max_y)
+        max_y = y;
+    }
+    else
+    {
+      offset = (u32)((u8 *)block[i].fb_ptr -
+       (u8 *)psx_gpu->enhancement_buf_ptr);
+    }
+
+    // Sprite blocks aren't aligned, and the store of one running off the
+    // end of a line would race with the worker drawing the next band.
+    band = offset >> (BAND_LINES_SHIFT + 11);
+    band_straddled |= band ^ ((offset + 15) >> (BAND_LINES_SHIFT + 11));
+
+    worker = bands.worker_by_band[band & (BAND_MAX_BANDS - 1)];
+    block_worker[i] = worker;
+    worker_position[worker]++;
+  }
+
+  if(min_x <= max_x)
+    write_mask = band_region_mask(min_x, min_y, max_x + 7, max_y);
+
+  // All of a flush is textured before any of it is drawn, which the
+  // workers can't do for a primitive drawing over its own texture.
+  if(band_straddled || (read_mask & write_mask))
+  {
+    render_bands_sync(psx_gpu);
+    render_block_handler->texture_blocks(psx_gpu);
+    render_block_handler->shade_blocks(psx_gpu);
+    render_block_handler->blend_blocks(psx_gpu);
+    return;
+  }
+
+  // a worker could otherwise draw over a texture before another is done
+  // reading it for an older job
+  if(write_mask & bands.reading_mask)
+    render_bands_sync(psx_gpu);
+
+  band_wait(BAND_JOBS - 1);
+
+  job = &bands.jobs[bands.wpos & (BAND_JOBS - 1)];
+  job_blocks = band_blocks(job->state);
+  memcpy(job->state, psx_gpu, BAND_HEADER_SIZE);
+
+  job->worker_blocks_start[0] = 0;
+  for(i = 0; i < bands.num_workers; i++)
+  {
+    job->worker_blocks_start[i + 1] =
+     job->worker_blocks_start[i] + worker_position[i];
+    worker_position[i] = job->worker_blocks_start[i];
+  }
+
+  for(i = 0; i < num_blocks; i++)
+    job_blocks[worker_position[block_worker[i]]++] = block[i];
+
+  bands.drawing_mask |= write_mask;
+  bands.reading_mask |= read_mask;
+
+  band_store(bands.wpos, bands.wpos + 1);
+
+  if(band_load(bands.idle_workers) &&
+   bands.wpos - bands.wake_pos >= BAND_WAKE_JOBS)
+  {
+    pthread_mutex_lock(&bands.lock);
+    pthread_cond_broadcast(&bands.cond_work);
+    pthread_mutex_unlock(&bands.lock);
+    bands.wake_pos = bands.wpos;
+  }
+}
+
+int render_bands_start(psx_gpu_struct *psx_gpu)
+{
+  long cpus = 1;
+  u32 i;
+
+  if(psx_gpu->render_bands)
+    return 0;
+
+#ifdef _SC_NPROCESSORS_ONLN
+  cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  if(cpus < 2)
+  {
+    fprintf(stderr, "psx_gpu: single cpu, not using band rendering\n");
+    return -1;
+  }
+
+  flush_render_block_buffer(psx_gpu);
+
+  bands.wpos = bands.wake_pos = 0;
+  bands.drawing_mask = 0;
+  bands.reading_mask = 0;
+  bands.quit = 0;
+  bands.num_workers = 0;
+
+  for(i = 0; i < cpus - 1 && i < BAND_MAX_WORKERS; i++)
+  {
+    band_worker_struct *worker = &bands.workers[i];
+
+    worker->rpos = 0;
+    worker->index = i;
+    if(pthread_create(&worker->thread, NULL, band_worker_thread, worker) != 0)
+      break;
+    bands.num_workers++;
+  }
+
+  if(bands.num_workers == 0)
+  {
+    fprintf(stderr, "psx_gpu: failed to create band workers\n");
+    return -1;
+  }
+
+  for(i = 0; i < sizeof(bands.worker_by_band); i++)
+    bands.worker_by_band[i] = i % bands.num_workers;
+
+  psx_gpu->render_bands = 1;
+  return 0;
+}
+
+void render_bands_stop(psx_gpu_struct *psx_gpu)
+{
+  u32 i;
+
+  if(!psx_gpu->render_bands)
+    return;
+
+  // the workers finish the queue before quitting
+  flush_render_block_buffer(psx_gpu);
+
+  pthread_mutex_lock(&bands.lock);
+  bands.quit = 1;
+  pthread_cond_broadcast(&bands.cond_work);
+  pthread_mutex_unlock(&bands.lock);
+
+  for(i = 0; i < bands.num_workers; i++)
+    pthread_join(bands.workers[i].thread, NULL);
+
+  bands.num_workers = 0;
+  psx_gpu->render_bands = 0;
+}
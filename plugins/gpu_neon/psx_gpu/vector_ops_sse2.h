@@ -0,0 +1,518 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+/*
+ * SSE2 (and SSSE3 when the compiler targets it) versions of the
+ * vector_ops.h operations the C renderer spends its time in. Included
+ * at the end of vector_ops.h, each one replaces the generic element loop
+ * of the same name and must give bit identical results for every
+ * element type it is used with. The vector types stay plain structs,
+ * so everything is loaded from and stored to their .e arrays unaligned.
+ */
+
+#ifndef VECTOR_OPS_SSE2
+#define VECTOR_OPS_SSE2
+
+#include <emmintrin.h>
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+// the element loops only care about the count, these care about the size
+#define sse_check_size(v, size)                                                \
+  (void)sizeof(char[sizeof((v).e) == (size) ? 1 : -1])                         \
+
+#define sse_load_128b(v)                                                       \
+  (sse_check_size(v, 16), _mm_loadu_si128((const __m128i *)(v).e))             \
+
+#define sse_load_64b(v)                                                        \
+  (sse_check_size(v, 8), _mm_loadl_epi64((const __m128i *)(v).e))              \
+
+// statements in braces, like foreach_element, the callers depend on it
+#define sse_store_128b(v, x)                                                   \
+{                                                                              \
+  sse_check_size(v, 16);                                                       \
+  _mm_storeu_si128((__m128i *)(v).e, x);                                       \
+}                                                                              \
+
+#define sse_store_64b(v, x)                                                    \
+{                                                                              \
+  sse_check_size(v, 8);                                                        \
+  _mm_storel_epi64((__m128i *)(v).e, x);                                       \
+}                                                                              \
+
+// true when the vector holds signed elements, a compile time constant
+#define sse_is_signed(v)                                                       \
+  ((__typeof__((v).e[0]))-1 < 0)                                               \
+
+// low 8 elements to 16 bits, zero or sign extended depending on type
+#define sse_widen_8x8b(v)                                                      \
+  (sse_is_signed(v) ?                                                          \
+   _mm_srai_epi16(_mm_unpacklo_epi8(sse_load_64b(v), sse_load_64b(v)), 8) :    \
+   _mm_unpacklo_epi8(sse_load_64b(v), _mm_setzero_si128()))                    \
+
+// keeps the low 16 bits of each 32 bit element, packed to the low half
+#define sse_narrow_4x32b(x)                                                    \
+  _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(x, 16), 16),                   \
+   _mm_setzero_si128())                                                        \
+
+// keeps the low 8 bits of each 16 bit element, packed to the low half
+#define sse_narrow_8x16b(x)                                                    \
+  _mm_packus_epi16(_mm_and_si128(x, _mm_set1_epi16(0xFF)),                     \
+   _mm_setzero_si128())                                                        \
+
+
+#undef vector_cast
+#undef vector_cast_high
+
+// strict aliasing is disabled for this code on x86, see the Makefiles
+#define vector_cast(vec_to, source)                                            \
+  (*((vec_to *)(&(source))))                                                   \
+
+#define vector_cast_high(vec_to, source)                                       \
+  (*((vec_to *)((u8 *)source.e + (sizeof(source.e) / 2))))                     \
+
+
+#undef load_8x16b
+#undef store_8x16b
+
+#define load_8x16b(dest, source)                                               \
+  sse_store_128b(dest, _mm_loadu_si128((const __m128i *)(source)))             \
+
+#define store_8x16b(source, dest)                                              \
+  { _mm_storeu_si128((__m128i *)(dest), sse_load_128b(source)); }              \
+
+
+#undef dup_8x8b
+#undef dup_16x8b
+#undef dup_4x16b
+#undef dup_8x16b
+#undef dup_2x32b
+#undef dup_4x32b
+
+#define dup_8x8b(dest, value)                                                  \
+  sse_store_64b(dest, _mm_set1_epi8(value))                                    \
+
+#define dup_16x8b(dest, value)                                                 \
+  sse_store_128b(dest, _mm_set1_epi8(value))                                   \
+
+#define dup_4x16b(dest, value)                                                 \
+  sse_store_64b(dest, _mm_set1_epi16(value))                                   \
+
+#define dup_8x16b(dest, value)                                                 \
+  sse_store_128b(dest, _mm_set1_epi16(value))                                  \
+
+#define dup_2x32b(dest, value)                                                 \
+  sse_store_64b(dest, _mm_set1_epi32(value))                                   \
+
+#define dup_4x32b(dest, value)                                                 \
+  sse_store_128b(dest, _mm_set1_epi32(value))                                  \
+
+
+#define sse_op_64b(dest, source_a, source_b, op)                               \
+  sse_store_64b(dest, op(sse_load_64b(source_a), sse_load_64b(source_b)))      \
+
+#define sse_op_128b(dest, source_a, source_b, op)                              \
+  sse_store_128b(dest, op(sse_load_128b(source_a), sse_load_128b(source_b)))   \
+
+#undef add_8x8b
+#undef add_4x16b
+#undef add_2x32b
+#undef add_16x8b
+#undef add_8x16b
+#undef add_4x32b
+#undef add_2x64b
+#undef sub_4x16b
+#undef sub_2x32b
+#undef sub_16x8b
+#undef sub_8x16b
+#undef sub_4x32b
+
+#define add_8x8b(dest, source_a, source_b)                                     \
+  sse_op_64b(dest, source_a, source_b, _mm_add_epi8)                           \
+
+#define add_4x16b(dest, source_a, source_b)                                    \
+  sse_op_64b(dest, source_a, source_b, _mm_add_epi16)                          \
+
+#define add_2x32b(dest, source_a, source_b)                                    \
+  sse_op_64b(dest, source_a, source_b, _mm_add_epi32)                          \
+
+#define add_16x8b(dest, source_a, source_b)                                    \
+  sse_op_128b(dest, source_a, source_b, _mm_add_epi8)                          \
+
+#define add_8x16b(dest, source_a, source_b)                                    \
+  sse_op_128b(dest, source_a, source_b, _mm_add_epi16)                         \
+
+#define add_4x32b(dest, source_a, source_b)                                    \
+  sse_op_128b(dest, source_a, source_b, _mm_add_epi32)                         \
+
+#define add_2x64b(dest, source_a, source_b)                                    \
+  sse_op_128b(dest, source_a, source_b, _mm_add_epi64)                         \
+
+#define sub_4x16b(dest, source_a, source_b)                                    \
+  sse_op_64b(dest, source_a, source_b, _mm_sub_epi16)                          \
+
+#define sub_2x32b(dest, source_a, source_b)                                    \
+  sse_op_64b(dest, source_a, source_b, _mm_sub_epi32)                          \
+
+#define sub_16x8b(dest, source_a, source_b)                                    \
+  sse_op_128b(dest, source_a, source_b, _mm_sub_epi8)                          \
+
+#define sub_8x16b(dest, source_a, source_b)                                    \
+  sse_op_128b(dest, source_a, source_b, _mm_sub_epi16)                         \
+
+#define sub_4x32b(dest, source_a, source_b)                                    \
+  sse_op_128b(dest, source_a, source_b, _mm_sub_epi32)                         \
+
+
+#undef and_8x8b
+#undef and_4x16b
+#undef and_2x32b
+#undef and_16x8b
+#undef and_8x16b
+#undef and_4x32b
+#undef bic_8x8b
+#undef bic_8x16b
+#undef or_8x16b
+#undef eor_2x32b
+#undef eor_8x16b
+#undef eor_4x32b
+#undef or_immediate_8x16b
+#undef bic_immediate_8x16b
+
+// bic is a & ~b, andnot is ~a & b
+#define sse_bic(a, b)                                                          \
+  _mm_andnot_si128(b, a)                                                       \
+
+#define and_8x8b(dest, source_a, source_b)                                     \
+  sse_op_64b(dest, source_a, source_b, _mm_and_si128)                          \
+
+#define and_4x16b(dest, source_a, source_b)                                    \
+  sse_op_64b(dest, source_a, source_b, _mm_and_si128)                          \
+
+#define and_2x32b(dest, source_a, source_b)                                    \
+  sse_op_64b(dest, source_a, source_b, _mm_and_si128)                          \
+
+#define and_16x8b(dest, source_a, source_b)                                    \
+  sse_op_128b(dest, source_a, source_b, _mm_and_si128)                         \
+
+#define and_8x16b(dest, source_a, source_b)                                    \
+  sse_op_128b(dest, source_a, source_b, _mm_and_si128)                         \
+
+#define and_4x32b(dest, source_a, source_b)                                    \
+  sse_op_128b(dest, source_a, source_b, _mm_and_si128)                         \
+
+#define bic_8x8b(dest, source_a, source_b)                                     \
+  sse_op_64b(dest, source_a, source_b, sse_bic)                                \
+
+#define bic_8x16b(dest, source_a, source_b)                                    \
+  sse_op_128b(dest, source_a, source_b, sse_bic)                               \
+
+#define or_8x16b(dest, source_a, source_b)                                     \
+  sse_op_128b(dest, source_a, source_b, _mm_or_si128)                          \
+
+#define eor_2x32b(dest, source_a, source_b)                                    \
+  sse_op_64b(dest, source_a, source_b, _mm_xor_si128)                          \
+
+#define eor_8x16b(dest, source_a, source_b)                                    \
+  sse_op_128b(dest, source_a, source_b, _mm_xor_si128)                         \
+
+#define eor_4x32b(dest, source_a, source_b)                                    \
+  sse_op_128b(dest, source_a, source_b, _mm_xor_si128)                         \
+
+#define or_immediate_8x16b(dest, source_a, value)                              \
+  sse_store_128b(dest,                                                         \
+   _mm_or_si128(sse_load_128b(source_a), _mm_set1_epi16(value)))               \
+
+#define bic_immediate_8x16b(dest, value)                                       \
+  sse_store_128b(dest,                                                         \
+   sse_bic(sse_load_128b(dest), _mm_set1_epi16(value)))                        \
+
+
+#undef shr_8x8b
+#undef shl_8x8b
+#undef shl_4x16b
+#undef shl_2x32b
+#undef shr_2x32b
+#undef shr_8x16b
+#undef shl_8x16b
+#undef shr_4x32b
+#undef shl_4x32b
+#undef shl_2x64b
+
+#define shr_8x8b(dest, source, shift)                                          \
+  sse_store_64b(dest, _mm_and_si128(                                           \
+   _mm_srli_epi16(sse_load_64b(source), shift),                                \
+   _mm_set1_epi8(0xFF >> (shift))))                                            \
+
+#define shl_8x8b(dest, source, shift)                                          \
+  sse_store_64b(dest, _mm_and_si128(                                           \
+   _mm_slli_epi16(sse_load_64b(source), shift),                                \
+   _mm_set1_epi8((u8)(0xFF << (shift)))))                                      \
+
+#define shl_4x16b(dest, source, shift)                                         \
+  sse_store_64b(dest, _mm_slli_epi16(sse_load_64b(source), shift))             \
+
+#define shl_2x32b(dest, source, shift)                                         \
+  sse_store_64b(dest, _mm_slli_epi32(sse_load_64b(source), shift))             \
+
+#define shr_2x32b(dest, source, shift)                                         \
+  sse_store_64b(dest, _mm_srli_epi32(sse_load_64b(source), shift))             \
+
+#define shr_8x16b(dest, source, shift)                                         \
+  sse_store_128b(dest, _mm_srli_epi16(sse_load_128b(source), shift))           \
+
+#define shl_8x16b(dest, source, shift)                                         \
+  sse_store_128b(dest, _mm_slli_epi16(sse_load_128b(source), shift))           \
+
+#define shr_4x32b(dest, source, shift)                                         \
+  sse_store_128b(dest, _mm_srli_epi32(sse_load_128b(source), shift))           \
+
+#define shl_4x32b(dest, source, shift)                                         \
+  sse_store_128b(dest, _mm_slli_epi32(sse_load_128b(source), shift))           \
+
+#define shl_2x64b(dest, source, shift)                                         \
+  sse_store_128b(dest, _mm_slli_epi64(sse_load_128b(source), shift))           \
+
+
+#undef sli_8x8b
+#undef sri_8x8b
+
+#define sli_8x8b(dest, source, shift)                                          \
+  sse_store_64b(dest, _mm_or_si128(                                            \
+   _mm_and_si128(sse_load_64b(dest), _mm_set1_epi8((u8)~(0xFF << (shift)))),       \
+   _mm_and_si128(_mm_slli_epi16(sse_load_64b(source), shift),                  \
+    _mm_set1_epi8((u8)(0xFF << (shift))))))                                    \
+
+#define sri_8x8b(dest, source, shift)                                          \
+  sse_store_64b(dest, _mm_or_si128(                                            \
+   _mm_and_si128(sse_load_64b(dest), _mm_set1_epi8((u8)~(0xFF >> (shift)))),       \
+   _mm_and_si128(_mm_srli_epi16(sse_load_64b(source), shift),                  \
+    _mm_set1_epi8(0xFF >> (shift)))))                                          \
+
+
+#undef mov_narrow_8x16b
+#undef mov_narrow_4x32b
+#undef shr_narrow_8x16b
+#undef shr_narrow_4x32b
+#undef add_high_narrow_4x32b
+#undef shrq_narrow_signed_8x16b
+
+#define mov_narrow_8x16b(dest, source)                                         \
+  sse_store_64b(dest, sse_narrow_8x16b(sse_load_128b(source)))                 \
+
+#define mov_narrow_4x32b(dest, source)                                         \
+  sse_store_64b(dest, sse_narrow_4x32b(sse_load_128b(source)))                 \
+
+#define shr_narrow_8x16b(dest, source, shift)                                  \
+  sse_store_64b(dest,                                                          \
+   sse_narrow_8x16b(_mm_srli_epi16(sse_load_128b(source), shift)))             \
+
+// after a shift of 16 or more the results fit the saturating pack as is
+#define shr_narrow_4x32b(dest, source, shift)                                  \
+  sse_store_64b(dest, (__builtin_constant_p(shift) && (shift) >= 16) ?         \
+   _mm_packs_epi32(_mm_srai_epi32(sse_load_128b(source), shift),               \
+    _mm_setzero_si128()) :                                                     \
+   sse_narrow_4x32b(_mm_srli_epi32(sse_load_128b(source), shift)))             \
+
+#define add_high_narrow_4x32b(dest, source_a, source_b)                        \
+  sse_store_64b(dest, _mm_packs_epi32(_mm_srai_epi32(                          \
+   _mm_add_epi32(sse_load_128b(source_a), sse_load_128b(source_b)), 16),       \
+   _mm_setzero_si128()))                                                       \
+
+#define shrq_narrow_signed_8x16b(dest, source, shift)                          \
+  sse_store_64b(dest, _mm_packus_epi16(                                        \
+   _mm_srai_epi16(sse_load_128b(source), shift), _mm_setzero_si128()))         \
+
+
+#undef shl_long_8x8b
+#undef mul_long_8x8b
+#undef mla_long_8x8b
+
+#define shl_long_8x8b(dest, source, shift)                                     \
+  sse_store_128b(dest, _mm_slli_epi16(sse_widen_8x8b(source), shift))          \
+
+#define mul_long_8x8b(dest, source_a, source_b)                                \
+  sse_store_128b(dest,                                                         \
+   _mm_mullo_epi16(sse_widen_8x8b(source_a), sse_widen_8x8b(source_b)))        \
+
+#define mla_long_8x8b(dest, source_a, source_b)                                \
+  sse_store_128b(dest, _mm_add_epi16(sse_load_128b(dest),                      \
+   _mm_mullo_epi16(sse_widen_8x8b(source_a), sse_widen_8x8b(source_b))))       \
+
+
+#undef zip_8x16b
+#undef zip_4x32b
+#undef unzip_16x8b
+
+#define sse_op_64b_to_128b(dest, source_a, source_b, op)                       \
+  sse_store_128b(dest, op(sse_load_64b(source_a), sse_load_64b(source_b)))     \
+
+#define zip_8x16b(dest, source_a, source_b)                                    \
+  sse_op_64b_to_128b(dest, source_a, source_b, _mm_unpacklo_epi8)              \
+
+#define zip_4x32b(dest, source_a, source_b)                                    \
+  sse_op_64b_to_128b(dest, source_a, source_b, _mm_unpacklo_epi16)             \
+
+#define unzip_16x8b(dest_a, dest_b, source_a, source_b)                        \
+{                                                                              \
+  __m128i _a = sse_load_128b(source_a);                                        \
+  __m128i _b = sse_load_128b(source_b);                                        \
+  __m128i _mask = _mm_set1_epi16(0xFF);                                        \
+  sse_store_128b(dest_a, _mm_packus_epi16(_mm_and_si128(_a, _mask),            \
+   _mm_and_si128(_b, _mask)));                                                 \
+  sse_store_128b(dest_b, _mm_packus_epi16(_mm_srli_epi16(_a, 8),               \
+   _mm_srli_epi16(_b, 8)));                                                    \
+}                                                                              \
+
+
+#undef addq_8x8b
+#undef subq_8x8b
+#undef subs_16x8b
+#undef subs_8x16b
+
+// for signed elements a result below zero is the only one out of range
+#define sse_subs_signed(a, b, cmpgt, sub)                                      \
+  _mm_andnot_si128(cmpgt(b, a), sub(a, b))                                     \
+
+#define sse_subs_8b(a, b, is_signed)                                           \
+  ((is_signed) ? sse_subs_signed(a, b, _mm_cmpgt_epi8, _mm_sub_epi8) :         \
+   _mm_subs_epu8(a, b))                                                        \
+
+// for signed elements a negative sum saturates to 0xFF as well
+#define addq_8x8b(dest, source_a, source_b)                                    \
+{                                                                              \
+  if(sse_is_signed(source_a) || sse_is_signed(source_b))                       \
+  {                                                                            \
+    __m128i _sum = _mm_add_epi16(sse_widen_8x8b(source_a),                     \
+     sse_widen_8x8b(source_b));                                                \
+    sse_store_64b(dest, _mm_or_si128(                                          \
+     _mm_packus_epi16(_sum, _mm_setzero_si128()),                              \
+     _mm_packs_epi16(_mm_srai_epi16(_sum, 15), _mm_setzero_si128())));         \
+  }                                                                            \
+  else                                                                         \
+    sse_op_64b(dest, source_a, source_b, _mm_adds_epu8);                       \
+}                                                                              \
+
+#define subq_8x8b(dest, source_a, source_b)                                    \
+  sse_store_64b(dest, sse_subs_8b(sse_load_64b(source_a),                      \
+   sse_load_64b(source_b), sse_is_signed(source_a)))                           \
+
+#define subs_16x8b(dest, source_a, source_b)                                   \
+  sse_store_128b(dest, sse_subs_8b(sse_load_128b(source_a),                    \
+   sse_load_128b(source_b), sse_is_signed(source_a)))                          \
+
+#define subs_8x16b(dest, source_a, source_b)                                   \
+  sse_store_128b(dest, sse_is_signed(source_a) ?                               \
+   sse_subs_signed(sse_load_128b(source_a), sse_load_128b(source_b),           \
+    _mm_cmpgt_epi16, _mm_sub_epi16) :                                          \
+   _mm_subs_epu16(sse_load_128b(source_a), sse_load_128b(source_b)))          \
+
+
+#undef min_16x8b
+#undef min_8x16b
+#undef max_8x16b
+#undef average_8x16b
+
+#define min_16x8b(dest, source_a, source_b)                                    \
+{                                                                              \
+  __m128i _a = sse_load_128b(source_a);                                        \
+  __m128i _b = sse_load_128b(source_b);                                        \
+  if(sse_is_signed(source_a))                                                  \
+  {                                                                            \
+    __m128i _gt = _mm_cmpgt_epi8(_a, _b);                                      \
+    sse_store_128b(dest, _mm_or_si128(_mm_and_si128(_gt, _b),                  \
+     _mm_andnot_si128(_gt, _a)));                                              \
+  }                                                                            \
+  else                                                                         \
+    sse_store_128b(dest, _mm_min_epu8(_a, _b));                                \
+}                                                                              \
+
+// unsigned min(a, b) is a - sat(a - b) and max(a, b) is b + sat(a - b)
+#define min_8x16b(dest, source_a, source_b)                                    \
+{                                                                              \
+  __m128i _a = sse_load_128b(source_a);                                        \
+  __m128i _b = sse_load_128b(source_b);                                        \
+  sse_store_128b(dest, sse_is_signed(source_a) ? _mm_min_epi16(_a, _b) :      \
+   _mm_sub_epi16(_a, _mm_subs_epu16(_a, _b)));                                 \
+}                                                                              \
+
+#define max_8x16b(dest, source_a, source_b)                                    \
+{                                                                              \
+  __m128i _a = sse_load_128b(source_a);                                        \
+  __m128i _b = sse_load_128b(source_b);                                        \
+  sse_store_128b(dest, sse_is_signed(source_a) ? _mm_max_epi16(_a, _b) :      \
+   _mm_add_epi16(_b, _mm_subs_epu16(_a, _b)));                                 \
+}                                                                              \
+
+// rounds down like the element loop, unlike pavgw
+#define average_8x16b(dest, source_a, source_b)                                \
+{                                                                              \
+  __m128i _a = sse_load_128b(source_a);                                        \
+  __m128i _b = sse_load_128b(source_b);                                        \
+  __m128i _x = _mm_xor_si128(_a, _b);                                          \
+  sse_store_128b(dest, _mm_add_epi16(_mm_and_si128(_a, _b),                    \
+   sse_is_signed(source_a) ? _mm_srai_epi16(_x, 1) : _mm_srli_epi16(_x, 1)));  \
+}                                                                              \
+
+
+#undef cmpeqz_8x16b
+#undef cmpltz_8x16b
+#undef cmpltz_4x32b
+#undef tst_8x16b
+#undef bif_8x16b
+#undef bsl_8x16b
+#undef bsl_4x32b
+
+#define cmpeqz_8x16b(dest, source)                                             \
+  sse_store_128b(dest,                                                         \
+   _mm_cmpeq_epi16(sse_load_128b(source), _mm_setzero_si128()))                \
+
+#define cmpltz_8x16b(dest, source)                                             \
+  sse_store_128b(dest, _mm_srai_epi16(sse_load_128b(source), 15))              \
+
+#define cmpltz_4x32b(dest, source)                                             \
+  sse_store_128b(dest, _mm_srai_epi32(sse_load_128b(source), 31))              \
+
+#define tst_8x16b(dest, source_a, source_b)                                    \
+  sse_store_128b(dest, _mm_xor_si128(_mm_cmpeq_epi16(                          \
+   _mm_and_si128(sse_load_128b(source_a), sse_load_128b(source_b)),            \
+   _mm_setzero_si128()), _mm_set1_epi16(-1)))                                  \
+
+// dest = mask ? a : b
+#define sse_select(mask, a, b)                                                 \
+  _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b))              \
+
+#define bif_8x16b(dest, source, mask)                                          \
+  sse_store_128b(dest, sse_select(sse_load_128b(mask), sse_load_128b(dest),    \
+   sse_load_128b(source)))                                                     \
+
+#define bsl_8x16b(dest_mask, source_a, source_b)                               \
+  sse_store_128b(dest_mask, sse_select(sse_load_128b(dest_mask),               \
+   sse_load_128b(source_a), sse_load_128b(source_b)))                          \
+
+#define bsl_4x32b(dest_mask, source_a, source_b)                               \
+  bsl_8x16b(dest_mask, source_a, source_b)                                     \
+
+
+#ifdef __SSSE3__
+
+#undef tbl_16
+
+// indexes of 16 and up become 0x80 and over, which pshufb turns to zero
+#define tbl_16(dest, indexes, table)                                           \
+  sse_store_64b(dest, _mm_shuffle_epi8(sse_load_128b(table),                   \
+   _mm_adds_epu8(sse_load_64b(indexes), _mm_set1_epi8(0x70))))                 \
+
+#endif
+
+#endif
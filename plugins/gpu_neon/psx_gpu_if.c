@@ -31,6 +31,9 @@ int do_cmd_list(uint32_t *list, int count, int *last_cmd)
 {
   int ret;
 
+  // may change when the render thread is toggled
+  ex_regs = gpu.renderer_ex_regs;
+
   if (gpu.state.enhancement_active)
     ret = gpu_parse_enhanced(&egpu, list, count * 4, (u32 *)last_cmd);
   else
@@ -82,12 +85,13 @@ int renderer_init(void)
   if (gpu.mmap != NULL && egpu.enhancement_buf_ptr == NULL)
     map_enhancement_buffer();
 
-  ex_regs = gpu.ex_regs;
+  ex_regs = gpu.renderer_ex_regs;
   return 0;
 }
 
 void renderer_finish(void)
 {
+  render_bands_stop(&egpu);
   if (egpu.enhancement_buf_ptr != NULL) {
     egpu.enhancement_buf_ptr -= 4096 / 2;
     gpu.munmap(egpu.enhancement_buf_ptr, ENHANCEMENT_BUF_SIZE);
@@ -127,6 +131,7 @@ sync_enhancement_buffers(int x, int y, int w, int h)
 
 void renderer_sync_ecmds(uint32_t *ecmds)
 {
+  ex_regs = gpu.renderer_ex_regs;
   gpu_parse(&egpu, ecmds + 1, 6 * 4, NULL);
 }
 
@@ -140,6 +145,7 @@ void renderer_update_caches(int x, int y, int w, int h)
 void renderer_flush_queues(void)
 {
   flush_render_block_buffer(&egpu);
+  render_bands_sync(&egpu);
 }
 
 void renderer_set_interlace(int enable, int is_odd)
@@ -171,6 +177,7 @@ void renderer_set_config(const struct rearmed_cbs *cbs)
   if (egpu.enhancement_buf_ptr != NULL && cbs->gpu_neon.enhancement_enable
       && !enhancement_was_on)
   {
+    render_bands_sync(&egpu);
     sync_enhancement_buffers(0, 0, 1024, 512);
   }
   enhancement_was_on = cbs->gpu_neon.enhancement_enable;
@@ -182,6 +189,10 @@ void renderer_set_config(const struct rearmed_cbs *cbs)
 
   if (gpu.mmap != NULL && egpu.enhancement_buf_ptr == NULL)
     map_enhancement_buffer();
+  if (cbs->gpu_neon.band_rendering)
+    render_bands_start(&egpu);
+  else
+    render_bands_stop(&egpu);
   if (cbs->pl_set_gpu_caps)
     cbs->pl_set_gpu_caps(GPU_CAP_SUPPORTS_2X);
 }
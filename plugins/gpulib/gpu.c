@@ -10,7 +10,10 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include "gpu.h"
+#include "gpu_thread.h"
+#include "gpu_trace.h"
 
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 #ifdef __GNUC__
@@ -35,12 +38,25 @@ struct psx_gpu gpu;
 
 static noinline int do_cmd_buffer(uint32_t *data, int count);
 static void finish_vram_transfer(int is_read);
+static void defer_commit(void);
+static void defer_frame_done(void);
+static void fskip_update_stats(void);
+
+// draws everything queued so far into vram, but unlike a save leaves
+// a partial command in the buffer alone
+void gpu_sync_vram(void)
+{
+  defer_commit();
+  gpu_thread_sync();
+  renderer_flush_queues();
+}
 
 static noinline void do_cmd_reset(void)
 {
   if (unlikely(gpu.cmd_len > 0))
     do_cmd_buffer(gpu.cmd_buffer, gpu.cmd_len);
   gpu.cmd_len = 0;
+  defer_commit();
 
   if (unlikely(gpu.dma.h > 0))
     finish_vram_transfer(gpu.dma_start.is_read);
@@ -85,8 +101,255 @@ static noinline void update_height(void)
   gpu.screen.h = sh;
 }
 
+// 16 lines per gpu.state.dirty_bands bit
+#define DIRTY_BAND_SHIFT 4
+
+static void mark_vram_dirty(int y, int h)
+{
+  uint32_t first, count, mask;
+
+  if (h <= 0)
+    return;
+
+  y &= 511;
+  first = y >> DIRTY_BAND_SHIFT;
+  count = ((y + h - 1) >> DIRTY_BAND_SHIFT) - first + 1;
+  if (count >= 32) {
+    gpu.state.dirty_bands = ~0;
+    return;
+  }
+
+  // wraps around the bottom of vram
+  mask = (1u << count) - 1;
+  gpu.state.dirty_bands |= mask << first;
+  if (first != 0)
+    gpu.state.dirty_bands |= mask >> (32 - first);
+}
+
+static void mark_draw_area_dirty(uint32_t cmd_e3, uint32_t cmd_e4)
+{
+  int y1 = (cmd_e3 >> 10) & 0x1ff;
+  int y2 = (cmd_e4 >> 10) & 0x1ff;
+
+  mark_vram_dirty(y1, y2 - y1 + 1);
+}
+
+// command length, more than count if it doesn't end within count words,
+// including polylines that have no terminator yet
+static int get_cmd_len(const uint32_t *list, int count)
+{
+  int len = 1 + cmd_lengths[list[0] >> 24];
+  int v;
+
+  switch (list[0] >> 24) {
+    case 0x48 ... 0x4F:
+      for (v = 3; v < count; v++)
+      {
+        if ((list[v] & 0xf000f000) == 0x50005000)
+          break;
+      }
+      if (v >= count)
+        return count + 1;
+      len += v - 3;
+      break;
+    case 0x58 ... 0x5F:
+      for (v = 4; v < count; v += 2)
+      {
+        if ((list[v] & 0xf000f000) == 0x50005000)
+          break;
+      }
+      if (v >= count)
+        return count + 1;
+      len += v - 4;
+      break;
+  }
+  return len;
+}
+
+/*
+ * Marks what a list that was just drawn could have touched: the drawing
+ * area for primitives, the rectangle itself for fills and copies.
+ * The E3/E4 args are the drawing area the list started with.
+ */
+static void mark_cmd_list_dirty(const uint32_t *data, int count,
+  uint32_t cmd_e3, uint32_t cmd_e4)
+{
+  int cmd, pos, len, drawn = 0;
+
+  for (pos = 0; pos < count; pos += len) {
+    const uint32_t *list = data + pos;
+    cmd = list[0] >> 24;
+    len = get_cmd_len(list, count - pos);
+
+    switch (cmd) {
+      case 0x02:
+        mark_vram_dirty(list[1] >> 16, (list[2] >> 16) & 0x1ff);
+        break;
+      case 0x20 ... 0x7f:
+        drawn = 1;
+        break;
+      case 0x80:
+        mark_vram_dirty(list[2] >> 16, (((list[3] >> 16) - 1) & 0x1ff) + 1);
+        break;
+      case 0xe3:
+      case 0xe4:
+        if (drawn)
+          mark_draw_area_dirty(cmd_e3, cmd_e4);
+        drawn = 0;
+        if (cmd == 0xe3)
+          cmd_e3 = list[0];
+        else
+          cmd_e4 = list[0];
+        break;
+    }
+  }
+
+  if (drawn)
+    mark_draw_area_dirty(cmd_e3, cmd_e4);
+}
+
+// finds the drawn rows among the h lines starting at vram line y
+int gpu_dirty_rows(int y, int h, int *dirty_y)
+{
+  int first = -1, end = 0;
+  int l, n;
+
+  for (l = 0; l < h; l += n) {
+    int line = (y + l) & 511;
+    n = (1 << DIRTY_BAND_SHIFT) - (line & ((1 << DIRTY_BAND_SHIFT) - 1));
+    if (gpu.state.dirty_bands & (1u << (line >> DIRTY_BAND_SHIFT))) {
+      if (first < 0)
+        first = l;
+      end = l + n;
+    }
+  }
+
+  if (first < 0)
+    return 0;
+  if (end > h)
+    end = h;
+  *dirty_y = first;
+  return end - first;
+}
+
+/*
+ * Adaptive frameskip (frameskip.set == -2). Rather than waiting for the
+ * frontend to notice it's running late, keep averages of what drawing a
+ * frame costs and of what the rest of the emulation takes per frame, and
+ * skip just the fraction of frames that lets both fit in the frame time.
+ * With the render thread, drawing only has to keep up by itself.
+ * The emulation side is measured in this thread's cpu time, so that
+ * the frame limiter's sleeping doesn't count.
+ */
+#define FSKIP_TARGET_PCT 90  // of the frame time, leaves some slack
+#define FSKIP_MAX_RATE   192 // of 256 frames, so at most 3 skipped in a row
+
+static struct {
+  uint64_t cpu_ns;      // thread cpu time at the last decision
+  uint32_t frame;       // vsync count at the last decision
+  uint32_t render_us;   // averages, new samples weigh 1/8
+  uint32_t emu_us;
+  uint32_t vsyncs_x16;  // vsyncs per game frame, *16
+  uint32_t budget_us;
+  uint32_t rate;        // frames to skip, of 256
+  uint32_t acc;
+  uint32_t frames, skipped;
+  uint32_t started:1;
+  uint32_t drawn:1;     // the frame measured next gets drawn
+  struct gpu_fskip_stats *stats;
+} fskip;
+
+static uint64_t fskip_cpu_ns(void)
+{
+  struct timespec ts;
+#ifdef CLOCK_THREAD_CPUTIME_ID
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void fskip_average(uint32_t *avg, uint32_t sample)
+{
+  *avg += ((int32_t)sample - (int32_t)*avg) / 8;
+}
+
+static void fskip_reset(void)
+{
+  gpu_thread_measure(gpu.frameskip.set == -2);
+  fskip.started = 0;
+  fskip.rate = fskip.acc = 0;
+}
+
+// called at each flip, returns 1 if the next frame should be skipped
+static int fskip_adaptive(void)
+{
+  uint64_t cpu_ns = fskip_cpu_ns();
+  uint32_t render_us = gpu_thread_take_render_ns() / 1000;
+  uint32_t busy_us = (cpu_ns - fskip.cpu_ns) / 1000;
+  uint32_t vsyncs = *gpu.state.frame_count - fskip.frame;
+  uint32_t frame_us = gpu.status.video ? 20000 : 16683;
+  int32_t avail;
+  int skip;
+
+  fskip.cpu_ns = cpu_ns;
+  fskip.frame = *gpu.state.frame_count;
+
+  // the first sample, or one spanning a load/pause, tells nothing
+  if (fskip.started && 0 < vsyncs && vsyncs <= 4) {
+    if (!gpu_thread_running())
+      busy_us -= render_us < busy_us ? render_us : busy_us;
+    fskip_average(&fskip.emu_us, busy_us);
+    if (fskip.drawn)
+      fskip_average(&fskip.render_us, render_us);
+    fskip_average(&fskip.vsyncs_x16, vsyncs * 16);
+  }
+  if (!fskip.started) {
+    fskip.vsyncs_x16 = 16;
+    fskip.started = 1;
+  }
+
+  fskip.budget_us = frame_us * fskip.vsyncs_x16 / 16 * FSKIP_TARGET_PCT / 100;
+  avail = fskip.budget_us;
+  if (!gpu_thread_running())
+    avail -= fskip.emu_us;
+
+  if (avail >= (int32_t)fskip.render_us)
+    fskip.rate = 0;
+  else if (avail <= 0)
+    fskip.rate = FSKIP_MAX_RATE;
+  else {
+    fskip.rate = 256 - avail * 256 / fskip.render_us;
+    if (fskip.rate > FSKIP_MAX_RATE)
+      fskip.rate = FSKIP_MAX_RATE;
+  }
+
+  // spread the skipped frames evenly
+  fskip.acc += fskip.rate;
+  skip = fskip.acc >= 256;
+  if (skip)
+    fskip.acc -= 256;
+  return skip;
+}
+
+// what actually happened to the frame, deciding is not always up to us
+static void fskip_done(int skipped)
+{
+  fskip.drawn = !skipped;
+  fskip.frames++;
+  fskip.skipped += skipped;
+  if (fskip.stats)
+    fskip_update_stats();
+}
+
 static noinline void decide_frameskip(void)
 {
+  if (gpu.frameskip.deferred) {
+    defer_frame_done();
+    return;
+  }
+
   if (gpu.frameskip.active)
     gpu.frameskip.cnt++;
   else {
@@ -94,7 +357,11 @@ static noinline void decide_frameskip(void)
     gpu.frameskip.frame_ready = 1;
   }
 
-  if (!gpu.frameskip.active && *gpu.frameskip.advice)
+  if (gpu.frameskip.set == -2) {
+    gpu.frameskip.active = fskip_adaptive();
+    fskip_done(gpu.frameskip.active);
+  }
+  else if (!gpu.frameskip.active && *gpu.frameskip.advice)
     gpu.frameskip.active = 1;
   else if (gpu.frameskip.set > 0 && gpu.frameskip.cnt < gpu.frameskip.set)
     gpu.frameskip.active = 1;
@@ -102,9 +369,11 @@ static noinline void decide_frameskip(void)
     gpu.frameskip.active = 0;
 
   if (!gpu.frameskip.active && gpu.frameskip.pending_fill[0] != 0) {
+    uint32_t *fill = gpu.frameskip.pending_fill;
     int dummy;
-    do_cmd_list(gpu.frameskip.pending_fill, 3, &dummy);
-    gpu.frameskip.pending_fill[0] = 0;
+    gpu_thread_cmd_list(fill, 3, &dummy);
+    mark_vram_dirty(fill[1] >> 16, (fill[2] >> 16) & 0x1ff);
+    fill[0] = 0;
   }
 }
 
@@ -167,6 +436,7 @@ long GPUinit(void)
   gpu.state.hcnt = &gpu.zero;
   gpu.frameskip.active = 0;
   gpu.cmd_len = 0;
+  gpu.renderer_ex_regs = gpu.ex_regs;
   do_reset();
 
   if (gpu.mmap != NULL) {
@@ -180,6 +450,8 @@ long GPUshutdown(void)
 {
   long ret;
 
+  gpu_trace_stop();
+  gpu_thread_stop();
   renderer_finish();
   ret = vout_finish();
   if (gpu.vram != NULL) {
@@ -197,28 +469,34 @@ void GPUwriteStatus(uint32_t data)
   static const short vres[4] = { 240, 480, 256, 480 };
   uint32_t cmd = data >> 24;
 
+  if (unlikely(gpu.state.tracing))
+    gpu_trace_record_word(GPU_TRACE_WRITE_STATUS, data);
+
   if (cmd < ARRAY_SIZE(gpu.regs)) {
     if (cmd > 1 && cmd != 5 && gpu.regs[cmd] == data)
       return;
     gpu.regs[cmd] = data;
   }
 
-  gpu.state.fb_dirty = 1;
-
   switch (cmd) {
     case 0x00:
       do_reset();
+      gpu.state.fb_dirty = 1;
       break;
     case 0x01:
       do_cmd_reset();
       break;
     case 0x03:
       gpu.status.blanking = data & 1;
+      gpu.state.fb_dirty = 1;
       break;
     case 0x04:
       gpu.status.dma = data & 3;
       break;
     case 0x05:
+      // games tend to write this every frame, even if it stays the same
+      if (gpu.screen.x != (data & 0x3ff) || gpu.screen.y != ((data >> 10) & 0x1ff))
+        gpu.state.fb_dirty = 1;
       gpu.screen.x = data & 0x3ff;
       gpu.screen.y = (data >> 10) & 0x1ff;
       if (gpu.frameskip.set) {
@@ -233,11 +511,13 @@ void GPUwriteStatus(uint32_t data)
       gpu.screen.x1 = data & 0xfff;
       gpu.screen.x2 = (data >> 12) & 0xfff;
       update_width();
+      gpu.state.fb_dirty = 1;
       break;
     case 0x07:
       gpu.screen.y1 = data & 0x3ff;
       gpu.screen.y2 = (data >> 10) & 0x3ff;
       update_height();
+      gpu.state.fb_dirty = 1;
       break;
     case 0x08:
       gpu.status.reg = (gpu.status.reg & ~0x7f0000) | ((data & 0x3F) << 17) | ((data & 0x40) << 10);
@@ -245,7 +525,9 @@ void GPUwriteStatus(uint32_t data)
       gpu.screen.vres = vres[(gpu.status.reg >> 19) & 3];
       update_width();
       update_height();
+      gpu_thread_sync();
       renderer_notify_res_change();
+      gpu.state.fb_dirty = 1;
       break;
     default:
       if ((cmd & 0xf0) == 0x10)
@@ -299,6 +581,9 @@ static int do_vram_io(uint32_t *data, int count, int is_read)
   int l;
   count *= 2; // operate in 16bpp pixels
 
+  if (!is_read)
+    mark_vram_dirty(y, h);
+
   if (gpu.dma.offset) {
     l = w - gpu.dma.offset;
     if (count < l)
@@ -352,6 +637,9 @@ static void start_vram_transfer(uint32_t pos_word, uint32_t size_word, int is_re
   gpu.dma.is_read = is_read;
   gpu.dma_start = gpu.dma;
 
+  // vram is accessed directly from here on
+  defer_commit();
+  gpu_thread_sync();
   renderer_flush_queues();
   if (is_read) {
     gpu.status.img = 1;
@@ -368,9 +656,11 @@ static void finish_vram_transfer(int is_read)
 {
   if (is_read)
     gpu.status.img = 0;
-  else
+  else {
+    gpu_thread_sync();
     renderer_update_caches(gpu.dma_start.x, gpu.dma_start.y,
                            gpu.dma_start.w, gpu.dma_start.h);
+  }
 }
 
 static noinline int do_cmd_list_skip(uint32_t *data, int count, int *last_cmd)
@@ -387,9 +677,11 @@ static noinline int do_cmd_list_skip(uint32_t *data, int count, int *last_cmd)
 
     switch (cmd) {
       case 0x02:
-        if ((list[2] & 0x3ff) > gpu.screen.w || ((list[2] >> 16) & 0x1ff) > gpu.screen.h)
+        if ((list[2] & 0x3ff) > gpu.screen.w || ((list[2] >> 16) & 0x1ff) > gpu.screen.h) {
           // clearing something large, don't skip
-          do_cmd_list(list, 3, &dummy);
+          gpu_thread_cmd_list(list, 3, &dummy);
+          mark_vram_dirty(list[1] >> 16, (list[2] >> 16) & 0x1ff);
+        }
         else
           memcpy(gpu.frameskip.pending_fill, list, 3 * 4);
         break;
@@ -398,7 +690,7 @@ static noinline int do_cmd_list_skip(uint32_t *data, int count, int *last_cmd)
       case 0x34 ... 0x37:
       case 0x3c ... 0x3f:
         gpu.ex_regs[1] &= ~0x1ff;
-        gpu.ex_regs[1] |= list[4 + ((cmd >> 4) & 1)] & 0x1ff;
+        gpu.ex_regs[1] |= (list[4 + ((cmd >> 4) & 1)] >> 16) & 0x1ff;
         break;
       case 0x48 ... 0x4F:
         for (v = 3; pos + v < count; v++)
@@ -434,22 +726,206 @@ static noinline int do_cmd_list_skip(uint32_t *data, int count, int *last_cmd)
     pos += len;
   }
 
-  renderer_sync_ecmds(gpu.ex_regs);
+  gpu_thread_sync_ecmds(gpu.ex_regs);
   *last_cmd = cmd;
   return pos;
 }
 
+/*
+ * Deferred frameskip. Instead of guessing ahead of time if the next frame
+ * will be skipped, its commands are only recorded, and get drawn once the
+ * game flips to it and the frame turns out to be on time. A late frame is
+ * dropped without ever being drawn, except for its fills and copies,
+ * like do_cmd_list_skip() does. Anything that looks at vram draws the
+ * recorded commands first, as does drawing over what's being displayed,
+ * which isn't dropped.
+ */
+#define DEFER_BUF_LEN (1 << 17) // in words
+
+static struct {
+  uint32_t buf[DEFER_BUF_LEN];
+  int len;
+  int shown;       // drew on the display area, can't drop
+  uint32_t e3, e4; // drawing area at the start, for mark_cmd_list_dirty()
+} defer;
+
+static int rect_on_display(int x, int y, int w, int h)
+{
+  return x < gpu.screen.x + gpu.screen.w && gpu.screen.x < x + w
+    && y < gpu.screen.y + gpu.screen.h && gpu.screen.y < y + h;
+}
+
+static int draw_area_on_display(void)
+{
+  int x1 = gpu.ex_regs[3] & 0x3ff, y1 = (gpu.ex_regs[3] >> 10) & 0x1ff;
+  int x2 = gpu.ex_regs[4] & 0x3ff, y2 = (gpu.ex_regs[4] >> 10) & 0x1ff;
+
+  return rect_on_display(x1, y1, x2 - x1 + 1, y2 - y1 + 1);
+}
+
+static void defer_draw(uint32_t *list, int count)
+{
+  int pos, len, dummy;
+
+  for (pos = 0; pos < count; pos += len) {
+    len = gpu_thread_cmd_list(list + pos, count - pos, &dummy);
+    if (len <= 0)
+      break;
+  }
+  mark_cmd_list_dirty(list, count, defer.e3, defer.e4);
+}
+
+static void defer_commit(void)
+{
+  if (defer.len == 0)
+    return;
+
+  defer_draw(defer.buf, defer.len);
+  defer.len = 0;
+  defer.shown = 0;
+}
+
+// the frame won't be shown, only keep what doesn't depend on drawing
+static void defer_drop(void)
+{
+  int pos, len, out = 0;
+
+  for (pos = 0; pos < defer.len; pos += len) {
+    uint32_t *list = defer.buf + pos;
+    len = get_cmd_len(list, defer.len - pos);
+    if ((list[0] >> 24) == 0x02 || (list[0] >> 24) == 0x80
+        || (list[0] >> 28) == 0xe) {
+      memmove(defer.buf + out, list, len * 4);
+      out += len;
+    }
+  }
+
+  defer_draw(defer.buf, out);
+  // the textured primitives' texpage bits
+  gpu_thread_sync_ecmds(gpu.ex_regs);
+  defer.len = 0;
+  defer.shown = 0;
+}
+
+// the game flips to a new frame, draw or drop the one it's done with
+static void defer_frame_done(void)
+{
+  int adaptive = gpu.frameskip.set == -2;
+  int late = adaptive ? fskip_adaptive()
+    : gpu.frameskip.set > 0
+    ? gpu.frameskip.cnt < gpu.frameskip.set
+    : gpu.frameskip.cnt == 0 && *gpu.frameskip.advice;
+  int drop = defer.len > 0 && !defer.shown && late;
+
+  if (drop) {
+    defer_drop();
+    gpu.frameskip.cnt++;
+    gpu.frameskip.frame_ready = 0;
+  }
+  else {
+    defer_commit();
+    gpu.frameskip.cnt = 0;
+    gpu.frameskip.frame_ready = 1;
+  }
+  if (adaptive)
+    fskip_done(drop);
+}
+
+static noinline int do_cmd_list_defer(uint32_t *data, int count, int *last_cmd)
+{
+  int cmd = 0, pos = 0, len, partial_polyline = 0;
+  int area_shown = draw_area_on_display();
+
+  if (defer.len == 0) {
+    defer.e3 = gpu.ex_regs[3];
+    defer.e4 = gpu.ex_regs[4];
+  }
+
+  while (pos < count) {
+    uint32_t *list = data + pos;
+    cmd = list[0] >> 24;
+    len = get_cmd_len(list, count - pos);
+
+    if (0xa0 <= cmd && cmd <= 0xdf)
+      break; // image i/o
+    if (pos + len > count) {
+      partial_polyline = (cmd & 0xe8) == 0x48;
+      if (partial_polyline)
+        break; // see below
+      cmd = -1;
+      break; // incomplete cmd
+    }
+    if (defer.len + pos + len > DEFER_BUF_LEN) {
+      if (pos > 0)
+        break; // store what fits, the caller comes back for the rest
+      if (defer.len > 0) {
+        defer_commit();
+        defer.e3 = gpu.ex_regs[3];
+        defer.e4 = gpu.ex_regs[4];
+        continue;
+      }
+      // doesn't fit at all
+      pos = gpu_thread_cmd_list(data, count, last_cmd);
+      mark_cmd_list_dirty(data, pos, defer.e3, defer.e4);
+      return pos;
+    }
+
+    switch (cmd) {
+      case 0x02:
+        defer.shown |= rect_on_display(list[1] & 0x3ff, (list[1] >> 16) & 0x1ff,
+          list[2] & 0x3ff, (list[2] >> 16) & 0x1ff);
+        break;
+      case 0x24 ... 0x27:
+      case 0x2c ... 0x2f:
+      case 0x34 ... 0x37:
+      case 0x3c ... 0x3f:
+        gpu.ex_regs[1] &= ~0x1ff;
+        gpu.ex_regs[1] |= (list[4 + ((cmd >> 4) & 1)] >> 16) & 0x1ff;
+        break;
+      case 0x80:
+        defer.shown |= rect_on_display(list[2] & 0x3ff, (list[2] >> 16) & 0x1ff,
+          ((list[3] - 1) & 0x3ff) + 1, (((list[3] >> 16) - 1) & 0x1ff) + 1);
+        break;
+      default:
+        if ((cmd & 0xf8) == 0xe0)
+          gpu.ex_regs[cmd & 7] = list[0];
+        if (cmd == 0xe3 || cmd == 0xe4)
+          area_shown = draw_area_on_display();
+        break;
+    }
+    if (0x20 <= cmd && cmd < 0x80)
+      defer.shown |= area_shown;
+
+    pos += len;
+  }
+
+  memcpy(defer.buf + defer.len, data, pos * 4);
+  defer.len += pos;
+  *last_cmd = cmd;
+
+  if (partial_polyline) {
+    // the renderer draws as much of an unterminated polyline as there is,
+    // so do just that, in order with what was recorded
+    uint32_t e3 = gpu.ex_regs[3], e4 = gpu.ex_regs[4];
+    defer_commit();
+    len = gpu_thread_cmd_list(data + pos, count - pos, last_cmd);
+    mark_cmd_list_dirty(data + pos, len, e3, e4);
+    pos += len;
+  }
+  return pos;
+}
+
 static noinline int do_cmd_buffer(uint32_t *data, int count)
 {
   int cmd, pos;
   uint32_t old_e3 = gpu.ex_regs[3];
-  int vram_dirty = 0;
+  uint32_t e3, e4;
+  int len;
 
   // process buffer
   for (pos = 0; pos < count; )
   {
     if (gpu.dma.h && !gpu.dma_start.is_read) { // XXX: need to verify
-      vram_dirty = 1;
       pos += do_vram_io(data + pos, count - pos, 0);
       if (pos == count)
         break;
@@ -466,9 +942,15 @@ static noinline int do_cmd_buffer(uint32_t *data, int count)
     // 0xex cmds might affect frameskip.allow, so pass to do_cmd_list_skip
     if (gpu.frameskip.active && (gpu.frameskip.allow || ((data[pos] >> 24) & 0xf0) == 0xe0))
       pos += do_cmd_list_skip(data + pos, count - pos, &cmd);
+    else if (gpu.frameskip.deferred && gpu.frameskip.set)
+      pos += do_cmd_list_defer(data + pos, count - pos, &cmd);
     else {
-      pos += do_cmd_list(data + pos, count - pos, &cmd);
-      vram_dirty = 1;
+      // the renderer updates ex_regs as it goes
+      e3 = gpu.ex_regs[3];
+      e4 = gpu.ex_regs[4];
+      len = gpu_thread_cmd_list(data + pos, count - pos, &cmd);
+      mark_cmd_list_dirty(data + pos, len, e3, e4);
+      pos += len;
     }
 
     if (cmd == -1)
@@ -480,8 +962,6 @@ static noinline int do_cmd_buffer(uint32_t *data, int count)
   gpu.status.reg |= gpu.ex_regs[1] & 0x7ff;
   gpu.status.reg |= (gpu.ex_regs[6] & 3) << 11;
 
-  gpu.state.fb_dirty |= vram_dirty;
-
   if (old_e3 != gpu.ex_regs[3])
     decide_frameskip_allow(gpu.ex_regs[3]);
 
@@ -502,6 +982,9 @@ void GPUwriteDataMem(uint32_t *mem, int count)
 
   log_io("gpu_dma_write %p %d\n", mem, count);
 
+  if (unlikely(gpu.state.tracing))
+    gpu_trace_record(GPU_TRACE_WRITE_MEM, mem, count);
+
   if (unlikely(gpu.cmd_len > 0))
     flush_cmd_buffer();
 
@@ -513,6 +996,8 @@ void GPUwriteDataMem(uint32_t *mem, int count)
 void GPUwriteData(uint32_t data)
 {
   log_io("gpu_write %08x\n", data);
+  if (unlikely(gpu.state.tracing))
+    gpu_trace_record_word(GPU_TRACE_WRITE_DATA, data);
   gpu.cmd_buffer[gpu.cmd_len++] = data;
   if (gpu.cmd_len >= CMD_BUFFER_LEN)
     flush_cmd_buffer();
@@ -545,6 +1030,8 @@ long GPUdmaChain(uint32_t *rambase, uint32_t start_addr)
     log_io(".chain %08x #%d\n", (list - rambase) * 4, len);
 
     if (len) {
+      if (unlikely(gpu.state.tracing))
+        gpu_trace_record(GPU_TRACE_DMA_LINK, list + 1, len);
       left = do_cmd_buffer(list + 1, len);
       if (left)
         log_anomaly("GPUdmaChain: discarded %d/%d words\n", left, len);
@@ -575,6 +1062,9 @@ long GPUdmaChain(uint32_t *rambase, uint32_t start_addr)
     }
   }
 
+  if (unlikely(gpu.state.tracing))
+    gpu_trace_record(GPU_TRACE_DMA_END, NULL, 0);
+
   gpu.state.last_list.frame = *gpu.state.frame_count;
   gpu.state.last_list.hcnt = *gpu.state.hcnt;
   gpu.state.last_list.cycles = cpu_cycles;
@@ -587,23 +1077,33 @@ void GPUreadDataMem(uint32_t *mem, int count)
 {
   log_io("gpu_dma_read  %p %d\n", mem, count);
 
+  if (unlikely(gpu.state.tracing))
+    gpu_trace_record_word(GPU_TRACE_READ_MEM, count);
+
   if (unlikely(gpu.cmd_len > 0))
     flush_cmd_buffer();
 
-  if (gpu.dma.h)
+  if (gpu.dma.h) {
+    gpu_thread_sync();
     do_vram_io(mem, count, 1);
+  }
 }
 
 uint32_t GPUreadData(void)
 {
   uint32_t ret;
 
+  if (unlikely(gpu.state.tracing))
+    gpu_trace_record_word(GPU_TRACE_READ_DATA, 1);
+
   if (unlikely(gpu.cmd_len > 0))
     flush_cmd_buffer();
 
   ret = gpu.gp0;
-  if (gpu.dma.h)
+  if (gpu.dma.h) {
+    gpu_thread_sync();
     do_vram_io(&ret, 1, 1);
+  }
 
   log_io("gpu_read %08x\n", ret);
   return ret;
@@ -613,36 +1113,42 @@ uint32_t GPUreadStatus(void)
 {
   uint32_t ret;
 
-  if (unlikely(gpu.cmd_len > 0))
+  if (unlikely(gpu.cmd_len > 0)) {
+    if (unlikely(gpu.state.tracing))
+      gpu_trace_record(GPU_TRACE_FLUSH, NULL, 0);
     flush_cmd_buffer();
+  }
 
   ret = gpu.status.reg;
   log_io("gpu_read_status %08x\n", ret);
   return ret;
 }
 
-struct GPUFreeze
-{
-  uint32_t ulFreezeVersion;      // should be always 1 for now (set by main emu)
-  uint32_t ulStatus;             // current gpu status
-  uint32_t ulControl[256];       // latest control register values
-  unsigned char psxVRam[1024*1024*2]; // current VRam image (full 2 MB for ZN)
-};
-
 long GPUfreeze(uint32_t type, struct GPUFreeze *freeze)
 {
   int i;
 
   switch (type) {
     case 1: // save
-      if (gpu.cmd_len > 0)
+      if (gpu.cmd_len > 0) {
+        if (unlikely(gpu.state.tracing))
+          gpu_trace_record(GPU_TRACE_FLUSH, NULL, 0);
         flush_cmd_buffer();
+      }
+      defer_commit();
+      gpu_thread_sync();
+      renderer_flush_queues();
       memcpy(freeze->psxVRam, gpu.vram, 1024 * 512 * 2);
       memcpy(freeze->ulControl, gpu.regs, sizeof(gpu.regs));
       memcpy(freeze->ulControl + 0xe0, gpu.ex_regs, sizeof(gpu.ex_regs));
       freeze->ulStatus = gpu.status.reg;
       break;
     case 0: // load
+      // what's recorded belongs to the old state
+      defer.len = 0;
+      defer.shown = 0;
+      gpu_thread_sync();
+      renderer_flush_queues();
       memcpy(gpu.vram, freeze->psxVRam, 1024 * 512 * 2);
       memcpy(gpu.regs, freeze->ulControl, sizeof(gpu.regs));
       memcpy(gpu.ex_regs, freeze->ulControl + 0xe0, sizeof(gpu.ex_regs));
@@ -654,6 +1160,9 @@ long GPUfreeze(uint32_t type, struct GPUFreeze *freeze)
       }
       renderer_sync_ecmds(gpu.ex_regs);
       renderer_update_caches(0, 0, 1024, 512);
+      gpu.state.fb_dirty = 1;
+      if (unlikely(gpu.state.tracing))
+        gpu_trace_snapshot();
       break;
   }
 
@@ -662,8 +1171,16 @@ long GPUfreeze(uint32_t type, struct GPUFreeze *freeze)
 
 void GPUupdateLace(void)
 {
+  int dummy;
+
+  if (unlikely(gpu.state.tracing))
+    gpu_trace_record_word(GPU_TRACE_UPDATE_LACE, *gpu.state.frame_count);
+
   if (gpu.cmd_len > 0)
     flush_cmd_buffer();
+  if (defer.shown)
+    defer_commit();
+  gpu_thread_sync();
   renderer_flush_queues();
 
   if (gpu.status.blanking) {
@@ -675,7 +1192,9 @@ void GPUupdateLace(void)
     return;
   }
 
-  if (!gpu.state.fb_dirty)
+  if (!gpu.state.fb_dirty
+      && !gpu_dirty_rows(gpu.screen.y, gpu.screen.h, &dummy))
+    // nothing new to show
     return;
 
   if (gpu.frameskip.set) {
@@ -689,6 +1208,7 @@ void GPUupdateLace(void)
 
   vout_update();
   gpu.state.fb_dirty = 0;
+  gpu.state.dirty_bands = 0;
   gpu.state.blanked = 0;
 }
 
@@ -696,6 +1216,11 @@ void GPUvBlank(int is_vblank, int lcf)
 {
   int interlace = gpu.state.allow_interlace
     && gpu.status.interlace && gpu.status.dheight;
+
+  if (unlikely(gpu.state.tracing)) {
+    uint32_t args[3] = { is_vblank, lcf, *gpu.state.frame_count };
+    gpu_trace_record(GPU_TRACE_VBLANK, args, 3);
+  }
   // interlace doesn't look nice on progressive displays,
   // so we have this "auto" mode here for games that don't read vram
   if (gpu.state.allow_interlace == 2
@@ -708,6 +1233,8 @@ void GPUvBlank(int is_vblank, int lcf)
 
     if (gpu.cmd_len > 0)
       flush_cmd_buffer();
+    defer_commit();
+    gpu_thread_sync();
     renderer_flush_queues();
     renderer_set_interlace(interlace, !lcf);
   }
@@ -715,16 +1242,35 @@ void GPUvBlank(int is_vblank, int lcf)
 
 #include "../../frontend/plugin_lib.h"
 
+static void fskip_update_stats(void)
+{
+  struct gpu_fskip_stats *st = fskip.stats;
+
+  st->frames = fskip.frames;
+  st->skipped = fskip.skipped;
+  st->skip_rate = fskip.rate;
+  st->render_us = fskip.render_us;
+  st->emu_us = fskip.emu_us;
+  st->budget_us = fskip.budget_us;
+}
+
 void GPUrearmedCallbacks(const struct rearmed_cbs *cbs)
 {
+  defer_commit();
+  gpu_thread_sync();
+
   gpu.frameskip.set = cbs->frameskip;
+  gpu.frameskip.deferred = cbs->deferred_rendering;
   gpu.frameskip.advice = &cbs->fskip_advice;
   gpu.frameskip.active = 0;
   gpu.frameskip.frame_ready = 1;
+  fskip.stats = cbs->fskip_stats;
+  fskip_reset();
   gpu.state.hcnt = cbs->gpu_hcnt;
   gpu.state.frame_count = cbs->gpu_frame_count;
   gpu.state.allow_interlace = cbs->gpu_neon.allow_interlace;
   gpu.state.enhancement_enable = cbs->gpu_neon.enhancement_enable;
+  gpu.state.fb_dirty = 1;
 
   gpu.mmap = cbs->mmap;
   gpu.munmap = cbs->munmap;
@@ -737,6 +1283,17 @@ void GPUrearmedCallbacks(const struct rearmed_cbs *cbs)
     cbs->pl_vout_set_raw_vram(gpu.vram);
   renderer_set_config(cbs);
   vout_set_config(cbs);
+
+  // can't draw from another thread if the renderer owns the display (GL)
+  if (cbs->thread_rendering && !(cbs->gpu_caps & GPU_CAP_OWNS_DISPLAY))
+    gpu_thread_start();
+  else
+    gpu_thread_stop();
+
+  if (cbs->gpu_trace_file != NULL)
+    gpu_trace_start(cbs->gpu_trace_file);
+  else
+    gpu_trace_stop();
 }
 
 // vim:shiftwidth=2:expandtab
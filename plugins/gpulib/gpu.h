@@ -8,6 +8,9 @@
  * See the COPYING file in the top-level directory.
  */
 
+#ifndef __GPULIB_GPU_H__
+#define __GPULIB_GPU_H__
+
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -49,6 +52,8 @@ struct psx_gpu {
   } status;
   uint32_t gp0;
   uint32_t ex_regs[8];
+  uint32_t *renderer_ex_regs; /* where do_cmd_list keeps E1-E6, ex_regs
+                                 unless the render thread is used */
   struct {
     int hres, vres;
     int x, y, w, h;
@@ -62,12 +67,13 @@ struct psx_gpu {
   int cmd_len;
   uint32_t zero;
   struct {
-    uint32_t fb_dirty:1;
+    uint32_t fb_dirty:1;    /* display must be redrawn in full */
     uint32_t old_interlace:1;
     uint32_t allow_interlace:2;
     uint32_t blanked:1;
     uint32_t enhancement_enable:1;
     uint32_t enhancement_active:1;
+    uint32_t tracing:1;
     uint32_t *frame_count;
     uint32_t *hcnt; /* hsync count */
     struct {
@@ -77,13 +83,15 @@ struct psx_gpu {
       uint32_t hcnt;
     } last_list;
     uint32_t last_vram_read_frame;
+    uint32_t dirty_bands;   /* vram drawn since the last flip, bit per 16 lines */
   } state;
   struct {
-    int32_t set:3; /* -1 auto, 0 off, 1-3 fixed */
+    int32_t set:3; /* -2 adaptive, -1 auto, 0 off, 1-3 fixed */
     int32_t cnt:3; /* amount skipped in a row */
     uint32_t active:1;
     uint32_t allow:1;
     uint32_t frame_ready:1;
+    uint32_t deferred:1;  /* decide after recording the frame (gpu.c) */
     const int *advice;
     uint32_t last_flip_frame;
     uint32_t pending_fill[3];
@@ -99,6 +107,8 @@ extern struct psx_gpu gpu;
 extern const unsigned char cmd_lengths[256];
 
 int do_cmd_list(uint32_t *list, int count, int *last_cmd);
+int gpu_dirty_rows(int y, int h, int *dirty_y);
+void gpu_sync_vram(void);
 
 struct rearmed_cbs;
 
@@ -117,8 +127,15 @@ void vout_update(void);
 void vout_blank(void);
 void vout_set_config(const struct rearmed_cbs *config);
 
+struct GPUFreeze
+{
+  uint32_t ulFreezeVersion;      // should be always 1 for now (set by main emu)
+  uint32_t ulStatus;             // current gpu status
+  uint32_t ulControl[256];       // latest control register values
+  unsigned char psxVRam[1024*1024*2]; // current VRam image (full 2 MB for ZN)
+};
+
 /* listing these here for correct linkage if rasterizer uses c++ */
-struct GPUFreeze;
 
 long GPUinit(void);
 long GPUshutdown(void);
@@ -139,3 +156,5 @@ void GPUrearmedCallbacks(const struct rearmed_cbs *cbs_);
 #ifdef __cplusplus
 }
 #endif
+
+#endif /* __GPULIB_GPU_H__ */
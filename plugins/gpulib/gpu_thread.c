@@ -0,0 +1,353 @@
+/*
+ * This work is licensed under the terms of any of these licenses
+ * (at your option):
+ *  - GNU GPL, version 2 or later.
+ *  - GNU LGPL, version 2.1 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+/*
+ * Render thread for gpulib.
+ *
+ * The emulation thread only scans command lists for their length and
+ * the E1-E6 state gpulib itself needs (GPUSTAT, frameskip), copies them
+ * to a single producer/single consumer ring and carries on. The render
+ * thread feeds the ring to the renderer's do_cmd_list. The renderer
+ * stores its own idea of E1-E6 to a private copy meanwhile, so the two
+ * threads never write the same registers.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "gpu.h"
+#include "gpu_thread.h"
+
+// ring positions and wait flags are shared without holding the lock
+#define shared_load(v)     __atomic_load_n(&(v), __ATOMIC_SEQ_CST)
+#define shared_store(v, x) __atomic_store_n(&(v), x, __ATOMIC_SEQ_CST)
+
+//#define log_anomaly printf
+#define log_anomaly(...)
+
+#define RING_SIZE   (1 << 16) // in words
+#define RING_MASK   (RING_SIZE - 1)
+// lists are queued in pieces of up to this size
+#define MAX_ENTRY   (RING_SIZE / 8)
+// don't wake an idle render thread for less than this
+#define WAKE_WORDS  256
+
+// entry header: op << 24 | word count, the words follow
+#define OP_WRAP       0 // rest of the ring unused, continue from the start
+#define OP_CMD_LIST   1
+#define OP_SYNC_ECMDS 2
+
+static struct {
+  uint32_t ring[RING_SIZE];
+  unsigned int wpos;  // free running, in words
+  unsigned int rpos;
+  int thread_idle;    // render thread waits for work
+  int main_waiting;   // emu thread waits for space or sync
+  int quit;
+  int running;
+  int measure;        // time the renderer for the adaptive frameskip
+  uint32_t render_ns; // spent in it since the last take, while measuring
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond_work;
+  pthread_cond_t cond_progress;
+  uint32_t renderer_ex_regs[8];
+} thr = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .cond_work = PTHREAD_COND_INITIALIZER,
+  .cond_progress = PTHREAD_COND_INITIALIZER,
+};
+
+static uint64_t render_clock_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int draw_cmd_list(uint32_t *list, int count, int *last_cmd)
+{
+  uint64_t start;
+  int ret;
+
+  if (!shared_load(thr.measure))
+    return do_cmd_list(list, count, last_cmd);
+
+  start = render_clock_ns();
+  ret = do_cmd_list(list, count, last_cmd);
+  __atomic_add_fetch(&thr.render_ns, (uint32_t)(render_clock_ns() - start),
+    __ATOMIC_SEQ_CST);
+  return ret;
+}
+
+static void *render_thread(void *unused)
+{
+  unsigned int rpos = shared_load(thr.rpos);
+  uint32_t *entry;
+  int n, done, cmd;
+
+  for (;;) {
+    if (rpos == shared_load(thr.wpos)) {
+      pthread_mutex_lock(&thr.lock);
+      shared_store(thr.thread_idle, 1);
+      while (rpos == shared_load(thr.wpos) && !thr.quit)
+        pthread_cond_wait(&thr.cond_work, &thr.lock);
+      shared_store(thr.thread_idle, 0);
+      pthread_mutex_unlock(&thr.lock);
+      if (rpos == shared_load(thr.wpos))
+        break; // quit, and everything is drawn
+    }
+
+    entry = &thr.ring[rpos & RING_MASK];
+    n = entry[0] & 0xffffff;
+    switch (entry[0] >> 24) {
+      case OP_WRAP:
+        n = RING_SIZE - (rpos & RING_MASK) - 1;
+        break;
+      case OP_CMD_LIST:
+        done = draw_cmd_list(entry + 1, n, &cmd);
+        if (done != n)
+          log_anomaly("render_thread: discarded %d/%d words\n", n - done, n);
+        break;
+      case OP_SYNC_ECMDS:
+        // words 1-6 are the E1-E6 commands
+        renderer_sync_ecmds(entry);
+        break;
+    }
+    rpos += 1 + n;
+
+    shared_store(thr.rpos, rpos);
+    if (shared_load(thr.main_waiting)) {
+      pthread_mutex_lock(&thr.lock);
+      pthread_cond_signal(&thr.cond_progress);
+      pthread_mutex_unlock(&thr.lock);
+    }
+  }
+
+  return NULL;
+}
+
+static void wake_thread(void)
+{
+  pthread_mutex_lock(&thr.lock);
+  if (shared_load(thr.thread_idle))
+    pthread_cond_signal(&thr.cond_work);
+  pthread_mutex_unlock(&thr.lock);
+}
+
+static unsigned int ring_free(void)
+{
+  return RING_SIZE - (shared_load(thr.wpos) - shared_load(thr.rpos));
+}
+
+// waits until the ring has this many free words
+static void wait_space(unsigned int words)
+{
+  if (ring_free() >= words)
+    return;
+
+  pthread_mutex_lock(&thr.lock);
+  shared_store(thr.main_waiting, 1);
+  if (shared_load(thr.thread_idle))
+    pthread_cond_signal(&thr.cond_work);
+  while (ring_free() < words)
+    pthread_cond_wait(&thr.cond_progress, &thr.lock);
+  shared_store(thr.main_waiting, 0);
+  pthread_mutex_unlock(&thr.lock);
+}
+
+static void queue_words(int op, const uint32_t *words, int count)
+{
+  unsigned int wpos = thr.wpos; // only this thread writes it
+  unsigned int off = wpos & RING_MASK;
+  unsigned int need = count + 1;
+
+  if (off + need > RING_SIZE) {
+    wait_space(RING_SIZE - off + need);
+    thr.ring[off] = OP_WRAP << 24;
+    wpos += RING_SIZE - off;
+    off = 0;
+  }
+  else
+    wait_space(need);
+
+  thr.ring[off] = (op << 24) | count;
+  memcpy(&thr.ring[off + 1], words, count * 4);
+
+  shared_store(thr.wpos, wpos + need);
+  if (shared_load(thr.thread_idle) && ring_free() <= RING_SIZE - WAKE_WORDS)
+    wake_thread();
+}
+
+/*
+ * Finds how much of the list can be drawn (stopping at an incomplete
+ * command or image i/o like the renderers do) and applies its E1-E6
+ * changes, which the renderer would otherwise have made.
+ */
+static int scan_cmd_list(uint32_t *data, int count, int *last_cmd)
+{
+  int cmd = 0, pos = 0, len, v;
+
+  while (pos < count && pos < MAX_ENTRY) {
+    uint32_t *list = data + pos;
+    cmd = list[0] >> 24;
+    len = 1 + cmd_lengths[cmd];
+
+    if (cmd == 0xa0 || cmd == 0xc0)
+      break; // image i/o, the renderers only stop at these
+
+    switch (cmd) {
+      case 0x48 ... 0x4F:
+        for (v = 3; pos + v < count; v++)
+        {
+          if ((list[v] & 0xf000f000) == 0x50005000)
+            break;
+        }
+        len += v - 3;
+        if (pos + v >= count)
+          len++; // no terminator yet
+        break;
+      case 0x58 ... 0x5F:
+        for (v = 4; pos + v < count; v += 2)
+        {
+          if ((list[v] & 0xf000f000) == 0x50005000)
+            break;
+        }
+        len += v - 4;
+        if (pos + v >= count)
+          len++;
+        break;
+    }
+
+    if (pos + len > count) {
+      cmd = -1;
+      break; // incomplete cmd
+    }
+
+    switch (cmd) {
+      case 0x24 ... 0x27:
+      case 0x2c ... 0x2f:
+      case 0x34 ... 0x37:
+      case 0x3c ... 0x3f:
+        gpu.ex_regs[1] &= ~0x1ff;
+        gpu.ex_regs[1] |= (list[4 + ((cmd >> 4) & 1)] >> 16) & 0x1ff;
+        break;
+      default:
+        if ((cmd & 0xf8) == 0xe0)
+          gpu.ex_regs[cmd & 7] = list[0];
+        break;
+    }
+
+    pos += len;
+  }
+
+  *last_cmd = cmd;
+  return pos;
+}
+
+int gpu_thread_cmd_list(uint32_t *list, int count, int *last_cmd)
+{
+  int pos, queued, dummy;
+
+  if (!thr.running)
+    return draw_cmd_list(list, count, last_cmd);
+
+  pos = queued = scan_cmd_list(list, count, last_cmd);
+  // the renderer draws what there is of an unterminated polyline
+  // but doesn't consume it, so send it along without consuming either
+  if (*last_cmd == -1 && pos < count && ((list[pos] >> 24) & 0xe8) == 0x48)
+    queued = count;
+
+  if (queued > MAX_ENTRY * 2) {
+    // the last cmd was a huge polyline, just draw it all here
+    gpu_thread_sync();
+    draw_cmd_list(list, queued, &dummy);
+  }
+  else if (queued > 0)
+    queue_words(OP_CMD_LIST, list, queued);
+
+  return pos;
+}
+
+void gpu_thread_sync_ecmds(uint32_t *ecmds)
+{
+  if (!thr.running)
+    renderer_sync_ecmds(ecmds);
+  else
+    queue_words(OP_SYNC_ECMDS, ecmds + 1, 6);
+}
+
+void gpu_thread_sync(void)
+{
+  if (!thr.running)
+    return;
+
+  wait_space(RING_SIZE);
+}
+
+void gpu_thread_measure(int enable)
+{
+  shared_store(thr.measure, enable);
+  shared_store(thr.render_ns, 0);
+}
+
+uint32_t gpu_thread_take_render_ns(void)
+{
+  return __atomic_exchange_n(&thr.render_ns, 0, __ATOMIC_SEQ_CST);
+}
+
+int gpu_thread_running(void)
+{
+  return thr.running;
+}
+
+int gpu_thread_start(void)
+{
+  if (thr.running)
+    return 0;
+
+#ifdef _SC_NPROCESSORS_ONLN
+  if (sysconf(_SC_NPROCESSORS_ONLN) < 2) {
+    fprintf(stderr, "gpulib: single cpu, not using the render thread\n");
+    return -1;
+  }
+#endif
+
+  memcpy(thr.renderer_ex_regs, gpu.ex_regs, sizeof(thr.renderer_ex_regs));
+  gpu.renderer_ex_regs = thr.renderer_ex_regs;
+  thr.wpos = thr.rpos = 0;
+  thr.quit = 0;
+
+  if (pthread_create(&thr.thread, NULL, render_thread, NULL) != 0) {
+    fprintf(stderr, "gpulib: failed to create the render thread\n");
+    gpu.renderer_ex_regs = gpu.ex_regs;
+    return -1;
+  }
+  thr.running = 1;
+
+  return 0;
+}
+
+void gpu_thread_stop(void)
+{
+  if (!thr.running)
+    return;
+
+  pthread_mutex_lock(&thr.lock);
+  thr.quit = 1;
+  pthread_cond_signal(&thr.cond_work);
+  pthread_mutex_unlock(&thr.lock);
+
+  pthread_join(thr.thread, NULL);
+  thr.running = 0;
+  gpu.renderer_ex_regs = gpu.ex_regs;
+}
+
+// vim:shiftwidth=2:expandtab
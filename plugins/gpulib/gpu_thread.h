@@ -0,0 +1,39 @@
+/*
+ * This work is licensed under the terms of any of these licenses
+ * (at your option):
+ *  - GNU GPL, version 2 or later.
+ *  - GNU LGPL, version 2.1 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef __GPULIB_GPU_THREAD_H__
+#define __GPULIB_GPU_THREAD_H__
+
+#include <stdint.h>
+
+/*
+ * Optional render thread. When it's running, command lists are queued
+ * for it instead of being drawn right away, and everything else that
+ * touches the renderer or vram must call gpu_thread_sync() first.
+ * When it's not, these just call the renderer directly.
+ */
+
+int  gpu_thread_start(void);
+void gpu_thread_stop(void);
+int  gpu_thread_running(void);
+
+/* waits until everything queued so far has been drawn */
+void gpu_thread_sync(void);
+
+/* do_cmd_list()/renderer_sync_ecmds() replacements for gpulib */
+int  gpu_thread_cmd_list(uint32_t *list, int count, int *last_cmd);
+void gpu_thread_sync_ecmds(uint32_t *ecmds);
+
+/* renderer time accounting, for the adaptive frameskip:
+ * take returns the time spent drawing since the last take */
+void     gpu_thread_measure(int enable);
+uint32_t gpu_thread_take_render_ns(void);
+
+#endif /* __GPULIB_GPU_THREAD_H__ */
+
+// vim:shiftwidth=2:expandtab
@@ -0,0 +1,107 @@
+/*
+ * This work is licensed under the terms of any of these licenses
+ * (at your option):
+ *  - GNU GPL, version 2 or later.
+ *  - GNU LGPL, version 2.1 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+/*
+ * Command stream recorder, for replaying sessions against the renderers
+ * (see replay.c). gpu.c calls in here for each API call while
+ * gpu.state.tracing is set.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <zlib.h>
+#include "gpu.h"
+#include "gpu_trace.h"
+
+static gzFile trace_file;
+
+static void trace_close(void)
+{
+  gzclose(trace_file);
+  trace_file = NULL;
+  gpu.state.tracing = 0;
+}
+
+void gpu_trace_record(int type, const uint32_t *words, int count)
+{
+  uint32_t hdr = (type << 24) | count;
+
+  if (trace_file == NULL)
+    return;
+
+  if (gzwrite(trace_file, &hdr, 4) != 4
+      || (count > 0 && gzwrite(trace_file, words, count * 4) != count * 4))
+  {
+    fprintf(stderr, "gpulib: trace write failed, stopping\n");
+    trace_close();
+  }
+}
+
+void gpu_trace_record_word(int type, uint32_t word)
+{
+  gpu_trace_record(type, &word, 1);
+}
+
+void gpu_trace_snapshot(void)
+{
+  struct GPUFreeze *f;
+
+  f = malloc(sizeof(*f));
+  if (f == NULL) {
+    fprintf(stderr, "gpulib: OOM for trace snapshot\n");
+    return;
+  }
+  f->ulFreezeVersion = 1;
+  GPUfreeze(1, f);
+  // ulStatus, ulControl and the first half of psxVRam are contiguous
+  gpu_trace_record(GPU_TRACE_FREEZE, &f->ulStatus,
+    1 + 256 + 1024 * 512 * 2 / 4);
+  free(f);
+}
+
+int gpu_trace_start(const char *fname)
+{
+  uint32_t start[2];
+
+  if (trace_file != NULL)
+    return 0;
+
+  trace_file = gzopen(fname, "wb1");
+  if (trace_file == NULL) {
+    fprintf(stderr, "gpulib: can't open trace file %s\n", fname);
+    return -1;
+  }
+
+  start[0] = GPU_TRACE_VERSION;
+  start[1] = gpu.state.allow_interlace;
+  gpu_trace_record(GPU_TRACE_START, start, 2);
+  gpu_trace_snapshot();
+
+  if (trace_file == NULL)
+    return -1;
+  gpu.state.tracing = 1;
+  printf("gpulib: tracing to %s\n", fname);
+  return 0;
+}
+
+void gpu_trace_stop(void)
+{
+  uint32_t crc;
+
+  if (trace_file == NULL)
+    return;
+
+  // what replay.c does at the end, so that the crcs compare
+  gpu_sync_vram();
+  crc = crc32(0, (void *)gpu.vram, 1024 * 512 * 2);
+  gpu_trace_record(GPU_TRACE_END, &crc, 1);
+  if (trace_file != NULL)
+    trace_close();
+}
+
+// vim:shiftwidth=2:expandtab
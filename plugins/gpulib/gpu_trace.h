@@ -0,0 +1,52 @@
+/*
+ * This work is licensed under the terms of any of these licenses
+ * (at your option):
+ *  - GNU GPL, version 2 or later.
+ *  - GNU LGPL, version 2.1 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef __GPULIB_GPU_TRACE_H__
+#define __GPULIB_GPU_TRACE_H__
+
+#include <stdint.h>
+
+/*
+ * GPU command stream trace, gzip compressed, host endian.
+ *
+ * A sequence of records, each a header word (type << 24 | word count)
+ * followed by that many words. It starts with GPU_TRACE_START and a
+ * GPU_TRACE_FREEZE snapshot of the state at that moment, then has one
+ * record for each call to the gpulib API (that has any effect) in the
+ * order they were made. See replay.c for a player.
+ */
+
+#define GPU_TRACE_VERSION 1
+
+enum gpu_trace_record {
+  GPU_TRACE_START = 1,   // version, allow_interlace
+  GPU_TRACE_FREEZE,      // status, control regs[256], 1MB of vram
+  GPU_TRACE_WRITE_DATA,  // the word
+  GPU_TRACE_WRITE_MEM,   // the words
+  GPU_TRACE_DMA_LINK,    // words of a GPUdmaChain list entry
+  GPU_TRACE_DMA_END,     // the chain is complete, process it
+  GPU_TRACE_WRITE_STATUS,// the word
+  GPU_TRACE_READ_DATA,   // word count read
+  GPU_TRACE_READ_MEM,    // word count read
+  GPU_TRACE_FLUSH,       // status read/save with commands buffered
+  GPU_TRACE_VBLANK,      // is_vblank, lcf, frame count
+  GPU_TRACE_UPDATE_LACE, // frame count
+  GPU_TRACE_END,         // crc32 of vram
+};
+
+int  gpu_trace_start(const char *fname);
+void gpu_trace_stop(void);
+
+void gpu_trace_record(int type, const uint32_t *words, int count);
+void gpu_trace_record_word(int type, uint32_t word);
+/* a freeze snapshot of the current state */
+void gpu_trace_snapshot(void);
+
+#endif /* __GPULIB_GPU_TRACE_H__ */
+
+// vim:shiftwidth=2:expandtab
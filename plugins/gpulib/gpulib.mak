@@ -15,6 +15,7 @@ ifdef DEBUG
 endif
 
 GPULIB_A = ../gpulib/gpulib$(EXT).a
+LDLIBS_GPULIB += -lpthread -lz
 
 ifdef BIN_STANDALONE
 TARGETS += $(BIN_STANDALONE)
@@ -0,0 +1,472 @@
+/*
+ * Replays a gpulib command trace (see gpu_trace.h) through a renderer
+ * and reports how long it took, per frame and per command type, plus
+ * a hash of the resulting vram. Built for each renderer by Makefile.test.
+ *
+ * This work is licensed under the terms of any of these licenses
+ * (at your option):
+ *  - GNU GPL, version 2 or later.
+ *  - GNU LGPL, version 2.1 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+// all of gpulib is built in here, so that its calls to the renderer
+// can be intercepted for timing
+#define do_cmd_list timed_do_cmd_list
+#include "gpu.c"
+#include "gpu_thread.c"
+#include "gpu_trace.c"
+#undef do_cmd_list
+
+int do_cmd_list(uint32_t *list, int count, int *last_cmd);
+
+static struct rearmed_cbs cbs;
+static struct gpu_fskip_stats fskip_stats;
+static unsigned int frame_count, hcnt;
+
+static struct {
+  unsigned int count;
+  uint64_t ns;
+} cmd_stats[256];
+static int cmd_timing;
+
+static uint64_t get_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// gpulib side stubs
+
+int vout_init(void) { return 0; }
+int vout_finish(void) { return 0; }
+void vout_update(void) {}
+void vout_blank(void) {}
+void vout_set_config(const struct rearmed_cbs *config) {}
+
+static void *replay_mmap(unsigned int size)
+{
+  return calloc(1, size);
+}
+
+static void replay_munmap(void *ptr, unsigned int size)
+{
+  free(ptr);
+}
+
+static int cmd_length(const uint32_t *list, int count)
+{
+  int cmd = list[0] >> 24;
+  int len = 1 + cmd_lengths[cmd];
+  int v;
+
+  switch (cmd) {
+    case 0x48 ... 0x4F:
+      for (v = 3; v < count; v++)
+        if ((list[v] & 0xf000f000) == 0x50005000)
+          break;
+      len += v - 3;
+      break;
+    case 0x58 ... 0x5F:
+      for (v = 4; v < count; v += 2)
+        if ((list[v] & 0xf000f000) == 0x50005000)
+          break;
+      len += v - 4;
+      break;
+  }
+  return len;
+}
+
+/*
+ * Passes the commands to the renderer one at a time when timing them.
+ * That defeats whatever batching the renderer does across commands,
+ * so the total is somewhat higher than when drawing whole lists.
+ */
+int timed_do_cmd_list(uint32_t *list, int count, int *last_cmd)
+{
+  int pos = 0, cmd = 0, len, done;
+  uint64_t t;
+
+  if (!cmd_timing)
+    return do_cmd_list(list, count, last_cmd);
+
+  while (pos < count) {
+    cmd = list[pos] >> 24;
+    len = cmd_length(list + pos, count - pos);
+    if (len > count - pos)
+      len = count - pos;
+
+    t = get_ns();
+    done = do_cmd_list(list + pos, len, last_cmd);
+    cmd_stats[cmd].ns += get_ns() - t;
+    cmd_stats[cmd].count++;
+
+    pos += done;
+    if (done < len) {
+      cmd = *last_cmd; // image i/o or incomplete
+      break;
+    }
+  }
+
+  *last_cmd = cmd;
+  return pos;
+}
+
+static const char *cmd_name(int cmd)
+{
+  static const char *rect_sizes[4] = { "", " 1x1", " 8x8", " 16x16" };
+  static char buf[64];
+
+  if (cmd == 0x02)
+    return "fill";
+  if (0x20 <= cmd && cmd < 0x40)
+    snprintf(buf, sizeof(buf), "poly%c%s%s%s%s", cmd & 8 ? '4' : '3',
+      cmd & 0x10 ? " shaded" : "", cmd & 4 ? " textured" : "",
+      cmd & 2 ? " semi" : "", (cmd & 5) == 5 ? " raw" : "");
+  else if (0x40 <= cmd && cmd < 0x60)
+    snprintf(buf, sizeof(buf), "%s%s%s", cmd & 8 ? "polyline" : "line",
+      cmd & 0x10 ? " shaded" : "", cmd & 2 ? " semi" : "");
+  else if (0x60 <= cmd && cmd < 0x80)
+    snprintf(buf, sizeof(buf), "rect%s%s%s%s", rect_sizes[(cmd >> 3) & 3],
+      cmd & 4 ? " textured" : "", cmd & 2 ? " semi" : "",
+      (cmd & 5) == 5 ? " raw" : "");
+  else if (0x80 <= cmd && cmd < 0xa0)
+    return "vram copy";
+  else if (cmd == 0xa0 || cmd == 0xc0)
+    return "vram write/read (in gpulib)";
+  else if (0xe1 <= cmd && cmd <= 0xe6)
+    return "env";
+  else
+    return "misc";
+  return buf;
+}
+
+/* the trace, decompressed */
+static uint32_t *trace;
+static size_t trace_words;
+
+static int load_trace(const char *fname)
+{
+  size_t alloc = 1 << 20;
+  gzFile f;
+  int ret;
+
+  f = gzopen(fname, "rb");
+  if (f == NULL) {
+    fprintf(stderr, "can't open %s\n", fname);
+    return -1;
+  }
+
+  trace = malloc(alloc * 4);
+  for (;;) {
+    if (trace == NULL) {
+      fprintf(stderr, "OOM\n");
+      gzclose(f);
+      return -1;
+    }
+    ret = gzread(f, trace + trace_words, (alloc - trace_words) * 4);
+    if (ret <= 0)
+      break;
+    trace_words += ret / 4;
+    if (trace_words == alloc) {
+      alloc *= 2;
+      trace = realloc(trace, alloc * 4);
+    }
+  }
+  gzclose(f);
+
+  if (ret < 0) {
+    fprintf(stderr, "%s: read error\n", fname);
+    return -1;
+  }
+  if (trace_words < 3 || (trace[0] >> 24) != GPU_TRACE_START
+      || trace[1] != GPU_TRACE_VERSION)
+  {
+    fprintf(stderr, "%s: not a gpu trace or unsupported version\n", fname);
+    return -1;
+  }
+  return 0;
+}
+
+// GPUdmaChain() input is rebuilt here, as a linear chain
+static uint32_t chain_ram[0x200000 / 4];
+static int chain_pos, chain_last = -1;
+
+static void chain_flush(void)
+{
+  if (chain_last < 0)
+    chain_ram[0] = 0xffffff;
+  GPUdmaChain(chain_ram, 0);
+  chain_pos = 0;
+  chain_last = -1;
+}
+
+static void chain_add(const uint32_t *words, int count)
+{
+  if (chain_pos + 1 + count > ARRAY_SIZE(chain_ram))
+    chain_flush(); // only if it doesn't fit
+  if (chain_last >= 0)
+    chain_ram[chain_last] = (chain_ram[chain_last] & 0xff000000) | (chain_pos * 4);
+  chain_ram[chain_pos] = (count << 24) | 0xffffff;
+  memcpy(&chain_ram[chain_pos + 1], words, count * 4);
+  chain_last = chain_pos;
+  chain_pos += 1 + count;
+}
+
+static void load_snapshot(const uint32_t *words, int count)
+{
+  struct GPUFreeze *f = calloc(1, sizeof(*f));
+
+  if (f == NULL || count != 1 + 256 + 1024 * 512 * 2 / 4) {
+    fprintf(stderr, "bad snapshot\n");
+    exit(1);
+  }
+  f->ulFreezeVersion = 1;
+  memcpy(&f->ulStatus, words, count * 4);
+  GPUfreeze(0, f);
+  free(f);
+}
+
+static int cmp_stats(const void *p1, const void *p2)
+{
+  uint64_t ns1 = cmd_stats[*(const int *)p1].ns;
+  uint64_t ns2 = cmd_stats[*(const int *)p2].ns;
+  return ns1 < ns2 ? 1 : (ns1 > ns2 ? -1 : 0);
+}
+
+static void usage(const char *argv0)
+{
+  printf("usage: %s [options] <trace>\n"
+    "\t-f\t\tprint every frame's time\n"
+    "\t-c\t\ttime each command type (slower)\n"
+    "\t-t\t\tdraw in a separate thread\n"
+    "\t-b\t\tsplit drawing between cores (gpu_neon)\n"
+    "\t-s N\t\tframeskip: -2 adaptive, -1 auto (never late here), 1-3 fixed\n"
+    "\t-d\t\tdeferred frameskip\n"
+    "\t-i N\t\tinterlace mode: 0 off, 1 on, 2 guess (default: as recorded)\n"
+    "\t-o FILE\t\tsave the final vram\n", argv0);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *fname = NULL, *vram_out = NULL;
+  int print_frames = 0, interlace = -1;
+  uint64_t t, t_frame, t_total, frame_min = ~0ull, frame_max = 0, cmd_total;
+  uint32_t *rec, *words, *end, recorded_crc = 0, crc;
+  int type, count, frames = 0, max_frame = 0, has_end = 0;
+  uint64_t *frame_ns = NULL;
+  int alloc_frames = 0;
+  int order[256];
+  FILE *f;
+  int i;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-f"))
+      print_frames = 1;
+    else if (!strcmp(argv[i], "-c"))
+      cmd_timing = 1;
+    else if (!strcmp(argv[i], "-t"))
+      cbs.thread_rendering = 1;
+    else if (!strcmp(argv[i], "-b"))
+      cbs.gpu_neon.band_rendering = 1;
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+      cbs.frameskip = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-d"))
+      cbs.deferred_rendering = 1;
+    else if (!strcmp(argv[i], "-i") && i + 1 < argc)
+      interlace = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+      vram_out = argv[++i];
+    else if (argv[i][0] != '-' && fname == NULL)
+      fname = argv[i];
+    else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (fname == NULL) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (cmd_timing && (cbs.thread_rendering || cbs.gpu_neon.band_rendering)) {
+    fprintf(stderr, "-c can't be used with -t or -b\n");
+    return 1;
+  }
+
+  if (load_trace(fname) != 0)
+    return 1;
+
+  cbs.mmap = replay_mmap;
+  cbs.munmap = replay_munmap;
+  cbs.gpu_frame_count = &frame_count;
+  cbs.gpu_hcnt = &hcnt;
+  cbs.fskip_stats = &fskip_stats;
+  cbs.gpu_neon.allow_interlace = interlace >= 0 ? interlace : trace[2];
+
+  GPUinit();
+  GPUrearmedCallbacks(&cbs);
+
+  rec = trace;
+  end = trace + trace_words;
+  t = t_frame = get_ns();
+  for (; rec < end; rec = words + count) {
+    type = rec[0] >> 24;
+    count = rec[0] & 0xffffff;
+    words = rec + 1;
+    if (words + count > end) {
+      fprintf(stderr, "truncated trace\n");
+      break;
+    }
+
+    switch (type) {
+      case GPU_TRACE_START:
+        break;
+      case GPU_TRACE_FREEZE:
+        // state loading is not drawing, keep it out of the frame time
+        t = get_ns();
+        load_snapshot(words, count);
+        t_frame += get_ns() - t;
+        break;
+      case GPU_TRACE_WRITE_DATA:
+        GPUwriteData(words[0]);
+        break;
+      case GPU_TRACE_WRITE_MEM:
+        GPUwriteDataMem(words, count);
+        break;
+      case GPU_TRACE_DMA_LINK:
+        chain_add(words, count);
+        break;
+      case GPU_TRACE_DMA_END:
+        chain_flush();
+        break;
+      case GPU_TRACE_WRITE_STATUS:
+        GPUwriteStatus(words[0]);
+        break;
+      case GPU_TRACE_READ_DATA:
+        GPUreadData();
+        break;
+      case GPU_TRACE_READ_MEM: {
+        static uint32_t dummy[0x10000];
+        uint32_t left = words[0], n;
+        for (; left > 0; left -= n) {
+          n = left < ARRAY_SIZE(dummy) ? left : ARRAY_SIZE(dummy);
+          GPUreadDataMem(dummy, n);
+        }
+        break;
+      }
+      case GPU_TRACE_FLUSH:
+        GPUreadStatus();
+        break;
+      case GPU_TRACE_VBLANK:
+        frame_count = words[2];
+        GPUvBlank(words[0], words[1]);
+        break;
+      case GPU_TRACE_UPDATE_LACE:
+        frame_count = words[0];
+        GPUupdateLace();
+        gpu_thread_sync();
+
+        t = get_ns();
+        if (frames == alloc_frames) {
+          alloc_frames = alloc_frames ? alloc_frames * 2 : 1024;
+          frame_ns = realloc(frame_ns, alloc_frames * sizeof(frame_ns[0]));
+          if (frame_ns == NULL) {
+            fprintf(stderr, "OOM\n");
+            return 1;
+          }
+        }
+        frame_ns[frames] = t - t_frame;
+        if (frame_ns[frames] < frame_min)
+          frame_min = frame_ns[frames];
+        if (frame_ns[frames] > frame_max) {
+          frame_max = frame_ns[frames];
+          max_frame = frames;
+        }
+        frames++;
+        t_frame = t;
+        break;
+      case GPU_TRACE_END:
+        recorded_crc = words[0];
+        has_end = 1;
+        break;
+      default:
+        fprintf(stderr, "unknown record %d, stopping\n", type);
+        rec = end;
+        count = 0;
+        words = end;
+        break;
+    }
+  }
+  defer_commit();
+  gpu_thread_sync();
+  renderer_flush_queues();
+
+  t_total = 0;
+  for (i = 0; i < frames; i++)
+    t_total += frame_ns[i];
+
+  if (print_frames)
+    for (i = 0; i < frames; i++)
+      printf("frame %5d: %8.3f ms\n", i, frame_ns[i] / 1e6);
+
+  if (frames > 0) {
+    printf("frames:     %d in %.3f ms\n", frames, t_total / 1e6);
+    printf("frame time: %.3f ms avg, %.3f ms min, %.3f ms max (frame %d)\n",
+      t_total / 1e6 / frames, frame_min / 1e6, frame_max / 1e6, max_frame);
+  }
+  else
+    printf("no frames in the trace\n");
+
+  if (cbs.frameskip == -2)
+    printf("adaptive:   %u/%u skipped, now %u/256, gpu %.3f ms, "
+      "emu %.3f ms, budget %.3f ms\n", fskip_stats.skipped, fskip_stats.frames,
+      fskip_stats.skip_rate, fskip_stats.render_us / 1e3,
+      fskip_stats.emu_us / 1e3, fskip_stats.budget_us / 1e3);
+
+  if (cmd_timing) {
+    cmd_total = 0;
+    for (i = 0; i < 256; i++) {
+      order[i] = i;
+      cmd_total += cmd_stats[i].ns;
+    }
+    qsort(order, 256, sizeof(order[0]), cmp_stats);
+
+    printf("\ncmd     count   total ms   avg ns  %%frames\n");
+    for (i = 0; i < 256 && cmd_stats[order[i]].count > 0; i++) {
+      int c = order[i];
+      printf("%02x %10u %10.3f %8.0f %7.2f%%  %s\n", c, cmd_stats[c].count,
+        cmd_stats[c].ns / 1e6, (double)cmd_stats[c].ns / cmd_stats[c].count,
+        t_total ? cmd_stats[c].ns * 100.0 / t_total : 0.0, cmd_name(c));
+    }
+    printf("rest                %10.3f          %7.2f%%  gpulib, vram i/o\n",
+      (t_total - cmd_total) / 1e6,
+      t_total ? (t_total - cmd_total) * 100.0 / t_total : 0.0);
+  }
+
+  crc = crc32(0, (void *)gpu.vram, 1024 * 512 * 2);
+  printf("\nvram crc32: %08x", crc);
+  if (has_end)
+    printf(", recorded %08x%s", recorded_crc,
+      crc == recorded_crc ? "" : " (differs)");
+  printf("\n");
+
+  if (vram_out != NULL) {
+    f = fopen(vram_out, "wb");
+    if (f == NULL || fwrite(gpu.vram, 1, 1024 * 512 * 2, f) != 1024 * 512 * 2)
+      fprintf(stderr, "failed to write %s\n", vram_out);
+    if (f != NULL)
+      fclose(f);
+  }
+
+  GPUshutdown();
+  return 0;
+}
+
+// vim:shiftwidth=2:expandtab
@@ -25,10 +25,11 @@ int vout_finish(void)
   return 0;
 }
 
-static void check_mode_change(int force)
+// returns 1 if the mode was set
+static int check_mode_change(int force)
 {
   static uint32_t old_status;
-  static int old_h;
+  static int old_h, old_enhancement;
   int w = gpu.screen.hres;
   int h = gpu.screen.h;
   int w_out = w;
@@ -44,13 +45,17 @@ static void check_mode_change(int force)
   }
 
   // width|rgb24 change?
-  if (force || (gpu.status.reg ^ old_status) & ((7<<16)|(1<<21)) || h != old_h)
+  if (force || (gpu.status.reg ^ old_status) & ((7<<16)|(1<<21)) || h != old_h
+      || gpu.state.enhancement_active != old_enhancement)
   {
     old_status = gpu.status.reg;
     old_h = h;
+    old_enhancement = gpu.state.enhancement_active;
 
     cbs->pl_vout_set_mode(w_out, h_out, w, h, gpu.status.rgb24 ? 24 : 16);
+    return 1;
   }
+  return 0;
 }
 
 void vout_update(void)
@@ -61,28 +66,39 @@ void vout_update(void)
   int h = gpu.screen.h;
   uint16_t *vram = gpu.vram;
   int vram_h = 512;
+  int dirty_y = 0, dirty_h = h;
 
   if (w == 0 || h == 0)
     return;
 
-  check_mode_change(0);
-  if (gpu.state.enhancement_active)
+  // only the rows drawn since the last flip need converting
+  if (!check_mode_change(0) && !gpu.state.fb_dirty)
+    dirty_h = gpu_dirty_rows(y, h, &dirty_y);
+
+  if (gpu.state.enhancement_active) {
     vram = gpu.get_enhancement_bufer(&x, &y, &w, &h, &vram_h);
+    dirty_y *= 2;
+    dirty_h *= 2;
+  }
 
   if (y + h > vram_h) {
     if (y + h - vram_h > h / 2) {
       // wrap
       h -= vram_h - y;
       y = 0;
+      dirty_y = 0;
+      dirty_h = h;
     }
     else
       // clip
       h = vram_h - y;
   }
+  if (dirty_y + dirty_h > h)
+    dirty_h = dirty_y < h ? h - dirty_y : 0;
 
   vram += y * 1024 + x;
 
-  cbs->pl_vout_flip(vram, 1024, gpu.status.rgb24, w, h);
+  cbs->pl_vout_flip(vram, 1024, gpu.status.rgb24, w, h, dirty_y, dirty_h);
 }
 
 void vout_blank(void)
@@ -95,7 +111,7 @@ void vout_blank(void)
     w *= 2;
     h *= 2;
   }
-  cbs->pl_vout_flip(NULL, 1024, gpu.status.rgb24, w, h);
+  cbs->pl_vout_flip(NULL, 1024, gpu.status.rgb24, w, h, 0, h);
 }
 
 long GPUopen(void **unused)
@@ -105,6 +121,7 @@ long GPUopen(void **unused)
 
   cbs->pl_vout_open();
   check_mode_change(1);
+  gpu.state.fb_dirty = 1;
   vout_update();
   return 0;
 }
@@ -0,0 +1,131 @@
+/*
+ * cspace_bench - times the frontend colour converters at each x86 SIMD
+ * level against the C versions and checks they produce the same output.
+ *
+ * usage: cspace_bench [lines]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../frontend/cspace.h"
+#include "../frontend/cspace_x86.h"
+
+#ifndef CSPACE_X86
+
+int main(void)
+{
+	fprintf(stderr, "no SIMD converters for this target\n");
+	return 1;
+}
+
+#else
+
+// widest PSX line at 24bpp, odd so tails get exercised too
+#define WIDTH 1023
+#define LINES 512
+
+static const char *level_names[] = { "c", "sse2", "ssse3", "avx2" };
+
+struct conv {
+	const char *name;
+	void (*func)(void *dst, const void *src, int n);
+	int src_bpp, dst_bpp;
+	int n_is_pixels;	// n is pixels, not source bytes
+};
+
+static const struct conv convs[] = {
+	{ "bgr555_to_rgb565", bgr555_to_rgb565, 2, 2, 0 },
+	{ "bgr888_to_rgb565", bgr888_to_rgb565, 3, 2, 0 },
+	{ "rgb888_to_rgb565", rgb888_to_rgb565, 3, 2, 0 },
+	{ "bgr888_to_rgb888", bgr888_to_rgb888, 3, 3, 0 },
+	{ "bgr555_to_uyvy",   bgr555_to_uyvy,   2, 2, 1 },
+};
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const struct conv *c, unsigned char *dst,
+	const unsigned char *src, int lines)
+{
+	int n = c->n_is_pixels ? WIDTH : WIDTH * c->src_bpp;
+	int i;
+
+	for (i = 0; i < lines; i++)
+		c->func(dst + i * WIDTH * c->dst_bpp, src + i * WIDTH * c->src_bpp, n);
+}
+
+int main(int argc, char *argv[])
+{
+	int lines = LINES, reps, have, l, i, r, bad = 0;
+	unsigned char *src, *dst, *ref;
+	size_t size;
+	double t, t_c = 0;
+
+	if (argc > 1)
+		lines = atoi(argv[1]);
+	if (lines <= 0) {
+		fprintf(stderr, "usage: %s [lines]\n", argv[0]);
+		return 1;
+	}
+	reps = 200000 / lines + 1;
+
+	// +1 for the source offset, +8 for the odd pixel of the last line
+	size = (size_t)lines * WIDTH * 4 + 16;
+	src = malloc(size);
+	dst = malloc(size);
+	ref = malloc(size);
+	if (src == NULL || dst == NULL || ref == NULL)
+		return 1;
+	srand(1);
+	for (i = 0; i < size; i++)
+		src[i] = rand();
+
+	bgr_to_uyvy_init();
+	have = cspace_x86_detect();
+	printf("cpu: %s, %d lines of %d pixels, %d reps\n",
+		level_names[have], lines, WIDTH, reps);
+
+	for (i = 0; i < sizeof(convs) / sizeof(convs[0]); i++) {
+		const struct conv *c = &convs[i];
+
+		for (l = CSPACE_X86_C; l <= have; l++) {
+			if (cspace_x86_set_level(l) != l)
+				break;
+
+			// unaligned source to keep the vector code honest
+			memset(dst, 0, size);
+			run(c, dst, src + 1, lines);
+			if (l == CSPACE_X86_C)
+				memcpy(ref, dst, size);
+			else if (memcmp(ref, dst, size) != 0) {
+				printf("%-18s %-6s MISMATCH\n", c->name, level_names[l]);
+				bad++;
+				continue;
+			}
+
+			t = now();
+			for (r = 0; r < reps; r++)
+				run(c, dst, src + 1, lines);
+			t = now() - t;
+			if (l == CSPACE_X86_C)
+				t_c = t;
+
+			printf("%-18s %-6s %8.1f Mpix/s  x%.2f\n", c->name, level_names[l],
+				(double)reps * lines * WIDTH / t / 1e6, t_c / t);
+		}
+	}
+
+	free(src);
+	free(dst);
+	free(ref);
+
+	return bad ? 1 : 0;
+}
+
+#endif
@@ -1,50 +1,309 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <zlib.h>
+#include "../libpcsxcore/cdrcompr.h"
 
 #define CD_FRAMESIZE_RAW 2352
 
+// sectors handed to a worker at a time
+#define CHUNK_SECTORS 256
+
 struct ztab_entry {
 	unsigned int offset;
 	unsigned short size;
 } __attribute__((packed));
 
-int main(int argc, char *argv[])
+struct chunk {
+	unsigned char *data;	// compressed sectors back to back
+	unsigned int size[CHUNK_SECTORS];
+	int plain[CHUNK_SECTORS];
+	long first, count;
+	int done, err;
+};
+
+static struct {
+	FILE *fin;
+	long total_sectors;
+	int cbin, best, level;
+
+	struct chunk *chunks;	// ring, indexed by chunk number % nring
+	long nchunks, nring;
+	long next;		// next chunk to be taken by a worker
+	long written;		// chunks the writer is done with
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} g;
+
+static int compress_sector(unsigned char *out, unsigned long *out_len,
+	const unsigned char *in, int level)
+{
+	z_stream z;
+	int ret;
+
+	if (!g.cbin)
+		return compress2(out, out_len, in, CD_FRAMESIZE_RAW, level);
+
+	// cbin blocks are raw deflate streams
+	memset(&z, 0, sizeof(z));
+	ret = deflateInit2(&z, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+	if (ret != Z_OK)
+		return ret;
+	z.next_in = (void *)in;
+	z.avail_in = CD_FRAMESIZE_RAW;
+	z.next_out = out;
+	z.avail_out = *out_len;
+	ret = deflate(&z, Z_FINISH);
+	*out_len -= z.avail_out;
+	deflateEnd(&z);
+
+	return ret == Z_STREAM_END ? Z_OK : Z_BUF_ERROR;
+}
+
+static int do_chunk(struct chunk *c)
 {
-	unsigned char outbuf[CD_FRAMESIZE_RAW * 2];
 	unsigned char inbuf[CD_FRAMESIZE_RAW];
-	struct ztab_entry *ztable;
-	char *out_basename, *out_fname, *out_tfname;
-	FILE *fin, *fout;
-	long in_bytes, out_bytes;
-	long s, total_sectors;
-	int ret, len;
-
-	if (argc < 2) {
-		fprintf(stderr, "usage:\n%s <cd_img> [out_basename]\n", argv[0]);
+	unsigned char outbuf[CD_FRAMESIZE_RAW * 2];
+	unsigned char best[CD_FRAMESIZE_RAW * 2];
+	unsigned long len, best_len;
+	size_t pos = 0;
+	int i, l, ret;
+
+	for (i = 0; i < c->count; i++) {
+		ret = pread(fileno(g.fin), inbuf, sizeof(inbuf),
+			(off_t)(c->first + i) * CD_FRAMESIZE_RAW);
+		if (ret != sizeof(inbuf)) {
+			fprintf(stderr, "\npread returned %d\n", ret);
+			return -1;
+		}
+
+		best_len = sizeof(best);
+		ret = compress_sector(best, &best_len, inbuf, g.level);
+		if (ret != Z_OK) {
+			fprintf(stderr, "\ncompress failed: %d\n", ret);
+			return -1;
+		}
+
+		for (l = 1; g.best && l <= 9; l++) {
+			if (l == g.level)
+				continue;
+			len = sizeof(outbuf);
+			if (compress_sector(outbuf, &len, inbuf, l) == Z_OK && len < best_len) {
+				memcpy(best, outbuf, len);
+				best_len = len;
+			}
+		}
+
+		// cbin can store a block as is when it doesn't compress
+		c->plain[i] = g.cbin && best_len >= CD_FRAMESIZE_RAW;
+		if (c->plain[i]) {
+			memcpy(best, inbuf, CD_FRAMESIZE_RAW);
+			best_len = CD_FRAMESIZE_RAW;
+		}
+
+		memcpy(c->data + pos, best, best_len);
+		c->size[i] = best_len;
+		pos += best_len;
+	}
+
+	return 0;
+}
+
+static void *worker(void *arg)
+{
+	struct chunk *c;
+	long n;
+	int ret;
+
+	pthread_mutex_lock(&g.lock);
+	while (g.next < g.nchunks) {
+		// don't get too far ahead of the writer
+		if (g.next - g.written >= g.nring) {
+			pthread_cond_wait(&g.cond, &g.lock);
+			continue;
+		}
+		n = g.next++;
+		c = &g.chunks[n % g.nring];
+		c->first = n * CHUNK_SECTORS;
+		c->count = g.total_sectors - c->first;
+		if (c->count > CHUNK_SECTORS)
+			c->count = CHUNK_SECTORS;
+		c->done = c->err = 0;
+		pthread_mutex_unlock(&g.lock);
+
+		ret = do_chunk(c);
+
+		pthread_mutex_lock(&g.lock);
+		c->err = ret;
+		c->done = 1;
+		pthread_cond_broadcast(&g.cond);
+	}
+	pthread_mutex_unlock(&g.lock);
+
+	return NULL;
+}
+
+// reads the result back the way the emulator does: the cdrcimg plugin
+// uncompress()es .Z sectors, cdriso reads cbin through cdrcompr.c
+static int verify(const char *out_fname, const char *out_tfname)
+{
+	unsigned char inbuf[CD_FRAMESIZE_RAW], outbuf[CD_FRAMESIZE_RAW];
+	unsigned char zbuf[CD_FRAMESIZE_RAW * 2];
+	struct ztab_entry *ztable = NULL;
+	off_t *index = NULL, offset;
+	unsigned int size, index_len = 0;
+	unsigned long out_len;
+	z_stream z;
+	FILE *f;
+	long s;
+	int ret = -1;
+
+	memset(&z, 0, sizeof(z));
+	f = fopen(out_fname, "rb");
+	if (f == NULL) {
+		fprintf(stderr, "fopen %s: ", out_fname);
+		perror(NULL);
+		return -1;
+	}
+
+	// reread the index as written
+	if (!g.cbin) {
+		FILE *ft = fopen(out_tfname, "rb");
+		ztable = malloc(g.total_sectors * sizeof(ztable[0]));
+		if (ft == NULL || ztable == NULL
+		    || fread(ztable, sizeof(ztable[0]), g.total_sectors, ft) != g.total_sectors) {
+			fprintf(stderr, "failed to read back %s\n", out_tfname);
+			if (ft != NULL)
+				fclose(ft);
+			goto out;
+		}
+		fclose(ft);
+	}
+	else if (cdr_compr_read_cbin(f, &index, &index_len) != 0
+		 || index_len != g.total_sectors) {
+		fprintf(stderr, "failed to read back the header and index\n");
+		goto out;
+	}
+
+	fseek(g.fin, 0, SEEK_SET);
+	for (s = 0; s < g.total_sectors; s++) {
+		int compressed = 1;
+
+		if (!g.cbin) {
+			offset = ztable[s].offset;
+			size = ztable[s].size;
+		}
+		else
+			compressed = cdr_compr_block_pos(index, s, &offset, &size);
+		if (size > sizeof(zbuf) || fseeko(f, offset, SEEK_SET) != 0
+		    || fread(zbuf, 1, size, f) != size) {
+			fprintf(stderr, "sector %ld: bad index entry %llx/%u\n", s,
+				(unsigned long long)offset, size);
+			goto out;
+		}
+		if (fread(inbuf, 1, sizeof(inbuf), g.fin) != sizeof(inbuf)) {
+			fprintf(stderr, "sector %ld: input read error\n", s);
+			goto out;
+		}
+
+		out_len = CD_FRAMESIZE_RAW;
+		if (!compressed) {
+			if (size != CD_FRAMESIZE_RAW) {
+				fprintf(stderr, "sector %ld: bad plain size %u\n", s, size);
+				goto out;
+			}
+			memcpy(outbuf, zbuf, CD_FRAMESIZE_RAW);
+		}
+		else if ((!g.cbin ? uncompress(outbuf, &out_len, zbuf, size)
+		          : cdr_compr_inflate(&z, outbuf, &out_len, zbuf, size)) != Z_OK
+		         || out_len != CD_FRAMESIZE_RAW) {
+			fprintf(stderr, "sector %ld: decompress failed\n", s);
+			goto out;
+		}
+
+		if (memcmp(inbuf, outbuf, CD_FRAMESIZE_RAW) != 0) {
+			fprintf(stderr, "sector %ld: mismatch\n", s);
+			goto out;
+		}
+	}
+	printf("verify ok\n");
+	ret = 0;
+
+out:
+	if (z.zalloc != NULL)
+		inflateEnd(&z);
+	free(index);
+	free(ztable);
+	fclose(f);
+	return ret;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "usage:\n%s [options] <cd_img> [out_basename]\n"
+		"  -j <n>   threads to use (default: all cpus)\n"
+		"  -l <n>   zlib level (default 9)\n"
+		"  -b       best ratio, try all levels for each sector\n"
+		"  -c       write .cbin instead of .Z + .Z.table\n"
+		"  -v       verify the result by decompressing it\n", argv0);
+}
+
+int main(int argc, char *argv[])
+{
+	struct ztab_entry *ztable = NULL;
+	unsigned int *index = NULL;
+	char *out_basename, *out_fname, *out_tfname = NULL;
+	pthread_t *threads;
+	FILE *fout;
+	long in_bytes, out_bytes, hdr_bytes = 0;
+	long s, n;
+	int threads_n = 0, do_verify = 0;
+	int i, ret, len;
+
+	g.level = 9;
+	while ((ret = getopt(argc, argv, "j:l:bcv")) != -1) {
+		switch (ret) {
+		case 'j': threads_n = atoi(optarg); break;
+		case 'l': g.level = atoi(optarg); break;
+		case 'b': g.best = 1; break;
+		case 'c': g.cbin = 1; break;
+		case 'v': do_verify = 1; break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind >= argc || g.level < 1 || g.level > 9) {
+		usage(argv[0]);
 		return 1;
 	}
+	if (threads_n <= 0)
+		threads_n = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads_n <= 0)
+		threads_n = 1;
 
-	fin = fopen(argv[1], "rb");
-	if (fin == NULL) {
-		fprintf(stderr, "fopen %s: ", argv[1]);
+	g.fin = fopen(argv[optind], "rb");
+	if (g.fin == NULL) {
+		fprintf(stderr, "fopen %s: ", argv[optind]);
 		perror(NULL);
 		return 1;
 	}
 
-	if (argv[2] != NULL)
-		out_basename = argv[2];
+	if (optind + 1 < argc)
+		out_basename = argv[optind + 1];
 	else
-		out_basename = argv[1];
+		out_basename = argv[optind];
 
-	len = strlen(out_basename) + 3;
+	len = strlen(out_basename) + 6;
 	out_fname = malloc(len);
 	if (out_fname == NULL) {
 		fprintf(stderr, "OOM\n");
 		return 1;
 	}
-	snprintf(out_fname, len, "%s.Z", out_basename);
+	snprintf(out_fname, len, g.cbin ? "%s.cbin" : "%s.Z", out_basename);
 
 	fout = fopen(out_fname, "wb");
 	if (fout == NULL) {
@@ -53,95 +312,180 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
-	if (fseek(fin, 0, SEEK_END) != 0) {
+	if (fseek(g.fin, 0, SEEK_END) != 0) {
 		fprintf(stderr, "fseek failed: ");
 		perror(NULL);
 		return 1;
 	}
 
-	in_bytes = ftell(fin);
+	in_bytes = ftell(g.fin);
 	if (in_bytes % CD_FRAMESIZE_RAW) {
 		fprintf(stderr, "warning: input size %ld is not "
 				"multiple of sector size\n", in_bytes);
 	}
-	total_sectors = in_bytes / CD_FRAMESIZE_RAW;
-	fseek(fin, 0, SEEK_SET);
+	g.total_sectors = in_bytes / CD_FRAMESIZE_RAW;
+	if (g.total_sectors == 0) {
+		fprintf(stderr, "input is smaller than a sector\n");
+		return 1;
+	}
+	fseek(g.fin, 0, SEEK_SET);
+
+	if (g.cbin) {
+		// header and index go in front, the index is filled in at the end
+		index = calloc(g.total_sectors + 1, sizeof(index[0]));
+		hdr_bytes = sizeof(struct ciso_header) + (g.total_sectors + 1) * sizeof(index[0]);
+		if (index == NULL || fseek(fout, hdr_bytes, SEEK_SET) != 0) {
+			fprintf(stderr, "OOM\n");
+			return 1;
+		}
+	}
+	else {
+		ztable = calloc(g.total_sectors, sizeof(ztable[0]));
+		if (ztable == NULL) {
+			fprintf(stderr, "OOM\n");
+			return 1;
+		}
+	}
 
-	ztable = calloc(total_sectors, sizeof(ztable[0]));
-	if (ztable == NULL) {
+	g.nchunks = (g.total_sectors + CHUNK_SECTORS - 1) / CHUNK_SECTORS;
+	g.nring = threads_n * 2;
+	g.chunks = calloc(g.nring, sizeof(g.chunks[0]));
+	threads = calloc(threads_n, sizeof(threads[0]));
+	if (g.chunks == NULL || threads == NULL) {
 		fprintf(stderr, "OOM\n");
 		return 1;
 	}
+	for (i = 0; i < g.nring; i++) {
+		g.chunks[i].data = malloc(CD_FRAMESIZE_RAW * 2 * CHUNK_SECTORS);
+		if (g.chunks[i].data == NULL) {
+			fprintf(stderr, "OOM\n");
+			return 1;
+		}
+	}
 
-	out_bytes = 0;
-	for (s = 0; s < total_sectors; s++) {
-		uLongf dest_len = sizeof(outbuf);
-
-		ret = fread(inbuf, 1, sizeof(inbuf), fin);
-		if (ret != sizeof(inbuf)) {
-			printf("\n");
-			fprintf(stderr, "fread returned %d\n", ret);
+	pthread_mutex_init(&g.lock, NULL);
+	pthread_cond_init(&g.cond, NULL);
+	for (i = 0; i < threads_n; i++) {
+		if (pthread_create(&threads[i], NULL, worker, NULL) != 0) {
+			fprintf(stderr, "pthread_create failed\n");
 			return 1;
 		}
+	}
 
-		ret = compress2(outbuf, &dest_len, inbuf, sizeof(inbuf), 9);
-		if (ret != Z_OK) {
+	// write the chunks out in order as they complete
+	out_bytes = hdr_bytes;
+	s = 0;
+	for (n = 0; n < g.nchunks; n++) {
+		struct chunk *c = &g.chunks[n % g.nring];
+		size_t pos = 0;
+
+		pthread_mutex_lock(&g.lock);
+		while (!c->done || c->first != n * CHUNK_SECTORS)
+			pthread_cond_wait(&g.cond, &g.lock);
+		pthread_mutex_unlock(&g.lock);
+
+		if (c->err) {
 			printf("\n");
-			fprintf(stderr, "compress2 failed: %d\n", ret);
 			return 1;
 		}
 
-		ret = fwrite(outbuf, 1, dest_len, fout);
-		if (ret != dest_len) {
+		for (i = 0; i < c->count; i++, s++) {
+			if (g.cbin) {
+				if (out_bytes + c->size[i] > 0x7fffffff) {
+					printf("\n");
+					fprintf(stderr, "output too large for cbin\n");
+					return 1;
+				}
+				index[s] = out_bytes | (c->plain[i] ? 0x80000000 : 0);
+			}
+			else {
+				ztable[s].offset = out_bytes;
+				ztable[s].size = c->size[i];
+			}
+			out_bytes += c->size[i];
+			pos += c->size[i];
+		}
+
+		ret = fwrite(c->data, 1, pos, fout);
+		if (ret != pos) {
 			printf("\n");
 			fprintf(stderr, "fwrite returned %d\n", ret);
 			return 1;
 		}
 
-		ztable[s].offset = out_bytes;
-		ztable[s].size = dest_len;
-		out_bytes += dest_len;
+		pthread_mutex_lock(&g.lock);
+		c->done = 0;
+		g.written = n + 1;
+		pthread_cond_broadcast(&g.cond);
+		pthread_mutex_unlock(&g.lock);
 
 		// print progress
-		if ((s & 0x1ff) == 0) {
-			printf("\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b");
-			printf("%3ld%% %ld/%ld", s * 100 / total_sectors, s, total_sectors);
-			fflush(stdout);
-		}
+		printf("\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b");
+		printf("%3ld%% %ld/%ld", s * 100 / g.total_sectors, s, g.total_sectors);
+		fflush(stdout);
 	}
 
-	fclose(fin);
-	fclose(fout);
+	for (i = 0; i < threads_n; i++)
+		pthread_join(threads[i], NULL);
 
-	// write .table
-	len = strlen(out_fname) + 7;
-	out_tfname = malloc(len);
-	if (out_tfname == NULL) {
-		printf("\n");
-		fprintf(stderr, "OOM\n");
-		return 1;
-	}
-	snprintf(out_tfname, len, "%s.table", out_fname);
+	if (g.cbin) {
+		struct ciso_header hdr;
 
-	fout = fopen(out_tfname, "wb");
-	if (fout == NULL) {
-		fprintf(stderr, "fopen %s: ", out_tfname);
-		perror(NULL);
-		return 1;
-	}
+		memset(&hdr, 0, sizeof(hdr));
+		memcpy(hdr.magic, "CISO", 4);
+		hdr.header_size = sizeof(hdr);
+		hdr.total_bytes = (unsigned long long)g.total_sectors * CD_FRAMESIZE_RAW;
+		hdr.block_size = CD_FRAMESIZE_RAW;
+		hdr.ver = 1;
+		index[g.total_sectors] = out_bytes;
 
-	ret = fwrite(ztable, sizeof(ztable[0]), total_sectors, fout);
-	if (ret != total_sectors) {
-		printf("\n");
-		fprintf(stderr, "fwrite returned %d\n", ret);
-		return 1;
+		fseek(fout, 0, SEEK_SET);
+		if (fwrite(&hdr, sizeof(hdr), 1, fout) != 1
+		    || fwrite(index, sizeof(index[0]), g.total_sectors + 1, fout)
+		       != g.total_sectors + 1) {
+			printf("\n");
+			fprintf(stderr, "failed to write the index\n");
+			return 1;
+		}
 	}
 	fclose(fout);
 
+	if (!g.cbin) {
+		// write .table
+		len = strlen(out_fname) + 7;
+		out_tfname = malloc(len);
+		if (out_tfname == NULL) {
+			printf("\n");
+			fprintf(stderr, "OOM\n");
+			return 1;
+		}
+		snprintf(out_tfname, len, "%s.table", out_fname);
+
+		fout = fopen(out_tfname, "wb");
+		if (fout == NULL) {
+			fprintf(stderr, "fopen %s: ", out_tfname);
+			perror(NULL);
+			return 1;
+		}
+
+		ret = fwrite(ztable, sizeof(ztable[0]), g.total_sectors, fout);
+		if (ret != g.total_sectors) {
+			printf("\n");
+			fprintf(stderr, "fwrite returned %d\n", ret);
+			return 1;
+		}
+		fclose(fout);
+	}
+
 	printf("\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b");
-	printf("%3ld%% %ld/%ld\n", s * 100 / total_sectors, s, total_sectors);
+	printf("%3ld%% %ld/%ld\n", s * 100 / g.total_sectors, s, g.total_sectors);
 	printf("%ld bytes from %ld (%.1f%%)\n", out_bytes, in_bytes,
 		(double)out_bytes * 100.0 / in_bytes);
 
+	if (do_verify && verify(out_fname, out_tfname) != 0)
+		return 1;
+
+	fclose(g.fin);
+
 	return 0;
 }